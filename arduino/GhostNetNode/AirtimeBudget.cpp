@@ -0,0 +1,88 @@
+#include "AirtimeBudget.h"
+
+// ETSI EN 300 220 sub-bands as used by LoRaWAN EU868
+const AirtimeBudget::SubBand AirtimeBudget::subBands[DUTY_SUBBANDS] = {
+  { "863.0-865.0 MHz 0.1%", 863.0f, 865.0f, 1 },
+  { "865.0-868.0 MHz 1%", 865.0f, 868.0f, 10 },
+  { "g1 868.0-868.6 MHz 1%", 868.0f, 868.6f, 10 },
+  { "g2 868.7-869.2 MHz 0.1%", 868.7f, 869.2f, 1 },
+  { "g3 869.4-869.65 MHz 10%", 869.4f, 869.65f, 100 },
+  { "g4 869.7-870.0 MHz 1%", 869.7f, 870.0f, 10 },
+};
+
+// Share of the budget each priority may fill, in percent
+static const uint8_t admitPercent[TX_PRIO_COUNT] = { 50, 90, 100 };
+
+// Queued frames older than this are not worth sending any more (0 = never drop)
+static const uint32_t maxWaitMs[TX_PRIO_COUNT] = { 60000, 0, 30000 };
+
+void AirtimeBudget::begin(float freqMHz) {
+  for (size_t i = 0; i < DUTY_SUBBANDS; i++) {
+    if (freqMHz >= subBands[i].fromMHz && freqMHz < subBands[i].toMHz) {
+      active = i;
+      return;
+    }
+  }
+}
+
+void AirtimeBudget::advance(Usage &u, uint32_t now) {
+  // Clear every bucket we skipped over, at most one full window
+  size_t steps = 0;
+  while (now - u.bucketStart >= DUTY_BUCKET_MS && steps < DUTY_BUCKETS) {
+    u.current = (u.current + 1) % DUTY_BUCKETS;
+    u.bucketMs[u.current] = 0;
+    u.bucketStart += DUTY_BUCKET_MS;
+    steps++;
+  }
+  if (now - u.bucketStart >= DUTY_BUCKET_MS)
+    u.bucketStart = now;
+}
+
+void AirtimeBudget::record(uint32_t airtimeUs, uint32_t now) {
+  Usage &u = usage[active];
+  advance(u, now);
+  u.bucketMs[u.current] += (airtimeUs + 999) / 1000;
+}
+
+uint32_t AirtimeBudget::budgetMs() const {
+  return DUTY_WINDOW_MS / 1000 * subBands[active].dutyPermille;
+}
+
+uint32_t AirtimeBudget::usedMs(uint32_t now) {
+  Usage &u = usage[active];
+  advance(u, now);
+  uint32_t used = 0;
+  for (uint32_t ms : u.bucketMs)
+    used += ms;
+  return used;
+}
+
+uint32_t AirtimeBudget::remainingMs(uint32_t now) {
+  uint32_t used = usedMs(now);
+  return used >= budgetMs() ? 0 : budgetMs() - used;
+}
+
+float AirtimeBudget::pressure(uint32_t now) {
+  return (float)usedMs(now) / budgetMs();
+}
+
+AirtimeBudget::Decision AirtimeBudget::admit(uint8_t priority, uint32_t airtimeUs, uint32_t waitedMs, bool firstCheck, uint32_t now) {
+  if (priority >= TX_PRIO_COUNT)
+    priority = TX_PRIO_NORMAL;
+
+  uint32_t limit = budgetMs() / 100 * admitPercent[priority];
+  if (usedMs(now) + airtimeUs / 1000 <= limit)
+    return ADMIT;
+
+  if (maxWaitMs[priority] && waitedMs > maxWaitMs[priority]) {
+    counters.dropped[priority]++;
+    return DROP;
+  }
+  if (firstCheck)
+    counters.deferred[priority]++;
+  return DEFER;
+}
+
+const char *AirtimeBudget::subBandName() const {
+  return subBands[active].name;
+}
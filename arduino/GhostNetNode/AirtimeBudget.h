@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file AirtimeBudget.h
+ * @brief EU868 duty-cycle bookkeeping and admission control for transmissions.
+ *
+ * ETSI EN 300 220 limits each sub-band to a duty cycle measured over one
+ * hour. Airtime is recorded per sub-band in one-minute buckets, so the budget
+ * that is still available in the rolling hour is always known.
+ *
+ * Admission is priority aware: low priority traffic (beacons, tables) may
+ * only use the first half of the budget, normal game traffic up to 90%, and
+ * the last 10% is kept for ACKs. Frames that cannot be admitted are deferred
+ * and low priority frames that waited too long are dropped.
+ */
+
+#define DUTY_WINDOW_MS 3600000UL
+#define DUTY_BUCKETS 60
+#define DUTY_BUCKET_MS (DUTY_WINDOW_MS / DUTY_BUCKETS)
+#define DUTY_SUBBANDS 6
+
+enum TxPriority : uint8_t {
+  TX_PRIO_LOW = 0,     ///< Beacons and neighbour tables
+  TX_PRIO_NORMAL = 1,  ///< Game traffic and its forwards
+  TX_PRIO_HIGH = 2,    ///< ACKs
+};
+#define TX_PRIO_COUNT 3
+
+struct AirtimeStats {
+  uint32_t deferred[TX_PRIO_COUNT] = {};  ///< Frames that had to wait for budget
+  uint32_t dropped[TX_PRIO_COUNT] = {};   ///< Frames dropped after waiting too long
+};
+
+class AirtimeBudget {
+public:
+  enum Decision { ADMIT, DEFER, DROP };
+
+  /**
+   * @brief Select the sub-band that contains the operating frequency.
+   * @param freqMHz Carrier frequency in MHz.
+   */
+  void begin(float freqMHz);
+
+  /**
+   * @brief Decide whether a frame may go on air now.
+   * @param priority TX_PRIO_* class of the frame.
+   * @param airtimeUs Time on air of the frame.
+   * @param waitedMs How long the frame has been queued.
+   * @param firstCheck true the first time this frame is checked, so deferrals are counted once.
+   * @param now Current time in ms.
+   * @return ADMIT, DEFER (try again later) or DROP.
+   */
+  Decision admit(uint8_t priority, uint32_t airtimeUs, uint32_t waitedMs, bool firstCheck, uint32_t now);
+
+  /**
+   * @brief Account a transmission against the active sub-band.
+   */
+  void record(uint32_t airtimeUs, uint32_t now);
+
+  uint32_t budgetMs() const;
+  uint32_t usedMs(uint32_t now);
+  uint32_t remainingMs(uint32_t now);
+
+  /**
+   * @brief Fraction of the hourly budget in use, 0.0 .. 1.0 (or more when over).
+   */
+  float pressure(uint32_t now);
+
+  /**
+   * @brief Name and limits of the active sub-band, e.g. "g1 868.0-868.6 MHz 1%".
+   */
+  const char *subBandName() const;
+
+  const AirtimeStats &stats() const { return counters; }
+
+private:
+  struct SubBand {
+    const char *name;
+    float fromMHz;
+    float toMHz;
+    uint16_t dutyPermille;  ///< Duty cycle limit in 1/1000
+  };
+
+  struct Usage {
+    uint32_t bucketMs[DUTY_BUCKETS] = {};  ///< Airtime per minute, in ms
+    uint32_t bucketStart = 0;              ///< Start time of the current bucket
+    size_t current = 0;                    ///< Index of the current bucket
+  };
+
+  void advance(Usage &u, uint32_t now);
+
+  static const SubBand subBands[DUTY_SUBBANDS];
+  Usage usage[DUTY_SUBBANDS];
+  size_t active = 2;  ///< g1, the band of the 868.0 MHz default
+  AirtimeStats counters;
+};
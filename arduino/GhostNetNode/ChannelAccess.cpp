@@ -0,0 +1,82 @@
+#include "ChannelAccess.h"
+
+static const uint16_t contentionWindow[TX_PRIO_COUNT] = { CSMA_CW_LOW, CSMA_CW_NORMAL, CSMA_CW_HIGH };
+
+uint32_t ChannelAccess::next() {
+  // xorshift32, as in TrickleTimer
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+void ChannelAccess::begin(uint32_t seed) {
+  rng = seed ? seed : 1;
+  pending = false;
+}
+
+uint32_t ChannelAccess::slotUs(uint8_t sf, float bw) {
+  uint32_t symbolUs = (uint32_t)((float)(1UL << sf) * 1000.0f / bw);
+  return CSMA_SLOT_SYMBOLS * symbolUs + CSMA_TURNAROUND_US;
+}
+
+uint32_t ChannelAccess::draw(uint8_t prio, uint8_t busy, uint32_t slot) {
+  uint32_t cw = contentionWindow[prio < TX_PRIO_COUNT ? prio : (uint8_t)TX_PRIO_NORMAL];
+  cw <<= busy;
+  if (cw > CSMA_CW_MAX)
+    cw = CSMA_CW_MAX;
+  uint32_t slots = next() % cw;
+  uint32_t ms = (slots * slot + 999) / 1000;
+  counters.backoffs++;
+  counters.backoffMs += ms;
+  return ms;
+}
+
+bool ChannelAccess::ready(uint8_t prio, uint32_t slot, uint32_t now) {
+  if (!pending) {
+    pending = true;
+    heard = false;
+    priority = prio;
+    busyCount = 0;
+    backoffUntil = now + draw(prio, 0, slot);
+  } else if (prio > priority && busyCount == 0) {
+    // An ACK overtakes a beacon: it need not sit out the beacon's window
+    uint32_t until = now + draw(prio, 0, slot);
+    if ((int32_t)(until - backoffUntil) < 0)
+      backoffUntil = until;
+    priority = prio;
+  }
+  return (int32_t)(now - backoffUntil) >= 0;
+}
+
+bool ChannelAccess::onCad(bool busy, uint32_t slot, uint32_t now) {
+  counters.cads++;
+  if (!busy) {
+    pending = false;
+    return true;
+  }
+  counters.busy[priority < TX_PRIO_COUNT ? priority : (uint8_t)TX_PRIO_NORMAL]++;
+  if (busyCount >= CSMA_MAX_BUSY) {
+    counters.forced++;
+    pending = false;
+    return true;
+  }
+  busyCount++;
+  backoffUntil = now + draw(priority, busyCount, slot);
+  return false;
+}
+
+void ChannelAccess::onReceiving(uint32_t slot, uint32_t now) {
+  if (!heard)
+    counters.receiving++;
+  heard = true;
+  backoffUntil = now + (slot + 999) / 1000;
+}
+
+bool ChannelAccess::onIdle(uint32_t slot, uint32_t now) {
+  if (!heard)
+    return true;
+  heard = false;
+  backoffUntil = now + draw(priority, busyCount, slot);
+  return (int32_t)(now - backoffUntil) >= 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "AirtimeBudget.h"
+
+/**
+ * @file ChannelAccess.h
+ * @brief Listen-before-talk (CSMA) with SX1262 channel activity detection.
+ *
+ * A received broadcast makes every neighbour answer or forward at the same
+ * moment. Before a frame goes on air the transmitter therefore waits a random
+ * number of slots, runs a CAD and only sends when the channel is free. A slot
+ * is long enough for a CAD plus the RX-to-TX turnaround, so a node that drew
+ * one slot more already sees the preamble of the one that went first.
+ *
+ * The contention window depends on the TX_PRIO_* class: ACKs draw from the
+ * smallest window, beacons and tables from the largest. Each busy CAD doubles
+ * the window (up to CSMA_CW_MAX); after CSMA_MAX_BUSY busy CADs the frame is
+ * sent anyway rather than starve behind a node that never stops talking.
+ *
+ * The backoff belongs to the transmitter, not to one frame: when a frame of
+ * a higher class shows up during a backoff it may shorten the wait to its own
+ * window.
+ *
+ * CAD needs the radio in standby, which aborts a frame it is receiving, and
+ * only reliably sees a preamble. While the radio reports a preamble or a
+ * valid header the transmitter therefore waits without a CAD, and draws its
+ * backoff again once the frame is over, so the nodes that heard the same
+ * frame do not all go at its end.
+ */
+
+#define CSMA_SLOT_SYMBOLS 3     ///< CAD of two symbols plus one symbol of margin
+#define CSMA_TURNAROUND_US 1000 ///< Task wake-up, SPI and RX-to-TX switch
+#define CSMA_CW_HIGH 4          ///< Contention window in slots, ACKs
+#define CSMA_CW_NORMAL 16       ///< Game traffic and forwards
+#define CSMA_CW_LOW 32          ///< Beacons and tables
+#define CSMA_CW_MAX 256
+#define CSMA_MAX_BUSY 6         ///< Busy CADs before the frame is sent regardless
+
+struct CsmaStats {
+  uint32_t cads = 0;                      ///< Channel activity detections run
+  uint32_t busy[TX_PRIO_COUNT] = {};      ///< CADs that found a LoRa signal, per class
+  uint32_t backoffs = 0;                  ///< Backoff periods drawn, initial and after busy
+  uint32_t forced = 0;                    ///< Frames sent on a busy channel after CSMA_MAX_BUSY
+  uint32_t receiving = 0;                 ///< Backoffs that waited for a frame coming in instead of a CAD
+  uint32_t corrupted = 0;                 ///< Frames received with a CRC error, mostly collisions
+  uint64_t backoffMs = 0;                 ///< Total time drawn for backoffs
+};
+
+class ChannelAccess {
+public:
+  /**
+   * @param seed Seed for the backoff draws (node specific).
+   */
+  void begin(uint32_t seed);
+
+  /**
+   * @brief Slot length for the current modulation.
+   */
+  static uint32_t slotUs(uint8_t sf, float bw);
+
+  /**
+   * @brief May a frame of this class do its CAD now?
+   *
+   * The first call for a new frame draws the initial backoff.
+   * @param slotUs Slot length, see slotUs().
+   * @return false while backing off; wakeAt() tells until when.
+   */
+  bool ready(uint8_t priority, uint32_t slotUs, uint32_t now);
+
+  /**
+   * @brief Feed the result of the CAD.
+   * @return true if the frame may go on air now, false to back off again.
+   */
+  bool onCad(bool busy, uint32_t slotUs, uint32_t now);
+
+  /**
+   * @brief The radio is receiving a frame: look again a slot later, without a CAD.
+   *
+   * Unlike a busy CAD this does not widen the window or count towards
+   * CSMA_MAX_BUSY; the frame ends by itself.
+   */
+  void onReceiving(uint32_t slotUs, uint32_t now);
+
+  /**
+   * @brief The radio is not receiving (any more).
+   * @return true if the CAD may run now, false after a reception: the
+   *         backoff starts over from the end of the frame.
+   */
+  bool onIdle(uint32_t slotUs, uint32_t now);
+
+  /**
+   * @brief Forget the backoff, e.g. when the queue emptied before the frame went out.
+   */
+  void reset() { pending = false; }
+
+  bool backingOff() const { return pending; }
+  uint32_t wakeAt() const { return backoffUntil; }
+
+  void countCorrupted() { counters.corrupted++; }
+  const CsmaStats &stats() const { return counters; }
+
+private:
+  uint32_t draw(uint8_t priority, uint8_t busyCount, uint32_t slotUs);
+  uint32_t next();
+
+  bool pending = false;         ///< A backoff was drawn for the next frame
+  bool heard = false;           ///< A frame came in during this backoff
+  uint8_t priority = 0;         ///< Class the backoff was drawn for
+  uint8_t busyCount = 0;
+  uint32_t backoffUntil = 0;
+  uint32_t rng = 1;
+  CsmaStats counters;
+};
@@ -0,0 +1,204 @@
+#include "CustodyStore.h"
+#include <string.h>
+
+#define CUSTODY_RECORD_VERSION 1
+
+static void putU32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int CustodyStore::add(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, uint32_t now) {
+  if (len > CUSTODY_MAX_BYTES)
+    return -1;
+  int slot = -1;
+  for (size_t i = 0; i < CUSTODY_SLOTS && slot < 0; i++)
+    if (slots[i].state == CUSTODY_FREE)
+      slot = i;
+  if (slot < 0) {
+    // Full: make room by giving up the oldest message not in the outbox
+    for (size_t i = 0; i < CUSTODY_SLOTS; i++)
+      if (slots[i].state != CUSTODY_SENDING && (slot < 0 || now - slots[i].takenAt > now - slots[slot].takenAt))
+        slot = i;
+    if (slot < 0)
+      return -1;
+    counters.dropped++;
+  }
+
+  CustodyEntry &e = slots[slot];
+  e.state = CUSTODY_SENDING;
+  e.type = hdr.type;
+  e.flags = hdr.flags & LORA_FLAG_COMPRESSED;
+  e.seq = hdr.seq;
+  e.len = len;
+  e.origin = hdr.origin;
+  e.dest = hdr.dest;
+  e.takenAt = now;
+  e.offerAt = now;
+  e.offeredAt = 0;
+  e.backoff = CUSTODY_CHECK_MS;
+  e.via = 0;
+  memcpy(e.data, data, len);
+  return slot;
+}
+
+void CustodyStore::hold(size_t i, uint32_t delay, uint32_t via, uint32_t now) {
+  CustodyEntry &e = slots[i];
+  e.state = CUSTODY_HELD;
+  e.offerAt = now + delay;
+  e.backoff = CUSTODY_CHECK_MS;
+  e.via = via;
+}
+
+void CustodyStore::reroute(size_t i, uint32_t via, uint32_t now) {
+  CustodyEntry &e = slots[i];
+  if (via == e.via)
+    return;
+  e.via = via;
+  if (!via)
+    return;
+  uint32_t earliest = e.offeredAt && now - e.offeredAt < CUSTODY_CHECK_MS ? e.offeredAt + CUSTODY_CHECK_MS : now;
+  if ((int32_t)(e.offerAt - earliest) > 0)
+    e.offerAt = earliest;
+}
+
+void CustodyStore::remove(size_t i) {
+  slots[i].state = CUSTODY_FREE;
+  slots[i].saved = false;
+}
+
+int CustodyStore::find(uint32_t origin, uint16_t seq) const {
+  for (size_t i = 0; i < CUSTODY_SLOTS; i++)
+    if (slots[i].state != CUSTODY_FREE && slots[i].origin == origin && slots[i].seq == seq)
+      return i;
+  return -1;
+}
+
+bool CustodyStore::nextDue(uint32_t &at) const {
+  bool found = false;
+  auto earliest = [&](uint32_t t) {
+    if (!found || (int32_t)(t - at) < 0) {
+      at = t;
+      found = true;
+    }
+  };
+  for (const CustodyEntry &e : slots) {
+    if (e.state == CUSTODY_FREE || e.state == CUSTODY_SENDING)
+      continue;
+    earliest(e.takenAt + CUSTODY_TTL_MS + 1);
+    if (e.state == CUSTODY_HELD && e.via)
+      earliest(e.offerAt);
+  }
+  return found;
+}
+
+size_t CustodyStore::size() const {
+  size_t n = 0;
+  for (const CustodyEntry &e : slots)
+    if (e.state != CUSTODY_FREE)
+      n++;
+  return n;
+}
+
+size_t CustodyStore::encodeOffer(uint32_t dest, uint32_t now, uint8_t *out) {
+  size_t n = 0;
+  for (CustodyEntry &e : slots) {
+    if (n == CUSTODY_SUMMARY_MAX)
+      break;
+    if (e.state != CUSTODY_HELD || e.dest != dest || (int32_t)(now - e.offerAt) < 0)
+      continue;
+    uint8_t *p = out + 2 + n * CUSTODY_SUMMARY_ENTRY_SIZE;
+    putU32(p, e.origin);
+    p[4] = e.seq & 0xFF;
+    p[5] = e.seq >> 8;
+    p[6] = 0;
+    n++;
+    e.offeredAt = now ? now : 1;
+    e.offerAt = now + e.backoff;
+    e.backoff = e.backoff * 2 < CUSTODY_BACKOFF_MAX_MS ? e.backoff * 2 : CUSTODY_BACKOFF_MAX_MS;
+  }
+  if (n == 0)
+    return 0;
+  out[0] = CUSTODY_OFFER;
+  out[1] = n;
+  counters.offers++;
+  return 2 + n * CUSTODY_SUMMARY_ENTRY_SIZE;
+}
+
+size_t CustodyStore::answerOffer(const uint8_t *offer, size_t len, uint8_t *out) const {
+  uint8_t kind;
+  CustodyId ids[CUSTODY_SUMMARY_MAX];
+  size_t n = decodeSummary(offer, len, kind, ids);
+  if (n == 0 || kind != CUSTODY_OFFER)
+    return 0;
+  out[0] = CUSTODY_REPLY;
+  out[1] = n;
+  for (size_t k = 0; k < n; k++) {
+    bool have = false;
+    for (const DeliveredId &d : delivered)
+      if (d.origin == ids[k].origin && d.seq == ids[k].seq)
+        have = true;
+    uint8_t *p = out + 2 + k * CUSTODY_SUMMARY_ENTRY_SIZE;
+    memcpy(p, offer + 2 + k * CUSTODY_SUMMARY_ENTRY_SIZE, 6);
+    p[6] = have ? 1 : 0;
+  }
+  return 2 + n * CUSTODY_SUMMARY_ENTRY_SIZE;
+}
+
+size_t CustodyStore::decodeSummary(const uint8_t *data, size_t len, uint8_t &kind, CustodyId *ids) {
+  if (len < 2 || data[1] == 0 || data[1] > CUSTODY_SUMMARY_MAX || len < 2 + (size_t)data[1] * CUSTODY_SUMMARY_ENTRY_SIZE)
+    return 0;
+  kind = data[0];
+  size_t n = data[1];
+  for (size_t k = 0; k < n; k++) {
+    const uint8_t *p = data + 2 + k * CUSTODY_SUMMARY_ENTRY_SIZE;
+    ids[k] = { getU32(p), (uint16_t)(p[4] | (p[5] << 8)), p[6] != 0 };
+  }
+  return n;
+}
+
+void CustodyStore::noteDelivered(uint32_t origin, uint16_t seq) {
+  delivered[deliveredHead] = { origin, seq };
+  deliveredHead = (deliveredHead + 1) % CUSTODY_DELIVERED_SLOTS;
+}
+
+size_t CustodyStore::save(size_t i, uint8_t *out) const {
+  const CustodyEntry &e = slots[i];
+  memset(out, 0, CUSTODY_RECORD_HEADER);
+  out[0] = CUSTODY_RECORD_VERSION;
+  out[1] = e.type;
+  out[2] = e.flags;
+  putU32(out + 4, e.origin);
+  putU32(out + 8, e.dest);
+  out[12] = e.seq & 0xFF;
+  out[13] = e.seq >> 8;
+  out[14] = e.len & 0xFF;
+  out[15] = e.len >> 8;
+  memcpy(out + CUSTODY_RECORD_HEADER, e.data, e.len);
+  return CUSTODY_RECORD_HEADER + e.len;
+}
+
+bool CustodyStore::load(size_t i, const uint8_t *in, size_t len, uint32_t now) {
+  if (len < CUSTODY_RECORD_HEADER || in[0] != CUSTODY_RECORD_VERSION)
+    return false;
+  size_t dataLen = in[14] | (in[15] << 8);
+  if (dataLen > CUSTODY_MAX_BYTES || len != CUSTODY_RECORD_HEADER + dataLen)
+    return false;
+  CustodyEntry &e = slots[i];
+  e.type = in[1];
+  e.flags = in[2];
+  e.origin = getU32(in + 4);
+  e.dest = getU32(in + 8);
+  e.seq = in[12] | (in[13] << 8);
+  e.len = dataLen;
+  memcpy(e.data, in + CUSTODY_RECORD_HEADER, dataLen);
+  e.takenAt = now;
+  e.offeredAt = 0;
+  e.saved = true;
+  hold(i, 0, 0, now);
+  return true;
+}
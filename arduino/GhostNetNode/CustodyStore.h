@@ -0,0 +1,196 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "LoRaPacket.h"
+
+/**
+ * @file CustodyStore.h
+ * @brief Store-and-forward custody of originated unicast messages.
+ *
+ * An outbox ACK only says that the first hop holds the message; relays
+ * forward it once and immediately, so a destination that walked out of range
+ * never gets it. The origin therefore keeps a copy of every unicast and
+ * gateway message until it knows the destination has it:
+ *  - when the first hop was the destination itself, the outbox ACK is enough;
+ *  - otherwise the entry is held and, once the destination is reachable,
+ *    offered in a summary vector: a list of message ids. The destination
+ *    answers with the ids it has and those it lacks, so only missing
+ *    messages are sent again.
+ * Entries that were not confirmed are re-offered when the destination or a
+ * different next hop appears in the route table, and otherwise on an
+ * exponential backoff until CUSTODY_TTL_MS has passed.
+ *
+ * A resend gets a new sequence number: relays still remember the fragments
+ * of the first attempt in their seen cache and would drop them as copies.
+ *
+ * Held entries are written to NVS by LoRaRadio (see save() and load()), so
+ * they survive a reboot; their lifetime starts again at boot.
+ */
+
+#define CUSTODY_SLOTS 8
+#define CUSTODY_MAX_BYTES 320                 ///< Longest (compressed) message kept, four fragments
+#define CUSTODY_TTL_MS (30UL * 60UL * 1000UL)
+#define CUSTODY_CHECK_MS 60000UL              ///< Ask the destination this long after a multi-hop send
+#define CUSTODY_BACKOFF_MAX_MS (10UL * 60UL * 1000UL)
+#define CUSTODY_DELIVERED_SLOTS 32            ///< Received message ids remembered for summary answers
+#define CUSTODY_SUMMARY_MAX 8                 ///< Message ids per summary frame
+#define CUSTODY_SUMMARY_ENTRY_SIZE 7          ///< Origin, sequence, have flag
+#define CUSTODY_RECORD_HEADER 16              ///< Bytes before the message data in a saved entry
+
+// Summary frame kinds (first payload byte of a LORA_PKT_CUSTODY frame)
+#define CUSTODY_OFFER 1  ///< Custodian -> destination: do you have these?
+#define CUSTODY_REPLY 2  ///< Destination -> custodian: have flag per id
+
+enum CustodyState : uint8_t {
+  CUSTODY_FREE = 0,
+  CUSTODY_SENDING,  ///< In the outbox
+  CUSTODY_HELD,     ///< Waiting to be offered to the destination
+  CUSTODY_WANTED    ///< Destination lacks it, resent when the outbox has room
+};
+
+struct CustodyEntry {
+  CustodyState state = CUSTODY_FREE;
+  uint8_t type = 0;
+  uint8_t flags = 0;       ///< Header flags of the message (LORA_FLAG_COMPRESSED)
+  bool saved = false;      ///< NVS holds a record for this slot
+  uint16_t seq = 0;        ///< Sequence number of the latest attempt
+  uint16_t len = 0;
+  uint32_t origin = 0;
+  uint32_t dest = 0;       ///< Node hash or LORA_DEST_GATEWAY
+  uint32_t takenAt = 0;
+  uint32_t offerAt = 0;    ///< Next summary offer once the destination is reachable
+  uint32_t offeredAt = 0;  ///< Time of the last offer, 0 if none yet
+  uint32_t backoff = 0;    ///< Wait after an unanswered offer
+  uint32_t via = 0;        ///< Next hop towards dest at the last check, 0 if unreachable
+  uint8_t data[CUSTODY_MAX_BYTES];
+};
+
+/// One id of a summary vector
+struct CustodyId {
+  uint32_t origin;
+  uint16_t seq;
+  bool have;
+};
+
+struct CustodyStats {
+  uint32_t held = 0;       ///< Messages not confirmed by their first hop
+  uint32_t confirmed = 0;  ///< Destination reported it has the message
+  uint32_t resent = 0;     ///< Sent again because the destination lacked it
+  uint32_t expired = 0;    ///< Given up after CUSTODY_TTL_MS
+  uint32_t dropped = 0;    ///< Evicted for a newer message
+  uint32_t offers = 0;     ///< Summary offers sent
+  uint32_t replies = 0;    ///< Summary replies sent
+};
+
+class CustodyStore {
+public:
+  /**
+   * @brief Keep a copy of a message handed to the outbox.
+   *
+   * When every slot is taken the oldest entry that is not in the outbox is
+   * evicted. The slot keeps its saved flag, so the caller can overwrite or
+   * erase the evicted entry's NVS record.
+   * @return Slot index, -1 if the message is too long or no slot can be freed.
+   */
+  int add(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, uint32_t now);
+
+  /**
+   * @brief Wait before offering entry i; its backoff starts over.
+   * @param via Current next hop towards the destination, 0 if unreachable.
+   */
+  void hold(size_t i, uint32_t delay, uint32_t via, uint32_t now);
+
+  /**
+   * @brief Report the current next hop towards the destination of entry i.
+   *
+   * When the destination reappears or is reached through another neighbour
+   * the entry is offered again right away, but not within CUSTODY_CHECK_MS
+   * of the previous offer, so a flapping route cannot cause an offer storm.
+   */
+  void reroute(size_t i, uint32_t via, uint32_t now);
+
+  /**
+   * @brief Free slot i.
+   */
+  void remove(size_t i);
+
+  /**
+   * @brief Slot holding the message with this id, -1 if none.
+   */
+  int find(uint32_t origin, uint16_t seq) const;
+
+  /**
+   * @brief Earliest time an entry expires or a reachable destination is due for an offer.
+   *
+   * Everything else (outbox results, outbox room, a route to the destination)
+   * comes with a received frame or a retransmission timeout, not at a time
+   * known in advance.
+   * @return false if nothing is due at a known time.
+   */
+  bool nextDue(uint32_t &at) const;
+
+  CustodyEntry &entry(size_t i) { return slots[i]; }
+  const CustodyEntry &entry(size_t i) const { return slots[i]; }
+  size_t size() const;
+
+  /**
+   * @brief Build an offer of the held entries for dest that are due.
+   *
+   * The offered entries wait their backoff before the next offer, which
+   * then doubles.
+   * @param dest Destination to offer to.
+   * @param out Payload buffer, at least 2 + CUSTODY_SUMMARY_MAX * CUSTODY_SUMMARY_ENTRY_SIZE bytes.
+   * @return Payload length, 0 if nothing is due.
+   */
+  size_t encodeOffer(uint32_t dest, uint32_t now, uint8_t *out);
+
+  /**
+   * @brief Answer an offer with the have flag of every id.
+   * @return Reply payload length, 0 if the offer is malformed.
+   */
+  size_t answerOffer(const uint8_t *offer, size_t len, uint8_t *out) const;
+
+  /**
+   * @brief Decode a summary frame payload.
+   * @param kind Receives CUSTODY_OFFER or CUSTODY_REPLY.
+   * @param ids Receives up to CUSTODY_SUMMARY_MAX ids.
+   * @return Number of ids, 0 if malformed.
+   */
+  static size_t decodeSummary(const uint8_t *data, size_t len, uint8_t &kind, CustodyId *ids);
+
+  /**
+   * @brief Remember that a message for this node arrived, for answerOffer().
+   */
+  void noteDelivered(uint32_t origin, uint16_t seq);
+
+  /**
+   * @brief Serialize entry i for NVS.
+   * @param out At least CUSTODY_RECORD_HEADER + CUSTODY_MAX_BYTES bytes.
+   * @return Record length.
+   */
+  size_t save(size_t i, uint8_t *out) const;
+
+  /**
+   * @brief Restore a saved record into slot i as a held entry.
+   * @return false if the record is not valid.
+   */
+  bool load(size_t i, const uint8_t *in, size_t len, uint32_t now);
+
+  void countHeld() { counters.held++; }
+  void countConfirmed() { counters.confirmed++; }
+  void countResent() { counters.resent++; }
+  void countExpired() { counters.expired++; }
+  void countReply() { counters.replies++; }
+  const CustodyStats &stats() const { return counters; }
+
+private:
+  struct DeliveredId {
+    uint32_t origin;
+    uint16_t seq;
+  };
+
+  CustodyEntry slots[CUSTODY_SLOTS];
+  DeliveredId delivered[CUSTODY_DELIVERED_SLOTS] = {};
+  size_t deliveredHead = 0;
+  CustodyStats counters;
+};
@@ -0,0 +1,155 @@
+#include "FecCodec.h"
+#include <string.h>
+
+// GF(2^8) with the Reed-Solomon polynomial x^8 + x^4 + x^3 + x^2 + 1
+static uint8_t gfExp[512];
+static uint8_t gfLog[256];
+static bool gfReady = false;
+
+static void gfInit() {
+  if (gfReady)
+    return;
+  uint16_t x = 1;
+  for (int i = 0; i < 255; i++) {
+    gfExp[i] = (uint8_t)x;
+    gfLog[x] = (uint8_t)i;
+    x <<= 1;
+    if (x & 0x100)
+      x ^= 0x11D;
+  }
+  // Doubled so a sum of two logs needs no modulo
+  for (int i = 255; i < 512; i++)
+    gfExp[i] = gfExp[i - 255];
+  gfReady = true;
+}
+
+static uint8_t gfMul(uint8_t a, uint8_t b) {
+  return a && b ? gfExp[gfLog[a] + gfLog[b]] : 0;
+}
+
+static uint8_t gfInv(uint8_t a) {
+  return gfExp[255 - gfLog[a]];
+}
+
+// Cauchy coefficient of data block i in repair block r: x_r = 32 + r and
+// y_i = i never meet, so x_r + y_i is never 0
+static uint8_t coefficient(uint8_t r, uint8_t i) {
+  return gfInv((uint8_t)((FEC_MAX_BLOCKS + r) ^ i));
+}
+
+// dst += c * src
+static void mulAdd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size) {
+  if (c == 0)
+    return;
+  const uint8_t *row = gfExp + gfLog[c];
+  for (size_t j = 0; j < size; j++)
+    if (src[j])
+      dst[j] ^= row[gfLog[src[j]]];
+}
+
+static void mulRow(uint8_t *dst, uint8_t c, size_t size) {
+  for (size_t j = 0; j < size; j++)
+    dst[j] = gfMul(c, dst[j]);
+}
+
+uint8_t FecPolicy::repairFor(uint8_t fragments, FecLinkQuality quality) const {
+  if (!enabled || fragments < 2 || fragments >= FEC_MAX_BLOCKS || quality >= FEC_LINK_QUALITIES)
+    return 0;
+  float want = fragments * ratio[quality];
+  uint32_t k = (uint32_t)want;
+  if ((float)k < want)
+    k++;
+  if (k > FEC_MAX_REPAIR)
+    k = FEC_MAX_REPAIR;
+  if (fragments + k > FEC_MAX_BLOCKS)
+    k = FEC_MAX_BLOCKS - fragments;
+  return (uint8_t)k;
+}
+
+FecLinkQuality fecLinkQuality(float marginDb) {
+  if (marginDb >= FEC_GOOD_MARGIN_DB)
+    return FEC_LINK_GOOD;
+  if (marginDb >= FEC_FAIR_MARGIN_DB)
+    return FEC_LINK_FAIR;
+  return FEC_LINK_POOR;
+}
+
+void fecEncode(const uint8_t *data, uint8_t n, size_t size, uint8_t r, uint8_t *out) {
+  gfInit();
+  memset(out, 0, size);
+  for (uint8_t i = 0; i < n; i++)
+    mulAdd(out, data + i * size, coefficient(r, i), size);
+}
+
+bool fecDecode(uint8_t *blocks, uint8_t n, size_t size, uint32_t have) {
+  gfInit();
+  uint8_t missing[FEC_MAX_REPAIR];
+  uint8_t repairs[FEC_MAX_REPAIR];
+  uint8_t m = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (have & (1UL << i))
+      continue;
+    if (m == FEC_MAX_REPAIR)
+      return false;
+    missing[m++] = i;
+  }
+  if (m == 0)
+    return true;
+  uint8_t found = 0;
+  for (uint8_t i = n; i < FEC_MAX_BLOCKS && found < m; i++)
+    if (have & (1UL << i))
+      repairs[found++] = i - n;
+  if (found < m)
+    return false;
+
+  // Take the data blocks we have out of the repair blocks, leaving
+  // m equations in the m missing blocks
+  for (uint8_t a = 0; a < m; a++) {
+    uint8_t *syndrome = blocks + (n + repairs[a]) * size;
+    for (uint8_t i = 0; i < n; i++)
+      if (have & (1UL << i))
+        mulAdd(syndrome, blocks + i * size, coefficient(repairs[a], i), size);
+  }
+
+  // Gauss-Jordan on the Cauchy submatrix, applied to the syndromes as we go
+  uint8_t matrix[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+  for (uint8_t a = 0; a < m; a++)
+    for (uint8_t b = 0; b < m; b++)
+      matrix[a][b] = coefficient(repairs[a], missing[b]);
+  for (uint8_t col = 0; col < m; col++) {
+    // Every square part of a Cauchy matrix is invertible, so a pivot exists
+    uint8_t pivot = col;
+    while (pivot < m && matrix[pivot][col] == 0)
+      pivot++;
+    if (pivot == m)
+      return false;
+    if (pivot != col) {
+      for (uint8_t b = 0; b < m; b++) {
+        uint8_t t = matrix[col][b];
+        matrix[col][b] = matrix[pivot][b];
+        matrix[pivot][b] = t;
+      }
+      uint8_t t = repairs[col];
+      repairs[col] = repairs[pivot];
+      repairs[pivot] = t;
+    }
+    uint8_t *rowData = blocks + (n + repairs[col]) * size;
+    uint8_t scale = gfInv(matrix[col][col]);
+    for (uint8_t b = 0; b < m; b++)
+      matrix[col][b] = gfMul(matrix[col][b], scale);
+    mulRow(rowData, scale, size);
+    for (uint8_t a = 0; a < m; a++) {
+      uint8_t factor = matrix[a][col];
+      if (a == col || factor == 0)
+        continue;
+      for (uint8_t b = 0; b < m; b++)
+        matrix[a][b] ^= gfMul(factor, matrix[col][b]);
+      mulAdd(blocks + (n + repairs[a]) * size, rowData, factor, size);
+    }
+  }
+
+  // Row a now holds missing block a
+  for (uint8_t a = 0; a < m; a++)
+    memcpy(blocks + missing[a] * size, blocks + (n + repairs[a]) * size, size);
+  return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file FecCodec.h
+ * @brief Erasure code across the fragments of a message.
+ *
+ * A systematic Reed-Solomon code over GF(2^8): the n data fragments are sent
+ * as they are, followed by k repair fragments. Repair fragment r is the sum
+ * of all data fragments, each multiplied by the Cauchy coefficient
+ * 1 / (x_r + y_i). Every square part of a Cauchy matrix is invertible, so
+ * the receiver rebuilds the message from any n of the n + k fragments,
+ * without another round trip.
+ *
+ * On air a repair fragment has LORA_FLAG_REPAIR, fragment index n + r and
+ * fragment count n. Its payload is the length of the last data fragment
+ * (which the receiver may never see) followed by one coded block. The last
+ * data fragment is coded as if zero padded to a full block.
+ *
+ * How many repair fragments a message gets depends on the link it goes
+ * out on; see FecPolicy. This file has no Arduino dependencies.
+ */
+
+#define FEC_MAX_BLOCKS 32      ///< Data plus repair fragments, width of the fragment bitmap
+#define FEC_MAX_REPAIR 8
+#define FEC_GOOD_MARGIN_DB 10.0f  ///< SNR above the demodulation floor of a good link
+#define FEC_FAIR_MARGIN_DB 4.0f
+
+enum FecLinkQuality : uint8_t {
+  FEC_LINK_GOOD = 0,     ///< Direct neighbour with a wide SNR margin
+  FEC_LINK_FAIR = 1,
+  FEC_LINK_POOR = 2,     ///< Close to the demodulation floor
+  FEC_LINK_UNKNOWN = 3   ///< Broadcast, flooded, or a neighbour not heard yet
+};
+#define FEC_LINK_QUALITIES 4
+
+/**
+ * @brief Repair fragments per data fragment for each link quality.
+ */
+struct FecPolicy {
+  bool enabled = false;
+  float ratio[FEC_LINK_QUALITIES] = { 0.0f, 0.125f, 0.25f, 0.25f };
+
+  /**
+   * @brief Repair fragments for a message of this many data fragments.
+   *
+   * ceil(fragments * ratio), at most FEC_MAX_REPAIR and never more than fit
+   * in FEC_MAX_BLOCKS. Single-fragment messages get none: the outbox
+   * retransmission is as cheap as a repair fragment.
+   */
+  uint8_t repairFor(uint8_t fragments, FecLinkQuality quality) const;
+};
+
+/**
+ * @brief Quality class of a link from its SNR margin above the demodulation floor.
+ */
+FecLinkQuality fecLinkQuality(float marginDb);
+
+/**
+ * @brief Compute repair block r.
+ * @param data n data blocks of size bytes, back to back.
+ * @param n Number of data blocks.
+ * @param size Block size in bytes.
+ * @param r Repair index, 0 .. FEC_MAX_BLOCKS - n - 1.
+ * @param out Receives size bytes.
+ */
+void fecEncode(const uint8_t *data, uint8_t n, size_t size, uint8_t r, uint8_t *out);
+
+/**
+ * @brief Rebuild missing data blocks in place.
+ * @param blocks n data blocks followed by the repair blocks, each size bytes.
+ * @param n Number of data blocks.
+ * @param size Block size in bytes.
+ * @param have Bit i set when block i (data for i < n, repair i - n otherwise) is present.
+ * @return false if fewer than n blocks are present.
+ */
+bool fecDecode(uint8_t *blocks, uint8_t n, size_t size, uint32_t have);
@@ -0,0 +1,404 @@
+#include "FileTransfer.h"
+#include <string.h>
+
+#define FILE_RECORD_VERSION 1
+
+static void putU32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool bitGet(const uint8_t *bitmap, uint16_t i) {
+  return bitmap[i >> 3] & (1 << (i & 7));
+}
+
+static void bitSet(uint8_t *bitmap, uint16_t i) {
+  bitmap[i >> 3] |= 1 << (i & 7);
+}
+
+static uint16_t bitCount(const uint8_t *bitmap, uint16_t n) {
+  uint16_t c = 0;
+  for (uint16_t i = 0; i < n; i++)
+    c += bitGet(bitmap, i);
+  return c;
+}
+
+uint16_t fileChunks(uint32_t size) {
+  return (uint16_t)((size + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE);
+}
+
+uint32_t fileHash(const uint8_t *data, size_t len, uint32_t hash) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+size_t fileEncodeOffer(uint32_t id, uint32_t size, const char *name, uint8_t *out) {
+  size_t nameLen = strlen(name);
+  if (nameLen > FILE_NAME_MAX)
+    nameLen = FILE_NAME_MAX;
+  out[0] = FILE_OP_OFFER;
+  putU32(out + 1, id);
+  putU32(out + 5, size);
+  memcpy(out + 9, name, nameLen);
+  return 9 + nameLen;
+}
+
+size_t fileEncodeChunkHeader(uint32_t id, uint16_t index, bool report, uint8_t *out) {
+  out[0] = FILE_OP_CHUNK | (report ? FILE_OP_REPORT : 0);
+  putU32(out + 1, id);
+  out[5] = index & 0xFF;
+  out[6] = index >> 8;
+  return FILE_CHUNK_HEADER;
+}
+
+size_t fileEncodeStatus(uint32_t id, uint8_t flags, const uint8_t *bitmap, uint16_t chunks, uint8_t *out) {
+  size_t bytes = (chunks + 7) / 8;
+  out[0] = FILE_OP_STATUS;
+  putU32(out + 1, id);
+  out[5] = flags;
+  memcpy(out + 6, bitmap, bytes);
+  return 6 + bytes;
+}
+
+size_t fileEncodeCancel(uint32_t id, uint8_t *out) {
+  out[0] = FILE_OP_CANCEL;
+  putU32(out + 1, id);
+  return 5;
+}
+
+bool fileDecode(const uint8_t *payload, size_t len, FileFrame &out) {
+  if (len < 5)
+    return false;
+  out = FileFrame();
+  out.op = payload[0] & ~FILE_OP_REPORT;
+  out.report = payload[0] & FILE_OP_REPORT;
+  out.id = getU32(payload + 1);
+  switch (out.op) {
+    case FILE_OP_OFFER:
+      if (len < 9)
+        return false;
+      out.size = getU32(payload + 5);
+      out.data = payload + 9;
+      out.len = len - 9;
+      return true;
+    case FILE_OP_CHUNK:
+      if (len <= FILE_CHUNK_HEADER || len > FILE_CHUNK_HEADER + FILE_CHUNK_SIZE)
+        return false;
+      out.index = payload[5] | (payload[6] << 8);
+      out.data = payload + FILE_CHUNK_HEADER;
+      out.len = len - FILE_CHUNK_HEADER;
+      return true;
+    case FILE_OP_STATUS:
+      if (len < 6 || len > FILE_STATUS_MAX)
+        return false;
+      out.flags = payload[5];
+      out.data = payload + 6;
+      out.len = len - 6;
+      return true;
+    case FILE_OP_CANCEL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// =======================
+// Sender
+// =======================
+
+int FileTransfer::send(uint32_t id, uint32_t dest, uint32_t size, const char *path, uint32_t now) {
+  if (size == 0 || size > FILE_MAX_SIZE || strlen(path) > FILE_PATH_MAX)
+    return -1;
+  int slot = -1;
+  for (size_t i = 0; i < FILE_TX_SLOTS; i++) {
+    if (tx[i].used && tx[i].id == id && tx[i].dest == dest) {
+      // Sent again by hand: a paused transfer tries right away
+      if (tx[i].paused) {
+        tx[i].paused = false;
+        tx[i].offerDue = true;
+        tx[i].probes = 0;
+      }
+      return i;
+    }
+    if (!tx[i].used && slot < 0)
+      slot = i;
+  }
+  if (slot < 0)
+    return -1;
+  FileTxTransfer &t = tx[slot];
+  t = FileTxTransfer();
+  t.used = true;
+  t.offerDue = true;
+  t.id = id;
+  t.dest = dest;
+  t.size = size;
+  t.chunks = fileChunks(size);
+  t.startedAt = now;
+  strcpy(t.path, path);
+  counters.started++;
+  return slot;
+}
+
+bool FileTransfer::next(uint32_t now, FileStep &step) {
+  for (size_t k = 1; k <= FILE_TX_SLOTS; k++) {
+    size_t i = (served + k) % FILE_TX_SLOTS;
+    FileTxTransfer &t = tx[i];
+    if (!t.used)
+      continue;
+    if (t.paused) {
+      if ((int32_t)(now - t.deadline) < 0)
+        continue;
+      t.paused = false;
+      t.offerDue = true;
+      t.probes = 0;
+    }
+    if (t.awaiting && !t.reportQueued && (int32_t)(now - t.deadline) >= 0) {
+      // No status for the round or the probe: ask again with the offer
+      t.awaiting = false;
+      if (++t.probes > FILE_MAX_PROBES) {
+        t.paused = true;
+        t.deadline = now + FILE_RESUME_MS;
+        counters.pauses++;
+        continue;
+      }
+      t.offerDue = true;
+      counters.probes++;
+    }
+    if (t.awaiting || t.inFlight >= FILE_IN_FLIGHT)
+      continue;
+
+    step.slot = i;
+    step.index = 0;
+    step.report = true;
+    step.op = FILE_OP_OFFER;
+    uint16_t index = t.cursor;
+    while (index < t.chunks && bitGet(t.have, index))
+      index++;
+    if (!t.offerDue && index < t.chunks) {
+      // The round ends after FILE_WINDOW chunks or with the last missing one
+      uint16_t after = index + 1;
+      while (after < t.chunks && bitGet(t.have, after))
+        after++;
+      step.op = FILE_OP_CHUNK;
+      step.index = index;
+      step.report = ++t.roundSent == FILE_WINDOW || after == t.chunks;
+      t.cursor = index + 1;
+      if (bitGet(t.sent, index))
+        counters.chunksResent++;
+      bitSet(t.sent, index);
+      counters.chunksSent++;
+    }
+    // Nothing missing but no DONE status yet: the offer asks for it
+    t.offerDue = false;
+    if (step.report) {
+      t.awaiting = true;
+      t.reportQueued = true;
+      t.roundSent = 0;
+    }
+    t.inFlight++;
+    step.tag = FILE_TAG | (i << 8) | (step.report ? FILE_TAG_REPORT : 0);
+    served = i;
+    return true;
+  }
+  return false;
+}
+
+void FileTransfer::onFrameDone(uint16_t tag, uint32_t now, uint32_t timeoutMs) {
+  size_t i = (tag >> 8) & 0x0F;
+  if ((tag & 0xF000) != FILE_TAG || i >= FILE_TX_SLOTS || !tx[i].used)
+    return;
+  FileTxTransfer &t = tx[i];
+  if (t.inFlight)
+    t.inFlight--;
+  if ((tag & FILE_TAG_REPORT) && t.reportQueued) {
+    t.reportQueued = false;
+    t.deadline = now + timeoutMs;
+  }
+}
+
+FileTransfer::StatusResult FileTransfer::onStatus(uint32_t origin, const FileFrame &status, uint32_t now, size_t &slot) {
+  for (slot = 0; slot < FILE_TX_SLOTS; slot++)
+    if (tx[slot].used && tx[slot].id == status.id && tx[slot].dest == origin)
+      break;
+  if (slot == FILE_TX_SLOTS)
+    return STATUS_IGNORED;
+  FileTxTransfer &t = tx[slot];
+  if (status.flags & FILE_STATUS_DONE) {
+    counters.completed++;
+    return STATUS_DONE;
+  }
+  if (status.flags & FILE_STATUS_REFUSED) {
+    t.paused = true;
+    t.awaiting = false;
+    t.deadline = now + FILE_RESUME_MS;
+    counters.pauses++;
+    return STATUS_REFUSED;
+  }
+  if (status.flags & FILE_STATUS_CORRUPT)
+    return STATUS_CORRUPT;
+  if (status.len < (size_t)(t.chunks + 7) / 8)
+    return STATUS_IGNORED;
+  memcpy(t.have, status.data, (t.chunks + 7) / 8);
+  t.acked = bitCount(t.have, t.chunks);
+  // Next round: whatever is still missing, from the start
+  t.awaiting = false;
+  t.offerDue = false;
+  t.probes = 0;
+  t.cursor = 0;
+  t.roundSent = 0;
+  return STATUS_PROGRESS;
+}
+
+bool FileTransfer::nextDeadline(uint32_t &at) const {
+  bool any = false;
+  for (const FileTxTransfer &t : tx) {
+    if (!t.used || !(t.paused || (t.awaiting && !t.reportQueued)))
+      continue;
+    if (!any || (int32_t)(t.deadline - at) < 0)
+      at = t.deadline;
+    any = true;
+  }
+  return any;
+}
+
+void FileTransfer::removeOutgoing(size_t i) {
+  tx[i].used = false;
+}
+
+size_t FileTransfer::save(size_t i, uint8_t *out) const {
+  const FileTxTransfer &t = tx[i];
+  size_t pathLen = strlen(t.path);
+  out[0] = FILE_RECORD_VERSION;
+  putU32(out + 1, t.id);
+  putU32(out + 5, t.dest);
+  putU32(out + 9, t.size);
+  memcpy(out + 13, t.path, pathLen);
+  return 13 + pathLen;
+}
+
+bool FileTransfer::load(size_t i, const uint8_t *in, size_t len, uint32_t now) {
+  if (len <= 13 || len > FILE_RECORD_MAX || in[0] != FILE_RECORD_VERSION)
+    return false;
+  uint32_t size = getU32(in + 9);
+  if (size == 0 || size > FILE_MAX_SIZE)
+    return false;
+  FileTxTransfer &t = tx[i];
+  t = FileTxTransfer();
+  t.used = true;
+  t.saved = true;
+  t.offerDue = true;
+  t.id = getU32(in + 1);
+  t.dest = getU32(in + 5);
+  t.size = size;
+  t.chunks = fileChunks(size);
+  t.startedAt = now;
+  memcpy(t.path, in + 13, len - 13);
+  t.path[len - 13] = 0;
+  return true;
+}
+
+// =======================
+// Receiver
+// =======================
+
+int FileTransfer::accept(uint32_t origin, const FileFrame &offer, uint32_t now, bool &fresh) {
+  fresh = false;
+  int slot = find(origin, offer.id);
+  if (slot >= 0) {
+    rx[slot].lastHeard = now;
+    return slot;
+  }
+  if (offer.size == 0 || offer.size > FILE_MAX_SIZE)
+    return -1;
+  // A free slot, else the one finished or silent the longest
+  for (size_t i = 0; i < FILE_RX_SLOTS && slot < 0; i++)
+    if (!rx[i].used)
+      slot = i;
+  for (size_t i = 0; i < FILE_RX_SLOTS && slot < 0; i++)
+    if (rx[i].done || now - rx[i].lastHeard > FILE_RX_IDLE_MS)
+      slot = i;
+  if (slot < 0)
+    return -1;
+
+  FileRxTransfer &r = rx[slot];
+  r = FileRxTransfer();
+  r.used = true;
+  r.origin = origin;
+  r.id = offer.id;
+  r.size = offer.size;
+  r.chunks = fileChunks(offer.size);
+  r.lastHeard = now;
+  // Only the base name, and nothing that could climb out of the folder
+  size_t n = offer.len < FILE_NAME_MAX ? offer.len : FILE_NAME_MAX;
+  for (size_t i = 0; i < n; i++) {
+    char c = (char)offer.data[i];
+    bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' ||
+                 (c == '.' && i > 0);
+    r.name[i] = plain ? c : '_';
+  }
+  if (n == 0)
+    strcpy(r.name, "bestand");
+  fresh = true;
+  return slot;
+}
+
+int FileTransfer::find(uint32_t origin, uint32_t id) const {
+  for (size_t i = 0; i < FILE_RX_SLOTS; i++)
+    if (rx[i].used && rx[i].origin == origin && rx[i].id == id)
+      return i;
+  return -1;
+}
+
+bool FileTransfer::holds(size_t i, uint16_t index) const {
+  if (rx[i].done)
+    return true;
+  return index < rx[i].chunks && bitGet(rx[i].have, index);
+}
+
+bool FileTransfer::mark(size_t i, uint16_t index, uint32_t now) {
+  FileRxTransfer &r = rx[i];
+  r.lastHeard = now;
+  if (index < r.chunks && !bitGet(r.have, index)) {
+    bitSet(r.have, index);
+    r.count++;
+    counters.chunksReceived++;
+  }
+  return r.count == r.chunks;
+}
+
+size_t FileTransfer::status(size_t i, uint8_t *out, uint8_t flags) const {
+  const FileRxTransfer &r = rx[i];
+  if (r.done)
+    flags |= FILE_STATUS_DONE;
+  return fileEncodeStatus(r.id, flags, r.have, flags ? 0 : r.chunks, out);
+}
+
+size_t FileTransfer::saveMap(size_t i, uint8_t *out) const {
+  const FileRxTransfer &r = rx[i];
+  out[0] = FILE_RECORD_VERSION;
+  putU32(out + 1, r.origin);
+  putU32(out + 5, r.id);
+  putU32(out + 9, r.size);
+  memcpy(out + 13, r.name, FILE_NAME_MAX + 1);
+  memcpy(out + 13 + FILE_NAME_MAX + 1, r.have, FILE_BITMAP_BYTES);
+  return FILE_MAP_SIZE;
+}
+
+bool FileTransfer::loadMap(size_t i, const uint8_t *in, size_t len) {
+  FileRxTransfer &r = rx[i];
+  if (len != FILE_MAP_SIZE || in[0] != FILE_RECORD_VERSION || getU32(in + 1) != r.origin || getU32(in + 5) != r.id ||
+      getU32(in + 9) != r.size)
+    return false;
+  memcpy(r.have, in + 13 + FILE_NAME_MAX + 1, FILE_BITMAP_BYTES);
+  r.count = bitCount(r.have, r.chunks);
+  if (r.count)
+    counters.resumed++;
+  return true;
+}
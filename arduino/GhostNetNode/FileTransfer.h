@@ -0,0 +1,271 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file FileTransfer.h
+ * @brief Resumable transfer of a file to one node in LORA_PKT_FILE frames.
+ *
+ * The sender offers the file (id, size, name) and sends it in chunks of
+ * FILE_CHUNK_SIZE bytes, at most FILE_WINDOW chunks per round. The last chunk
+ * of a round asks for a status: the receiver answers with a bitmap of every
+ * chunk it holds, so the next round only carries what is missing. A round
+ * that gets no answer is probed with the offer, which is small and which the
+ * receiver answers with a status as well. After FILE_MAX_PROBES unanswered
+ * probes the transfer pauses and tries again after FILE_RESUME_MS.
+ *
+ * Neither end holds the file in memory. LoRaRadio reads a chunk from LittleFS
+ * when it goes out; the receiver writes it at its offset into a temp file and
+ * saves the bitmap next to it with every status. Both ends may reboot in the
+ * middle: the sender keeps its transfers in NVS (save() and load()) and
+ * offers them again at boot, the receiver finds the saved bitmap for that id
+ * and reports the chunks it already has. The file id is a hash of the
+ * content, which the receiver checks before it renames the temp file into
+ * place.
+ *
+ * Frames go end to end; relays forward them like any other unicast frame.
+ * At most FILE_IN_FLIGHT frames of a transfer wait in the TX queue, so a file
+ * never crowds out game traffic.
+ *
+ * This file has no Arduino dependencies.
+ */
+
+#define FILE_CHUNK_SIZE 200          ///< Data bytes per chunk frame
+#define FILE_MAX_CHUNKS 512
+#define FILE_MAX_SIZE ((uint32_t)FILE_CHUNK_SIZE * FILE_MAX_CHUNKS)
+#define FILE_BITMAP_BYTES (FILE_MAX_CHUNKS / 8)
+#define FILE_WINDOW 16               ///< Chunks per round
+#define FILE_IN_FLIGHT 2             ///< Frames of one transfer in the TX queue
+#define FILE_NAME_MAX 31
+#define FILE_PATH_MAX 47
+#define FILE_TX_SLOTS 2
+#define FILE_RX_SLOTS 2
+#define FILE_MAX_PROBES 5            ///< Unanswered status requests before a pause
+#define FILE_RESUME_MS (60UL * 1000UL)
+#define FILE_RX_IDLE_MS (10UL * 60UL * 1000UL)  ///< A silent incoming transfer is forgotten; its temp file stays
+#define FILE_TAG 0xF000              ///< TxQueue tags of file frames: FILE_TAG | slot << 8 | FILE_TAG_REPORT
+#define FILE_TAG_REPORT 0x01
+#define FILE_HASH_INIT 2166136261UL  ///< FNV-1a offset basis
+
+// Frame kinds (first payload byte of a LORA_PKT_FILE frame)
+#define FILE_OP_OFFER 1    ///< id, size, name; also asks for a status
+#define FILE_OP_CHUNK 2    ///< id, chunk index, data
+#define FILE_OP_STATUS 3   ///< id, FILE_STATUS_* flags, bitmap of the chunks held
+#define FILE_OP_CANCEL 4   ///< id: the sender gave the transfer up
+#define FILE_OP_REPORT 0x80  ///< On a chunk: answer with a status
+
+#define FILE_STATUS_DONE 0x01     ///< Complete, checked and renamed into place
+#define FILE_STATUS_REFUSED 0x02  ///< No slot free or file too large
+#define FILE_STATUS_CORRUPT 0x04  ///< Complete, but the content did not match the id; the temp file is gone
+
+#define FILE_CHUNK_HEADER 7
+#define FILE_OFFER_MAX (9 + FILE_NAME_MAX)
+#define FILE_STATUS_MAX (6 + FILE_BITMAP_BYTES)
+#define FILE_RECORD_MAX (13 + FILE_PATH_MAX)             ///< Saved outgoing transfer
+#define FILE_MAP_SIZE (13 + FILE_NAME_MAX + 1 + FILE_BITMAP_BYTES)  ///< Saved bitmap of an incoming transfer
+
+/// A decoded LORA_PKT_FILE payload
+struct FileFrame {
+  uint8_t op = 0;               ///< FILE_OP_* without FILE_OP_REPORT
+  bool report = false;
+  uint32_t id = 0;
+  uint32_t size = 0;            ///< Offer
+  uint16_t index = 0;           ///< Chunk
+  uint8_t flags = 0;            ///< Status
+  const uint8_t *data = nullptr;  ///< Offer name, chunk data or status bitmap
+  size_t len = 0;
+};
+
+struct FileTxTransfer {
+  bool used = false;
+  bool paused = false;          ///< Quiet until deadline
+  bool awaiting = false;        ///< Round or probe sent, waiting for a status
+  bool reportQueued = false;    ///< The frame asking for the status has not left yet
+  bool offerDue = false;        ///< Offer first: at the start, as a probe and on resume
+  bool saved = false;           ///< NVS holds a record for this slot
+  uint8_t probes = 0;
+  uint8_t inFlight = 0;         ///< Frames in the TX queue
+  uint8_t roundSent = 0;        ///< Chunks queued in this round
+  uint16_t chunks = 0;
+  uint16_t cursor = 0;          ///< Next chunk to look at in this round
+  uint16_t acked = 0;           ///< Chunks the receiver reported
+  uint32_t id = 0;
+  uint32_t dest = 0;
+  uint32_t size = 0;
+  uint32_t deadline = 0;        ///< Status overdue, or end of the pause
+  uint32_t startedAt = 0;
+  uint8_t have[FILE_BITMAP_BYTES] = {};  ///< Chunks the receiver reported
+  uint8_t sent[FILE_BITMAP_BYTES] = {};  ///< Chunks sent at least once
+  char path[FILE_PATH_MAX + 1] = {};
+};
+
+struct FileRxTransfer {
+  bool used = false;
+  bool done = false;            ///< Renamed into place, kept to answer late frames
+  uint16_t chunks = 0;
+  uint16_t count = 0;           ///< Chunks held
+  uint32_t origin = 0;
+  uint32_t id = 0;
+  uint32_t size = 0;
+  uint32_t lastHeard = 0;
+  uint8_t have[FILE_BITMAP_BYTES] = {};
+  char name[FILE_NAME_MAX + 1] = {};
+};
+
+/// What the sender should put on air next
+struct FileStep {
+  size_t slot = 0;
+  uint8_t op = 0;               ///< FILE_OP_OFFER or FILE_OP_CHUNK
+  uint16_t index = 0;
+  bool report = false;
+  uint16_t tag = 0;             ///< Pass to onFrameDone() when the frame leaves the queue
+};
+
+struct FileStats {
+  uint32_t started = 0;         ///< Outgoing transfers accepted
+  uint32_t completed = 0;       ///< Outgoing transfers the receiver confirmed
+  uint32_t pauses = 0;          ///< Outgoing transfers that went quiet for FILE_RESUME_MS
+  uint32_t probes = 0;          ///< Offers sent again because a round got no status
+  uint32_t chunksSent = 0;
+  uint32_t chunksResent = 0;
+  uint32_t received = 0;        ///< Incoming files renamed into place
+  uint32_t chunksReceived = 0;  ///< New chunks written
+  uint32_t duplicates = 0;      ///< Chunks we held already
+  uint32_t resumed = 0;         ///< Incoming transfers continued from a saved bitmap
+  uint32_t corrupt = 0;         ///< Complete files whose content did not match the id
+};
+
+/**
+ * @brief Number of chunks of a file.
+ */
+uint16_t fileChunks(uint32_t size);
+
+/**
+ * @brief 32-bit FNV-1a over a stream, feed it piece by piece.
+ */
+uint32_t fileHash(const uint8_t *data, size_t len, uint32_t hash = FILE_HASH_INIT);
+
+size_t fileEncodeOffer(uint32_t id, uint32_t size, const char *name, uint8_t *out);
+size_t fileEncodeChunkHeader(uint32_t id, uint16_t index, bool report, uint8_t *out);
+size_t fileEncodeStatus(uint32_t id, uint8_t flags, const uint8_t *bitmap, uint16_t chunks, uint8_t *out);
+size_t fileEncodeCancel(uint32_t id, uint8_t *out);
+
+/**
+ * @brief Decode a LORA_PKT_FILE payload.
+ * @return false if it is malformed.
+ */
+bool fileDecode(const uint8_t *payload, size_t len, FileFrame &out);
+
+class FileTransfer {
+public:
+  // ---- Sender ----
+
+  /**
+   * @brief Start sending a file, or wake a transfer of the same file to dest.
+   * @param id Content hash of the file, see fileHash().
+   * @param path LittleFS path the chunks are read from.
+   * @return Slot index, -1 if the file is empty or too large, the path too
+   *         long or every slot busy.
+   */
+  int send(uint32_t id, uint32_t dest, uint32_t size, const char *path, uint32_t now);
+
+  /**
+   * @brief Next frame to queue, round robin over the transfers.
+   * @return false if no transfer has a frame ready.
+   */
+  bool next(uint32_t now, FileStep &step);
+
+  /**
+   * @brief A tagged frame left the TX queue (sent, failed or dropped).
+   * @param timeoutMs How long to wait for a status once the frame that asked for it is on air.
+   */
+  void onFrameDone(uint16_t tag, uint32_t now, uint32_t timeoutMs);
+
+  enum StatusResult { STATUS_IGNORED, STATUS_PROGRESS, STATUS_DONE, STATUS_REFUSED, STATUS_CORRUPT };
+
+  /**
+   * @brief A status from the receiver of one of our transfers.
+   * @param slot Receives the slot it was for.
+   */
+  StatusResult onStatus(uint32_t origin, const FileFrame &status, uint32_t now, size_t &slot);
+
+  /**
+   * @brief Earliest status timeout or end of a pause.
+   * @return false if nothing is due at a known time.
+   */
+  bool nextDeadline(uint32_t &at) const;
+
+  FileTxTransfer &outgoing(size_t i) { return tx[i]; }
+  const FileTxTransfer &outgoing(size_t i) const { return tx[i]; }
+  void removeOutgoing(size_t i);
+
+  /**
+   * @brief Serialize outgoing transfer i for NVS.
+   * @param out At least FILE_RECORD_MAX bytes.
+   */
+  size_t save(size_t i, uint8_t *out) const;
+
+  /**
+   * @brief Restore a saved transfer into slot i; it starts with an offer.
+   * @return false if the record is not valid.
+   */
+  bool load(size_t i, const uint8_t *in, size_t len, uint32_t now);
+
+  // ---- Receiver ----
+
+  /**
+   * @brief Take an offer: the transfer it belongs to, or a new one.
+   *
+   * A new transfer evicts one that is done or has been silent for
+   * FILE_RX_IDLE_MS if no slot is free.
+   * @param fresh Set when the slot is new; the caller may restore a saved bitmap.
+   * @return Slot index, -1 if refused.
+   */
+  int accept(uint32_t origin, const FileFrame &offer, uint32_t now, bool &fresh);
+
+  /**
+   * @brief Slot of an incoming transfer, -1 if unknown.
+   */
+  int find(uint32_t origin, uint32_t id) const;
+
+  bool holds(size_t i, uint16_t index) const;
+
+  /**
+   * @brief Record a chunk written to the temp file.
+   * @return true if the file is complete now.
+   */
+  bool mark(size_t i, uint16_t index, uint32_t now);
+
+  /**
+   * @brief Status payload for incoming transfer i.
+   * @param flags Extra FILE_STATUS_* flags; FILE_STATUS_DONE is set for a finished transfer.
+   * @param out At least FILE_STATUS_MAX bytes.
+   */
+  size_t status(size_t i, uint8_t *out, uint8_t flags = 0) const;
+
+  /**
+   * @brief Bitmap record of incoming transfer i, FILE_MAP_SIZE bytes.
+   */
+  size_t saveMap(size_t i, uint8_t *out) const;
+
+  /**
+   * @brief Continue incoming transfer i from a saved bitmap.
+   * @return false if the record belongs to another transfer.
+   */
+  bool loadMap(size_t i, const uint8_t *in, size_t len);
+
+  FileRxTransfer &incoming(size_t i) { return rx[i]; }
+  const FileRxTransfer &incoming(size_t i) const { return rx[i]; }
+  void removeIncoming(size_t i) { rx[i].used = false; }
+
+  void countDuplicate() { counters.duplicates++; }
+  void countReceived() { counters.received++; }
+  void countCorrupt() { counters.corrupt++; }
+  const FileStats &stats() const { return counters; }
+
+private:
+  FileTxTransfer tx[FILE_TX_SLOTS];
+  FileRxTransfer rx[FILE_RX_SLOTS];
+  size_t served = 0;  ///< Slot that queued the last frame
+  FileStats counters;
+};
@@ -0,0 +1,84 @@
+#include "FloodControl.h"
+#include <string.h>
+
+bool FloodControl::checkAndRemember(const FloodKey &key, uint32_t now) {
+  for (SeenEntry &e : seen) {
+    if (!e.valid || !(e.key == key))
+      continue;
+    if (now - e.heardAt > SEEN_CACHE_TTL_MS) {
+      e.valid = false;
+      break;
+    }
+    counters.duplicates++;
+    // Somebody else already (re)broadcast this frame, ours is redundant
+    for (PendingFrame &p : rebroadcasts) {
+      if (p.used && p.key == key) {
+        p.used = false;
+        counters.cancelled++;
+      }
+    }
+    return false;
+  }
+
+  // Ring: the oldest entry is overwritten first
+  seen[seenHead] = { key, now, true };
+  seenHead = (seenHead + 1) % SEEN_CACHE_SIZE;
+  return true;
+}
+
+bool FloodControl::schedule(const FloodKey &key, const uint8_t *frame, size_t len, uint32_t dueAt) {
+  if (len > LORA_PACKET_MAX_SIZE)
+    return false;
+  for (PendingFrame &p : rebroadcasts) {
+    if (p.used)
+      continue;
+    p.used = true;
+    p.key = key;
+    p.dueAt = dueAt;
+    p.len = len;
+    memcpy(p.frame, frame, len);
+    return true;
+  }
+  counters.overflow++;
+  return false;
+}
+
+bool FloodControl::popDue(uint32_t now, uint8_t *frame, size_t &len) {
+  for (PendingFrame &p : rebroadcasts) {
+    if (!p.used || (int32_t)(now - p.dueAt) < 0)
+      continue;
+    p.used = false;
+    memcpy(frame, p.frame, p.len);
+    len = p.len;
+    counters.forwarded++;
+    return true;
+  }
+  return false;
+}
+
+bool FloodControl::nextDue(uint32_t &at) const {
+  bool found = false;
+  for (const PendingFrame &p : rebroadcasts) {
+    if (p.used && (!found || (int32_t)(p.dueAt - at) < 0)) {
+      at = p.dueAt;
+      found = true;
+    }
+  }
+  return found;
+}
+
+uint32_t FloodControl::seenBitmap(uint32_t origin, uint16_t seq, uint32_t now) const {
+  uint32_t bitmap = 0;
+  for (const SeenEntry &e : seen)
+    if (e.valid && e.key.origin == origin && e.key.seq == seq && e.key.fragIndex < 32 && now - e.heardAt <= SEEN_CACHE_TTL_MS)
+      bitmap |= 1UL << e.key.fragIndex;
+  return bitmap;
+}
+
+size_t FloodControl::pending() const {
+  size_t n = 0;
+  for (const PendingFrame &p : rebroadcasts)
+    if (p.used)
+      n++;
+  return n;
+}
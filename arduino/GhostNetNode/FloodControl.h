@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "LoRaPacket.h"
+
+/**
+ * @file FloodControl.h
+ * @brief Duplicate suppression and delayed rebroadcast for mesh flooding.
+ *
+ * Every frame is identified by (origin, sequence, fragment index). The seen
+ * cache is a ring of recently heard keys with an expiry time; a frame whose
+ * key is still in the ring is a duplicate and must not be logged, ACKed or
+ * forwarded again.
+ *
+ * Forwarding is not immediate: a frame is held for a random delay first. If
+ * a neighbour is overheard forwarding the same frame while it is held, the
+ * neighbourhood already has it and the pending rebroadcast is cancelled.
+ */
+
+#define SEEN_CACHE_SIZE 64
+#define SEEN_CACHE_TTL_MS (10UL * 60UL * 1000UL)
+#define REBROADCAST_SLOTS 4
+
+struct FloodStats {
+  uint32_t duplicates = 0;  ///< Frames suppressed by the seen cache
+  uint32_t forwarded = 0;   ///< Rebroadcasts put on air
+  uint32_t cancelled = 0;   ///< Rebroadcasts cancelled because a neighbour was faster
+  uint32_t overflow = 0;    ///< Rebroadcasts dropped because all slots were busy
+};
+
+struct FloodKey {
+  uint32_t origin;
+  uint16_t seq;
+  uint8_t fragIndex;
+
+  bool operator==(const FloodKey &o) const {
+    return origin == o.origin && seq == o.seq && fragIndex == o.fragIndex;
+  }
+};
+
+class FloodControl {
+public:
+  /**
+   * @brief Check a received frame against the seen cache and remember it.
+   *
+   * A duplicate also cancels a pending rebroadcast of the same frame.
+   * @param key Frame identity.
+   * @param now Current time in ms.
+   * @return true if the frame is new, false if it is a duplicate.
+   */
+  bool checkAndRemember(const FloodKey &key, uint32_t now);
+
+  /**
+   * @brief Hold an encoded frame for rebroadcast at dueAt.
+   * @return false if all rebroadcast slots are busy.
+   */
+  bool schedule(const FloodKey &key, const uint8_t *frame, size_t len, uint32_t dueAt);
+
+  /**
+   * @brief Take the next rebroadcast whose delay has elapsed.
+   * @param now Current time in ms.
+   * @param frame Receives the frame bytes (LORA_PACKET_MAX_SIZE).
+   * @param len Receives the frame length.
+   * @return true if a frame was returned.
+   */
+  bool popDue(uint32_t now, uint8_t *frame, size_t &len);
+
+  /**
+   * @brief Due time of the earliest scheduled rebroadcast.
+   * @return false if none is scheduled.
+   */
+  bool nextDue(uint32_t &at) const;
+
+  /**
+   * @brief Fragments of a message still in the seen cache (bit i = fragment i).
+   */
+  uint32_t seenBitmap(uint32_t origin, uint16_t seq, uint32_t now) const;
+
+  /**
+   * @brief Number of rebroadcasts waiting for their delay.
+   */
+  size_t pending() const;
+
+  const FloodStats &stats() const { return counters; }
+
+private:
+  struct SeenEntry {
+    FloodKey key;
+    uint32_t heardAt;
+    bool valid;
+  };
+
+  struct PendingFrame {
+    bool used = false;
+    FloodKey key;
+    uint32_t dueAt = 0;
+    uint8_t len = 0;
+    uint8_t frame[LORA_PACKET_MAX_SIZE];
+  };
+
+  SeenEntry seen[SEEN_CACHE_SIZE] = {};
+  size_t seenHead = 0;
+  PendingFrame rebroadcasts[REBROADCAST_SLOTS];
+  FloodStats counters;
+};
@@ -5,6 +5,8 @@
 #include <Arduino.h>
 #include <esp_arduino_version.h>
 #include <esp_system.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
 
 #include "LoRaRadio.h"
 #include "LoRaWeb.h"
@@ -21,11 +23,32 @@ LoRaWeb Web(LoRa);
 
 HeltecDisplay& Display = HeltecDisplay::instance();
 
+#define PRG_BUTTON 0             // Held at boot: stay awake with WiFi, whatever the saved mode
+#define LIGHT_SLEEP_MIN_MS 5     // Shorter waits are not worth the wake-up time
+
+bool lowPower = false;           // POWER_SAVE: relay only, no WiFi and no display
+
+// Light sleep until the next radio timer or DIO1; the SX1262 keeps its duty cycle
+static void lightSleep(uint32_t sleepMs) {
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000ULL);
+  gpio_wakeup_enable((gpio_num_t)LORA_DIO1, GPIO_INTR_HIGH_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  Serial.flush();
+  esp_light_sleep_start();
+  gpio_wakeup_disable((gpio_num_t)LORA_DIO1);
+  LoRa.resumeAfterSleep(digitalRead(LORA_DIO1) == HIGH);
+}
+
 void loraTask(void *param) {
   Serial.printf("[LoRaTask] Gestart op core %d\n", xPortGetCoreID());
+  LoRa.setConsumerTask(xTaskGetCurrentTaskHandle());
   for(;;) {
-    LoRa.loop();
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    uint32_t sleepMs = LoRa.loop();
+    // Sleep until the next timer, DIO1 or a queued message
+    if (lowPower && sleepMs >= LIGHT_SLEEP_MIN_MS)
+      lightSleep(sleepMs);
+    else
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs));
   }
 }
 
@@ -33,15 +56,16 @@ void webTask(void *param) {
   Serial.printf("[WebTask] Gestart op core %d\n", xPortGetCoreID());
   for(;;) {
     Web.loop();
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    // The web server runs in its own task; this one only serves DNS and the journal
+    vTaskDelay(50 / portTICK_PERIOD_MS);
   }
 }
 
 void displayTask(void *param) {
   Serial.printf("[DisplayTask] Gestart op core %d\n", xPortGetCoreID());
   for(;;) {
-    Display.loop();
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    // Sleep until the next frame is due (30 fps)
+    vTaskDelay(pdMS_TO_TICKS(Display.loop()) + 1);
   }
 }
 
@@ -76,6 +100,22 @@ void setup() {
   }
   Serial.println("[DEBUG] LoRa init OK");
 
+  pinMode(PRG_BUTTON, INPUT_PULLUP);
+  if (LoRa.getPowerMode() == POWER_SAVE && digitalRead(PRG_BUTTON) == LOW) {
+    Serial.println("[DEBUG] PRG ingedrukt: energiezuinige modus uit");
+    LoRa.setPowerMode(POWER_ALWAYS_ON);
+  }
+  lowPower = LoRa.getPowerMode() == POWER_SAVE;
+  if (lowPower) {
+    // Field relay: switch the OLED rail off and leave WiFi unstarted
+    Serial.println("[DEBUG] Energiezuinige modus: geen WiFi en geen scherm");
+    pinMode(VEXT, OUTPUT);
+    digitalWrite(VEXT, HIGH);
+    UserManager::loadUsersNVS();
+    xTaskCreatePinnedToCore(loraTask, "LoRaTask", 8192, NULL, 1, NULL, 1);
+    return;
+  }
+
   // Web init
   Serial.println("[DEBUG] Web begin...");
   Web.begin(("GhostNetNode " + String(GAMEVERSION)).c_str(), "");   // AP mode
@@ -96,13 +136,21 @@ void setup() {
 }
 
 unsigned long lastMemPrint = 0;
+LoopStats lastLoopStats;
 
 void loop() {
     unsigned long now = millis();
     if (now - lastMemPrint > 60000) { // elke minuut
         Serial.print("Free heap: ");
         Serial.println(ESP.getFreeHeap());
+        LoopStats s = LoRa.getStatus()->loop;
+        Serial.printf("[LoRaTask] %u wakeups, %u timers, %u ms busy in the last minute\n",
+                      s.wakeups - lastLoopStats.wakeups, s.timers - lastLoopStats.timers,
+                      (unsigned)((s.busyUs - lastLoopStats.busyUs) / 1000));
+        lastLoopStats = s;
         lastMemPrint = now;
     }
     // niets nodig, taken draaien onder FreeRTOS
+    if (lowPower)
+        delay(1000);
 }
@@ -0,0 +1,144 @@
+#include "LinkAdr.h"
+
+float LinkAdr::requiredSnr(uint8_t sf) {
+  // SX1262 datasheet: -7.5 dB at SF7, 2.5 dB lower for every SF step
+  if (sf < ADR_SF_MIN)
+    sf = ADR_SF_MIN;
+  return -7.5f - 2.5f * (sf - ADR_SF_MIN);
+}
+
+bool LinkAdr::alive(const Link &l, uint32_t now) const {
+  return l.id && now - l.lastSeen <= ttlMs;
+}
+
+LinkAdr::Link *LinkAdr::find(uint32_t id) {
+  for (Link &l : links)
+    if (l.id == id)
+      return &l;
+  return nullptr;
+}
+
+const LinkAdr::Link *LinkAdr::find(uint32_t id) const {
+  for (const Link &l : links)
+    if (l.id == id)
+      return &l;
+  return nullptr;
+}
+
+bool LinkAdr::knows(uint32_t id, uint32_t now) const {
+  const Link *l = find(id);
+  return l && alive(*l, now);
+}
+
+bool LinkAdr::snrMargin(uint32_t id, uint8_t sf, uint32_t now, float &marginDb) const {
+  const Link *l = find(id);
+  if (!l || !alive(*l, now))
+    return false;
+  marginDb = l->snr - requiredSnr(sf);
+  return true;
+}
+
+LinkAdr::Link *LinkAdr::findOrClaim(uint32_t id, uint32_t now) {
+  Link *l = find(id);
+  if (l)
+    return l;
+
+  // Reuse an expired entry, otherwise the one heard least recently
+  Link *victim = &links[0];
+  for (Link &c : links) {
+    if (!alive(c, now)) {
+      victim = &c;
+      break;
+    }
+    if ((int32_t)(c.lastSeen - victim->lastSeen) < 0)
+      victim = &c;
+  }
+  *victim = Link();
+  victim->id = id;
+  victim->lastSeen = now;
+  return victim;
+}
+
+void LinkAdr::observe(uint32_t id, float snr, uint32_t now) {
+  Link *l = findOrClaim(id, now);
+  l->snr = l->samples == 0 ? snr : l->snr + (snr - l->snr) / 4;
+  if (l->samples < 255)
+    l->samples++;
+  l->lastSeen = now;
+  if (l->samples < ADR_MIN_SAMPLES)
+    return;
+
+  // Fastest SF with margin; one step at a time towards faster
+  uint8_t target = ADR_SF_MIN;
+  while (target < ADR_SF_MAX && l->snr - ADR_SNR_MARGIN_DB < requiredSnr(target))
+    target++;
+  if (target > l->localSf)
+    l->localSf = target;
+  else if (target < l->localSf && l->snr - ADR_SNR_MARGIN_DB - ADR_HYSTERESIS_DB >= requiredSnr(l->localSf - 1))
+    l->localSf--;
+}
+
+void LinkAdr::onReport(uint32_t reporter, uint32_t self, const uint8_t *data, size_t len, uint32_t now) {
+  for (size_t pos = 0; pos + ADR_REPORT_ENTRY_SIZE <= len; pos += ADR_REPORT_ENTRY_SIZE) {
+    uint32_t id = (uint32_t)data[pos] | ((uint32_t)data[pos + 1] << 8) |
+                  ((uint32_t)data[pos + 2] << 16) | ((uint32_t)data[pos + 3] << 24);
+    if (id != self)
+      continue;
+    uint8_t sf = data[pos + 4];
+    if (sf < ADR_SF_MIN || sf > ADR_SF_MAX)
+      return;
+    Link *l = findOrClaim(reporter, now);
+    l->remoteSf = sf;
+    l->lastSeen = now;
+    return;
+  }
+}
+
+size_t LinkAdr::encodeReport(uint8_t *out, uint32_t now, size_t maxEntries) {
+  if (maxEntries > ADR_REPORT_MAX_ENTRIES)
+    maxEntries = ADR_REPORT_MAX_ENTRIES;
+  size_t n = 0;
+  for (size_t k = 0; k < ADR_MAX_LINKS && n < maxEntries; k++) {
+    Link &l = links[(reportCursor + k) % ADR_MAX_LINKS];
+    if (!alive(l, now) || l.samples < ADR_MIN_SAMPLES || (l.localSf >= ADR_SF_MAX && !l.slowReports))
+      continue;
+    if (l.localSf < ADR_SF_MAX)
+      l.slowReports = ADR_SLOW_REPORTS;
+    else
+      l.slowReports--;
+    uint8_t *p = out + n * ADR_REPORT_ENTRY_SIZE;
+    for (int i = 0; i < 4; i++)
+      p[i] = (l.id >> (8 * i)) & 0xFF;
+    p[4] = l.localSf;
+    n++;
+    if (n == maxEntries)
+      reportCursor = (reportCursor + k + 1) % ADR_MAX_LINKS;
+  }
+  return n * ADR_REPORT_ENTRY_SIZE;
+}
+
+uint8_t LinkAdr::txSf(uint32_t id, uint32_t now) const {
+  const Link *l = find(id);
+  if (!l || !alive(*l, now) || l->remoteSf == 0)
+    return ADR_SF_MAX;
+  uint8_t sf = l->localSf > l->remoteSf ? l->localSf : l->remoteSf;
+  if ((int32_t)(now - l->penaltyUntil) < 0 && l->penaltySf > sf)
+    sf = l->penaltySf;
+  return sf;
+}
+
+void LinkAdr::penalize(uint32_t id, uint32_t now) {
+  Link *l = find(id);
+  if (!l)
+    return;
+  uint8_t sf = txSf(id, now);
+  l->penaltySf = sf < ADR_SF_MAX ? sf + 1 : ADR_SF_MAX;
+  l->penaltyUntil = now + ADR_PENALTY_MS;
+  counters.fallbacks++;
+}
+
+void LinkAdr::recordFastFrame(uint32_t baseAirtimeUs, uint32_t airtimeUs) {
+  counters.fastFrames++;
+  if (baseAirtimeUs > airtimeUs)
+    counters.airtimeSavedUs += baseAirtimeUs - airtimeUs;
+}
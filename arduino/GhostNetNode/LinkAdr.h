@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file LinkAdr.h
+ * @brief Per-neighbour adaptive data rate from measured SNR.
+ *
+ * Every frame heard directly from a neighbour updates a smoothed SNR for that
+ * link. The fastest spreading factor whose demodulation floor still leaves
+ * ADR_SNR_MARGIN_DB is the SF at which we can hear that neighbour. Beacons
+ * carry these choices as a link report, so each side also learns the SF at
+ * which the other hears it; unicast frames use the slower of the two. Links
+ * at ADR_SF_MAX are only reported after they were reported faster, so the
+ * neighbour learns the link got slow without SF12 links filling the report.
+ *
+ * Moving to a faster SF needs ADR_HYSTERESIS_DB extra margin, moving to a
+ * slower one happens immediately. A failed exchange at a fast SF forces the
+ * link one step slower for ADR_PENALTY_MS.
+ */
+
+#define ADR_MAX_LINKS 16
+#define ADR_SF_MIN 7
+#define ADR_SF_MAX 12
+#define ADR_SNR_MARGIN_DB 8.0f
+#define ADR_HYSTERESIS_DB 3.0f
+#define ADR_MIN_SAMPLES 3                        ///< Frames heard before a link may go faster
+#define ADR_LINK_TTL_MS (10UL * 60UL * 1000UL)   ///< Forget links not heard for this long, until setTtl()
+#define ADR_PENALTY_MS (5UL * 60UL * 1000UL)
+#define ADR_REPORT_ENTRY_SIZE 5                  ///< Node hash + SF
+#define ADR_REPORT_MAX_ENTRIES 6
+#define ADR_SLOW_REPORTS 2                       ///< Reports of a link that fell back to ADR_SF_MAX, in case one is lost
+
+struct AdrStats {
+  uint32_t fastFrames = 0;      ///< Frames sent below the base SF
+  uint32_t fallbacks = 0;       ///< Exchanges that failed at a fast SF
+  uint64_t airtimeSavedUs = 0;  ///< Time on air saved against the base SF
+};
+
+class LinkAdr {
+public:
+  /**
+   * @brief Feed the SNR of a frame received directly from a neighbour.
+   * @param id Neighbour node hash.
+   * @param snr Packet SNR in dB.
+   * @param now Current time in ms.
+   */
+  void observe(uint32_t id, float snr, uint32_t now);
+
+  /**
+   * @brief Parse a beacon link report and remember the SF at which the reporter hears us.
+   * @param reporter Node hash of the beacon origin.
+   * @param self Our own node hash.
+   * @param data Report bytes (ADR_REPORT_ENTRY_SIZE per entry).
+   * @param len Report length.
+   * @param now Current time in ms.
+   */
+  void onReport(uint32_t reporter, uint32_t self, const uint8_t *data, size_t len, uint32_t now);
+
+  /**
+   * @brief Build the link report for our next beacon.
+   * @param out Output buffer, at least ADR_REPORT_MAX_ENTRIES * ADR_REPORT_ENTRY_SIZE bytes.
+   * @param now Current time in ms.
+   * @param maxEntries Entries that fit the beacon; the rest rotates through
+   *        later beacons.
+   * @return Report length in bytes.
+   */
+  size_t encodeReport(uint8_t *out, uint32_t now, size_t maxEntries = ADR_REPORT_MAX_ENTRIES);
+
+  /**
+   * @brief Forget links not heard for this long. Beacons may come further
+   *        apart than ADR_LINK_TTL_MS at a slow SF.
+   */
+  void setTtl(uint32_t ms) { ttlMs = ms; }
+
+  /**
+   * @brief true if a frame from this neighbour was heard within the link TTL.
+   */
+  bool knows(uint32_t id, uint32_t now) const;
+
+  /**
+   * @brief Smoothed SNR of a neighbour above the demodulation floor of an SF.
+   * @return false if the neighbour was not heard within the link TTL.
+   */
+  bool snrMargin(uint32_t id, uint8_t sf, uint32_t now, float &marginDb) const;
+
+  /**
+   * @brief SF to use for unicast frames with a neighbour, ADR_SF_MAX if unknown.
+   */
+  uint8_t txSf(uint32_t id, uint32_t now) const;
+
+  /**
+   * @brief An exchange with this neighbour failed at a fast SF: slow the link down.
+   */
+  void penalize(uint32_t id, uint32_t now);
+
+  /**
+   * @brief Count a frame sent at a faster SF than the base one.
+   */
+  void recordFastFrame(uint32_t baseAirtimeUs, uint32_t airtimeUs);
+
+  /**
+   * @brief Demodulation floor of the SX1262 for a spreading factor, in dB.
+   */
+  static float requiredSnr(uint8_t sf);
+
+  const AdrStats &stats() const { return counters; }
+
+private:
+  struct Link {
+    uint32_t id = 0;
+    uint32_t lastSeen = 0;
+    float snr = 0;
+    uint8_t samples = 0;
+    uint8_t localSf = ADR_SF_MAX;   ///< SF at which we hear this neighbour
+    uint8_t remoteSf = 0;           ///< SF at which it hears us, 0 until reported
+    uint8_t penaltySf = 0;          ///< Minimum SF while penalised
+    uint8_t slowReports = 0;        ///< ADR_SF_MAX reports still owed since the last fast one
+    uint32_t penaltyUntil = 0;
+  };
+
+  Link *find(uint32_t id);
+  const Link *find(uint32_t id) const;
+  Link *findOrClaim(uint32_t id, uint32_t now);
+  bool alive(const Link &l, uint32_t now) const;
+
+  Link links[ADR_MAX_LINKS];
+  uint32_t ttlMs = ADR_LINK_TTL_MS;
+  size_t reportCursor = 0;  ///< Rotates through the links when they do not fit one beacon
+  AdrStats counters;
+};
@@ -0,0 +1,158 @@
+#include "LiveFeed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char KEEPALIVE[] = ":\n\n";
+static const char EVENT_END[] = "\n\n";
+
+bool LiveFeed::begin(uint16_t bootNumber, size_t arenaBytes, size_t maxEvents) {
+  boot = bootNumber;
+  return events.begin(arenaBytes, maxEvents);
+}
+
+uint32_t LiveFeed::publish(const char *event, const char *data, size_t len) {
+  uint32_t number = nextNumber();
+  events.append(0, event, strlen(event), data, len, 0, 0);
+  counters.events++;
+  return number;
+}
+
+void LiveFeed::setText(LiveClient &c, const char *text, size_t len) {
+  if (len > sizeof(c.text))
+    len = sizeof(c.text);
+  memcpy(c.text, text, len);
+  c.textLen = (uint8_t)len;
+  c.textSent = 0;
+}
+
+int LiveFeed::attach(const char *lastEventId, uint32_t now) {
+  for (size_t i = 0; i < LIVE_CLIENTS; i++) {
+    LiveClient &c = clients[i];
+    if (c.used)
+      continue;
+    c = LiveClient();
+    c.used = true;
+    c.open = true;
+    c.lastSent = now;
+    c.next = nextNumber();
+
+    bool reset = false;
+    if (lastEventId) {
+      // Continue after the last event the browser got, if that was this run
+      // and the ring still holds what came after it
+      char *end;
+      unsigned long idBoot = strtoul(lastEventId, &end, 10);
+      uint32_t want = *end == '-' ? (uint32_t)strtoul(end + 1, nullptr, 10) + 1 : 0;
+      if (*end == '-' && idBoot == boot && (int32_t)(want - events.firstNumber()) >= 0 && (int32_t)(c.next - want) >= 0)
+        c.next = want;
+      else
+        reset = true;
+    }
+    char text[LIVE_TEXT_MAX];
+    int len = snprintf(text, sizeof(text), reset ? "retry: %d\nevent: reset\ndata: {}\n\n" : "retry: %d\n\n", LIVE_RETRY_MS);
+    setText(c, text, len);
+    if (reset)
+      counters.resets++;
+    counters.connects++;
+    return (int)i;
+  }
+  counters.refused++;
+  return -1;
+}
+
+void LiveFeed::detach(int client) {
+  if (client >= 0 && client < LIVE_CLIENTS)
+    clients[client].used = false;
+}
+
+size_t LiveFeed::connected() const {
+  size_t n = 0;
+  for (const LiveClient &c : clients)
+    n += c.used;
+  return n;
+}
+
+size_t LiveFeed::fill(int client, uint8_t *buf, size_t maxLen, uint32_t now) {
+  LiveClient &c = clients[client];
+  if (!c.used || !c.open)
+    return 0;
+  if (!c.inEvent && c.textSent == c.textLen && c.next == nextNumber() && now - c.lastSent >= LIVE_KEEPALIVE_MS)
+    setText(c, KEEPALIVE, sizeof(KEEPALIVE) - 1);
+
+  size_t n = 0;
+  while (n < maxLen) {
+    if (c.textSent < c.textLen) {
+      size_t take = c.textLen - c.textSent;
+      if (take > maxLen - n)
+        take = maxLen - n;
+      memcpy(buf + n, c.text + c.textSent, take);
+      c.textSent += take;
+      n += take;
+      continue;
+    }
+    if (c.inEvent && c.dataDone) {
+      c.inEvent = false;
+      c.next++;
+    }
+    if (!c.inEvent && c.next == nextNumber())
+      break;
+    if ((int32_t)(c.next - events.firstNumber()) < 0) {
+      // The ring overtook this client, possibly halfway through an event: close
+      // the stream, the browser reconnects and gets a reset
+      c.open = false;
+      counters.evicted++;
+      break;
+    }
+    LogEntry e = events.at(c.next - events.firstNumber());
+    if (!c.inEvent) {
+      char text[LIVE_TEXT_MAX];
+      int len = snprintf(text, sizeof(text), "id: %u-%lu\nevent: %s\ndata: ", (unsigned)boot, (unsigned long)c.next, e.sender);
+      setText(c, text, len);
+      c.inEvent = true;
+      c.dataDone = false;
+      c.dataSent = 0;
+      continue;
+    }
+    size_t take = e.contentLen - c.dataSent;
+    if (take > maxLen - n)
+      take = maxLen - n;
+    memcpy(buf + n, e.content + c.dataSent, take);
+    c.dataSent += take;
+    n += take;
+    if (c.dataSent == e.contentLen) {
+      c.dataDone = true;
+      setText(c, EVENT_END, sizeof(EVENT_END) - 1);
+    }
+  }
+  if (n)
+    c.lastSent = now;
+  counters.bytes += n;
+  return n;
+}
+
+bool LiveFeed::notify(uint16_t seq, uint8_t state) {
+  uint32_t head = noticeHead.load(std::memory_order_relaxed);
+  if (head - noticeTail.load(std::memory_order_acquire) >= LIVE_NOTICES) {
+    noticesLost.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  notices[head & (LIVE_NOTICES - 1)] = LiveNotice{ seq, state };
+  noticeHead.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool LiveFeed::takeNotice(LiveNotice &out) {
+  uint32_t tail = noticeTail.load(std::memory_order_relaxed);
+  if (tail == noticeHead.load(std::memory_order_acquire))
+    return false;
+  out = notices[tail & (LIVE_NOTICES - 1)];
+  noticeTail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+LiveStats LiveFeed::stats() const {
+  LiveStats s = counters;
+  s.noticesLost = noticesLost.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "MessageRing.h"
+
+/**
+ * @file LiveFeed.h
+ * @brief Server-Sent Events for every open live page, from one shared ring.
+ *
+ * Events (a name and one line of JSON) are stored once, in a MessageRing
+ * whose running numbers, behind the boot number, are the SSE ids. A client is no more than a position
+ * in that ring: fill() copies the event it is at straight from the arena into
+ * the response buffer, so a connection costs a LiveClient and no heap,
+ * however many events it still has to take. That position is also the bound
+ * on its send queue: a client that falls so far behind that the ring evicts
+ * an event it has not sent yet is closed. The browser reconnects with
+ * Last-Event-ID and gets a "reset" event; the page then picks up what it
+ * missed from the JSON API. The web server publishes the same event when
+ * delivery results were lost because the notice queue was full.
+ *
+ * Every feed is a TCP connection that stays open, so lwIP must allow
+ * LIVE_CLIENTS of them plus those of page and JSON requests
+ * (CONFIG_LWIP_MAX_ACTIVE_TCP in the core's sdkconfig).
+ *
+ * The ring and the clients belong to the web server task; only notify() may
+ * be called from another task (the LoRa task reports delivery results with
+ * it) and never waits.
+ *
+ * This file has no Arduino dependencies.
+ */
+
+#define LIVE_ARENA_BYTES 8192     ///< Shared by all clients; a full message event is about 1.2 KB
+#define LIVE_EVENTS 64            ///< Events kept for clients that lag behind
+#define LIVE_CLIENTS 24           ///< Open feeds, each a TCP connection; further phones poll the JSON API
+#define LIVE_NOTICES 64           ///< Power of two: delivery results waiting for the web task
+#define LIVE_TEXT_MAX 64          ///< SSE lines around one event's data
+#define LIVE_KEEPALIVE_MS 15000UL
+#define LIVE_RETRY_MS 3000        ///< Reconnect delay asked of the browser
+
+struct LiveStats {
+  uint32_t events = 0;        ///< Events published
+  uint32_t connects = 0;
+  uint32_t refused = 0;       ///< Connections refused, every client slot taken
+  uint32_t evicted = 0;       ///< Clients closed because the ring overtook them
+  uint32_t resets = 0;        ///< Reconnects that asked for events no longer held
+  uint32_t noticesLost = 0;   ///< Delivery results dropped, the queue was full
+  uint32_t bytes = 0;         ///< Sent to all clients together
+};
+
+struct LiveClient {
+  bool used = false;
+  bool open = false;          ///< false once evicted: end the response
+  bool inEvent = false;       ///< Event next is being sent
+  bool dataDone = false;      ///< Its data is out, the blank line follows
+  uint32_t next = 0;          ///< Event being sent, or the next one to send
+  uint16_t dataSent = 0;
+  uint8_t textLen = 0;
+  uint8_t textSent = 0;
+  uint32_t lastSent = 0;      ///< For keepalive comments
+  char text[LIVE_TEXT_MAX];   ///< id and event lines, the blank line, or a control block
+};
+
+/// Delivery result handed over by the LoRa task
+struct LiveNotice {
+  uint16_t seq;
+  uint8_t state;              ///< DeliveryState
+};
+
+class LiveFeed {
+public:
+  /**
+   * @brief Allocate the ring. Call once at boot.
+   * @param boot Boot number; ids are "boot-number", so a browser that comes
+   *        back after a restart is not resumed at a number of the last run.
+   * @return false if the allocation failed.
+   */
+  bool begin(uint16_t boot, size_t arenaBytes = LIVE_ARENA_BYTES, size_t maxEvents = LIVE_EVENTS);
+
+  /**
+   * @brief Append an event for every client.
+   * @param event Event name, a few characters.
+   * @param data One line of JSON, no newline.
+   * @return Its number.
+   */
+  uint32_t publish(const char *event, const char *data, size_t len);
+
+  /// Number the next event gets
+  uint32_t nextNumber() const { return events.firstNumber() + events.size(); }
+
+  /**
+   * @brief Take a client slot. It starts with the events published from now on.
+   * @param lastEventId Last-Event-ID sent by a reconnecting browser, or
+   *        nullptr. The client continues after it while the ring still holds
+   *        the next event, and gets a "reset" event otherwise.
+   * @return Client slot, -1 if all LIVE_CLIENTS are taken.
+   */
+  int attach(const char *lastEventId, uint32_t now);
+
+  /**
+   * @brief Free a client slot when its connection is gone.
+   */
+  void detach(int client);
+
+  /**
+   * @brief Copy what client still has to get into buf.
+   * @return Bytes written; 0 if there is nothing to send now, or if the
+   *         client was evicted (see isOpen()).
+   */
+  size_t fill(int client, uint8_t *buf, size_t maxLen, uint32_t now);
+
+  bool isOpen(int client) const { return clients[client].used && clients[client].open; }
+
+  /// Clients connected
+  size_t connected() const;
+
+  /**
+   * @brief Queue a delivery result. Any one task, never blocks.
+   * @return false if the queue was full and the result is lost.
+   */
+  bool notify(uint16_t seq, uint8_t state);
+
+  /**
+   * @brief Oldest queued delivery result. Web server task only.
+   * @return false if there is none.
+   */
+  bool takeNotice(LiveNotice &out);
+
+  LiveStats stats() const;
+
+private:
+  void setText(LiveClient &c, const char *text, size_t len);
+
+  MessageRing events;
+  uint16_t boot = 0;
+  LiveClient clients[LIVE_CLIENTS];
+  LiveStats counters;
+
+  LiveNotice notices[LIVE_NOTICES];
+  std::atomic<uint32_t> noticeHead{0};   ///< Next position notify() writes
+  std::atomic<uint32_t> noticeTail{0};   ///< Next position takeNotice() reads
+  std::atomic<uint32_t> noticesLost{0};
+};
@@ -0,0 +1,220 @@
+#include "LoRaPacket.h"
+#include <string.h>
+#include <math.h>
+
+// =======================
+// Byte order helpers
+// =======================
+static void putU16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void putU32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint16_t getU16(const uint8_t *p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// CRC covers header bytes 0..10 and the payload, skipping the CRC field itself
+static uint16_t frameCrc(const uint8_t *frame, size_t len) {
+  uint16_t crc = loraCrc16(frame, LORA_PACKET_HEADER_SIZE - 2);
+  return loraCrc16(frame + LORA_PACKET_HEADER_SIZE, len - LORA_PACKET_HEADER_SIZE, crc);
+}
+
+// =======================
+// Codec
+// =======================
+size_t loraHeaderSize(const LoRaPacketHeader &hdr) {
+  return LORA_PACKET_HEADER_SIZE + (hdr.dest ? 4 : 0) + (hdr.nextHop ? 4 : 0) + (hdr.nextSf ? 1 : 0) +
+         (hdr.beaconLen ? 1 + hdr.beaconLen : 0);
+}
+
+size_t loraEncodePacket(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len,
+                        uint8_t *out, size_t outSize) {
+  size_t headerLen = loraHeaderSize(hdr);
+  size_t total = headerLen + len;
+  if (total > outSize || total > LORA_PACKET_MAX_SIZE)
+    return 0;
+
+  uint8_t flags = hdr.flags & ~(LORA_FLAG_DEST | LORA_FLAG_NEXT_HOP | LORA_FLAG_NEXT_SF | LORA_FLAG_BEACON);
+  uint8_t *ext = out + LORA_PACKET_HEADER_SIZE;
+  if (hdr.dest) {
+    flags |= LORA_FLAG_DEST;
+    putU32(ext, hdr.dest);
+    ext += 4;
+  }
+  if (hdr.nextHop) {
+    flags |= LORA_FLAG_NEXT_HOP;
+    putU32(ext, hdr.nextHop);
+    ext += 4;
+  }
+  if (hdr.nextSf) {
+    flags |= LORA_FLAG_NEXT_SF;
+    *ext++ = hdr.nextSf;
+  }
+  if (hdr.beaconLen) {
+    flags |= LORA_FLAG_BEACON;
+    *ext++ = hdr.beaconLen;
+    memcpy(ext, hdr.beacon, hdr.beaconLen);
+    ext += hdr.beaconLen;
+  }
+
+  out[0] = (LORA_PACKET_VERSION << 4) | (hdr.type & 0x0F);
+  out[1] = flags;
+  putU32(out + 2, hdr.origin);
+  putU16(out + 6, hdr.seq);
+  out[8] = hdr.fragIndex;
+  out[9] = hdr.fragCount;
+  out[10] = (hdr.hopLimit << 4) | (hdr.hopCount & 0x0F);
+  if (len > 0)
+    memcpy(out + headerLen, payload, len);
+  putU16(out + 11, frameCrc(out, total));
+  return total;
+}
+
+int loraDecodePacket(const uint8_t *frame, size_t len, LoRaPacketHeader &hdr,
+                     const uint8_t *&payload, size_t &payloadLen) {
+  if (len < LORA_PACKET_HEADER_SIZE)
+    return LORA_PKT_ERR_SHORT;
+  if ((frame[0] >> 4) != LORA_PACKET_VERSION)
+    return LORA_PKT_ERR_VERSION;
+  if (getU16(frame + 11) != frameCrc(frame, len))
+    return LORA_PKT_ERR_CRC;
+
+  hdr.type = frame[0] & 0x0F;
+  hdr.flags = frame[1];
+  hdr.origin = getU32(frame + 2);
+  hdr.seq = getU16(frame + 6);
+  hdr.fragIndex = frame[8];
+  hdr.fragCount = frame[9];
+  hdr.hopLimit = frame[10] >> 4;
+  hdr.hopCount = frame[10] & 0x0F;
+  hdr.dest = 0;
+  hdr.nextHop = 0;
+  hdr.nextSf = 0;
+  hdr.beacon = nullptr;
+  hdr.beaconLen = 0;
+
+  size_t pos = LORA_PACKET_HEADER_SIZE;
+  if (hdr.flags & LORA_FLAG_DEST) {
+    if (len < pos + 4)
+      return LORA_PKT_ERR_SHORT;
+    hdr.dest = getU32(frame + pos);
+    pos += 4;
+  }
+  if (hdr.flags & LORA_FLAG_NEXT_HOP) {
+    if (len < pos + 4)
+      return LORA_PKT_ERR_SHORT;
+    hdr.nextHop = getU32(frame + pos);
+    pos += 4;
+  }
+  if (hdr.flags & LORA_FLAG_NEXT_SF) {
+    if (len < pos + 1)
+      return LORA_PKT_ERR_SHORT;
+    hdr.nextSf = frame[pos++];
+  }
+  if (hdr.flags & LORA_FLAG_BEACON) {
+    if (len < pos + 1 || len < pos + 1 + frame[pos])
+      return LORA_PKT_ERR_SHORT;
+    hdr.beaconLen = frame[pos];
+    hdr.beacon = frame + pos + 1;
+    pos += 1 + hdr.beaconLen;
+  }
+  payload = frame + pos;
+  payloadLen = len - pos;
+  return LORA_PKT_OK;
+}
+
+void loraSetHopCount(uint8_t *frame, size_t len, uint8_t hopCount) {
+  frame[10] = (frame[10] & 0xF0) | (hopCount & 0x0F);
+  putU16(frame + 11, frameCrc(frame, len));
+}
+
+size_t loraBatchAppend(uint8_t *payload, size_t len, size_t cap, const uint8_t *frame, size_t frameLen) {
+  if (frameLen == 0 || frameLen > 0xFF || len + 1 + frameLen > cap)
+    return 0;
+  payload[len] = (uint8_t)frameLen;
+  memcpy(payload + len + 1, frame, frameLen);
+  return len + 1 + frameLen;
+}
+
+bool loraBatchNext(const uint8_t *payload, size_t len, size_t &pos, size_t &start, size_t &frameLen) {
+  if (pos >= len || payload[pos] == 0 || pos + 1 + payload[pos] > len)
+    return false;
+  frameLen = payload[pos];
+  start = pos + 1;
+  pos = start + frameLen;
+  return true;
+}
+
+size_t loraEncodeAck(const LoRaAckPayload &ack, uint8_t *out) {
+  putU32(out, ack.origin);
+  putU16(out + 4, ack.seq);
+  putU32(out + 6, ack.bitmap);
+  return LORA_ACK_PAYLOAD_SIZE;
+}
+
+bool loraDecodeAck(const uint8_t *payload, size_t len, LoRaAckPayload &ack) {
+  if (len < LORA_ACK_PAYLOAD_SIZE)
+    return false;
+  ack.origin = getU32(payload);
+  ack.seq = getU16(payload + 4);
+  ack.bitmap = getU32(payload + 6);
+  return true;
+}
+
+// =======================
+// Helpers
+// =======================
+uint16_t loraCrc16(const uint8_t *data, size_t len, uint16_t crc) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+uint32_t loraNodeHash(const char *name) {
+  uint32_t hash = 2166136261UL;
+  while (*name) {
+    hash ^= (uint8_t)*name++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+const char *loraPacketTypeName(uint8_t type) {
+  switch (type) {
+    case LORA_PKT_DATA: return "DATA";
+    case LORA_PKT_ACK: return "ACK";
+    case LORA_PKT_BEACON: return "BEACON";
+    case LORA_PKT_TABLE: return "TABLE";
+    case LORA_PKT_USER: return "USER";
+    case LORA_PKT_FILE: return "FILE";
+    case LORA_PKT_CUSTODY: return "CUSTODY";
+    case LORA_PKT_BATCH: return "BATCH";
+    default: return "?";
+  }
+}
+
+uint32_t loraTimeOnAirUs(size_t len, uint8_t sf, float bw, uint8_t cr, uint16_t preamble) {
+  float symbolUs = (float)(1UL << sf) * 1000.0f / bw;
+  // Low data rate optimisation is mandatory once a symbol exceeds 16 ms
+  int de = symbolUs > 16000.0f ? 1 : 0;
+  int num = 8 * (int)len - 4 * sf + 28 + 16;
+  int den = 4 * (sf - 2 * de);
+  int payloadSymbols = 8;
+  if (num > 0)
+    payloadSymbols += ((num + den - 1) / den) * cr;
+  float preambleUs = (preamble + 4.25f) * symbolUs;
+  return (uint32_t)lroundf(preambleUs + payloadSymbols * symbolUs);
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file LoRaPacket.h
+ * @brief Compact binary on-air frame format for GhostNet LoRa packets.
+ *
+ * Every frame starts with a fixed header, followed by the payload bytes:
+ *
+ *   byte  0     version (high nibble) | packet type (low nibble)
+ *   byte  1     flags (LORA_FLAG_*)
+ *   bytes 2-5   origin node hash (little endian)
+ *   bytes 6-7   origin sequence number (little endian)
+ *   byte  8     fragment index (0-based)
+ *   byte  9     fragment count (1 = not fragmented)
+ *   byte  10    hop limit (high nibble) | hop count (low nibble)
+ *   bytes 11-12 CRC-16/CCITT over the frame with these two bytes left out
+ *
+ * Optional extensions follow the fixed header in this order, each present
+ * only when its flag is set:
+ *
+ *   LORA_FLAG_DEST     4 bytes destination node hash (unicast)
+ *   LORA_FLAG_NEXT_HOP 4 bytes neighbour that should relay the frame (routed)
+ *   LORA_FLAG_NEXT_SF  1 byte  spreading factor the receiving end should follow
+ *   LORA_FLAG_BEACON   1 byte length, then a beacon payload carried along
+ *
+ * A LORA_PKT_BATCH frame carries other frames unchanged, each as a length
+ * byte followed by the complete frame. It is sent by the neighbour itself
+ * (hop limit 0); the receiver handles every frame in it as if it had come
+ * on its own.
+ *
+ * This file has no Arduino dependencies so it can be built on the host too.
+ */
+
+#define LORA_PACKET_VERSION 1
+#define LORA_PACKET_HEADER_SIZE 13
+#define LORA_PACKET_MAX_SIZE 255  ///< SX1262 FIFO limit
+#define LORA_PACKET_MAX_EXT 9      ///< All optional extensions together except a piggybacked beacon
+#define LORA_PACKET_MAX_PAYLOAD (LORA_PACKET_MAX_SIZE - LORA_PACKET_HEADER_SIZE)
+#define LORA_DEFAULT_HOP_LIMIT 3
+#define LORA_DEST_GATEWAY 0xFFFFFFFFUL  ///< Destination meaning "the nearest gateway"
+
+// ============ Packet types ============
+enum LoRaPacketType : uint8_t {
+  LORA_PKT_DATA = 1,    ///< Game message (was "MSG:")
+  LORA_PKT_ACK = 2,     ///< Acknowledgement, payload is LoRaAckPayload
+  LORA_PKT_BEACON = 3,  ///< Presence beacon: node name, 0, then LORA_BEACON_* sections
+  LORA_PKT_TABLE = 4,   ///< Neighbour table dump
+  LORA_PKT_USER = 5,    ///< Serialized user record
+  LORA_PKT_FILE = 6,    ///< File transfer
+  LORA_PKT_CUSTODY = 7, ///< Summary vector of held messages, see CustodyStore.h
+  LORA_PKT_BATCH = 8,   ///< Several complete frames for one next hop, see loraBatchAppend()
+};
+
+// Beacon sections after the node name: type byte, length byte, data
+#define LORA_BEACON_LINKS 1   ///< LinkAdr report
+#define LORA_BEACON_ROUTES 2  ///< RouteTable advertisement
+#define LORA_BEACON_POWER 3   ///< POWER_FLAG_* of the sender, only sent in POWER_SAVE
+
+// ============ Flags ============
+#define LORA_FLAG_ACK_REQ 0x01  ///< Direct receivers should ACK with their fragment bitmap
+#define LORA_FLAG_DEST 0x02     ///< Destination extension present
+#define LORA_FLAG_NEXT_SF 0x04  ///< Spreading factor extension present
+#define LORA_FLAG_COMPRESSED 0x08  ///< Message (all fragments together) is PayloadCodec output
+#define LORA_FLAG_NEXT_HOP 0x10    ///< Next hop extension present
+#define LORA_FLAG_BEACON 0x20      ///< Piggybacked beacon extension present
+#define LORA_FLAG_REPAIR 0x40      ///< Repair fragment (index >= count) of an erasure-coded message, see FecCodec.h
+
+// ============ Decode results ============
+#define LORA_PKT_OK 0
+#define LORA_PKT_ERR_SHORT -1
+#define LORA_PKT_ERR_VERSION -2
+#define LORA_PKT_ERR_CRC -3
+
+// ============ Structs ============
+struct LoRaPacketHeader {
+  uint8_t type = LORA_PKT_DATA;
+  uint8_t flags = 0;
+  uint32_t origin = 0;
+  uint16_t seq = 0;
+  uint8_t fragIndex = 0;
+  uint8_t fragCount = 1;
+  uint8_t hopCount = 0;
+  uint8_t hopLimit = LORA_DEFAULT_HOP_LIMIT;
+  uint32_t dest = 0;    ///< Destination node hash, 0 = broadcast
+  uint32_t nextHop = 0; ///< Relaying neighbour for routed frames, 0 = flood or direct
+  uint8_t nextSf = 0;   ///< SF the destination should switch to, 0 = stay
+  const uint8_t *beacon = nullptr;  ///< Piggybacked beacon payload (points into the frame after decoding)
+  uint8_t beaconLen = 0;            ///< 0 = no beacon carried
+};
+
+/// Payload of a LORA_PKT_ACK frame: which message is being acknowledged and
+/// which of its fragments (bit i = fragment i) the sender of the ACK holds.
+struct LoRaAckPayload {
+  uint32_t origin;
+  uint16_t seq;
+  uint32_t bitmap;
+};
+#define LORA_ACK_PAYLOAD_SIZE 10
+
+// ============ Codec ============
+
+/**
+ * @brief Header length including the extensions hdr needs.
+ */
+size_t loraHeaderSize(const LoRaPacketHeader &hdr);
+
+/**
+ * @brief Encode header and payload into an on-air frame.
+ *
+ * The extension flags are derived from dest, nextHop, nextSf and beaconLen.
+ * @param hdr Header fields.
+ * @param payload Payload bytes (may be nullptr when len is 0).
+ * @param len Payload length.
+ * @param out Output buffer.
+ * @param outSize Size of the output buffer.
+ * @return Frame length, or 0 if it does not fit.
+ */
+size_t loraEncodePacket(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len,
+                        uint8_t *out, size_t outSize);
+
+/**
+ * @brief Decode and verify an on-air frame.
+ * @param frame Received bytes.
+ * @param len Number of received bytes.
+ * @param hdr Receives the header fields.
+ * @param payload Receives a pointer into frame where the payload starts.
+ * @param payloadLen Receives the payload length.
+ * @return LORA_PKT_OK or one of the LORA_PKT_ERR_* codes.
+ */
+int loraDecodePacket(const uint8_t *frame, size_t len, LoRaPacketHeader &hdr,
+                     const uint8_t *&payload, size_t &payloadLen);
+
+/**
+ * @brief Rewrite the hop count of an encoded frame in place and refresh its CRC.
+ */
+void loraSetHopCount(uint8_t *frame, size_t len, uint8_t hopCount);
+
+/**
+ * @brief Append an encoded frame to a LORA_PKT_BATCH payload.
+ * @param payload Batch payload being built.
+ * @param len Bytes already in it.
+ * @param cap Size of the payload buffer.
+ * @return New payload length, or 0 if the frame does not fit.
+ */
+size_t loraBatchAppend(uint8_t *payload, size_t len, size_t cap, const uint8_t *frame, size_t frameLen);
+
+/**
+ * @brief Step to the next frame in a LORA_PKT_BATCH payload.
+ * @param pos Offset of the next entry, start at 0; advanced past it.
+ * @param start Receives the offset of the frame in payload.
+ * @param frameLen Receives the frame length.
+ * @return false at the end of the payload or on a truncated entry.
+ */
+bool loraBatchNext(const uint8_t *payload, size_t len, size_t &pos, size_t &start, size_t &frameLen);
+
+size_t loraEncodeAck(const LoRaAckPayload &ack, uint8_t *out);
+bool loraDecodeAck(const uint8_t *payload, size_t len, LoRaAckPayload &ack);
+
+// ============ Helpers ============
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+ */
+uint16_t loraCrc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+/**
+ * @brief 32-bit FNV-1a hash of a node name, used as origin address on air.
+ */
+uint32_t loraNodeHash(const char *name);
+
+/**
+ * @brief Short human readable name of a packet type ("DATA", "ACK", ...).
+ */
+const char *loraPacketTypeName(uint8_t type);
+
+/**
+ * @brief LoRa time on air for an explicit-header frame with CRC (Semtech AN1200.13).
+ * @param len Frame length in bytes (header + payload).
+ * @param sf Spreading factor (7..12).
+ * @param bw Bandwidth in kHz.
+ * @param cr Coding rate denominator (5..8 for 4/5..4/8).
+ * @param preamble Preamble length in symbols.
+ * @return Time on air in microseconds.
+ */
+uint32_t loraTimeOnAirUs(size_t len, uint8_t sf, float bw, uint8_t cr, uint16_t preamble = 8);
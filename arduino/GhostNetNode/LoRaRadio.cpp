@@ -2,206 +2,1480 @@
 #include "User.h"
 #include "RPI4.h"
 #include "GameCommon.h"
-// Define static member for neighbours
-std::map<String, NeighbourInfo> LoRaRadio::neighbours;
+#include <Preferences.h>
+#include <LittleFS.h>
+LoRaRadio *LoRaRadio::dio1Target = nullptr;
 
 Module loraModule(LORA_CS, LORA_DIO1, LORA_RST, LORA_BUSY);
 
 LoRaRadio::LoRaRadio()
-  : radio(&loraModule), radioQueue(nullptr) {}
+  : radio(&loraModule) {}
 
-bool LoRaRadio::sendToQueueString(const String &msgType, const String &msg) {
-  RadioMessage rm;
-  rm.content = msg;
-  rm.sender = getNodeName();
-  rm.receiver = "ALL";
-  rm.msgType = msgType;
+bool LoRaRadio::sendToQueueString(const String &msgType, const String &msg, const String &receiver) {
+  uint8_t type = LORA_PKT_DATA;
+  if (msgType.equalsIgnoreCase("user"))
+    type = LORA_PKT_USER;
+  else if (msgType == "TableNeighbours")
+    type = LORA_PKT_TABLE;
+  else if (msgType.equalsIgnoreCase("file"))
+    type = LORA_PKT_FILE;
+  return enqueueMessage(type, msg.c_str(), msg.length(), receiver.c_str()) == RADIO_QUEUE_OK;
+}
 
-  return sendToQueue(rm);
+bool LoRaRadio::sendFile(const String &path, const String &receiver) {
+  return enqueueMessage(LORA_PKT_FILE, path.c_str(), path.length(), receiver.c_str()) == RADIO_QUEUE_OK;
 }
 
-bool LoRaRadio::sendToQueue(RadioMessage rm) {
-  if (!radioQueue) {
-    Serial.println("[LoRaRadio] ERROR: radioQueue not initialized!");
-    return false;
-  }
-  BaseType_t result = xQueueSend(radioQueue, &rm, 0);
-  if (result != pdPASS) {
-    Serial.println("[LoRaRadio] ERROR: xQueueSend failed (queue full?)");
-    return false;
-  }
-  return true;
+RadioQueueResult LoRaRadio::enqueueMessage(uint8_t type, const char *content, size_t len, const char *receiver) {
+  RadioQueueResult result = radioQueue.push(type, (const uint8_t *)content, len, receiver);
+  if (result == RADIO_QUEUE_FULL)
+    Serial.println("[LoRaRadio] ERROR: radioQueue full, message refused");
+  else if (result == RADIO_QUEUE_TOO_LONG)
+    Serial.printf("[LoRaRadio] ERROR: message of %u bytes does not fit in radioQueue\n", (unsigned)len);
+  else if (consumerTask)
+    xTaskNotifyGive(consumerTask);
+  return result;
 }
 
-bool LoRaRadio::receiveFromQueue(RadioMessage &msg) {
-  if (!radioQueue) {
-    Serial.println("[LoRaRadio] ERROR: radioQueue not initialized!");
-    return false;
-  }
-  BaseType_t result = xQueueReceive(radioQueue, &msg, 0);
-  if (result != pdPASS) {
-    // Optionally log: Serial.println("[LoRaRadio] No message in queue");
-    return false;
-  }
-  return true;
+void LoRaRadio::setConsumerTask(TaskHandle_t task) {
+  consumerTask = task;
+}
+
+size_t LoRaRadio::getMessageQueueDepth() const {
+  return radioQueue.size();
+}
+
+RadioQueueStats LoRaRadio::getMessageQueueStats() const {
+  return radioQueue.stats();
 }
 
 bool LoRaRadio::begin(float freq, float bw, int sf, int cr, byte syncWord) {
+  if (!messageLog.begin(LORA_MESSAGE_LOG_BYTES, maxMessageCount) || !rawLog.begin(LORA_RAW_LOG_BYTES, maxMessageCount)) {
+    Serial.println("[LoRaRadio] ERROR: no memory for the message logs!");
+    return false;
+  }
   int state = radio.begin(freq, bw, sf, cr, syncWord);
   if (state != RADIOLIB_ERR_NONE) {
     Serial.println("[LoRa] Init failed, code=" + String(state));
     return false;
   }
-  radio.setDio1Action(onReceiveStatic);
-  radio.startReceive();
-  radioQueue = xQueueCreate(10, sizeof(RadioMessage));
-  if (!radioQueue) {
-    Serial.println("[LoRaRadio] ERROR: Failed to create radioQueue!");
-    return false;
-  }
+  bandwidth = bw;
+  airtime.begin(freq);
+  spreadingFactor = sf;
+  radioSf = sf;
+  codingRate = cr;
+  // Longest beacon that stays within LORA_BEACON_MAX_MS at the base SF
+  while (beaconMaxLen > 0 &&
+         loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + beaconMaxLen, sf, bw, cr) > LORA_BEACON_MAX_MS * 1000UL)
+    beaconMaxLen--;
+  nodeId = loraNodeHash(getNodeName().c_str());
+  nextSeq = (uint16_t)esp_random();
+  Preferences prefs;
+  prefs.begin("lora", true);
+  routes.begin(nodeId, prefs.getBool("gateway", false));
+  powerMode = prefs.getBool("powersave", false) ? POWER_SAVE : POWER_ALWAYS_ON;
+  fecPolicy.enabled = prefs.getBool("fec", false);
+  gatewayWanted = routes.gateway();
+  fecWanted = fecPolicy.enabled;
+  prefs.end();
+  loadCustody();
+  loadFiles();
+  // Beacons, and the routes they keep alive, slow down with the SF
+  size_t beaconLen = getNodeName().length() + 1 + 4 + ADR_REPORT_MAX_ENTRIES * ADR_REPORT_ENTRY_SIZE +
+                     ROUTE_ADVERT_MAX_ENTRIES * ROUTE_ADVERT_ENTRY_SIZE + 3;
+  if (beaconLen > beaconMaxLen)
+    beaconLen = beaconMaxLen;
+  beaconTimer.fitAirtime(loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + beaconLen, sf, bw, cr), airtime.budgetMs());
+  adr.setTtl(LORA_BEACON_TTL_INTERVALS * beaconTimer.imax());
+  routes.setTtl(LORA_BEACON_TTL_INTERVALS * beaconTimer.imax());
+  routes.setSettle(LORA_BEACON_SETTLE_INTERVALS * beaconTimer.imin());
+  sleepers.setTtl(LORA_BEACON_TTL_INTERVALS * beaconTimer.imax());
+  beaconTimer.begin(millis(), nodeId ^ esp_random());
+  csma.begin(esp_random() ^ (nodeId << 1));
+  dio1Target = this;
+  radio.setDio1Action(onDio1Static);
+  startReceive();
+  publishStatus();  // the web server may ask before the LoRa task runs
   return true;
 }
 
-void IRAM_ATTR LoRaRadio::onReceiveStatic() {
-  // This will be patched to instance method (singleton or global)
-  extern LoRaRadio LoRa;
-  LoRa.receivedFlag = true;
+void LoRaRadio::resumeAfterSleep(bool dio1High) {
+  // The edge interrupt does not fire in light sleep; the GPIO wake-up may
+  // also have taken over the pin's interrupt type
+  radio.setDio1Action(onDio1Static);
+  if (dio1High)
+    dio1Flag = true;
+}
+
+void IRAM_ATTR LoRaRadio::onDio1Static() {
+  LoRaRadio *r = dio1Target;
+  if (!r)
+    return;
+  r->dio1Flag = true;
+  // Wake the LoRa task straight away instead of at its next poll
+  if (r->consumerTask) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(r->consumerTask, &woken);
+    if (woken)
+      portYIELD_FROM_ISR();
+  }
 }
 
 void LoRaRadio::handleReceive() {
-  String str;
-  int state = radio.readData(str);
+  uint8_t frame[LORA_PACKET_MAX_SIZE];
+  size_t len = radio.getPacketLength();
+  if (len == 0 || len > sizeof(frame))
+    return;
+  int state = radio.readData(frame, len);
+  if (state != RADIOLIB_ERR_NONE) {
+    // A CRC error is nearly always a collision with another frame
+    if (state == RADIOLIB_ERR_CRC_MISMATCH)
+      csma.countCorrupted();
+    return;
+  }
+
+  handleFrame(frame, len, radio.getRSSI(), radio.getSNR(), false);
+}
+
+void LoRaRadio::handleFrame(uint8_t *frame, size_t len, float rssi, float snr, bool batched) {
+  LoRaPacketHeader hdr;
+  const uint8_t *payload = nullptr;
+  size_t payloadLen = 0;
+  int rc = loraDecodePacket(frame, len, hdr, payload, payloadLen);
+
+  // Always log raw message
+  String rawContent;
+  if (rc == LORA_PKT_OK) {
+    rawContent = String(loraPacketTypeName(hdr.type)) + " #" + String(hdr.seq) +
+                 " frag " + String(hdr.fragIndex + 1) + "/" + String(hdr.fragCount) +
+                 " hop " + String(hdr.hopCount) + " (" + String(len) + " B)";
+  } else {
+    rawContent = "Invalid frame (" + String(len) + " B, code=" + String(rc) + ")";
+  }
+  String rawSender = rc == LORA_PKT_OK ? nodeLabel(hdr.origin) : String("?");
+  rawLog.append(millis(), rawSender.c_str(), rawSender.length(), rawContent.c_str(), rawContent.length(), rssi, snr,
+                rc == LORA_PKT_OK ? hdr.type : 0);
+  rawChanged = true;
 
-  if (state == RADIOLIB_ERR_NONE && str.length() > 0) {
 #if DEBUG_ENABLED
-    Serial.printf("[LoRa PACKET] Raw packet: %s\n", str.c_str());
+  Serial.printf("[LoRa PACKET] Raw packet: %s\n", rawContent.c_str());
 #endif
 
-    float rssi = radio.getRSSI();
-    float snr = radio.getSNR();
+  if (rc != LORA_PKT_OK || hdr.origin == nodeId)
+    return;
 
-    // Always log raw message
-    ReceivedMessage rawMsg{ millis(), "?", str, rssi, snr };
-    rawLog.push_back(rawMsg);
-    if (rawLog.size() > maxMessageCount)
-      rawLog.pop_front();
+  // Only a frame with hop count 0 was transmitted by its origin, so only
+  // those say something about the link to that neighbour. The frames in a
+  // batch came with the batch, which was counted already.
+  uint32_t now = millis();
+  if (hdr.hopCount == 0 && !batched) {
+    if (!adr.knows(hdr.origin, now))
+      topologyChanged();  // new neighbour
+    adr.observe(hdr.origin, snr, now);
+    if (followActive(now) && hdr.origin == followPeer)
+      followUntil = now + LORA_FOLLOW_WINDOW_MS;
+  }
+  // The neighbour this hop is addressed to: the next hop of a routed frame,
+  // the destination of a direct one
+  uint32_t linkTarget = hdr.nextHop ? hdr.nextHop : (hdr.hopLimit == 0 ? hdr.dest : 0);
+  if (hdr.nextSf && linkTarget == nodeId)
+    follow(hdr.origin, hdr.nextSf, now);
+
+  // Each frame in a batch goes its own way, as if it had come alone
+  if (hdr.type == LORA_PKT_BATCH) {
+    size_t offset = payload - frame;
+    size_t pos = 0, start, innerLen;
+    while (!batched && loraBatchNext(payload, payloadLen, pos, start, innerLen))
+      handleFrame(frame + offset + start, innerLen, rssi, snr, true);
+    return;
+  }
+
+  // Beacon: node name, then after a 0 byte the link report and routes
+  if (hdr.type == LORA_PKT_BEACON) {
+    const uint8_t *end = (const uint8_t *)memchr(payload, 0, payloadLen);
+    if (end) {
+      size_t nameLen = end - payload;
+      if (hdr.hopCount == 0)
+        handleBeaconSections(hdr.origin, end + 1, payloadLen - nameLen - 1);
+      payloadLen = nameLen;
+    }
+  }
+  // Beacon carried along on another frame, only meaningful from the origin itself
+  if (hdr.beaconLen && hdr.hopCount == 0)
+    handlePiggyback(hdr.origin, hdr.beacon, hdr.beaconLen);
 
-    // Check for ACK
-    if (str.startsWith("ACK:")) {
-      int idx1 = str.indexOf(':');
-      int idx2 = str.indexOf(':', idx1 + 1);
-      if (idx1 > 0 && idx2 > idx1) {
-        String ackMsgID = str.substring(idx1 + 1, idx2);
-        receivedAcks.insert(ackMsgID);
+  // Check for ACK
+  if (hdr.type == LORA_PKT_ACK) {
+    LoRaAckPayload ack;
+    if (loraDecodeAck(payload, payloadLen, ack) && ack.origin == nodeId) {
+      outbox.onAck(ack.seq, ack.bitmap, millis());
 #if DEBUG_ENABLED
-        Serial.printf("[LoRa ACK] Received ACK for msgID=%s\n", ackMsgID.c_str());
+      Serial.printf("[LoRa ACK] Received ACK for msgID=%u, fragments %08X\n", ack.seq, ack.bitmap);
 #endif
-      }
-      return;  // Don't process further
     }
+    return;  // Don't process further
+  }
 
-    // Try fragment assembly
-    String assembled = assembleFragment(str);
-    if (assembled.length() > 0)
-      str = assembled;
-    else
-      return;  // nothing complete, only in rawLog
+  // Routed frames are relayed by the named next hop only; other frames are
+  // flooded until the hop limit unless they reached their destination
+  bool forUs = hdr.dest == 0 || hdr.dest == nodeId || (hdr.dest == LORA_DEST_GATEWAY && routes.gateway());
+  bool relay = hdr.nextHop ? hdr.nextHop == nodeId && !forUs : hdr.hopCount < hdr.hopLimit && !(hdr.dest && forUs);
 
-    // Extract sender and msgID
-    String sender = "unknown";
-    String msgID = "";
-    if (str.startsWith("BEACON"))
-      sender = str.substring(10);
+  // Direct neighbours of the origin that deliver or relay the frame answer
+  // with the fragments they hold
+  bool ackWanted = (hdr.flags & LORA_FLAG_ACK_REQ) && hdr.hopCount == 0 &&
+                   (hdr.nextHop ? hdr.nextHop == nodeId : forUs || relay);
+
+  // Drop copies we already handled, whichever path they took. A repeated
+  // ACK_REQ frame means our ACK got lost, so answer it again.
+  FloodKey key{ hdr.origin, hdr.seq, hdr.fragIndex };
+  if (!flood.checkAndRemember(key, millis())) {
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa DUP] %s #%u frag %u from %08X\n", loraPacketTypeName(hdr.type), hdr.seq, hdr.fragIndex + 1, hdr.origin);
+#endif
+    if (ackWanted)
+      sendAck(hdr.origin, hdr.seq, ackBitmap(hdr));
+    return;
+  }
+
+  // Fragments are forwarded one by one, there is no need to reassemble first.
+  // A piggybacked beacon was for the origin's neighbours, relays leave it off.
+  if (relay && hdr.nextHop) {
+    forwardRouted(hdr, payload, payloadLen);
+  } else if (relay && hdr.beaconLen) {
+    uint8_t bare[LORA_PACKET_MAX_SIZE];
+    LoRaPacketHeader bareHdr = hdr;
+    bareHdr.beaconLen = 0;
+    size_t bareLen = loraEncodePacket(bareHdr, payload, payloadLen, bare, sizeof(bare));
+    if (bareLen)
+      scheduleForward(bareHdr, bare, bareLen);
+  } else if (relay) {
+    scheduleForward(hdr, frame, len);
+  }
+
+  // Summary vectors are single frames for one node, never logged
+  if (hdr.type == LORA_PKT_CUSTODY) {
+    if (forUs && hdr.dest)
+      handleCustody(hdr, payload, payloadLen);
+    return;
+  }
+  // File frames run their own end-to-end protocol, see FileTransfer.h
+  if (hdr.type == LORA_PKT_FILE) {
+    if (forUs && hdr.dest == nodeId)
+      handleFile(hdr, payload, payloadLen, rssi, snr);
+    return;
+  }
+
+  // Try fragment assembly
+  AssembledMessage msg;
+  if (forUs && assembleFragment(hdr, payload, payloadLen, msg))
+    handleMessage(msg, rssi, snr);
+
+  if (ackWanted)
+    sendAck(hdr.origin, hdr.seq, ackBitmap(hdr));
+}
+
+void LoRaRadio::handleMessage(const AssembledMessage &msg, float rssi, float snr) {
+  const LoRaPacketHeader &hdr = msg.header;
+
+  String sender;
+  String content;
+  if (hdr.type == LORA_PKT_BEACON) {
+    sender = msg.payload;
+    nodeNames[hdr.origin] = sender;
+    routesChanged = true;
+    content = "BEACON van " + sender;
 #if DEBUG_ENABLED
     Serial.printf("[LoRa RX BEACON] %s\n", sender.c_str());
 #endif
+  } else {
+    sender = nodeLabel(hdr.origin);
+    content = msg.payload;
+    if (hdr.dest)
+      custody.noteDelivered(hdr.origin, hdr.seq);  // for the origin's summary offer
+  }
+
+  // Update neighbours
+  NeighbourInfo info{ millis(), rssi, snr, adr.txSf(hdr.origin, millis()) };
+  neighbours[sender] = info;
+  neighboursChanged = true;
+
+  // Log complete message
+  messageLog.append(millis(), sender.c_str(), sender.length(), content.c_str(), content.length(), rssi, snr, hdr.type);
+  messagesChanged = true;
+
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa RX] %s | RSSI=%.1f | SNR=%.1f\n", content.c_str(), rssi, snr);
+#endif
 
-    else if (str.startsWith("MSG:")) {
-      int idx1 = str.indexOf(':');
-      int idx2 = str.indexOf(':', idx1 + 1);
-      if (idx1 > 0 && idx2 > idx1) {
-        msgID = str.substring(idx1 + 1, idx2);
-        sender = str.substring(idx2 + 1, str.indexOf(':', idx2 + 1));
+  if (hdr.type == LORA_PKT_USER && msg.payload.indexOf(',') > 0) {
+    User user = UserManager::deserializeUser(msg.payload);
+    UserManager::addUserFromLoRa(user);
+    String rpiMsg = "[RPI4 USER] " + user.username + ", team: " + user.team + ", token: " + user.token;
+    RPI4::sendToRPI4(rpiMsg);
+  }
+}
+
+void LoRaRadio::scheduleForward(const LoRaPacketHeader &hdr, uint8_t *frame, size_t len) {
+  loraSetHopCount(frame, len, hdr.hopCount + 1);
+
+  // Random delay of up to two frame times, so neighbours that heard the same
+  // frame do not all transmit at once and the first one can silence the rest
+  uint32_t toaMs = loraTimeOnAirUs(len, spreadingFactor, bandwidth, codingRate) / 1000;
+  uint32_t delayMs = random(toaMs / 4, 2 * toaMs + 1);
+  FloodKey key{ hdr.origin, hdr.seq, hdr.fragIndex };
+  flood.schedule(key, frame, len, millis() + delayMs);
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa FORWARD] %s #%u from %08X in %u ms\n", loraPacketTypeName(hdr.type), hdr.seq, hdr.origin, delayMs);
+#endif
+}
+
+void LoRaRadio::handleBeaconSections(uint32_t origin, const uint8_t *data, size_t len) {
+  uint32_t now = millis();
+  size_t pos = 0;
+  bool sleeps = false;
+  while (pos + 2 <= len && pos + 2 + data[pos + 1] <= len) {
+    uint8_t type = data[pos];
+    const uint8_t *section = data + pos + 2;
+    size_t sectionLen = data[pos + 1];
+    if (type == LORA_BEACON_LINKS) {
+      adr.onReport(origin, nodeId, section, sectionLen, now);
+    } else if (type == LORA_BEACON_ROUTES) {
+      routesChanged = true;  // ages at least
+      if (routes.onAdvert(origin, RouteTable::linkCost(adr.txSf(origin, now)), section, sectionLen, now)) {
+#if DEBUG_ENABLED
+        Serial.printf("[LoRa ROUTE] Table updated from %08X, %u routes\n", origin, (unsigned)routes.size(now));
+#endif
+        topologyChanged();
       }
+    } else if (type == LORA_BEACON_POWER && sectionLen >= 1) {
+      sleeps = section[0] & POWER_FLAG_SLEEPS;
     }
+    pos += 2 + sectionLen;
+  }
+  // Every beacon states the mode; one without the section comes from an awake node
+#if DEBUG_ENABLED
+  if (sleeps != sleepers.sleeps(origin, now))
+    Serial.printf("[LoRa POWER] %08X %s\n", origin, sleeps ? "sleeps, sending it wake-up preambles" : "is awake");
+#endif
+  sleepers.heard(origin, sleeps, now);
+}
+
+void LoRaRadio::handlePiggyback(uint32_t origin, const uint8_t *data, size_t len) {
+  const uint8_t *end = (const uint8_t *)memchr(data, 0, len);
+  if (!end)
+    return;
+  nodeNames[origin] = String((const char *)data, end - data);
+  routesChanged = true;
+  handleBeaconSections(origin, end + 1, len - (end - data) - 1);
+}
+
+void LoRaRadio::topologyChanged() {
+  // Under duty-cycle pressure the interval keeps backing off regardless
+  if (airtime.pressure(millis()) > 0.5)
+    return;
+  beaconTimer.reset(millis());
+}
+
+void LoRaRadio::applyRoute(LoRaPacketHeader &hdr) {
+  if (!hdr.dest)
+    return;
+  uint32_t now = millis();
+  const RouteEntry *r = hdr.dest == LORA_DEST_GATEWAY ? routes.nearestGateway(now) : routes.lookup(hdr.dest, now);
+  if (!r) {
+    // No route (yet): flood, the destination still gets it
+    hdr.nextHop = 0;
+    hdr.hopLimit = min(15, hdr.hopCount + LORA_DEFAULT_HOP_LIMIT);
+    routes.countFloodFallback();
+    return;
+  }
+  routes.countRouted();
+  if (r->nextHop == hdr.dest) {
+    hdr.nextHop = 0;  // direct neighbour
+    hdr.hopLimit = 0;
+  } else {
+    hdr.nextHop = r->nextHop;
+    hdr.hopLimit = ROUTE_MAX_HOPS;
+  }
+}
+
+uint8_t LoRaRadio::repairFragments(uint32_t dest, size_t len) {
+  // Quality of the first hop: the SNR margin at the SF the frames go out on
+  uint8_t fragments = len == 0 ? 1 : (len + maxFragmentSize - 1) / maxFragmentSize;
+  FecLinkQuality quality = FEC_LINK_UNKNOWN;
+  uint32_t now = millis();
+  const RouteEntry *r = !dest ? nullptr : dest == LORA_DEST_GATEWAY ? routes.nearestGateway(now) : routes.lookup(dest, now);
+  float margin;
+  if (r && adr.snrMargin(r->nextHop, min(adr.txSf(r->nextHop, now), spreadingFactor), now, margin))
+    quality = fecLinkQuality(margin);
+  return fecPolicy.repairFor(fragments, quality);
+}
+
+void LoRaRadio::forwardRouted(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len) {
+  if (hdr.hopCount + 1 >= ROUTE_MAX_HOPS)
+    return;
+  LoRaPacketHeader next = hdr;
+  next.hopCount = hdr.hopCount + 1;
+  next.nextSf = 0;
+  next.beaconLen = 0;
+  applyRoute(next);
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa ROUTE] #%u frag %u for %08X via %08X\n", hdr.seq, hdr.fragIndex + 1, hdr.dest, next.nextHop);
+#endif
+  transmitPacket(next, payload, len);
+}
+
+uint32_t LoRaRadio::ackBitmap(const LoRaPacketHeader &hdr) {
+  if (hdr.fragCount <= 1)
+    return 1;
+  return reassembly.receivedBitmap(hdr.origin, hdr.seq, hdr.fragCount) | flood.seenBitmap(hdr.origin, hdr.seq, millis());
+}
+
+void LoRaRadio::sendAck(uint32_t origin, uint16_t seq, uint32_t bitmap) {
+  LoRaAckPayload ack{ origin, seq, bitmap };
+  uint8_t payload[LORA_ACK_PAYLOAD_SIZE];
+  size_t len = loraEncodeAck(ack, payload);
+
+  LoRaPacketHeader hdr;
+  hdr.type = LORA_PKT_ACK;
+  hdr.origin = nodeId;
+  hdr.seq = nextSeq++;
+  hdr.hopLimit = 0;  // ACKs are for direct neighbours only
+  transmitPacket(hdr, payload, len, 0, origin);
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa ACK] Sent ACK for msgID=%u, fragments %08X\n", seq, bitmap);
+#endif
+}
 
-    // Update neighbours
-    NeighbourInfo info{ millis(), rssi, snr };
-    neighbours[sender] = info;
+bool LoRaRadio::transmitPacket(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len, uint16_t tag, uint32_t peer) {
+  // Unicast hop on a good link: tell the receiving end which SF to follow
+  LoRaPacketHeader onAir = hdr;
+  uint32_t target = hdr.nextHop ? hdr.nextHop : (hdr.hopLimit == 0 ? hdr.dest : 0);
+  if (target) {
+    peer = target;
+    uint8_t sf = adr.txSf(target, millis());
+    if (sf < spreadingFactor)
+      onAir.nextSf = sf;
+  }
 
-    // Log complete message
-    ReceivedMessage msg{ millis(), sender, str, rssi, snr };
-    messageLog.push_back(msg);
-    if (messageLog.size() > maxMessageCount)
-      messageLog.pop_front();      
-    while (!messageLog.empty() && millis() - messageLog.front().timestamp > maxMessageAge)
-      messageLog.pop_front();
+  // A beacon that is wanted rides along on our own broadcast frames, which
+  // every neighbour hears at the base SF
+  uint8_t beacon[LORA_PACKET_MAX_PAYLOAD];
+  bool piggyback = beaconTimer.wanted() && hdr.origin == nodeId && hdr.hopCount == 0 &&
+                   hdr.type != LORA_PKT_BEACON && !target && !peer;
+  if (piggyback) {
+    onAir.beaconLen = buildBeacon(getNodeName(), beacon);
+    onAir.beacon = beacon;
+    if (loraHeaderSize(onAir) + len > LORA_PACKET_MAX_SIZE)
+      onAir.beaconLen = 0;  // no room, the beacon goes out on its own later
+  }
 
+  uint8_t frame[LORA_PACKET_MAX_SIZE];
+  size_t frameLen = loraEncodePacket(onAir, payload, len, frame, sizeof(frame));
+  if (frameLen == 0) {
+    Serial.println("[LoRaRadio] ERROR: packet too large, dropped");
+    return false;
+  }
+  if (!txQueue.push(frame, frameLen, txPriorityForType(hdr.type), millis(), tag, peer, onAir.nextSf)) {
+    Serial.println("[LoRaRadio] ERROR: TX queue full, frame dropped");
+    return false;
+  }
+  if (onAir.beaconLen) {
+    size_t extLen = 1 + onAir.beaconLen;
+    uint32_t extraUs = loraTimeOnAirUs(frameLen, spreadingFactor, bandwidth, codingRate) -
+                       loraTimeOnAirUs(frameLen - extLen, spreadingFactor, bandwidth, codingRate);
+    uint32_t aloneUs = loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + onAir.beaconLen, spreadingFactor, bandwidth, codingRate);
+    beaconTimer.sent(millis(), extraUs, aloneUs, true);
 #if DEBUG_ENABLED
-    Serial.printf("[LoRa RX] %s | RSSI=%.1f | SNR=%.1f\n", str.c_str(), rssi, snr);
+    Serial.printf("[LoRa BEACON] Piggybacked on %s #%u (+%u B)\n", loraPacketTypeName(hdr.type), hdr.seq, (unsigned)extLen);
 #endif
+  }
+  return true;
+}
 
-    // Forward all non-beacon messages to all nodes, prevent looping
-    // Add a simple loop prevention: only forward if not already forwarded by this node
-    if (!str.startsWith("BEACON") && !str.startsWith("FORWARDED:")) {
-      String forwardedMsg = "FORWARDED:" + getNodeName() + ":" + str;
-      radio.transmit(forwardedMsg);
+TxFrame *LoRaRadio::selectFrame() {
+  uint32_t now = millis();
+  for (int prio = TX_PRIO_HIGH; prio >= TX_PRIO_LOW; prio--) {
+    TxFrame *frame;
+    while ((frame = txQueue.oldest(prio)) != nullptr) {
+      uint8_t sf = frameSf(*frame, now);
+      uint32_t toa = loraTimeOnAirUs(frame->len, sf, bandwidth, codingRate, framePreamble(*frame, sf, now));
+      AirtimeBudget::Decision d = airtime.admit(prio, toa, now - frame->queuedAt, !frame->deferred, now);
+      if (d == AirtimeBudget::ADMIT)
+        return frame;
+      if (d == AirtimeBudget::DEFER) {
+        frame->deferred = true;
+        break;  // keep FIFO order within a class, try a more modest class
+      }
 #if DEBUG_ENABLED
-      Serial.printf("[LoRa FORWARD] Forwarded message: %s\n", forwardedMsg.c_str());
+      Serial.printf("[LoRa TX] Duty cycle: dropped %s frame after %u ms\n", loraPacketTypeName(frame->data[0] & 0x0F), now - frame->queuedAt);
 #endif
+      frameDone(frame->tag, now);
+      txQueue.remove(frame);
     }
+  }
+  return nullptr;
+}
+
+void LoRaRadio::feedOutbox() {
+  // Fragments are queued lazily so a long message cannot crowd out ACKs and
+  // rebroadcasts, and a retransmission round only queues what is missing
+  LoRaPacketHeader hdr;
+  const uint8_t *payload;
+  size_t len;
+  uint16_t tag;
+#if DEBUG_ENABLED
+  uint32_t cycles = ESP.getCycleCount();
+#endif
+  while (txQueue.freeSlots() > 2 && outbox.nextFragment(hdr, payload, len, tag)) {
+#if DEBUG_ENABLED
+    if (hdr.flags & LORA_FLAG_REPAIR)
+      Serial.printf("[LoRa FEC] #%u repair fragment %u coded in %u cycles\n", hdr.seq, hdr.fragIndex - hdr.fragCount + 1,
+                    ESP.getCycleCount() - cycles);
+    Serial.printf("[LoRa PACKET] %s #%u frag %u/%u (%u B)\n", loraPacketTypeName(hdr.type), hdr.seq, hdr.fragIndex + 1, hdr.fragCount, (unsigned)len);
+#endif
+    applyRoute(hdr);
+    if (!transmitPacket(hdr, payload, len, tag))
+      outbox.onFrameDone(tag, millis());
+#if DEBUG_ENABLED
+    cycles = ESP.getCycleCount();
+#endif
+  }
+
+  uint32_t ackToaMs = loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + LORA_ACK_PAYLOAD_SIZE, spreadingFactor, bandwidth, codingRate) / 1000;
+  uint32_t lost = 0;
+  outbox.poll(millis(), ackToaMs, &lost);
 
-    // Send ACK if msgID found
-    if (msgID.length() > 0) {
-      String ack = "ACK:" + msgID + ":" + getNodeName();
-      radio.transmit(ack);
+  // A unicast exchange went unanswered. At a fast SF: slow that link down and
+  // let the retry open a new exchange at the base SF. At the base SF: stop
+  // routing through that neighbour, the retry floods until the next beacon.
+  const RouteEntry *r = !lost ? nullptr : lost == LORA_DEST_GATEWAY ? routes.nearestGateway(millis()) : routes.lookup(lost, millis());
+  if (r && adr.txSf(r->nextHop, millis()) < spreadingFactor) {
+    uint32_t peer = r->nextHop;
+    adr.penalize(peer, millis());
+    if (peer == followPeer)
+      followPeer = 0;
 #if DEBUG_ENABLED
-      Serial.printf("[LoRa ACK] Sent ACK for msgID=%s\n", msgID.c_str());
+    Serial.printf("[LoRa ADR] No answer from %08X, now SF%u\n", peer, adr.txSf(peer, millis()));
 #endif
+  } else if (r) {
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa ROUTE] No answer from %08X, routes via it dropped\n", r->nextHop);
+#endif
+    routes.linkFailed(r->nextHop, millis());
+    routesChanged = true;
+    topologyChanged();
+  }
+
+  // Delivered or failed messages may still have fragments waiting
+  uint8_t finished = outbox.takeFinishedSlots();
+  for (uint8_t i = 0; i < OUTBOX_SLOTS; i++)
+    if (finished & (1 << i))
+      txQueue.removeTagged(0xFF00, (i + 1) << 8);
+}
+
+void LoRaRadio::startNextTransmit() {
+  lingering = false;
+  TxFrame *next = selectFrame();
+  if (!next) {
+    csma.reset();
+    return;
+  }
+
+  // Give small frames for the same hop a moment to join, unless there is no
+  // room left for them anyway
+  TxFrame *batch[TX_BATCH_MAX];
+  size_t left;
+  size_t count = txQueue.collect(next, batch, TX_BATCH_MAX, LORA_PACKET_MAX_PAYLOAD, left);
+  uint32_t until = TxQueue::lingerUntil(*next);
+  if (count < TX_BATCH_MAX && left >= TX_BATCH_MIN_ROOM && (int32_t)(until - millis()) > 0) {
+    lingering = true;
+    lingerUntil = until;
+    return;
+  }
+
+  // Listen before talk: random backoff, then CAD at the SF the frame goes out on
+  uint8_t sf = frameSf(*next, millis());
+  uint32_t slotUs = ChannelAccess::slotUs(sf, bandwidth);
+  if (!csma.ready(next->priority, slotUs, millis()))
+    return;
+
+  // CAD puts the radio in standby, which would abort a frame coming in. A
+  // frame that arrived since loop() looked at DIO1 is read out first.
+  uint32_t irq = dio1Flag ? 0 : radio.getIrqFlags();
+  bool header = irq & (RADIOLIB_SX126X_IRQ_RX_DONE | RADIOLIB_SX126X_IRQ_HEADER_VALID);
+  bool detected = irq & RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED;
+  if (!detected || header) {
+    rxPreambleAt = 0;
+  } else if (!rxPreambleAt) {
+    rxPreambleAt = millis() | 1;
+  } else {
+    // No header after the longest wake-up preamble: the detection was noise
+    uint32_t symbolUs = (uint32_t)((float)(1UL << radioSf) * 1000.0f / bandwidth);
+    if (millis() - rxPreambleAt > (powerWakePreamble(radioSf, bandwidth) + 13) * symbolUs / 1000) {
+      radio.clearIrqFlags(RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED);
+      rxPreambleAt = 0;
+      detected = false;
     }
   }
+  if (dio1Flag || header || detected) {
+    csma.onReceiving(slotUs, millis());
+    return;
+  }
+  if (!csma.onIdle(slotUs, millis())) {
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa CSMA] Frame heard, %s frame waits %u ms\n", loraPacketTypeName(next->data[0] & 0x0F),
+                  csma.wakeAt() - millis());
+#endif
+    return;
+  }
+  tuneRadio(sf);
+  int cad = radio.scanChannel();
+  // CAD done raised DIO1 as well; the radio was in standby, not receiving
+  dio1Flag = false;
+  if (!csma.onCad(cad == RADIOLIB_LORA_DETECTED, slotUs, millis())) {
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa CSMA] Channel busy, %s frame waits %u ms\n", loraPacketTypeName(next->data[0] & 0x0F),
+                  csma.wakeAt() - millis());
+#endif
+    // Someone is on air, maybe for us: listen until the backoff is over
+    startReceive();
+    return;
+  }
+
+  // Frames queued during the backoff may join as well. The longest preamble
+  // any of them needs covers them all.
+  count = txQueue.collect(next, batch, TX_BATCH_MAX, LORA_PACKET_MAX_PAYLOAD, left);
+  uint16_t preamble = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint16_t p = framePreamble(*batch[i], sf, millis());
+    if (p > preamble)
+      preamble = p;
+  }
+  uint8_t frame[LORA_PACKET_MAX_SIZE];
+  size_t len = count > 1 ? buildBatch(batch, count, frame) : 0;
+  uint32_t toa = len ? loraTimeOnAirUs(len, sf, bandwidth, codingRate, preamble) : 0;
+  if (len && airtime.admit(next->priority, toa, millis() - next->queuedAt, false, millis()) != AirtimeBudget::ADMIT)
+    len = 0;  // the budget took the first frame, not the batch
+  if (len == 0) {
+    count = 1;
+    preamble = framePreamble(*next, sf, millis());
+    len = next->len;
+    memcpy(frame, next->data, len);
+    toa = loraTimeOnAirUs(len, sf, bandwidth, codingRate, preamble);
+  }
+#if DEBUG_ENABLED
+  if (count > 1)
+    Serial.printf("[LoRa BATCH] %u frames for %08X in one (%u B)\n", (unsigned)count, next->peer, (unsigned)len);
+#endif
+
+  // startTransmit copies the frame into the radio FIFO, the slots can go
+  txQueuedAt = next->queuedAt;
+  txAirtimeUs = toa;
+  txPackets = count;
+  txPeer = next->peer;
+  txNextSf = 0;
+  for (size_t i = 0; i < count; i++) {
+    txTags[i] = batch[i]->tag;
+    if (!txNextSf)
+      txNextSf = batch[i]->nextSf;
+    txQueue.remove(batch[i]);
+  }
+  if (sf != spreadingFactor)
+    adr.recordFastFrame(loraTimeOnAirUs(len, spreadingFactor, bandwidth, codingRate), txAirtimeUs);
+  tuneRadio(sf);
+  if (preamble != radioPreamble) {
+    radio.setPreambleLength(preamble);
+    radioPreamble = preamble;
+  }
+  int state = radio.startTransmit(frame, len);
+  if (state != RADIOLIB_ERR_NONE) {
+    Serial.println("[LoRa TX] startTransmit failed, code=" + String(state));
+    txQueue.recordFailed();
+    for (size_t i = 0; i < txPackets; i++)
+      frameDone(txTags[i], millis());
+    startReceive();
+    return;
+  }
+  transmitting = true;
+  txStartedAt = millis();
+  airtime.record(txAirtimeUs, txStartedAt);
+}
+
+size_t LoRaRadio::buildBatch(TxFrame **frames, size_t count, uint8_t *out) {
+  uint8_t payload[LORA_PACKET_MAX_PAYLOAD];
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len = loraBatchAppend(payload, len, sizeof(payload), frames[i]->data, frames[i]->len);
+    if (len == 0)
+      return 0;
+  }
+  LoRaPacketHeader hdr;
+  hdr.type = LORA_PKT_BATCH;
+  hdr.origin = nodeId;
+  hdr.seq = nextSeq++;
+  hdr.hopLimit = 0;  // the frames inside are forwarded one by one
+  return loraEncodePacket(hdr, payload, len, out, LORA_PACKET_MAX_SIZE);
+}
+
+void LoRaRadio::finishTransmit(bool ok) {
+  transmitting = false;
+  radio.finishTransmit();
+  if (ok)
+    txQueue.recordSent(txQueuedAt, millis(), txAirtimeUs, txPackets);
+  else
+    txQueue.recordFailed();
+  for (size_t i = 0; i < txPackets; i++)
+    frameDone(txTags[i], millis());
+  txPackets = 0;
+  // Our SF extension is on air: the peer is listening at the fast SF now
+  if (ok && txNextSf)
+    follow(txPeer, txNextSf, millis());
+  // Keep listening for the ACK, it comes without a wake-up preamble
+  if (powerMode == POWER_SAVE) {
+    uint32_t ackToaMs = loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + LORA_ACK_PAYLOAD_SIZE, radioSf, bandwidth, codingRate) / 1000;
+    ackWindowUntil = millis() + 2 * ackToaMs + POWER_ACK_WINDOW_MS;
+  }
+  startReceive();
 }
 
-std::deque<ReceivedMessage> &LoRaRadio::getRawLog() {
-  return rawLog;
+uint8_t LoRaRadio::frameSf(const TxFrame &frame, uint32_t now) const {
+  if (frame.peer && frame.peer == followPeer && followActive(now))
+    return followSf;
+  return spreadingFactor;
 }
 
-String LoRaRadio::sendMessageWithAck(const String &msg) {
-  // Generate unique msgID
-  String msgID = String(millis());
-  String nodeName = getNodeName();
-  String fullMsg = "MSG:" + msgID + ":" + nodeName + ":" + msg;
+uint16_t LoRaRadio::framePreamble(const TxFrame &frame, uint8_t sf, uint32_t now) const {
+  // A sleeping receiver only catches a preamble that outlasts its sleep;
+  // for an ACK it is still listening after its own frame
+  if ((frame.data[0] & 0x0F) == LORA_PKT_ACK)
+    return POWER_DEFAULT_PREAMBLE;
+  bool wake = frame.peer ? sleepers.sleeps(frame.peer, now) : sleepers.any(now);
+  return wake ? powerWakePreamble(sf, bandwidth) : POWER_DEFAULT_PREAMBLE;
+}
 
-  size_t totalLen = fullMsg.length();
-  if (totalLen <= maxFragmentSize) {
-    radio.transmit(fullMsg);
-    pendingAcks[msgID] = millis();
-    return msgID;
+bool LoRaRadio::ackWindowOpen(uint32_t now) const {
+  return (int32_t)(ackWindowUntil - now) > 0;
+}
+
+bool LoRaRadio::followActive(uint32_t now) const {
+  return followPeer != 0 && (int32_t)(followUntil - now) > 0;
+}
+
+void LoRaRadio::follow(uint32_t peer, uint8_t sf, uint32_t now) {
+  if (sf < ADR_SF_MIN || sf > spreadingFactor)
+    return;
+#if DEBUG_ENABLED
+  if (!followActive(now) || peer != followPeer || sf != followSf)
+    Serial.printf("[LoRa ADR] Exchange with %08X at SF%u\n", peer, sf);
+#endif
+  followPeer = peer;
+  followSf = sf;
+  followUntil = now + LORA_FOLLOW_WINDOW_MS;
+}
+
+void LoRaRadio::tuneRadio(uint8_t sf) {
+  if (sf == radioSf)
+    return;
+  radio.standby();
+  radio.setSpreadingFactor(sf);
+  radioSf = sf;
+}
+
+void LoRaRadio::startReceive() {
+  uint8_t sf = followActive(millis()) ? followSf : spreadingFactor;
+  tuneRadio(sf);
+  radioDutyCycled = powerMode == POWER_SAVE && !ackWindowOpen(millis());
+  if (radioDutyCycled)
+    radio.startReceiveDutyCycleAuto(powerWakePreamble(sf, bandwidth), POWER_MIN_SYMBOLS, LORA_RX_IRQ_FLAGS);
+  else
+    radio.startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF, LORA_RX_IRQ_FLAGS);
+}
+
+MessageLogView LoRaRadio::getRawLog() {
+  return MessageLogView(rawSnap);
+}
+
+RadioStatusView LoRaRadio::getStatus() {
+  return RadioStatusView(statusSnap);
+}
+
+String LoRaRadio::sendMessageWithAck(const String &msg, uint8_t type, uint32_t dest) {
+  return sendMessageWithAck((const uint8_t *)msg.c_str(), msg.length(), type, dest);
+}
+
+String LoRaRadio::sendMessageWithAck(const uint8_t *data, size_t totalLen, uint8_t type, uint32_t dest) {
+  LoRaPacketHeader hdr;
+  hdr.type = type;
+  hdr.flags = LORA_FLAG_ACK_REQ;
+  hdr.origin = nodeId;
+  hdr.dest = dest;  // next hop and hop limit are chosen per fragment in feedOutbox()
+
+  if (totalLen > CODEC_MAX_SIZE) {
+    Serial.println("[LoRaRadio] ERROR: message too long, dropped");
+    return "";
   }
 
-  int totalFragments = (totalLen + maxFragmentSize - 1) / maxFragmentSize;
-  for (int i = 0; i < totalFragments; i++) {
-    int startIdx = i * maxFragmentSize;
-    int len = min((int)totalLen - startIdx, (int)maxFragmentSize);
-    String fragment = fullMsg.substring(startIdx, startIdx + len);
-    String packet = "[" + msgID + "|" + String(i + 1) + "|" + String(totalFragments) + "]" + fragment;
+  // Compress the whole message before it is split into fragments
+#if DEBUG_ENABLED
+  uint32_t cycles = ESP.getCycleCount();
+#endif
+  size_t packedLen = codecCompress(data, totalLen, codecBuf, sizeof(codecBuf));
+  if (packedLen) {
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa CODEC] %u -> %u bytes in %u cycles\n", (unsigned)totalLen, (unsigned)packedLen, ESP.getCycleCount() - cycles);
+#endif
+    data = codecBuf;
+    totalLen = packedLen;
+    hdr.flags |= LORA_FLAG_COMPRESSED;
+  }
 
-    Serial.printf("[LoRa PACKET] Raw packet: %s\n", packet.c_str());
+  int totalFragments = totalLen == 0 ? 1 : (totalLen + maxFragmentSize - 1) / maxFragmentSize;
+  if (totalFragments > REASSEMBLY_MAX_FRAGMENTS) {
+    Serial.println("[LoRaRadio] ERROR: message too long, dropped");
+    return "";
+  }
 
-    radio.transmit(packet);
-    delay(10);
+  // The sequence number is only used up by a message the outbox takes
+  hdr.seq = nextSeq;
+  if (!outbox.add(hdr, data, totalLen, OUTBOX_MAX_RETRIES, repairFragments(dest, totalLen))) {
+    Serial.println("[LoRaRadio] ERROR: outbox full, message dropped");
+    return "";
   }
-  pendingAcks[msgID] = millis();
-  return msgID;
+  nextSeq++;
+  if (dest)
+    custody.add(hdr, data, totalLen, millis());
+  feedOutbox();
+  return String(hdr.seq);
 }
+
 bool LoRaRadio::isAcked(const String &msgID) {
-  Serial.printf("[LoRa ACK] Checking ACK for msgID=%s\n", msgID.c_str());
-  return receivedAcks.count(msgID) > 0;
+  return getDeliveryState(msgID) == DELIVERY_DELIVERED;
+}
+
+DeliveryState LoRaRadio::getDeliveryState(const String &msgID) {
+  if (msgID.length() == 0)
+    return DELIVERY_UNKNOWN;
+  return outbox.state((uint16_t)msgID.toInt(), millis());
+}
+
+void LoRaRadio::setDeliveryCallback(DeliveryCallback cb) {
+  outbox.setCallback(cb);
+}
+
+RouteView LoRaRadio::getRoutes() {
+  return RouteView(routeSnap);
+}
+
+void LoRaRadio::setGateway(bool gateway) {
+  gatewayWanted = gateway;
+  Preferences prefs;
+  prefs.begin("lora", false);
+  prefs.putBool("gateway", gateway);
+  prefs.end();
+  if (consumerTask)
+    xTaskNotifyGive(consumerTask);
+}
+
+void LoRaRadio::setFec(bool enabled) {
+  fecWanted = enabled;
+  Preferences prefs;
+  prefs.begin("lora", false);
+  prefs.putBool("fec", enabled);
+  prefs.end();
+  if (consumerTask)
+    xTaskNotifyGive(consumerTask);
+}
+
+bool LoRaRadio::isFecEnabled() const {
+  return fecWanted;
+}
+
+// Settings changed by the web server; the route table, the beacon timer and
+// the FEC policy are only touched here, on the LoRa task
+void LoRaRadio::applySettings() {
+  bool gateway = gatewayWanted;
+  if (gateway != routes.gateway()) {
+    routes.setGateway(gateway);
+    topologyChanged();  // neighbours learn it from the next beacon
+  }
+  fecPolicy.enabled = fecWanted;
+}
+
+void LoRaRadio::setPowerMode(PowerMode mode) {
+  if (mode == powerMode)
+    return;
+  powerMode = mode;
+  // Neighbours learn it from the next beacon
+  topologyChanged();
+  if (!transmitting)
+    startReceive();
+}
+
+PowerMode LoRaRadio::getPowerMode() const {
+  return powerMode;
+}
+
+void LoRaRadio::savePowerMode(PowerMode mode) {
+  Preferences prefs;
+  prefs.begin("lora", false);
+  prefs.putBool("powersave", mode == POWER_SAVE);
+  prefs.end();
+}
+
+PowerMode LoRaRadio::getSavedPowerMode() const {
+  Preferences prefs;
+  prefs.begin("lora", true);
+  bool powerSave = prefs.getBool("powersave", false);
+  prefs.end();
+  return powerSave ? POWER_SAVE : POWER_ALWAYS_ON;
+}
+
+bool LoRaRadio::isGateway() const {
+  return gatewayWanted;
+}
+
+size_t LoRaRadio::buildBeacon(const String &nodeName, uint8_t *payload) {
+  size_t nameLen = nodeName.length();
+  if (nameLen + 1 + 4 + ADR_REPORT_MAX_ENTRIES * ADR_REPORT_ENTRY_SIZE +
+      ROUTE_ADVERT_MAX_ENTRIES * ROUTE_ADVERT_ENTRY_SIZE + 3 > LORA_PACKET_MAX_PAYLOAD)
+    return 0;
+  memcpy(payload, nodeName.c_str(), nameLen);
+  payload[nameLen] = 0;
+  size_t len = nameLen + 1;
+
+  // At a slow SF the name and our own route entry may be all that fits in
+  // LORA_BEACON_MAX_MS; other links and routes then take turns
+  size_t fixed = len + 2 + 2 + ROUTE_ADVERT_ENTRY_SIZE + (powerMode == POWER_SAVE ? 3 : 0);
+  size_t room = beaconMaxLen > fixed ? beaconMaxLen - fixed : 0;
+
+  uint8_t *section = payload + len;
+  section[0] = LORA_BEACON_LINKS;
+  section[1] = adr.encodeReport(section + 2, millis(), room * LORA_BEACON_LINK_SHARE / 100 / ADR_REPORT_ENTRY_SIZE);
+  len += 2 + section[1];
+  room -= section[1];
+
+  section = payload + len;
+  section[0] = LORA_BEACON_ROUTES;
+  section[1] = routes.encodeAdvert(section + 2, millis(), 1 + room / ROUTE_ADVERT_ENTRY_SIZE);
+  len += 2 + section[1];
+
+  // A route that gets its turn every few beacons, here and at the
+  // neighbours alike, has to outlive two rounds of the rotation
+  size_t turn = room / ROUTE_ADVERT_ENTRY_SIZE;
+  if (turn > ROUTE_ADVERT_MAX_ENTRIES - 1)
+    turn = ROUTE_ADVERT_MAX_ENTRIES - 1;
+  size_t known = routes.size(millis());
+  size_t rounds = turn && known > turn ? (known + turn - 1) / turn : 1;
+  size_t intervals = 2 * rounds + 1 > LORA_BEACON_TTL_INTERVALS ? 2 * rounds + 1 : LORA_BEACON_TTL_INTERVALS;
+  routes.setTtl(intervals * beaconTimer.imax());
+
+  if (powerMode == POWER_SAVE) {
+    section = payload + len;
+    section[0] = LORA_BEACON_POWER;
+    section[1] = 1;
+    section[2] = POWER_FLAG_SLEEPS;
+    len += 3;
+  }
+  return len;
 }
 
 void LoRaRadio::sendBeacon(const String &nodeName) {
-  Serial.printf("[LoRa BEACON] Sending beacon from node: %s\n", nodeName.c_str());
-  sendMessageWithAck("BEACON van " + nodeName);
+  Serial.printf("[LoRa BEACON] Sending beacon from node: %s (interval %u s)\n", nodeName.c_str(),
+                (unsigned)(beaconTimer.stats().intervalMs / 1000));
+
+  uint8_t payload[LORA_PACKET_MAX_PAYLOAD];
+  size_t len = buildBeacon(nodeName, payload);
+  if (len == 0)
+    return;
+
+  // A lost beacon is covered by the next one, so nobody ACKs it
+  LoRaPacketHeader hdr;
+  hdr.type = LORA_PKT_BEACON;
+  hdr.origin = nodeId;
+  hdr.seq = nextSeq++;
+  hdr.hopLimit = 0;
+  if (transmitPacket(hdr, payload, len)) {
+    uint32_t toa = loraTimeOnAirUs(loraHeaderSize(hdr) + len, spreadingFactor, bandwidth, codingRate);
+    beaconTimer.sent(millis(), toa, toa, false);
+  }
+}
+
+// =======================
+// Store and forward
+// =======================
+void LoRaRadio::serviceCustody() {
+  uint32_t now = millis();
+  for (size_t i = 0; i < CUSTODY_SLOTS; i++) {
+    CustodyEntry &e = custody.entry(i);
+    if (e.state == CUSTODY_FREE)
+      continue;
+    if (e.state != CUSTODY_SENDING && now - e.takenAt > CUSTODY_TTL_MS) {
+      Serial.printf("[LoRa CUSTODY] Gave up on #%u for %08X\n", e.seq, e.dest);
+      custody.countExpired();
+      releaseCustody(i);
+      continue;
+    }
+    const RouteEntry *r = e.dest == LORA_DEST_GATEWAY ? routes.nearestGateway(now) : routes.lookup(e.dest, now);
+    uint32_t via = r ? r->nextHop : 0;
+
+    if (e.state == CUSTODY_SENDING) {
+      DeliveryState st = outbox.state(e.seq, now);
+      if (st == DELIVERY_PENDING)
+        continue;
+      // The ACK came from the destination itself: nothing left to do
+      if (st == DELIVERY_DELIVERED && r && r->nextHop == r->dest) {
+        releaseCustody(i);
+        continue;
+      }
+      // A relay has it: ask the destination in a while. Nobody has it:
+      // offer it as soon as the destination is reachable.
+      custody.hold(i, st == DELIVERY_DELIVERED ? CUSTODY_CHECK_MS : 0, via, now);
+      custody.countHeld();
+      saveCustody(i);
+#if DEBUG_ENABLED
+      Serial.printf("[LoRa CUSTODY] Holding #%u for %08X (%s)\n", e.seq, e.dest, st == DELIVERY_DELIVERED ? "relayed" : "undelivered");
+#endif
+    } else if (e.state == CUSTODY_HELD) {
+      custody.reroute(i, via, now);
+    } else if (e.state == CUSTODY_WANTED && outbox.hasFreeSlot() && txQueue.freeSlots() > 2) {
+      // Same message, new sequence number: relays would drop the old one as a copy
+      LoRaPacketHeader hdr;
+      hdr.type = e.type;
+      hdr.flags = LORA_FLAG_ACK_REQ | e.flags;
+      hdr.origin = nodeId;
+      hdr.seq = nextSeq;
+      hdr.dest = e.dest;
+      if (outbox.add(hdr, e.data, e.len, OUTBOX_MAX_RETRIES, repairFragments(e.dest, e.len))) {
+        nextSeq++;
+#if DEBUG_ENABLED
+        Serial.printf("[LoRa CUSTODY] Resending #%u as #%u\n", e.seq, hdr.seq);
+#endif
+        e.seq = hdr.seq;
+        e.state = CUSTODY_SENDING;
+        custody.countResent();
+      }
+    }
+  }
+
+  // At most one offer per pass, for the first reachable destination with
+  // entries due; it lists all of them. Flooding offers to a destination
+  // without a route costs more airtime than waiting for its next beacon.
+  if (txQueue.freeSlots() <= 2)
+    return;
+  for (size_t i = 0; i < CUSTODY_SLOTS; i++) {
+    const CustodyEntry &e = custody.entry(i);
+    if (e.state != CUSTODY_HELD || !e.via || (int32_t)(now - e.offerAt) < 0)
+      continue;
+    uint8_t offer[2 + CUSTODY_SUMMARY_MAX * CUSTODY_SUMMARY_ENTRY_SIZE];
+    uint32_t dest = e.dest;
+    size_t len = custody.encodeOffer(dest, now, offer);
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa CUSTODY] Offering %u messages to %08X\n", offer[1], dest);
+#endif
+    sendCustodyFrame(dest, offer, len);
+    break;
+  }
+}
+
+void LoRaRadio::handleCustody(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len) {
+  uint8_t kind;
+  CustodyId ids[CUSTODY_SUMMARY_MAX];
+  size_t n = CustodyStore::decodeSummary(payload, len, kind, ids);
+  if (n == 0)
+    return;
+
+  // Destination: tell the custodian which of the offered messages arrived
+  if (kind == CUSTODY_OFFER) {
+    uint8_t reply[2 + CUSTODY_SUMMARY_MAX * CUSTODY_SUMMARY_ENTRY_SIZE];
+    size_t replyLen = custody.answerOffer(payload, len, reply);
+    if (replyLen) {
+#if DEBUG_ENABLED
+      Serial.printf("[LoRa CUSTODY] Answering offer of %u messages from %08X\n", (unsigned)n, hdr.origin);
+#endif
+      sendCustodyFrame(hdr.origin, reply, replyLen);
+      custody.countReply();
+    }
+    return;
+  }
+
+  // Custodian: drop what arrived, resend what did not
+  if (kind != CUSTODY_REPLY || hdr.dest != nodeId)
+    return;
+  for (size_t k = 0; k < n; k++) {
+    int i = custody.find(ids[k].origin, ids[k].seq);
+    if (i < 0 || custody.entry(i).state != CUSTODY_HELD)
+      continue;
+#if DEBUG_ENABLED
+    Serial.printf("[LoRa CUSTODY] %08X %s #%u\n", hdr.origin, ids[k].have ? "has" : "lacks", ids[k].seq);
+#endif
+    if (ids[k].have) {
+      custody.countConfirmed();
+      releaseCustody(i);
+    } else {
+      custody.entry(i).state = CUSTODY_WANTED;
+    }
+  }
+}
+
+void LoRaRadio::sendCustodyFrame(uint32_t dest, const uint8_t *payload, size_t len) {
+  // Not ACKed: a lost offer is repeated after its backoff, a lost reply
+  // when the custodian offers again
+  LoRaPacketHeader hdr;
+  hdr.type = LORA_PKT_CUSTODY;
+  hdr.origin = nodeId;
+  hdr.seq = nextSeq++;
+  hdr.dest = dest;
+  applyRoute(hdr);
+  transmitPacket(hdr, payload, len);
+}
+
+// Held entries live in NVS, one record per slot, so a reboot does not lose them
+void LoRaRadio::loadCustody() {
+  uint8_t record[CUSTODY_RECORD_HEADER + CUSTODY_MAX_BYTES];
+  Preferences prefs;
+  prefs.begin("custody", true);
+  size_t loaded = 0;
+  for (size_t i = 0; i < CUSTODY_SLOTS; i++) {
+    char key[4] = { 'm', (char)('0' + i), 0 };
+    size_t len = prefs.getBytesLength(key);
+    if (len && len <= sizeof(record) && prefs.getBytes(key, record, len) == len && custody.load(i, record, len, millis()))
+      loaded++;
+  }
+  prefs.end();
+  if (loaded)
+    Serial.printf("[LoRa CUSTODY] %u held messages restored\n", (unsigned)loaded);
+}
+
+void LoRaRadio::saveCustody(size_t i) {
+  uint8_t record[CUSTODY_RECORD_HEADER + CUSTODY_MAX_BYTES];
+  char key[4] = { 'm', (char)('0' + i), 0 };
+  size_t len = custody.save(i, record);
+  Preferences prefs;
+  prefs.begin("custody", false);
+  if (prefs.putBytes(key, record, len) == len)
+    custody.entry(i).saved = true;
+  prefs.end();
+}
+
+void LoRaRadio::releaseCustody(size_t i) {
+  if (custody.entry(i).saved) {
+    char key[4] = { 'm', (char)('0' + i), 0 };
+    Preferences prefs;
+    prefs.begin("custody", false);
+    prefs.remove(key);
+    prefs.end();
+  }
+  custody.remove(i);
+}
+
+// =======================
+// File transfer
+// =======================
+void LoRaRadio::frameDone(uint16_t tag, uint32_t now) {
+  if ((tag & 0xF000) == FILE_TAG)
+    files.onFrameDone(tag, now, fileStatusTimeoutMs());
+  else
+    outbox.onFrameDone(tag, now);
+}
+
+uint32_t LoRaRadio::fileStatusTimeoutMs() {
+  // A chunk out and the status back, each over up to a full hop limit and
+  // each hop waiting its linger time, plus the margin for CSMA and relays
+  uint32_t toaMs = loraTimeOnAirUs(LORA_PACKET_MAX_SIZE, spreadingFactor, bandwidth, codingRate) / 1000;
+  return (2 * LORA_DEFAULT_HOP_LIMIT + 1) * (toaMs + TX_LINGER_NORMAL_MS) + LORA_FILE_MARGIN_MS;
+}
+
+// Content hash of a file on LittleFS, one chunk at a time: a file is never in memory as a whole
+static bool hashFile(const char *path, uint32_t &hash, uint32_t &size) {
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f)
+    return false;
+  uint8_t buf[FILE_CHUNK_SIZE];
+  size_t n;
+  hash = FILE_HASH_INIT;
+  size = 0;
+  while ((n = f.read(buf, sizeof(buf))) > 0) {
+    hash = fileHash(buf, n, hash);
+    size += n;
+  }
+  f.close();
+  return true;
+}
+
+void LoRaRadio::startFile(const char *path, uint32_t dest) {
+  if (dest == 0 || dest == LORA_DEST_GATEWAY) {
+    Serial.printf("[LoRa FILE] %s not sent: a file goes to one node\n", path);
+    return;
+  }
+  uint32_t id, size;
+  if (!hashFile(path, id, size)) {
+    Serial.printf("[LoRa FILE] %s not found\n", path);
+    return;
+  }
+  int i = files.send(id, dest, size, path, millis());
+  if (i < 0) {
+    Serial.printf("[LoRa FILE] %s not sent: empty, over %u bytes or both transfer slots busy\n", path, (unsigned)FILE_MAX_SIZE);
+    return;
+  }
+  if (!files.outgoing(i).saved)
+    saveFile(i);
+  Serial.printf("[LoRa FILE] Sending %s (%u B, %u chunks) to %s\n", path, (unsigned)size, fileChunks(size), nodeLabel(dest).c_str());
+}
+
+void LoRaRadio::serviceFiles() {
+  // FILE_IN_FLIGHT frames per transfer at most, and never the last TX queue
+  // slots: a file only uses the airtime game traffic leaves over
+  FileStep step;
+  while (txQueue.freeSlots() > 2 && files.next(millis(), step))
+    sendFileStep(step);
+}
+
+void LoRaRadio::sendFileStep(const FileStep &step) {
+  const FileTxTransfer &t = files.outgoing(step.slot);
+  uint8_t payload[FILE_CHUNK_HEADER + FILE_CHUNK_SIZE];
+  size_t len;
+  if (step.op == FILE_OP_OFFER) {
+    const char *name = strrchr(t.path, '/');
+    len = fileEncodeOffer(t.id, t.size, name ? name + 1 : t.path, payload);
+  } else {
+    // Straight from flash: only this chunk is in memory
+    uint32_t offset = (uint32_t)step.index * FILE_CHUNK_SIZE;
+    size_t want = t.size - offset < FILE_CHUNK_SIZE ? t.size - offset : FILE_CHUNK_SIZE;
+    len = fileEncodeChunkHeader(t.id, step.index, step.report, payload);
+    File f = LittleFS.open(t.path, FILE_READ);
+    bool ok = f && f.size() == t.size && f.seek(offset) && f.read(payload + len, want) == want;
+    f.close();
+    if (!ok) {
+      Serial.printf("[LoRa FILE] %s changed or gone, transfer stopped\n", t.path);
+      len = fileEncodeCancel(t.id, payload);
+      sendFileFrame(t.dest, payload, len);
+      releaseFile(step.slot);
+      return;
+    }
+    len += want;
+  }
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa FILE] %s %u of %s to %08X\n", step.op == FILE_OP_OFFER ? "Offer" : "Chunk", step.index, t.path, t.dest);
+#endif
+  sendFileFrame(t.dest, payload, len, step.tag);
+}
+
+void LoRaRadio::sendFileFrame(uint32_t dest, const uint8_t *payload, size_t len, uint16_t tag) {
+  // Not ACKed per frame: the status bitmap covers a whole round
+  LoRaPacketHeader hdr;
+  hdr.type = LORA_PKT_FILE;
+  hdr.origin = nodeId;
+  hdr.seq = nextSeq++;
+  hdr.dest = dest;
+  applyRoute(hdr);
+  if (!transmitPacket(hdr, payload, len, tag) && tag)
+    frameDone(tag, millis());
+}
+
+void LoRaRadio::handleFile(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len, float rssi, float snr) {
+  FileFrame f;
+  if (!fileDecode(payload, len, f))
+    return;
+  uint32_t now = millis();
+
+  if (f.op == FILE_OP_OFFER) {
+    bool fresh;
+    int i = files.accept(hdr.origin, f, now, fresh);
+    if (i < 0) {
+      uint8_t reply[FILE_STATUS_MAX];
+      sendFileFrame(hdr.origin, reply, fileEncodeStatus(f.id, FILE_STATUS_REFUSED, nullptr, 0, reply));
+      return;
+    }
+    if (fresh)
+      openIncoming(i);
+    sendFileStatus(i);
+  } else if (f.op == FILE_OP_CHUNK) {
+    // Without the offer we do not know the file yet; the sender's probe brings it
+    int i = files.find(hdr.origin, f.id);
+    if (i < 0)
+      return;
+    if (files.holds(i, f.index)) {
+      files.countDuplicate();
+    } else if (writeChunk(i, f) && files.mark(i, f.index, now)) {
+      finishIncoming(i, rssi, snr);
+      return;
+    }
+    if (f.report)
+      sendFileStatus(i);
+  } else if (f.op == FILE_OP_STATUS) {
+    size_t i;
+    switch (files.onStatus(hdr.origin, f, now, i)) {
+    case FileTransfer::STATUS_DONE:
+      Serial.printf("[LoRa FILE] %s delivered to %s in %u s\n", files.outgoing(i).path, nodeLabel(hdr.origin).c_str(),
+                    (unsigned)((now - files.outgoing(i).startedAt) / 1000));
+      releaseFile(i);
+      break;
+    case FileTransfer::STATUS_REFUSED:
+      Serial.printf("[LoRa FILE] %s refused by %s, trying again later\n", files.outgoing(i).path, nodeLabel(hdr.origin).c_str());
+      break;
+    case FileTransfer::STATUS_CORRUPT:
+      Serial.printf("[LoRa FILE] %s arrived damaged at %s, transfer stopped\n", files.outgoing(i).path, nodeLabel(hdr.origin).c_str());
+      releaseFile(i);
+      break;
+    default:
+      break;
+    }
+  } else if (f.op == FILE_OP_CANCEL) {
+    int i = files.find(hdr.origin, f.id);
+    if (i >= 0)
+      dropIncoming(i);
+  }
+}
+
+String LoRaRadio::incomingPath(size_t i, const char *ext) {
+  const FileRxTransfer &r = files.incoming(i);
+  char path[40];
+  snprintf(path, sizeof(path), LORA_FILE_RX_DIR "/%08X%08X%s", (unsigned)r.origin, (unsigned)r.id, ext);
+  return path;
+}
+
+void LoRaRadio::openIncoming(size_t i) {
+  // A bitmap from before a reboot or an idle eviction: carry on from there
+  String part = incomingPath(i, ".part");
+  uint8_t record[FILE_MAP_SIZE];
+  File map = LittleFS.open(incomingPath(i, ".map"), FILE_READ);
+  bool resumed = map && LittleFS.exists(part) && map.read(record, sizeof(record)) == sizeof(record) &&
+                 files.loadMap(i, record, sizeof(record));
+  map.close();
+  if (resumed) {
+    Serial.printf("[LoRa FILE] Resuming %s from %s at %u/%u chunks\n", files.incoming(i).name,
+                  nodeLabel(files.incoming(i).origin).c_str(), files.incoming(i).count, files.incoming(i).chunks);
+    return;
+  }
+  // Received before a reboot, only the DONE status got lost
+  uint32_t hash, size;
+  String path = String(LORA_FILE_DIR "/") + files.incoming(i).name;
+  if (hashFile(path.c_str(), hash, size) && hash == files.incoming(i).id && size == files.incoming(i).size) {
+    files.incoming(i).done = true;
+    return;
+  }
+  if (!LittleFS.exists(LORA_FILE_RX_DIR))
+    LittleFS.mkdir(LORA_FILE_RX_DIR);
+  File f = LittleFS.open(part, FILE_WRITE);  // empty; chunks are written at their offset
+  f.close();
+#if DEBUG_ENABLED
+  Serial.printf("[LoRa FILE] Receiving %s (%u B) from %08X\n", files.incoming(i).name, files.incoming(i).size, files.incoming(i).origin);
+#endif
+}
+
+bool LoRaRadio::writeChunk(size_t i, const FileFrame &chunk) {
+  const FileRxTransfer &r = files.incoming(i);
+  uint32_t offset = (uint32_t)chunk.index * FILE_CHUNK_SIZE;
+  if (chunk.index >= r.chunks || chunk.len != (r.size - offset < FILE_CHUNK_SIZE ? r.size - offset : FILE_CHUNK_SIZE))
+    return false;
+  // Chunks arrive out of order after a loss; a gap before the offset reads as zeros until it is filled
+  File f = LittleFS.open(incomingPath(i, ".part"), "r+");
+  bool ok = f && f.seek(offset) && f.write(chunk.data, chunk.len) == chunk.len;
+  f.close();
+  if (!ok)
+    Serial.printf("[LoRa FILE] Writing chunk %u of %s failed\n", chunk.index, r.name);
+  return ok;
+}
+
+void LoRaRadio::finishIncoming(size_t i, float rssi, float snr) {
+  FileRxTransfer &r = files.incoming(i);
+  String part = incomingPath(i, ".part");
+
+  // Check the content against the id before the file shows up
+  uint32_t hash, size;
+  if (!hashFile(part.c_str(), hash, size) || size != r.size || hash != r.id) {
+    Serial.printf("[LoRa FILE] %s from %s failed the content check\n", r.name, nodeLabel(r.origin).c_str());
+    files.countCorrupt();
+    sendFileStatus(i, FILE_STATUS_CORRUPT);
+    dropIncoming(i);
+    return;
+  }
+
+  // Rename is atomic: LORA_FILE_DIR only ever holds complete files
+  String path = String(LORA_FILE_DIR "/") + r.name;
+  if (!LittleFS.exists(LORA_FILE_DIR))
+    LittleFS.mkdir(LORA_FILE_DIR);
+  if (!LittleFS.rename(part, path)) {
+    Serial.printf("[LoRa FILE] Cannot move %s into place\n", path.c_str());
+    return;
+  }
+  LittleFS.remove(incomingPath(i, ".map"));
+  r.done = true;
+  files.countReceived();
+  Serial.printf("[LoRa FILE] Received %s (%u B) from %s\n", path.c_str(), (unsigned)r.size, nodeLabel(r.origin).c_str());
+
+  String sender = nodeLabel(r.origin);
+  String content = "Bestand ontvangen: " + path + " (" + String(r.size) + " B)";
+  messageLog.append(millis(), sender.c_str(), sender.length(), content.c_str(), content.length(), rssi, snr, LORA_PKT_FILE);
+  messagesChanged = true;
+  sendFileStatus(i);
+}
+
+void LoRaRadio::sendFileStatus(size_t i, uint8_t flags) {
+  const FileRxTransfer &r = files.incoming(i);
+  // The bitmap goes to flash before the sender hears of it, so after a
+  // reboot we never claim a chunk we lack. Written aside and renamed, a
+  // reset halfway leaves the previous bitmap.
+  if (!r.done && !flags) {
+    uint8_t record[FILE_MAP_SIZE];
+    String next = incomingPath(i, ".new");
+    File map = LittleFS.open(next, FILE_WRITE);
+    bool ok = map && map.write(record, files.saveMap(i, record)) == FILE_MAP_SIZE;
+    map.close();
+    if (ok)
+      LittleFS.rename(next, incomingPath(i, ".map"));
+  }
+  uint8_t payload[FILE_STATUS_MAX];
+  sendFileFrame(r.origin, payload, files.status(i, payload, flags));
+}
+
+void LoRaRadio::dropIncoming(size_t i) {
+  LittleFS.remove(incomingPath(i, ".part"));
+  LittleFS.remove(incomingPath(i, ".map"));
+  files.removeIncoming(i);
+}
+
+// Outgoing transfers live in NVS, one record per slot; the bitmap does not,
+// the receiver reports it on the first offer after a reboot
+void LoRaRadio::loadFiles() {
+  uint8_t record[FILE_RECORD_MAX];
+  Preferences prefs;
+  prefs.begin("files", true);
+  size_t loaded = 0;
+  for (size_t i = 0; i < FILE_TX_SLOTS; i++) {
+    char key[4] = { 't', (char)('0' + i), 0 };
+    size_t len = prefs.getBytesLength(key);
+    if (len && len <= sizeof(record) && prefs.getBytes(key, record, len) == len && files.load(i, record, len, millis()))
+      loaded++;
+  }
+  prefs.end();
+  if (loaded)
+    Serial.printf("[LoRa FILE] %u file transfers resumed\n", (unsigned)loaded);
+}
+
+void LoRaRadio::saveFile(size_t i) {
+  uint8_t record[FILE_RECORD_MAX];
+  char key[4] = { 't', (char)('0' + i), 0 };
+  size_t len = files.save(i, record);
+  Preferences prefs;
+  prefs.begin("files", false);
+  if (prefs.putBytes(key, record, len) == len)
+    files.outgoing(i).saved = true;
+  prefs.end();
+}
+
+void LoRaRadio::releaseFile(size_t i) {
+  if (files.outgoing(i).saved) {
+    char key[4] = { 't', (char)('0' + i), 0 };
+    Preferences prefs;
+    prefs.begin("files", false);
+    prefs.remove(key);
+    prefs.end();
+  }
+  // Chunks still queued would only cost airtime
+  txQueue.removeTagged(0xFF00, FILE_TAG | (i << 8));
+  files.removeOutgoing(i);
 }
 
 // =======================
@@ -214,73 +1488,331 @@ String LoRaRadio::getNodeName() {
   return String("NODE_") + id;
 }
 
-String LoRaRadio::assembleFragment(const String &packet) {
-  int idx1 = packet.indexOf('[');
-  int idx2 = packet.indexOf(']');
-  if (idx1 != 0 || idx2 < 0)
-    return packet;
-
-  String header = packet.substring(1, idx2);
-  int sep1 = header.indexOf('|');
-  int sep2 = header.lastIndexOf('|');
-  if (sep1 < 0 || sep2 < 0 || sep1 == sep2)
-    return packet;
+uint32_t LoRaRadio::getNodeId() {
+  return nodeId;
+}
 
-  String msgID = header.substring(0, sep1);
-  int index = header.substring(sep1 + 1, sep2).toInt();
-  int total = header.substring(sep2 + 1).toInt();
-  String data = packet.substring(idx2 + 1);
+String LoRaRadio::nodeLabel(uint32_t id) {
+  auto it = nodeNames.find(id);
+  if (it != nodeNames.end())
+    return it->second;
+  char label[16];
+  snprintf(label, sizeof(label), "NODE_#%08X", (unsigned)id);
+  return String(label);
+}
 
-  fragmentBuffer[msgID][index] = { msgID, index, total, data, millis() };
+bool LoRaRadio::assembleFragment(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, AssembledMessage &out) {
+  const uint8_t *assembled = data;
+  size_t assembledLen = len;
+  if (hdr.fragCount > 1) {
+#if DEBUG_ENABLED
+    uint32_t recovered = reassembly.stats().recovered;
+    uint32_t cycles = ESP.getCycleCount();
+#endif
+    ReassemblyTable::Result result = reassembly.add(hdr.origin, hdr.seq, hdr.fragIndex, hdr.fragCount,
+                                                    data, len, millis(), assembled, assembledLen,
+                                                    hdr.flags & LORA_FLAG_REPAIR);
+#if DEBUG_ENABLED
+    if (reassembly.stats().recovered != recovered)
+      Serial.printf("[LoRa FEC] #%u from %08X rebuilt from repair fragments in %u cycles\n", hdr.seq, hdr.origin,
+                    ESP.getCycleCount() - cycles);
+#endif
+    if (result != ReassemblyTable::COMPLETE) {
+#if DEBUG_ENABLED
+      if (result == ReassemblyTable::REJECTED)
+        Serial.printf("[LoRa FRAG] Rejected fragment %u/%u of #%u\n", hdr.fragIndex + 1, hdr.fragCount, hdr.seq);
+#endif
+      return false;
+    }
+  }
 
-  String assembled;
-  for (int i = 1; i <= total; i++) {
-    if (fragmentBuffer[msgID].count(i) == 0)
-      return "";
-    assembled += fragmentBuffer[msgID][i].data;
+  if (hdr.flags & LORA_FLAG_COMPRESSED) {
+    size_t unpacked = codecDecompress(assembled, assembledLen, codecBuf, sizeof(codecBuf));
+    if (unpacked == 0) {
+      Serial.printf("[LoRa CODEC] Corrupt compressed message #%u from %08X\n", hdr.seq, hdr.origin);
+      return false;
+    }
+    assembled = codecBuf;
+    assembledLen = unpacked;
   }
 
-  fragmentBuffer.erase(msgID);
-  return assembled;
+  out.header = hdr;
+  out.header.fragIndex = 0;
+  out.header.beacon = nullptr;  // points into the received frame
+  out.header.beaconLen = 0;
+  out.payload = String((const char *)assembled, assembledLen);
+  return true;
 }
 
-std::map<String, NeighbourInfo> &LoRaRadio::getNeighbours() {
-  return neighbours;
+NeighbourView LoRaRadio::getNeighbours() {
+  return NeighbourView(neighbourSnap);
 }
-std::deque<ReceivedMessage> &LoRaRadio::getMessageLog() {
-  return messageLog;
+
+MessageLogView LoRaRadio::getMessageLog() {
+  return MessageLogView(messageSnap);
 }
 
-void LoRaRadio::loop() {
-  if (receivedFlag) {
-    receivedFlag = false;
-    handleReceive();
-    radio.startReceive();
+// Copy a changed container into its spare snapshot buffer; when a reader
+// still holds that buffer it stays marked and goes out on the next pass
+template <typename T>
+static void publishIfChanged(SnapshotBuffer<T> &snap, const T &live, bool &changed) {
+  if (!changed)
+    return;
+  T *next = snap.beginWrite();
+  if (!next)
+    return;
+  *next = live;
+  snap.publish();
+  changed = false;
+}
+
+void LoRaRadio::publishSnapshots() {
+  if (messageLog.trim(millis(), maxMessageAge))
+    messagesChanged = true;
+  if (rawLog.trim(millis(), maxMessageAge))
+    rawChanged = true;
+  publishIfChanged(neighbourSnap, neighbours, neighboursChanged);
+  publishIfChanged(messageSnap, messageLog, messagesChanged);
+  publishIfChanged(rawSnap, rawLog, rawChanged);
+  publishRoutes();
+  publishStatus();
+}
+
+void LoRaRadio::publishStatus() {
+  RadioStatus *s = statusSnap.beginWrite();
+  statusDeferred = s == nullptr;
+  if (!s)
+    return;
+  uint32_t now = millis();
+  s->airtime = { airtime.subBandName(), airtime.budgetMs(), airtime.usedMs(now), airtime.stats() };
+  s->tx = txQueue.stats();
+  s->txDepth = txQueue.size();
+  s->csma = csma.stats();
+  s->adr = adr.stats();
+  s->beacons = beaconTimer.stats();
+  s->routes = routes.stats();
+  s->outbox = outbox.stats();
+  s->custody = custody.stats();
+  s->reassembly = reassembly.stats();
+  s->flood = flood.stats();
+  s->files = files.stats();
+  s->loop = loopStats;
+  s->sleepers = sleepers.size(now);
+  s->routeCount = routes.size(now);
+  statusSnap.publish();
+}
+
+void LoRaRadio::publishRoutes() {
+  if (!routesChanged)
+    return;
+  RouteList *list = routeSnap.beginWrite();
+  if (!list)
+    return;
+  list->count = 0;
+  for (size_t i = 0; i < ROUTE_TABLE_SIZE; i++) {
+    const RouteEntry &r = routes.entry(i);
+    if (r.dest == 0 || r.metric >= ROUTE_METRIC_INFINITE)
+      continue;
+    RouteRow &row = list->rows[list->count++];
+    row.entry = r;
+    snprintf(row.dest, sizeof(row.dest), "%s", nodeLabel(r.dest).c_str());
+    snprintf(row.via, sizeof(row.via), "%s", nodeLabel(r.nextHop).c_str());
   }
+  routeSnap.publish();
+  routesChanged = false;
+}
 
-  if (millis() - lastBeacon > beaconInterval) {
-    sendBeacon(getNodeName());
-    lastBeacon = millis();
+void LoRaRadio::runTimer(uint8_t id) {
+  switch (id) {
+  case TIMER_TX_TIMEOUT:
+    // TX-done never came: reset the radio to RX instead of waiting forever
+    if (transmitting && millis() - txStartedAt > 2 * txAirtimeUs / 1000 + 1000) {
+      Serial.println("[LoRa TX] Timeout waiting for TX done");
+      finishTransmit(false);
+    }
+    break;
+  case TIMER_REASSEMBLY:
+    // Drop partial messages whose remaining fragments never arrived
+    reassembly.expire(millis());
+    break;
+  case TIMER_FLOOD: {
+    // Rebroadcasts whose random delay has elapsed
+    uint8_t frame[LORA_PACKET_MAX_SIZE];
+    size_t frameLen;
+    while (txQueue.freeSlots() > 0 && flood.popDue(millis(), frame, frameLen))
+      txQueue.push(frame, frameLen, txPriorityForType(frame[0] & 0x0F), millis());
+    break;
+  }
+  case TIMER_BEACON:
+    // Beacons back off while the neighbourhood is stable, see TrickleTimer.h
+    if (beaconTimer.poll(millis()))
+      sendBeacon(getNodeName());
+    break;
+  default:
+    break;
   }
+}
+
+void LoRaRadio::armTimers(uint32_t now) {
+  uint32_t at;
+  if (transmitting)
+    timers.arm(TIMER_TX_TIMEOUT, txStartedAt + 2 * txAirtimeUs / 1000 + 1001);
+  else
+    timers.cancel(TIMER_TX_TIMEOUT);
+
+  if (reassembly.nextExpiry(at))
+    timers.arm(TIMER_REASSEMBLY, at);
+  else
+    timers.cancel(TIMER_REASSEMBLY);
 
-  RadioMessage msg;
-  while (receiveFromQueue(msg))
+  if (outbox.nextDeadline(at))
+    timers.arm(TIMER_OUTBOX, at);
+  else
+    timers.cancel(TIMER_OUTBOX);
+
+  // Jobs that queue frames wait while the TX queue is full; the frame on air
+  // frees a slot and its TX done wakes the task anyway. Armed regardless they
+  // would be overdue and keep the task spinning.
+  if (txQueue.freeSlots() > 0 && flood.nextDue(at))
+    timers.arm(TIMER_FLOOD, at);
+  else
+    timers.cancel(TIMER_FLOOD);
+  if (txQueue.freeSlots() > 0)
+    timers.arm(TIMER_BEACON, beaconTimer.nextPoll());
+  else
+    timers.cancel(TIMER_BEACON);
+  if (txQueue.freeSlots() > 2 && custody.nextDue(at))
+    timers.arm(TIMER_CUSTODY, at);
+  else
+    timers.cancel(TIMER_CUSTODY);
+  if (txQueue.freeSlots() > 2 && airtime.pressure(now) <= LORA_FILE_MAX_PRESSURE && files.nextDeadline(at))
+    timers.arm(TIMER_FILES, at);
+  else
+    timers.cancel(TIMER_FILES);
+
+  if (followActive(now))
+    timers.arm(TIMER_FOLLOW, followUntil);
+  else
+    timers.cancel(TIMER_FOLLOW);
+  if (powerMode == POWER_SAVE && !radioDutyCycled && ackWindowOpen(now))
+    timers.arm(TIMER_ACK_WINDOW, ackWindowUntil);
+  else
+    timers.cancel(TIMER_ACK_WINDOW);
+
+  if (!transmitting && csma.backingOff())
+    timers.arm(TIMER_BACKOFF, csma.wakeAt());
+  else
+    timers.cancel(TIMER_BACKOFF);
+  if (!transmitting && lingering)
+    timers.arm(TIMER_LINGER, lingerUntil);
+  else
+    timers.cancel(TIMER_LINGER);
+
+  // Whatever is left in the queue while idle was deferred by the airtime budget
+  if (!transmitting && txQueue.size() > 0 && !timers.armed(TIMER_TX_RETRY))
+    timers.arm(TIMER_TX_RETRY, now + LORA_TX_RETRY_MS);
+  else if (transmitting || txQueue.size() == 0)
+    timers.cancel(TIMER_TX_RETRY);
+
+  if (neighboursChanged || messagesChanged || rawChanged || routesChanged || statusDeferred) {
+    timers.arm(TIMER_SNAPSHOTS, now + LORA_PUBLISH_RETRY_MS);
+  } else {
+    bool any = false;
+    if (messageLog.size()) {
+      at = messageLog.at(0).timestamp + maxMessageAge + 1;
+      any = true;
+    }
+    if (rawLog.size()) {
+      uint32_t t = rawLog.at(0).timestamp + maxMessageAge + 1;
+      if (!any || (int32_t)(t - at) < 0)
+        at = t;
+      any = true;
+    }
+    if (any)
+      timers.arm(TIMER_SNAPSHOTS, at);
+    else
+      timers.cancel(TIMER_SNAPSHOTS);
+  }
+}
+
+uint32_t LoRaRadio::loop() {
+  uint32_t startUs = micros();
+  loopStats.wakeups++;
+  if (dio1Flag) {
+    dio1Flag = false;
+    if (transmitting)
+      finishTransmit(true);
+    else {
+      handleReceive();
+      startReceive();
+    }
+  }
+
+  // Time-driven jobs whose deadline has passed, earliest first
+  uint8_t id;
+  while (timers.popDue(millis(), id)) {
+    loopStats.timers++;
+    runTimer(id);
+  }
+  applySettings();
+  float pressure = airtime.pressure(millis());
+
+  // Retransmission rounds and fragments of messages already accepted
+  feedOutbox();
+  serviceCustody();
+  if (pressure <= LORA_FILE_MAX_PRESSURE)
+    serviceFiles();
+
+  // New messages only when the outbox can take them; the rest waits in radioQueue
+  const RadioMessage *msg;
+  while (outbox.hasFreeSlot() && txQueue.freeSlots() > 2 && (msg = radioQueue.front()) != nullptr)
   {
-    if (msg.msgType == "msg") {
-      String rpiMsg = "[RPI4 MSG] From: " + msg.sender + " To: " + msg.receiver + " MsgID: " + msg.msgID + " Content: " + msg.content;
-  RPI4::sendToRPI4(rpiMsg);
+    if (msg->type == LORA_PKT_TABLE && pressure > 0.5) {
+      // A table is several low priority frames; skip it rather than starve game traffic
+      Serial.println("[LoRa TX] Duty cycle: neighbour table skipped");
+      radioQueue.pop();
+      continue;
     }
-    if (msg.msgType == "user") {
-      if (msg.content.indexOf(',') > 0)
-      {
-  User user = UserManager::deserializeUser(msg.content);
-  UserManager::addUserFromLoRa(user);
-        String rpiMsg = "[RPI4 USER] " + user.username + ", team: " + user.team + ", token: " + user.token;
-  RPI4::sendToRPI4(rpiMsg);
-      }
+    uint32_t dest = 0;
+    if (strcasecmp(msg->receiver, "GATEWAY") == 0)
+      dest = LORA_DEST_GATEWAY;
+    else if (msg->receiver[0] && strcmp(msg->receiver, "ALL") != 0)
+      dest = loraNodeHash(msg->receiver);
+    if (msg->type == LORA_PKT_FILE) {
+      char path[FILE_PATH_MAX + 2];
+      size_t n = msg->len < sizeof(path) - 1 ? msg->len : sizeof(path) - 1;
+      memcpy(path, msg->content, n);
+      path[n] = 0;
+      startFile(path, dest);
+      radioQueue.pop();
+      continue;
     }
-    if (msg.msgType == "file") {
-      // Handle file transfer messages here
+    String msgID = sendMessageWithAck(msg->content, msg->len, msg->type, dest);
+    if (msg->type == LORA_PKT_DATA) {
+      String rpiMsg = "[RPI4 MSG] From: " + getNodeName() + " To: " + String(msg->receiver) + " MsgID: " + msgID + " Content: " +
+                      String((const char *)msg->content, msg->len);
+      RPI4::sendToRPI4(rpiMsg);
     }
+    radioQueue.pop();
   }
+  // Fragments of what custody and radioQueue just handed over go out in this
+  // pass, not at the next wake
+  feedOutbox();
+
+  // One frame at a time; the radio is back in RX between frames. A pending
+  // DIO1 flag is a reception that must be read out first.
+  if (!transmitting && !dio1Flag)
+    startNextTransmit();
+
+  // Exchange over: listen at the base SF again. ACK window over: back to the duty cycle.
+  if (!transmitting && !dio1Flag && radioSf != spreadingFactor && !followActive(millis()))
+    startReceive();
+  else if (!transmitting && !dio1Flag && powerMode == POWER_SAVE && !radioDutyCycled && !ackWindowOpen(millis()))
+    startReceive();
+
+  publishSnapshots();
+
+  armTimers(millis());
+  loopStats.busyUs += micros() - startUs;
+  return timers.untilNext(millis(), LORA_MAX_SLEEP_MS);
 }
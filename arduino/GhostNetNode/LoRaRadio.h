@@ -3,43 +3,113 @@
 #include <RadioLib.h>
 #include <map>
 #include <deque>
-#include <set>
+#include <atomic>
+#include "LoRaPacket.h"
+#include "ReassemblyTable.h"
+#include "FloodControl.h"
+#include "TxQueue.h"
+#include "Outbox.h"
+#include "LinkAdr.h"
+#include "PayloadCodec.h"
+#include "RouteTable.h"
+#include "TrickleTimer.h"
+#include "RadioQueue.h"
+#include "SnapshotBuffer.h"
+#include "MessageRing.h"
+#include "CustodyStore.h"
+#include "TimerWheel.h"
+#include "PowerMode.h"
+#include "ChannelAccess.h"
+#include "FecCodec.h"
+#include "FileTransfer.h"
 
 // ============ Config =============
 #define LORA_CS 8
 #define LORA_RST 12
 #define LORA_BUSY 13
 #define LORA_DIO1 14
+#define LORA_FOLLOW_WINDOW_MS 3000  ///< Time spent on a neighbour's fast SF after the last exchange
+#define LORA_MESSAGE_LOG_BYTES 6144 ///< Arena of messageLog; each of its two snapshot buffers has one too
+#define LORA_RAW_LOG_BYTES 4096     ///< Arena of rawLog, about 70 bytes per frame
+#define LORA_MAX_SLEEP_MS 5000      ///< Longest sleep of the LoRa task, refreshes airtime status and route ages
+#define LORA_TX_RETRY_MS 1000       ///< Next admission check for frames deferred by the airtime budget
+#define LORA_PUBLISH_RETRY_MS 20    ///< Next try when a reader still held the spare snapshot buffer
+#define LORA_FILE_MAX_PRESSURE 0.5f ///< Duty-cycle pressure above which file transfers wait
+#define LORA_FILE_MARGIN_MS 2000    ///< Added to the round trip before a file round counts as unanswered
+#define LORA_FILE_DIR "/files"      ///< Received files
+#define LORA_FILE_RX_DIR "/rx"      ///< Temp files and bitmaps of incoming transfers
+#define LORA_LABEL_MAX 24           ///< Node names in the route snapshot, longer ones are cut
+#define LORA_BEACON_MAX_MS 4000     ///< Longest standalone beacon at the base SF; routes and links beyond it rotate
+#define LORA_BEACON_LINK_SHARE 40   ///< Percent of the beacon room the link report may take, routes get the rest
+#define LORA_BEACON_TTL_INTERVALS 5 ///< Links, routes and sleepers outlive this many beacon intervals at Imax
+#define LORA_BEACON_SETTLE_INTERVALS 3 ///< A route waits this many intervals at Imin for its next hop
+/// RX interrupts to latch: a detected preamble too, so CSMA can tell a frame is coming in
+#define LORA_RX_IRQ_FLAGS (RADIOLIB_IRQ_RX_DEFAULT_FLAGS | (1UL << RADIOLIB_IRQ_PREAMBLE_DETECTED))
 
 // ============ Structs ============
 struct NeighbourInfo {
   unsigned long lastSeen;
   float rssi;
   float snr;
+  uint8_t sf = 0;  ///< Unicast spreading factor agreed with this neighbour by ADR
 };
 
-struct ReceivedMessage {
-  unsigned long timestamp;
-  String sender;
-  String content;
-  float rssi;
-  float snr;
+typedef std::map<String, NeighbourInfo> NeighbourTable;
+typedef MessageRing MessageLog;
+typedef SnapshotBuffer<NeighbourTable>::Reader NeighbourView;
+typedef SnapshotBuffer<MessageLog>::Reader MessageLogView;
+
+struct AirtimeStatus {
+  const char *subBand;   ///< Active EU868 sub-band and its duty cycle
+  uint32_t budgetMs;     ///< Airtime allowed per rolling hour
+  uint32_t usedMs;       ///< Airtime used in the last hour
+  AirtimeStats stats;    ///< Deferred/dropped frames per priority
+};
+
+struct LoopStats {
+  uint32_t wakeups = 0;  ///< Passes through loop()
+  uint32_t timers = 0;   ///< Timers that fired
+  uint64_t busyUs = 0;   ///< Time spent in loop()
+};
+
+/// Counters of the LoRa task, published for the web page and the sketch
+struct RadioStatus {
+  AirtimeStatus airtime;
+  TxStats tx;
+  size_t txDepth;          ///< Frames waiting in the TX queue
+  CsmaStats csma;
+  AdrStats adr;
+  BeaconStats beacons;
+  RouteStats routes;
+  OutboxStats outbox;
+  CustodyStats custody;
+  ReassemblyStats reassembly;
+  FloodStats flood;
+  FileStats files;
+  LoopStats loop;
+  size_t sleepers;         ///< Neighbours that announced a duty-cycled receiver
+  size_t routeCount;       ///< Routes that have not timed out
 };
 
-struct Fragment {
-  String msgID;
-  int index;
-  int total;
-  String data;
-  unsigned long receivedAt;
+/// One route with the names of its destination and next hop
+struct RouteRow {
+  RouteEntry entry;
+  char dest[LORA_LABEL_MAX];
+  char via[LORA_LABEL_MAX];
 };
 
-struct RadioMessage {
-  String sender;
-  String receiver;
-  String msgID;
-  String msgType; // "MSG", "ACK", "BEACON"
-  String content;
+/// Routes in use, published for the web page
+struct RouteList {
+  RouteRow rows[ROUTE_TABLE_SIZE];
+  size_t count;
+};
+
+typedef SnapshotBuffer<RadioStatus>::Reader RadioStatusView;
+typedef SnapshotBuffer<RouteList>::Reader RouteView;
+
+struct AssembledMessage {
+  LoRaPacketHeader header;
+  String payload;
 };
 
 // ============ LoRaRadio Class ============
@@ -62,19 +132,38 @@ public:
   bool begin(float freq = 868.0, float bw = 125.0, int sf = 12, int cr = 8, byte syncWord = 0x56);
 
   /**
-   * @brief Main loop for radio operations. Should be called regularly.
+   * @brief Main loop for radio operations.
+   *
+   * Handles DIO1 (RX or TX done), queued messages and every timer that is
+   * due, then tells how long the task may sleep. The LoRa task blocks on its
+   * notification for that long: DIO1 and enqueueMessage() notify it, so it
+   * only wakes when there is work.
+   * @return Milliseconds until the next timer, at most LORA_MAX_SLEEP_MS; 0 to run again right away.
    */
-  void loop();
+  uint32_t loop();
 
   /**
    * @brief Send a message via LoRa, with fragmentation if needed. Returns msgID used.
+   *
+   * The message is kept in the outbox and missing fragments are resent until a
+   * neighbour ACKs all of them or the retries run out. Unicast messages follow
+   * the route table hop by hop (flooded while no route is known); a hop with
+   * a good link goes out at the SF agreed by ADR. Unless the first hop is the
+   * destination itself, a copy stays in custody until the destination
+   * confirms it, see CustodyStore.h.
    * @param msg Message to send.
-   * @return msgID used for tracking ACKs.
+   * @param type Packet type put in the frame header (LORA_PKT_*).
+   * @param dest Destination node hash, LORA_DEST_GATEWAY for the nearest gateway, 0 for broadcast.
+   * @return msgID used for tracking ACKs, empty if the message was not accepted.
    */
-  String sendMessageWithAck(const String &msg);
+  String sendMessageWithAck(const String &msg, uint8_t type = LORA_PKT_DATA, uint32_t dest = 0);
+  String sendMessageWithAck(const uint8_t *data, size_t len, uint8_t type = LORA_PKT_DATA, uint32_t dest = 0);
 
   /**
-   * @brief Send a beacon message with the node name.
+   * @brief Send a beacon with the node name, the ADR link report and the route advertisement.
+   *
+   * loop() sends these on the adaptive interval of TrickleTimer; when our own
+   * broadcast frames go out first, the beacon rides along on one of them.
    * @param nodeName Name of the node.
    */
   void sendBeacon(const String &nodeName);
@@ -91,42 +180,79 @@ public:
   String getNodeName();
 
   /**
-   * @brief Send a String message to the internal queue.
-   * @param msg Message to send.
-   * @return true if successful, false if queue is full or error occurred.
+   * @brief Get the 32-bit hash of the node name used as origin address on air.
+   * @return Node hash.
    */
+  uint32_t getNodeId();
 
-   bool sendToQueueString(const String &msgType, const String &msg);
   /**
-   * @brief Send a message to the internal queue.
-   * @param msg Message to send.
-   * @return true if successful, false if queue is full or error occurred.
+   * @brief Queue a message for the LoRa task.
+   * @param msgType "MSG", "USER", "TableNeighbours" or "FILE".
+   * @param msg Message to send; for "FILE" the LittleFS path of the file, see sendFile().
+   * @param receiver Node name, "GATEWAY" or "ALL".
+   * @return true if queued, false if the queue is full or the message does not fit.
    */
-  bool sendToQueue(RadioMessage rm);
+  bool sendToQueueString(const String &msgType, const String &msg, const String &receiver = "ALL");
+
   /**
-   * @brief Receive a message from the internal queue.
-   * @param msg Reference to store received message.
-   * @return true if a message was received, false otherwise.
+   * @brief Queue a file on LittleFS for one node. Safe from any task.
+   *
+   * The transfer is resumable and survives a reboot of either end; the
+   * receiver stores the file under LORA_FILE_DIR. See FileTransfer.h.
+   * @param path LittleFS path, at most FILE_PATH_MAX characters.
+   * @param receiver Node name.
+   * @return true if queued.
    */
-  bool receiveFromQueue(RadioMessage &msg);
+  bool sendFile(const String &path, const String &receiver);
 
   /**
-   * @brief Get the map of neighbours.
-   * @return Reference to neighbours map.
+   * @brief Queue a message for the LoRa task without allocating. Safe from any task.
+   *
+   * The LoRa task is woken right away and hands the message to the outbox as
+   * soon as it has room.
+   * @param type Packet type (LORA_PKT_DATA, LORA_PKT_USER, LORA_PKT_TABLE).
+   * @param content Message bytes, at most RADIO_MESSAGE_MAX.
+   * @param len Number of bytes.
+   * @param receiver Node name, "GATEWAY" or "ALL".
+   * @return RADIO_QUEUE_OK, or why the message was refused.
    */
-  static std::map<String, NeighbourInfo> &getNeighbours();
+  RadioQueueResult enqueueMessage(uint8_t type, const char *content, size_t len, const char *receiver = "ALL");
 
   /**
-   * @brief Get the log of received messages.
-   * @return Reference to message log deque.
+   * @brief Task that runs loop(); enqueueMessage() and DIO1 notify it.
    */
-  std::deque<ReceivedMessage> &getMessageLog();
+  void setConsumerTask(TaskHandle_t task);
 
   /**
-   * @brief Get the log of raw received messages.
-   * @return Reference to raw log deque.
+   * @brief Messages waiting for the LoRa task.
    */
-  std::deque<ReceivedMessage> &getRawLog();
+  size_t getMessageQueueDepth() const;
+  RadioQueueStats getMessageQueueStats() const;
+
+  /**
+   * @brief Snapshot of the neighbour table, safe to read from any task.
+   *
+   * loop() publishes a new version after a change; the view stays the same
+   * while it is held, so hold it only for one page or frame.
+   */
+  NeighbourView getNeighbours();
+
+  /**
+   * @brief Snapshot of the log of received messages, see getNeighbours().
+   */
+  MessageLogView getMessageLog();
+
+  /**
+   * @brief Snapshot of the log of raw received frames, see getNeighbours().
+   */
+  MessageLogView getRawLog();
+
+  /**
+   * @brief Snapshot of the counters of the LoRa task, see getNeighbours().
+   *
+   * Published on every pass through loop(); the counters are those of that pass.
+   */
+  RadioStatusView getStatus();
 
   /**
    * @brief Check if a message with given msgID has been ACKed.
@@ -135,31 +261,231 @@ public:
    */
   bool isAcked(const String &msgID);
 
+  /**
+   * @brief Delivery state of a message sent with sendMessageWithAck().
+   * @param msgID Message ID returned by sendMessageWithAck().
+   * @return PENDING while retrying, DELIVERED or FAILED for 10 minutes afterwards.
+   */
+  DeliveryState getDeliveryState(const String &msgID);
+
+  /**
+   * @brief Register a function called (from loop()) when a message is delivered or fails.
+   * @param cb Callback, nullptr to remove.
+   */
+  void setDeliveryCallback(DeliveryCallback cb);
+
+  /**
+   * @brief Snapshot of the routes in use with the names of their nodes, see getNeighbours().
+   */
+  RouteView getRoutes();
+
+  /**
+   * @brief Advertise this node as a gateway (Raspberry Pi attached). Stored in NVS.
+   *
+   * Any task; the LoRa task takes it over on its next pass through loop().
+   * @param gateway true for a gateway node.
+   */
+  void setGateway(bool gateway);
+  bool isGateway() const;
+
+  /**
+   * @brief Switch forward error correction on or off and store it in NVS.
+   *
+   * With FEC, fragmented messages get repair fragments; how many follows the
+   * link quality to the next hop, see FecPolicy. Any task, like setGateway().
+   */
+  void setFec(bool enabled);
+  bool isFecEnabled() const;
+
+  /**
+   * @brief Override the operating mode read from NVS, see PowerMode.h.
+   *
+   * Only for setup(), before the LoRa task runs; the saved mode is kept.
+   */
+  void setPowerMode(PowerMode mode);
+  PowerMode getPowerMode() const;
+
+  /**
+   * @brief Store the operating mode in NVS; it takes effect after a restart.
+   *
+   * WiFi, display and light sleep are set up by the sketch at boot, so the
+   * web page only saves the choice.
+   */
+  void savePowerMode(PowerMode mode);
+  PowerMode getSavedPowerMode() const;
+
+  /**
+   * @brief Back from ESP32 light sleep: re-attach DIO1 and pick up an interrupt that was missed.
+   * @param dio1High Level of the DIO1 pin; high means RX or TX done is pending.
+   */
+  void resumeAfterSleep(bool dio1High);
+
   void logoutHandler();
 
+  /// Radio served by the DIO1 interrupt, set by begin(). There is one radio
+  /// on the board; the host simulator points it at the node it is running.
+  static LoRaRadio *dio1Target;
+
 private:
   SX1262 radio;  ///< RadioLib SX1262 radio instance
-  static void IRAM_ATTR onReceiveStatic();
+  static void IRAM_ATTR onDio1Static();
   void handleReceive();
-  String assembleFragment(const String &packet);
+  void handleFrame(uint8_t *frame, size_t len, float rssi, float snr, bool batched);
+  bool assembleFragment(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, AssembledMessage &out);
+  void handleMessage(const AssembledMessage &msg, float rssi, float snr);
+  bool transmitPacket(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len, uint16_t tag = 0, uint32_t peer = 0);
+  void feedOutbox();
+  void startNextTransmit();
+  TxFrame *selectFrame();
+  size_t buildBatch(TxFrame **frames, size_t count, uint8_t *out);
+  void finishTransmit(bool ok);
+  uint8_t frameSf(const TxFrame &frame, uint32_t now) const;
+  uint16_t framePreamble(const TxFrame &frame, uint8_t sf, uint32_t now) const;
+  bool ackWindowOpen(uint32_t now) const;
+  bool followActive(uint32_t now) const;
+  void follow(uint32_t peer, uint8_t sf, uint32_t now);
+  void tuneRadio(uint8_t sf);
+  void startReceive();
+  void sendAck(uint32_t origin, uint16_t seq, uint32_t bitmap);
+  uint32_t ackBitmap(const LoRaPacketHeader &hdr);
+  void handleBeaconSections(uint32_t origin, const uint8_t *data, size_t len);
+  void handlePiggyback(uint32_t origin, const uint8_t *data, size_t len);
+  size_t buildBeacon(const String &nodeName, uint8_t *out);
+  void topologyChanged();
+  void applyRoute(LoRaPacketHeader &hdr);
+  uint8_t repairFragments(uint32_t dest, size_t len);
+  void forwardRouted(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len);
+  void scheduleForward(const LoRaPacketHeader &hdr, uint8_t *frame, size_t len);
+  void publishSnapshots();
+  void publishStatus();
+  void publishRoutes();
+  void applySettings();
+
+  /**
+   * @brief Resolve an origin hash to a node name learned from beacons. LoRa task only.
+   * @param id Origin hash from a frame header.
+   * @return Node name, or "NODE_#xxxxxxxx" if the node has not beaconed yet.
+   */
+  String nodeLabel(uint32_t id);
+  void runTimer(uint8_t id);
+  void armTimers(uint32_t now);
+  void serviceCustody();
+  void handleCustody(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len);
+  void sendCustodyFrame(uint32_t dest, const uint8_t *payload, size_t len);
+  void loadCustody();
+  void saveCustody(size_t i);
+  void releaseCustody(size_t i);
+  void frameDone(uint16_t tag, uint32_t now);
+  void startFile(const char *path, uint32_t dest);
+  void serviceFiles();
+  void sendFileStep(const FileStep &step);
+  void sendFileFrame(uint32_t dest, const uint8_t *payload, size_t len, uint16_t tag = 0);
+  void handleFile(const LoRaPacketHeader &hdr, const uint8_t *payload, size_t len, float rssi, float snr);
+  void openIncoming(size_t i);
+  bool writeChunk(size_t i, const FileFrame &chunk);
+  void finishIncoming(size_t i, float rssi, float snr);
+  void sendFileStatus(size_t i, uint8_t flags = 0);
+  void dropIncoming(size_t i);
+  String incomingPath(size_t i, const char *ext);
+  uint32_t fileStatusTimeoutMs();
+  void loadFiles();
+  void saveFile(size_t i);
+  void releaseFile(size_t i);
+
+  /// Timers in the wheel. Those without a job of their own only wake the
+  /// task; the pass through loop() does what they stand for.
+  enum LoopTimer : uint8_t {
+    TIMER_TX_TIMEOUT,  ///< TX done is overdue
+    TIMER_REASSEMBLY,  ///< A partial message expires
+    TIMER_FLOOD,       ///< A rebroadcast delay ends
+    TIMER_BEACON,      ///< Beacon due or Trickle interval over
+    TIMER_OUTBOX,      ///< Retransmission timeout
+    TIMER_CUSTODY,     ///< Custody offer due or entry expired
+    TIMER_FILES,       ///< File status overdue or a paused transfer resumes
+    TIMER_FOLLOW,      ///< ADR exchange over, back to the base SF
+    TIMER_ACK_WINDOW,  ///< POWER_SAVE: back to the RX duty cycle
+    TIMER_TX_RETRY,    ///< Frames wait for airtime budget
+    TIMER_BACKOFF,     ///< Listen-before-talk backoff over, run the CAD
+    TIMER_LINGER,      ///< The next frame waited long enough for others to batch with
+    TIMER_SNAPSHOTS    ///< Log entries age out or a publish has to be retried
+  };
 
   // Buffers
-  volatile bool receivedFlag = false;                        ///< Flag for received interrupt
-  std::map<String, std::map<int, Fragment>> fragmentBuffer;  ///< Fragment buffer for assembling messages
-  static std::map<String, NeighbourInfo> neighbours;         ///< Map of neighbours (now static)
-  std::deque<ReceivedMessage> messageLog;                    ///< Log of received messages
-  std::deque<ReceivedMessage> rawLog;                        ///< Log of all raw messages
+  volatile bool dio1Flag = false;                            ///< Set by DIO1: RX done or TX done
+  TimerWheel timers;                                         ///< Deadlines of the jobs above
+  LoopStats loopStats;
+  ReassemblyTable reassembly;                                ///< Fixed slots for assembling fragmented messages
+  FloodControl flood;                                        ///< Seen cache and delayed rebroadcasts
+  TxQueue txQueue;                                           ///< Frames waiting for the transmitter
+  AirtimeBudget airtime;                                     ///< EU868 duty-cycle accounting
+  Outbox outbox;                                             ///< Own messages until ACKed or given up
+  LinkAdr adr;                                               ///< Per-neighbour SNR and spreading factor
+  RouteTable routes;                                         ///< Next hops learned from beacons
+  TrickleTimer beaconTimer;                                  ///< Adaptive beacon interval
+  CustodyStore custody;                                      ///< Own unicast messages until the destination has them
+  FileTransfer files;                                        ///< Files going out and coming in
+  SleeperTable sleepers;                                     ///< Neighbours with a duty-cycled receiver
+  ChannelAccess csma;                                        ///< CAD and backoff before each frame
+  FecPolicy fecPolicy;                                       ///< Repair fragments per link quality
+  PowerMode powerMode = POWER_ALWAYS_ON;
+  std::atomic<bool> gatewayWanted{false};                    ///< From setGateway(), applied by loop()
+  std::atomic<bool> fecWanted{false};                        ///< From setFec(), applied by loop()
+
+  // Transmitter state: at most one frame on air, radio is in RX otherwise
+  bool transmitting = false;
+  uint32_t txQueuedAt = 0;   ///< Enqueue time of the frame on air
+  uint32_t txStartedAt = 0;  ///< startTransmit() time of the frame on air
+  uint32_t txAirtimeUs = 0;  ///< Expected time on air of the frame on air
+  uint16_t txTags[TX_BATCH_MAX] = {};  ///< Outbox tags of the frames in the frame on air
+  uint8_t txPackets = 0;     ///< Queued frames in the frame on air, more than 1 for a batch
+  uint32_t lingerUntil = 0;  ///< The next frame waits for others to batch with until then
+  bool lingering = false;
+  uint32_t rxPreambleAt = 0; ///< CSMA first saw a preamble without a header then, 0 if none
+  uint32_t txPeer = 0;       ///< Unicast neighbour of the frame on air
+  uint8_t txNextSf = 0;      ///< SF extension of the frame on air
+
+  // ADR rendezvous: broadcast and the first frame of a unicast exchange use the
+  // base SF; a frame with an SF extension moves both ends to the fast SF until
+  // the exchange has been quiet for LORA_FOLLOW_WINDOW_MS
+  uint8_t radioSf = 12;       ///< SF the radio is configured for
+  uint16_t radioPreamble = POWER_DEFAULT_PREAMBLE;  ///< TX preamble the radio is configured for
+  bool radioDutyCycled = false;  ///< Receiving with the RX duty cycle
+  uint32_t ackWindowUntil = 0;   ///< POWER_SAVE: continuous RX after our own frame until then
+  uint32_t followPeer = 0;    ///< Neighbour of the current exchange, 0 if none
+  uint8_t followSf = 0;
+  uint32_t followUntil = 0;
+  NeighbourTable neighbours;                                 ///< Map of neighbours
+  MessageLog messageLog;                                     ///< Log of received messages
+  MessageLog rawLog;                                         ///< Log of all raw messages
+  // Published copies of the three above, the routes and the counters for the web and display tasks
+  SnapshotBuffer<NeighbourTable> neighbourSnap;
+  SnapshotBuffer<MessageLog> messageSnap;
+  SnapshotBuffer<MessageLog> rawSnap;
+  SnapshotBuffer<RadioStatus> statusSnap;
+  SnapshotBuffer<RouteList> routeSnap;
+  bool neighboursChanged = false;
+  bool messagesChanged = false;
+  bool rawChanged = false;
+  bool routesChanged = false;   ///< Routes or the names of their nodes changed
+  bool statusDeferred = false;  ///< A reader held the spare status buffer
+  std::map<uint32_t, String> nodeNames;                      ///< Origin hash -> node name, learned from beacons
+
+  RadioQueue radioQueue;               ///< Messages from other tasks, see RadioQueue.h
+  TaskHandle_t consumerTask = nullptr; ///< Woken when a message is queued
+  uint8_t codecBuf[CODEC_MAX_SIZE];    ///< Compression scratch, too big for the task stack
 
-  QueueHandle_t radioQueue = nullptr;  ///< FreeRTOS queue for RadioMessage
+  // Identity
+  uint32_t nodeId = 0;   ///< Hash of getNodeName()
+  uint16_t nextSeq = 0;  ///< Sequence number for the next originated message
 
-  // ACK tracking
-  std::map<String, unsigned long> pendingAcks;  ///< msgID -> timestamp sent
-  std::set<String> receivedAcks;                ///< msgIDs for which ACK was received
+  // Modem settings from begin()
+  float bandwidth = 125.0;
+  uint8_t spreadingFactor = 12;
+  uint8_t codingRate = 8;
+  size_t beaconMaxLen = LORA_PACKET_MAX_PAYLOAD;  ///< Beacon payload within LORA_BEACON_MAX_MS
 
   // Settings
-  unsigned long lastBeacon = 0;
-  const unsigned long beaconInterval = 30000;
-  const size_t maxFragmentSize = 80;
+  const size_t maxFragmentSize = REASSEMBLY_FRAGMENT_SIZE;
   const size_t maxMessageCount = 100;
   const unsigned long maxMessageAge = 5 * 60 * 1000;
 };
@@ -11,6 +11,50 @@
 #include <LittleFS.h>
 
 static DNSServer dnsServer;
+static LiveFeed *deliveryFeed = nullptr;
+
+// Called on the LoRa task; the web server task turns it into an event
+static void onDelivery(uint16_t seq, DeliveryState state)
+{
+  if (deliveryFeed)
+    deliveryFeed->notify(seq, state);
+}
+
+// Frees the feed slot when AsyncWebServer deletes the response
+struct LiveSession
+{
+  LiveFeed &feed;
+  int slot;
+  LiveSession(LiveFeed &feed, int slot) : feed(feed), slot(slot) {}
+  ~LiveSession() { feed.detach(slot); }
+};
+
+// Keeps the message log and the neighbour table of the page current. What
+// the feed missed (before it opened, or after a reset) comes from the JSON
+// API, which is also polled when the feed is full; a restarted node reloads
+// the page.
+static const char LIVE_SCRIPT[] =
+    "var log=document.getElementById('log'),nb=document.getElementById('nb');"
+    "function msg(m){if(!log||m.n<next)return;next=m.n+1;var li=document.createElement('li');"
+    "li.textContent='['+m.timestamp+'] '+m.sender+': '+m.content+' (RSSI='+m.rssi.toFixed(1)+', SNR='+m.snr.toFixed(1)+')';"
+    "if(log.dataset.oldest)log.appendChild(li);else log.insertBefore(li,log.firstChild);}"
+    "function node(n){if(!nb)return;var r=document.getElementById('nb-'+n.node);"
+    "if(n.gone){if(r)r.remove();return;}"
+    "if(!r){r=nb.insertRow();r.id='nb-'+n.node;for(var i=0;i<5;i++)r.insertCell();r.cells[0].textContent=n.node;}"
+    "r.cells[1].textContent=n.age||0;r.cells[2].textContent=n.rssi.toFixed(1);r.cells[3].textContent=n.snr.toFixed(1);r.cells[4].textContent=n.sf||'-';}"
+    "function resync(){poll(false);if(nb)fetch('/neighbours.json').then(function(r){return r.json();}).then(function(d){var seen={};"
+    "d.neighbours.forEach(function(n){n.age=Math.floor((d.uptime-n.lastSeen)/1000);seen['nb-'+n.node]=1;node(n);});"
+    "[].slice.call(nb.rows,1).forEach(function(r){if(!seen[r.id])r.remove();});}).catch(function(){});}"
+    "function poll(again){fetch('/messages.json?since='+next).then(function(r){return r.json();})"
+    ".then(function(d){if(d.next<next)location.reload();d.messages.forEach(msg);}).catch(function(){})"
+    ".then(function(){if(again)setTimeout(function(){poll(true);},5000);});}"
+    "var es=new EventSource('/events');"
+    "es.onopen=function(){poll(false);};"
+    "es.addEventListener('msg',function(e){msg(JSON.parse(e.data));});"
+    "es.addEventListener('nb',function(e){node(JSON.parse(e.data));});"
+    "es.addEventListener('reset',resync);"
+    "es.onerror=function(){if(es.readyState==2)poll(true);};"
+    "</script>";
 
 LoRaWeb::LoRaWeb(LoRaRadio &radioRef)
     : radio(radioRef), server(80)
@@ -55,111 +99,637 @@ bool LoRaWeb::requireLogin(AsyncWebServerRequest *request)
   return true;
 }
 
-String LoRaWeb::rootHTML(String session)
+void LoRaWeb::addRoot(PageStream &page, const String &session)
 {
-  String html = "<h1>GhostNet Node</h1>";
-  if (session == "")
-  {
-    html += "<h2>Welkom</h2><a href='/login'>Login</a>";
-  }
-  else
-  {
-    html += "<h2>Welkom</h2> " + UserManager::getNameAndTeamByToken(session);
-    html += " <a href='/logout'>Logout</a>";
-  }
+  page.add(PageStream::once([session]() {
+    String html = "<h1>GhostNet Node</h1>";
+    if (session == "")
+    {
+      html += "<h2>Welkom</h2><a href='/login'>Login</a>";
+    }
+    else
+    {
+      html += "<h2>Welkom</h2> " + UserManager::getNameAndTeamByToken(session);
+      html += " <a href='/logout'>Logout</a>";
+    }
+    return html;
+  }));
 
-  html += this->userListHtml();
+  addUserList(page);
 
-  html += "<nav>";
-  html += "<a href='/adduser'>Add User</a> | ";
-  html += "<a href='/upload'>Upload Image</a> | ";
-  html += "<a href='/messages'>Messages</a> | ";
-  html += "<a href='/raw'>Raw</a> | ";
-  html += "<a href='/messages.json'>Messages JSON</a> | ";
-  html += "<a href='/raw.json'>Raw JSON</a>";
-  html += "</nav><br><br>";
-  return html;
+  page.add("<nav>"
+           "<a href='/adduser'>Add User</a> | "
+           "<a href='/upload'>Upload Image</a> | "
+           "<a href='/files'>Files</a> | "
+           "<a href='/messages'>Messages</a> | "
+           "<a href='/raw'>Raw</a> | "
+           "<a href='/messages.json'>Messages JSON</a> | "
+           "<a href='/raw.json'>Raw JSON</a> | "
+           "<a href='/neighbours.json'>Neighbours JSON</a> | "
+           "<a href='/users.json'>Users JSON</a>"
+           "</nav><br><br>");
+}
+
+void LoRaWeb::sendPage(AsyncWebServerRequest *request, std::shared_ptr<PageStream> page, const char *contentType, const String &etag)
+{
+  // Chunked: the page is rendered while the TCP buffer drains, never as a whole
+  AsyncWebServerResponse *response = request->beginChunkedResponse(contentType, [page](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    (void)index;
+    return page->fill(buffer, maxLen);
+  });
+  if (etag.length())
+  {
+    response->addHeader("ETag", etag);
+    // Ask again every time; an unchanged version costs a 304 without a body
+    response->addHeader("Cache-Control", "no-cache");
+  }
+  request->send(response);
 }
 
 // =======================
 // LoRa functies
 // =======================
 
-void LoRaWeb::loraSendTable()
+RadioQueueResult LoRaWeb::loraSendTable()
 {
 
   String nodeName = radio.getNodeName();
   String tableMsg = "TABLE van " + nodeName + " (" + String(GAMEVERSION) + "):\n";
-  auto &neighbours = radio.getNeighbours();
-  for (auto &kv : neighbours)
+  NeighbourView neighbours = radio.getNeighbours();
+  for (auto &kv : *neighbours)
   {
     unsigned long age = (millis() - kv.second.lastSeen) / 1000;
-    tableMsg += "Node: " + kv.first +
-                " | Laatst: " + String(age) + "s" +
-                " | RSSI: " + String(kv.second.rssi, 1) +
-                " | SNR: " + String(kv.second.snr, 1) + "\n";
+    String row = "Node: " + kv.first +
+                 " | Laatst: " + String(age) + "s" +
+                 " | RSSI: " + String(kv.second.rssi, 1) +
+                 " | SNR: " + String(kv.second.snr, 1) + "\n";
+    if (tableMsg.length() + row.length() > RADIO_MESSAGE_MAX)
+      break;  // the rest does not fit in one radioQueue slot
+    tableMsg += row;
   }
 
-  radio.sendToQueueString("TableNeighbours", tableMsg);
+  return radio.enqueueMessage(LORA_PKT_TABLE, tableMsg.c_str(), tableMsg.length());
 }
 
 void LoRaWeb::handleSendTable(AsyncWebServerRequest *request)
 {
-  loraSendTable();
+  sendQueueResult(request, loraSendTable());
+}
+
+void LoRaWeb::handleGateway(AsyncWebServerRequest *request)
+{
+  if (!requireLogin(request)) return;
+  radio.setGateway(request->hasParam("gateway", true));
+  request->redirect("/admin");
+}
+
+void LoRaWeb::handleFec(AsyncWebServerRequest *request)
+{
+  if (!requireLogin(request)) return;
+  radio.setFec(request->hasParam("fec", true));
   request->redirect("/admin");
 }
 
+void LoRaWeb::handlePower(AsyncWebServerRequest *request)
+{
+  if (!requireLogin(request)) return;
+  radio.savePowerMode(request->hasParam("powersave", true) ? POWER_SAVE : POWER_ALWAYS_ON);
+  request->redirect("/admin");
+}
+
+void LoRaWeb::handleMessageHistory(AsyncWebServerRequest *request)
+{
+  // One page from the journal, newest first: ?before=<seq>&sender=<name>&limit=N.
+  // next is the before of the older page, 0 at the oldest record.
+  uint32_t before = request->hasParam("before") ? strtoul(request->getParam("before")->value().c_str(), nullptr, 10) : 0;
+  long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 20;
+  limit = constrain(limit, 1, 50);
+  String sender = request->hasParam("sender") ? request->getParam("sender")->value() : String("");
+
+  // Every append moves nextSeq, also the one that drops the oldest segment
+  String etag = jsonTag("j" + String(journal.nextSeq()));
+  if (notModified(request, etag))
+    return;
+
+  // The rows come one record at a time, so the cursor goes after them
+  auto cursor = std::make_shared<uint32_t>(before);
+  auto page = std::make_shared<PageStream>();
+  page->add(PageStream::once([this]() -> String {
+    return "{\"boot\":" + String(boot) + ",\"messages\":[";
+  }));
+  page->add([this, cursor, limit, sender](size_t step, String &out) {
+    if ((long)step >= limit || (step && *cursor == 0))
+      return false;
+    std::vector<JournalRecord> one;
+    uint32_t next = journal.read(*cursor, 1, sender.c_str(), one);
+    if (one.empty())
+    {
+      *cursor = 0;
+      return false;
+    }
+    *cursor = next;
+    const JournalRecord &r = one.front();
+    StaticJsonDocument<JSON_OBJECT_SIZE(7)> doc;
+    doc["n"] = r.seq;
+    doc["boot"] = r.boot;
+    doc["timestamp"] = r.ms;
+    doc["sender"] = r.sender.c_str();
+    doc["content"] = r.content.c_str();
+    doc["rssi"] = r.rssi;
+    doc["snr"] = r.snr;
+    if (step)
+      out += ',';
+    serializeJson(doc, out);
+    return true;
+  });
+  page->add(PageStream::once([cursor]() -> String {
+    return "],\"next\":" + String(*cursor) + ",\"more\":" + (*cursor ? "true" : "false") + "}";
+  }));
+  sendPage(request, page, "application/json", etag);
+}
+
+String LoRaWeb::jsonTag(const String &state)
+{
+  // Weak: the body may differ in ages and uptime while the data is the same
+  return "W/\"" + String(boot) + "-" + state + "\"";
+}
+
+bool LoRaWeb::notModified(AsyncWebServerRequest *request, const String &etag)
+{
+  if (!request->hasHeader("If-None-Match") || request->header("If-None-Match") != etag)
+    return false;
+  AsyncWebServerResponse *response = request->beginResponse(304);
+  response->addHeader("ETag", etag);
+  request->send(response);
+  return true;
+}
+
+// One entry of a JSON log list; the text goes straight from the snapshot into the row
+static void logEntryJson(String &out, const LogEntry &m, uint32_t number, size_t step)
+{
+  StaticJsonDocument<JSON_OBJECT_SIZE(6)> doc;
+  doc["n"] = number;
+  doc["timestamp"] = m.timestamp;
+  doc["sender"] = m.sender;
+  doc["content"] = m.content;
+  doc["rssi"] = m.rssi;
+  doc["snr"] = m.snr;
+  if (step)
+    out += ',';
+  serializeJson(doc, out);
+}
+
+void LoRaWeb::handleLogJson(AsyncWebServerRequest *request, bool raw)
+{
+  // ?since=<n>&limit=N: entries from running number n on, oldest first, and
+  // the cursor for the next poll. Without either the whole log, newest first.
+  uint32_t first, end;
+  {
+    MessageLogView log = raw ? radio.getRawLog() : radio.getMessageLog();
+    first = log->firstNumber();
+    end = first + log->size();
+  }
+  String state = String(raw ? "r" : "m") + String(first) + "-" + String(end);
+  if (!request->hasParam("since") && !request->hasParam("limit"))
+  {
+    String etag = jsonTag(state);
+    if (notModified(request, etag))
+      return;
+    auto page = std::make_shared<PageStream>();
+    page->add("[");
+    addLogRows(*page, raw, end - 1, end - first, true, logEntryJson);
+    page->add("]");
+    sendPage(request, page, "application/json", etag);
+    return;
+  }
+
+  uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : first;
+  long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : WEB_JSON_LIMIT;
+  limit = constrain(limit, 1, WEB_JSON_LIMIT_MAX);
+  // Evicted entries are skipped (first tells the client); a cursor past the
+  // end comes from before a reboot (boot tells the client)
+  if ((int32_t)(since - first) < 0 || (int32_t)(end - since) < 0)
+    since = first;
+  uint32_t count = min(end - since, (uint32_t)limit);
+  // A client at the head polls the same URL until something new comes in
+  String etag = jsonTag(state + "-" + String(since) + "-" + String(count));
+  if (notModified(request, etag))
+    return;
+  auto page = std::make_shared<PageStream>();
+  page->add(PageStream::once([this, first, since, count, end]() -> String {
+    return "{\"boot\":" + String(boot) + ",\"first\":" + String(first) + ",\"next\":" + String(since + count) +
+           ",\"more\":" + (since + count != end ? "true" : "false") + ",\"messages\":[";
+  }));
+  addLogRows(*page, raw, since, count, false, logEntryJson);
+  page->add("]}");
+  sendPage(request, page, "application/json", etag);
+}
+
+void LoRaWeb::handleNeighboursJson(AsyncWebServerRequest *request)
+{
+  String etag = jsonTag("n" + String(radio.getNeighbours().version()));
+  if (notModified(request, etag))
+    return;
+
+  // lastSeen is in the node's millis(), uptime says where that clock was
+  auto page = std::make_shared<PageStream>();
+  page->add(PageStream::once([this]() -> String {
+    return "{\"boot\":" + String(boot) + ",\"uptime\":" + String(millis()) + ",\"neighbours\":[";
+  }));
+  String last;
+  page->add([this, last](size_t step, String &out) mutable {
+    NeighbourView neighbours = radio.getNeighbours();
+    auto it = step ? neighbours->upper_bound(last) : neighbours->begin();
+    if (it == neighbours->end())
+      return false;
+    last = it->first;
+    StaticJsonDocument<JSON_OBJECT_SIZE(5)> doc;
+    doc["node"] = it->first.c_str();
+    doc["lastSeen"] = it->second.lastSeen;
+    doc["rssi"] = it->second.rssi;
+    doc["snr"] = it->second.snr;
+    doc["sf"] = it->second.sf;
+    if (step)
+      out += ',';
+    serializeJson(doc, out);
+    return true;
+  });
+  page->add("]}");
+  sendPage(request, page, "application/json", etag);
+}
+
+void LoRaWeb::handleUsersJson(AsyncWebServerRequest *request)
+{
+  String etag = jsonTag("u" + String(UserManager::version));
+  if (notModified(request, etag))
+    return;
+
+  // Users are only ever appended, so the index is the cursor: ?since=<n>&limit=N
+  int since = request->hasParam("since") ? request->getParam("since")->value().toInt() : 0;
+  long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : MAX_USERS;
+  since = constrain(since, 0, UserManager::userCount);
+  int end = min(since + (int)constrain(limit, 1, MAX_USERS), UserManager::userCount);
+  auto page = std::make_shared<PageStream>();
+  page->add(PageStream::once([this, end]() -> String {
+    return "{\"boot\":" + String(boot) + ",\"next\":" + String(end) +
+           ",\"more\":" + (end < UserManager::userCount ? "true" : "false") + ",\"users\":[";
+  }));
+  page->add([since, end](size_t step, String &out) {
+    int i = since + (int)step;
+    if (i >= end || i >= UserManager::userCount)
+      return false;
+    StaticJsonDocument<JSON_OBJECT_SIZE(3)> doc;
+    doc["n"] = i;
+    doc["username"] = UserManager::users[i].username.c_str();
+    doc["team"] = UserManager::users[i].team.c_str();
+    if (step)
+      out += ',';
+    serializeJson(doc, out);
+    return true;
+  });
+  page->add("]}");
+  sendPage(request, page, "application/json", etag);
+}
+
+void LoRaWeb::updateLive()
+{
+  // Runs on the web server task (the /events handler and the feeds' fill
+  // callbacks), so the feed needs no lock; the radio only hands over
+  // delivery results. With nobody listening the positions just move on.
+  uint32_t now = millis();
+  if (now - liveUpdatedAt < WEB_LIVE_UPDATE_MS)
+    return;
+  liveUpdatedAt = now;
+  bool listening = live.connected() > 0;
+
+  // Delivery results were lost while the queue was full: the pages reload
+  // their state from the JSON API, which also covers the results still queued
+  LiveNotice notice;
+  uint32_t lost = live.stats().noticesLost;
+  if (lost != liveNoticesLost)
+  {
+    liveNoticesLost = lost;
+    while (live.takeNotice(notice))
+      ;
+    if (listening)
+      live.publish("reset", "{}", 2);
+  }
+
+  for (int i = 0; i < WEB_LIVE_NOTICES && live.takeNotice(notice); i++)
+  {
+    if (!listening)
+      continue;
+    String data = "{\"id\":" + String(notice.seq) + ",\"state\":\"" + (notice.state == DELIVERY_DELIVERED ? "delivered" : "failed") + "\"}";
+    live.publish("dlv", data.c_str(), data.length());
+  }
+
+  {
+    MessageLogView log = radio.getMessageLog();
+    uint32_t first = log->firstNumber();
+    size_t i = (int32_t)(liveMessages - first) > 0 ? liveMessages - first : 0;
+    for (; listening && i < log->size(); i++)
+    {
+      LogEntry m = log->at(i);
+      if (m.type == LORA_PKT_BEACON)
+        continue;
+      String data;
+      logEntryJson(data, m, first + i, 0);
+      live.publish("msg", data.c_str(), data.length());
+    }
+    liveMessages = first + log->size();
+  }
+
+  NeighbourView neighbours = radio.getNeighbours();
+  if (neighbours.version() == liveNeighbourVersion || !listening)
+    return;
+  liveNeighbourVersion = neighbours.version();
+  // Only new and lost neighbours and real changes; lastSeen moves with every frame
+  for (auto &kv : *neighbours)
+  {
+    auto old = liveNeighbours.find(kv.first);
+    if (old != liveNeighbours.end() && old->second.sf == kv.second.sf &&
+        fabsf(old->second.rssi - kv.second.rssi) < WEB_LIVE_SIGNAL_STEP && fabsf(old->second.snr - kv.second.snr) < WEB_LIVE_SIGNAL_STEP)
+      continue;
+    liveNeighbours[kv.first] = kv.second;
+    StaticJsonDocument<JSON_OBJECT_SIZE(4)> doc;
+    doc["node"] = kv.first.c_str();
+    doc["rssi"] = kv.second.rssi;
+    doc["snr"] = kv.second.snr;
+    doc["sf"] = kv.second.sf;
+    String data;
+    serializeJson(doc, data);
+    live.publish("nb", data.c_str(), data.length());
+  }
+  for (auto it = liveNeighbours.begin(); it != liveNeighbours.end();)
+  {
+    if (neighbours->count(it->first))
+    {
+      ++it;
+      continue;
+    }
+    StaticJsonDocument<JSON_OBJECT_SIZE(2)> doc;
+    doc["node"] = it->first.c_str();
+    doc["gone"] = true;
+    String data;
+    serializeJson(doc, data);
+    live.publish("nb", data.c_str(), data.length());
+    it = liveNeighbours.erase(it);
+  }
+}
+
+void LoRaWeb::handleEvents(AsyncWebServerRequest *request)
+{
+  if (!requireLogin(request)) return;
+  updateLive();
+  String lastId = request->hasHeader("Last-Event-ID") ? request->header("Last-Event-ID") : String("");
+  int slot = live.attach(lastId.length() ? lastId.c_str() : nullptr, millis());
+  if (slot < 0)
+  {
+    // Every feed is taken: the page polls the JSON API instead
+    AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Live feed vol");
+    response->addHeader("Retry-After", "30");
+    request->send(response);
+    return;
+  }
+  auto session = std::make_shared<LiveSession>(live, slot);
+  AsyncWebServerResponse *response = request->beginChunkedResponse("text/event-stream", [this, session](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    (void)index;
+    updateLive();
+    size_t n = live.fill(session->slot, buffer, maxLen, millis());
+    if (n)
+      return n;
+    // Nothing new: AsyncWebServer asks again on the next ACK or poll. An
+    // evicted client gets 0, which ends the response.
+    return live.isOpen(session->slot) ? RESPONSE_TRY_AGAIN : 0;
+  });
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+void LoRaWeb::addLiveScript(PageStream &page)
+{
+  page.add(PageStream::once([this]() -> String {
+    MessageLogView log = radio.getMessageLog();
+    return "<script>var next=" + String(log->firstNumber() + log->size()) + ";";
+  }));
+  page.add(LIVE_SCRIPT);
+}
+
 void LoRaWeb::handleSendMsg(AsyncWebServerRequest *request)
 {
   if (request->hasParam("msg", true))
   {
     String msg = request->getParam("msg", true)->value();
-    radio.sendToQueueString("MSG", msg);
+    String to = request->hasParam("to", true) ? request->getParam("to", true)->value() : String("");
+    to.trim();
+    sendQueueResult(request, radio.enqueueMessage(LORA_PKT_DATA, msg.c_str(), msg.length(), to.length() ? to.c_str() : "ALL"));
+    return;
   }
   request->redirect("/admin");
 }
 
+void LoRaWeb::sendQueueResult(AsyncWebServerRequest *request, RadioQueueResult result)
+{
+  if (result == RADIO_QUEUE_OK)
+  {
+    request->redirect("/admin");
+    return;
+  }
+  // Refused messages are not retried by the node; tell the player instead of dropping them
+  AsyncWebServerResponse *response;
+  if (result == RADIO_QUEUE_FULL)
+  {
+    response = request->beginResponse(503, "text/html", "<h2>Zendwachtrij vol</h2><p>Probeer het over een paar seconden opnieuw.</p><a href='/admin'>Terug</a>");
+    response->addHeader("Retry-After", "5");
+  }
+  else
+  {
+    response = request->beginResponse(413, "text/html", "<h2>Bericht te lang</h2><p>Maximaal " + String(RADIO_MESSAGE_MAX) + " tekens.</p><a href='/admin'>Terug</a>");
+  }
+  request->send(response);
+}
+
 // =======================
 // HTML helpers
 // =======================
 
-String LoRaWeb::neighbourTableHtml()
+void LoRaWeb::addNeighbourTable(PageStream &page)
 {
-  String tableHtml = "<h2>Neighbour Table - " + radio.getNodeName() + " (" + String(GAMEVERSION) + ")</h2><table border=1><tr><th>Node</th><th>Laatst gezien (s)</th><th>RSSI</th><th>SNR</th></tr>";
-  auto &neighbours = radio.getNeighbours();
-  for (auto &kv : neighbours)
-  {
-    unsigned long age = (millis() - kv.second.lastSeen) / 1000;
-    tableHtml += "<tr><td>" + kv.first + "</td><td>" + String(age) + "</td><td>" + String(kv.second.rssi, 1) + "</td><td>" + String(kv.second.snr, 1) + "</td></tr>";
-  }
-  tableHtml += "</table><br><form action='/sendtable' method='POST'><button type='submit'>Zend table via LoRa</button></form>";
-  return tableHtml;
+  page.add(PageStream::once([this]() -> String {
+    return "<h2>Neighbour Table - " + radio.getNodeName() + " (" + String(GAMEVERSION) + ")</h2><table id='nb' border=1><tr><th>Node</th><th>Laatst gezien (s)</th><th>RSSI</th><th>SNR</th><th>SF</th></tr>";
+  }));
+  // One row per step, continuing after the node of the previous row
+  String last;
+  page.add([this, last](size_t step, String &out) mutable {
+    NeighbourView neighbours = radio.getNeighbours();
+    auto it = step ? neighbours->upper_bound(last) : neighbours->begin();
+    if (it == neighbours->end())
+      return false;
+    last = it->first;
+    unsigned long age = (millis() - it->second.lastSeen) / 1000;
+    out += "<tr id='nb-" + it->first + "'><td>" + it->first + "</td><td>" + String(age) + "</td><td>" + String(it->second.rssi, 1) + "</td><td>" + String(it->second.snr, 1) + "</td><td>" + (it->second.sf ? String(it->second.sf) : String("-")) + "</td></tr>";
+    return true;
+  });
+  page.add("</table><br><form action='/sendtable' method='POST'><button type='submit'>Zend table via LoRa</button></form>");
 }
 
-String LoRaWeb::messageLogHtml()
+void LoRaWeb::addMessageLog(PageStream &page, const char *heading, bool raw, bool newestFirst)
 {
-  String logHtml = "<h2>Message Log</h2><ul>";
-  auto &messageLog = radio.getMessageLog();
-  for (auto &m : messageLog)
+  uint32_t start, count;
   {
-    logHtml += "<li>[" + String(m.timestamp) + "] " + m.sender + ": " + m.content +
-               " (RSSI=" + String(m.rssi, 1) + ", SNR=" + String(m.snr, 1) + ")</li>";
+    MessageLogView log = raw ? radio.getRawLog() : radio.getMessageLog();
+    count = log->size();
+    start = newestFirst ? log->firstNumber() + count - 1 : log->firstNumber();
   }
-  logHtml += "</ul>";
-  return logHtml;
+  page.add(heading);
+  addLogRows(page, raw, start, count, newestFirst, [](String &out, const LogEntry &m, uint32_t number, size_t step) {
+    (void)number;
+    (void)step;
+    out += "<li>[" + String(m.timestamp) + "] " + m.sender + ": " + m.content +
+           " (RSSI=" + String(m.rssi, 1) + ", SNR=" + String(m.snr, 1) + ")</li>";
+  });
+  page.add("</ul>");
 }
 
-String LoRaWeb::userListHtml()
+void LoRaWeb::addLogRows(PageStream &page, bool raw, uint32_t start, uint32_t count, bool newestFirst, LogRow row)
 {
-  String html = "<h2>Users</h2><ul>";
-  for (int i = 0; i < UserManager::userCount; ++i)
-  {
-    html += "<li>" + UserManager::users[i].username + " (" + UserManager::users[i].team + ")</li>";
-  }
+  // Rows are found by running number, so entries appended or evicted while
+  // the page goes out do not shift them; entries evicted by then are left out
+  uint32_t next = start, left = count;
+  page.add([this, raw, newestFirst, row, next, left](size_t step, String &out) mutable {
+    if (left == 0)
+      return false;
+    MessageLogView log = raw ? radio.getRawLog() : radio.getMessageLog();
+    uint32_t first = log->firstNumber();
+    if ((int32_t)(next - first) < 0)
+    {
+      // Evicted since: newest first, everything older is gone too
+      uint32_t gone = first - next;
+      if (newestFirst || gone >= left)
+        return false;
+      left -= gone;
+      next = first;
+    }
+    if (next - first >= log->size())
+      return false;
+    row(out, log->at(next - first), next, step);
+    next += newestFirst ? -1 : 1;
+    left--;
+    return true;
+  });
+}
+
+String LoRaWeb::radioStatsHtml()
+{
+  RadioStatusView status = radio.getStatus();
+  const ReassemblyStats &frag = status->reassembly;
+  String html = "<h2>Radio</h2><ul>";
+  const AirtimeStatus &air = status->airtime;
+  uint32_t remaining = air.usedMs >= air.budgetMs ? 0 : air.budgetMs - air.usedMs;
+  html += "<li>Zendtijdbudget " + String(air.subBand) + ": " + String(remaining / 1000.0, 1) + " s over van " +
+          String(air.budgetMs / 1000.0, 1) + " s per uur (" + String(air.usedMs / 1000.0, 1) + " s gebruikt)</li>";
+  html += "<li>Uitgesteld laag/normaal/ACK: " + String(air.stats.deferred[TX_PRIO_LOW]) + "/" + String(air.stats.deferred[TX_PRIO_NORMAL]) + "/" +
+          String(air.stats.deferred[TX_PRIO_HIGH]) + ", verworpen: " + String(air.stats.dropped[TX_PRIO_LOW]) + "/" +
+          String(air.stats.dropped[TX_PRIO_NORMAL]) + "/" + String(air.stats.dropped[TX_PRIO_HIGH]) + "</li>";
+  html += "<li>Fragmenten: " + String(frag.completed) + " compleet, " + String(frag.dropped) + " verdrongen, " +
+          String(frag.expired) + " verlopen, " + String(frag.rejected) + " geweigerd, " +
+          String(frag.recovered) + " hersteld met FEC</li>";
+  const FloodStats &flood = status->flood;
+  html += "<li>Doorsturen: " + String(flood.forwarded) + " verzonden, " + String(flood.cancelled) + " geannuleerd, " +
+          String(flood.duplicates) + " duplicaten, " + String(flood.overflow) + " overloop</li>";
+  const TxStats &tx = status->tx;
+  html += "<li>TX: " + String(tx.sent) + " verzonden, wachtrij " + String(status->txDepth) + " (max " + String(tx.maxDepth) + "), " +
+          String(tx.dropped) + " verworpen, " + String(tx.failed) + " mislukt</li>";
+  html += "<li>Bundelen: " + String(tx.packets) + " pakketten in " + String(tx.sent) + " frames, waarvan " + String(tx.batches) +
+          " bundels (" + String(tx.packets ? (float)tx.sent / tx.packets : 0.0f, 2) + " frame per pakket)</li>";
+  html += "<li>Tijd tot zenden: laatst " + String(tx.lastTimeToAir) + " ms, gem. " + String(tx.avgTimeToAir) + " ms, max " +
+          String(tx.maxTimeToAir) + " ms, zendtijd totaal " + String((uint32_t)(tx.airtimeUs / 1000)) + " ms</li>";
+  const CsmaStats &csma = status->csma;
+  html += "<li>Kanaal: " + String(csma.cads) + " keer geluisterd, bezet laag/normaal/ACK " + String(csma.busy[TX_PRIO_LOW]) + "/" +
+          String(csma.busy[TX_PRIO_NORMAL]) + "/" + String(csma.busy[TX_PRIO_HIGH]) + ", " + String(csma.forced) +
+          " toch verzonden, " + String(csma.receiving) + " gewacht op ontvangst, " + String(csma.corrupted) + " verminkt ontvangen (botsing), gem. wachttijd " +
+          String(csma.backoffs ? (uint32_t)(csma.backoffMs / csma.backoffs) : 0) + " ms</li>";
+  RadioQueueStats rq = radio.getMessageQueueStats();
+  html += "<li>Berichtenwachtrij: " + String(radio.getMessageQueueDepth()) + "/" + String(RADIO_QUEUE_SLOTS) + " (max " + String(rq.maxDepth) + "), " +
+          String(rq.accepted) + " aangenomen, " + String(rq.full) + " geweigerd (vol), " + String(rq.tooLong) + " te lang</li>";
+  const AdrStats &adr = status->adr;
+  html += "<li>ADR: " + String(adr.fastFrames) + " frames op snellere SF, " + String(adr.fallbacks) + " keer teruggevallen, " +
+          String((uint32_t)(adr.airtimeSavedUs / 1000)) + " ms zendtijd bespaard</li>";
+  const BeaconStats &bcn = status->beacons;
+  uint64_t bcnSaved = bcn.fixedAirtimeUs > bcn.airtimeUs ? bcn.fixedAirtimeUs - bcn.airtimeUs : 0;
+  html += "<li>Beacons: " + String(bcn.standalone) + " los, " + String(bcn.piggybacked) + " meegestuurd, interval " +
+          String(bcn.intervalMs / 1000) + " s, " + String(bcn.resets) + " keer teruggezet, " +
+          String((uint32_t)(bcnSaved / 1000)) + " ms zendtijd bespaard</li>";
+  JournalStats js = journal.stats();
+  html += "<li>Logboek: " + String(js.records) + " berichten in " + String(js.segments) + " segmenten, " + String(js.flushes) +
+          " keer geschreven (" + String(js.bytesWritten / 1024) + " KB), opstart " + String(js.boot) + "</li>";
+  const OutboxStats &out = status->outbox;
+  html += "<li>Aflevering: " + String(out.delivered) + " bevestigd, " + String(out.failed) + " mislukt, " +
+          String(out.retransmissions) + " fragmenten herhaald, " + String(out.repairs) + " herstelfragmenten, RTT " + String(out.srttMs) + " ms, time-out " + String(out.rtoMs) + " ms</li>";
+  const CustodyStats &cs = status->custody;
+  html += "<li>Bewaring: " + String(cs.held) + " vastgehouden, " + String(cs.confirmed) + " bevestigd door bestemming, " +
+          String(cs.resent) + " opnieuw verzonden, " + String(cs.expired) + " verlopen, " + String(cs.dropped) + " verdrongen</li>";
+  const FileStats &fs = status->files;
+  html += "<li>Bestanden: " + String(fs.started) + " verzonden, " + String(fs.completed) + " aangekomen, " + String(fs.received) +
+          " ontvangen; " + String(fs.chunksSent) + " stukken verzonden waarvan " + String(fs.chunksResent) + " herhaald, " +
+          String(fs.pauses) + " keer gepauzeerd, " + String(fs.resumed) + " hervat, " + String(fs.corrupt) + " beschadigd</li>";
+  LiveStats ls = live.stats();
+  html += "<li>Live: " + String(live.connected()) + " verbonden, " + String(ls.events) + " gebeurtenissen, " + String(ls.refused) +
+          " geweigerd, " + String(ls.evicted) + " te traag en afgesloten</li>";
   html += "</ul>";
   return html;
 }
 
+void LoRaWeb::addRouteTable(PageStream &page)
+{
+  page.add("<h2>Routes</h2><table border=1><tr><th>Bestemming</th><th>Via</th><th>Kosten</th><th>Gateway</th><th>Leeftijd (s)</th></tr>");
+  // The rows are copied once, so the table is one version of it however many
+  // callbacks the page takes
+  std::vector<RouteRow> rows;
+  page.add([this, rows](size_t step, String &out) mutable {
+    if (step == 0) {
+      RouteView routes = radio.getRoutes();
+      rows.assign(routes->rows, routes->rows + routes->count);
+    }
+    if (step >= rows.size())
+      return false;
+    const RouteRow &row = rows[step];
+    const RouteEntry &r = row.entry;
+    out += "<tr><td>" + String(row.dest) + "</td><td>" + String(row.via) + "</td><td>" + String(r.metric) +
+           "</td><td>" + String((r.flags & ROUTE_FLAG_GATEWAY) ? "ja" : "") + "</td><td>" + String((millis() - r.updatedAt) / 1000) + "</td></tr>";
+    return true;
+  });
+  page.add(PageStream::once([this]() {
+    String html = "</table>";
+    RadioStatusView status = radio.getStatus();
+    const RouteStats &stats = status->routes;
+    html += "<p>Gerouteerd: " + String(stats.routed) + " frames, geflood zonder route: " + String(stats.floodFallback) +
+            ", wijzigingen: " + String(stats.updates) + ", verbroken: " + String(stats.linkFailures) + "</p>";
+    html += "<form action='/gateway' method='POST'><label><input type='checkbox' name='gateway'" + String(radio.isGateway() ? " checked" : "") +
+            "> Deze node is een gateway</label> <input type='submit' value='Opslaan'></form>";
+    html += "<form action='/fec' method='POST'><label><input type='checkbox' name='fec'" + String(radio.isFecEnabled() ? " checked" : "") +
+            "> Foutcorrectie (herstelfragmenten bij lange berichten, meer bij zwakke verbindingen)</label> <input type='submit' value='Opslaan'></form>";
+    html += "<form action='/power' method='POST'><label><input type='checkbox' name='powersave'" +
+            String(radio.getSavedPowerMode() == POWER_SAVE ? " checked" : "") +
+            "> Energiezuinig: veldnode zonder wifi en scherm na herstart (houd PRG ingedrukt bij opstarten voor wifi)</label>"
+            " <input type='submit' value='Opslaan'></form>";
+    html += "<p>Slapende buren: " + String(status->sleepers) + "</p>";
+    return html;
+  }));
+}
+
+void LoRaWeb::addUserList(PageStream &page)
+{
+  page.add("<h2>Users</h2><ul>");
+  page.add([](size_t step, String &out) {
+    if ((int)step >= UserManager::userCount)
+      return false;
+    out += "<li>" + UserManager::users[step].username + " (" + UserManager::users[step].team + ")</li>";
+    return true;
+  });
+  page.add("</ul>");
+}
+
 // =======================
 // Begin
 // =======================
@@ -220,8 +790,10 @@ void LoRaWeb::handleRoot(AsyncWebServerRequest *request)
     html += "<h3>Uploaded Image:</h3>";
     html += "<img src='/uploaded.jpg' style='max-width:300px;'><br>";
   }
-  html += LoRaWeb::rootHTML(token);
-  request->send(200, "text/html", html);
+  auto page = std::make_shared<PageStream>();
+  page->add(PageStream::once([html]() { return html; }));
+  addRoot(*page, token);
+  sendPage(request, page);
 }
 
 void LoRaWeb::handleSetCookie(AsyncWebServerRequest *request)
@@ -245,6 +817,13 @@ void LoRaWeb::handleClearCookie(AsyncWebServerRequest *request)
 
 void LoRaWeb::begin(const char *ssid, const char *pass)
 {
+  journal.begin();
+  boot = journal.stats().boot;
+  if (!live.begin(boot))
+    Serial.println("[LoRaWeb] ERROR: no memory for the live feed");
+  deliveryFeed = &live;
+  radio.setDeliveryCallback(onDelivery);
+
   // Serve uploaded image
   server.on("/uploaded.jpg", HTTP_GET, [](AsyncWebServerRequest *request){
     if (LittleFS.exists("/uploaded.jpg")) {
@@ -254,10 +833,25 @@ void LoRaWeb::begin(const char *ssid, const char *pass)
     }
   });
 
+  // Files received over LoRa
+  server.serveStatic("/files/", LittleFS, LORA_FILE_DIR "/");
+  server.on("/files", HTTP_GET, [](AsyncWebServerRequest *request){
+    String html = "<h2>Ontvangen bestanden</h2><ul>";
+    File dir = LittleFS.open(LORA_FILE_DIR);
+    for (File f = dir ? dir.openNextFile() : File(); f; f = dir.openNextFile()) {
+      String name = f.name();
+      name = name.substring(name.lastIndexOf('/') + 1);
+      html += "<li><a href='/files/" + name + "'>" + name + "</a> (" + String(f.size()) + " B)</li>";
+    }
+    html += "</ul><a href='/'>Terug</a>";
+    request->send(200, "text/html", html);
+  });
+
   // ---- Image upload form
   server.on("/upload", HTTP_GET, [this](AsyncWebServerRequest *request){
     String html = "<h2>Upload Image</h2>";
     html += "<form method='POST' action='/upload' enctype='multipart/form-data'>";
+    html += "Naar node (leeg: niet verzenden): <input type='text' name='to'><br>";
     html += "<input type='file' name='image'><br>";
     html += "<input type='submit' value='Upload'></form>";
     request->send(200, "text/html", html);
@@ -266,7 +860,16 @@ void LoRaWeb::begin(const char *ssid, const char *pass)
   // ---- Image upload POST handler
   server.on("/upload", HTTP_POST,
     [this](AsyncWebServerRequest *request){
-      request->send(200, "text/html", "<h2>Image upload complete!</h2><a href='/'>Back</a>");
+      String html = "<h2>Image upload complete!</h2>";
+      // Over LoRa in chunks, straight from flash; see FileTransfer.h
+      if (request->hasParam("to", true) && request->getParam("to", true)->value().length()) {
+        String to = request->getParam("to", true)->value();
+        if (radio.sendFile("/uploaded.jpg", to))
+          html += "<p>Wordt verzonden naar " + to + ".</p>";
+        else
+          html += "<p>Verzenden mislukt: wachtrij vol.</p>";
+      }
+      request->send(200, "text/html", html + "<a href='/'>Back</a>");
     },
     [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final){
       Serial.printf("[LoRaWeb] Uploading file: %s, index: %u, len: %u, final: %d\n", filename.c_str(), index, len, final);
@@ -313,8 +916,9 @@ void LoRaWeb::begin(const char *ssid, const char *pass)
   /*server.on("/test", HTTP_GET, [this](AsyncWebServerRequest *request){
     Serial.println("[LoRaWeb] Root accessed");
     String token = getSessionToken(request);
-    String html = rootHTML(token);
-    request->send(200, "text/html", html);
+    auto page = std::make_shared<PageStream>();
+    addRoot(*page, token);
+    sendPage(request, page);
   });
 */
   // ---- Admin
@@ -322,13 +926,17 @@ void LoRaWeb::begin(const char *ssid, const char *pass)
             {
     if (!requireLogin(request)) return;
     String session = getSessionToken(request);
-    String html = rootHTML(session);
-    html += neighbourTableHtml();
-    html += userListHtml();
-    html += messageLogHtml();
-    html += "<h2>Stuur bericht</h2>";
-    html += "<form action='/sendmsg' method='POST'><input name='msg' size=40><input type='submit' value='Verstuur'></form>";
-    request->send(200, "text/html", html); });
+    auto page = std::make_shared<PageStream>();
+    addRoot(*page, session);
+    addNeighbourTable(*page);
+    page->add(PageStream::once([this]() { return radioStatsHtml(); }));
+    addRouteTable(*page);
+    addUserList(*page);
+    addMessageLog(*page, "<h2>Message Log</h2><ul id='log' data-oldest='1'>", false, false);
+    page->add("<h2>Stuur bericht</h2>"
+              "<form action='/sendmsg' method='POST'><input name='msg' size=40> Aan: <input name='to' placeholder='ALL of GATEWAY' size=20><input type='submit' value='Verstuur'></form>");
+    addLiveScript(*page);
+    sendPage(request, page); });
 
   // ---- Add User form
   server.on("/adduser", HTTP_GET, [this](AsyncWebServerRequest *request)
@@ -411,73 +1019,61 @@ void LoRaWeb::begin(const char *ssid, const char *pass)
   server.on("/messages", HTTP_GET, [this](AsyncWebServerRequest *request)
             {
     if (!requireLogin(request)) return;
-    auto &msgs = radio.getMessageLog();
-    String html = "<h2>Messages</h2><ul>";
-    for (auto it = msgs.rbegin(); it != msgs.rend(); ++it) {
-      html += "<li>[" + String(it->timestamp) + "] ";
-      html += it->sender + ": " + it->content;
-      html += " (RSSI=" + String(it->rssi) + ", SNR=" + String(it->snr) + ")</li>";
-    }
-    html += "</ul>";
-    request->send(200, "text/html", html); });
+    auto page = std::make_shared<PageStream>();
+    addMessageLog(*page, "<h2>Messages</h2><ul id='log'>", false, true);
+    addLiveScript(*page);
+    sendPage(request, page); });
 
   // ---- Raw HTML
   server.on("/raw", HTTP_GET, [this](AsyncWebServerRequest *request)
             {
     if (!requireLogin(request)) return;
-    auto &raw = radio.getRawLog();
-    String html = "<h2>Raw Messages</h2><ul>";
-    for (auto it = raw.rbegin(); it != raw.rend(); ++it) {
-      html += "<li>[" + String(it->timestamp) + "] ";
-      html += it->sender + ": " + it->content;
-      html += " (RSSI=" + String(it->rssi) + ", SNR=" + String(it->snr) + ")</li>";
-    }
-    html += "</ul>";
-    request->send(200, "text/html", html); });
+    auto page = std::make_shared<PageStream>();
+    addMessageLog(*page, "<h2>Raw Messages</h2><ul>", true, true);
+    sendPage(request, page); });
 
   // ---- Messages JSON
   server.on("/messages.json", HTTP_GET, [this](AsyncWebServerRequest *request)
             {
     if (!requireLogin(request)) return;
-    auto &msgs = radio.getMessageLog();
-    DynamicJsonDocument doc(4096);
-    JsonArray arr = doc.to<JsonArray>();
-    for (auto it = msgs.rbegin(); it != msgs.rend(); ++it) {
-      JsonObject obj = arr.createNestedObject();
-      obj["timestamp"] = it->timestamp;
-      obj["sender"] = it->sender;
-      obj["content"] = it->content;
-      obj["rssi"] = it->rssi;
-      obj["snr"] = it->snr;
+    if (!request->hasParam("since") && (request->hasParam("before") || request->hasParam("sender"))) {
+      handleMessageHistory(request);
+      return;
     }
-    String out;
-    serializeJson(arr, out);
-    request->send(200, "application/json", out); });
+    handleLogJson(request, false); });
 
   // ---- Raw JSON
   server.on("/raw.json", HTTP_GET, [this](AsyncWebServerRequest *request)
             {
     if (!requireLogin(request)) return;
-    auto &raw = radio.getRawLog();
-    DynamicJsonDocument doc(4096);
-    JsonArray arr = doc.to<JsonArray>();
-    for (auto it = raw.rbegin(); it != raw.rend(); ++it) {
-      JsonObject obj = arr.createNestedObject();
-      obj["timestamp"] = it->timestamp;
-      obj["sender"] = it->sender;
-      obj["content"] = it->content;
-      obj["rssi"] = it->rssi;
-      obj["snr"] = it->snr;
-    }
-    String out;
-    serializeJson(arr, out);
-    request->send(200, "application/json", out); });
+    handleLogJson(request, true); });
+
+  // ---- Live feed
+  server.on("/events", HTTP_GET, [this](AsyncWebServerRequest *request)
+            { handleEvents(request); });
+
+  // ---- Neighbours and users JSON
+  server.on("/neighbours.json", HTTP_GET, [this](AsyncWebServerRequest *request)
+            {
+    if (!requireLogin(request)) return;
+    handleNeighboursJson(request); });
+
+  server.on("/users.json", HTTP_GET, [this](AsyncWebServerRequest *request)
+            {
+    if (!requireLogin(request)) return;
+    handleUsersJson(request); });
 
   // ---- Actions
   server.on("/sendtable", HTTP_POST, [this](AsyncWebServerRequest *request)
             { handleSendTable(request); });
   server.on("/sendmsg", HTTP_POST, [this](AsyncWebServerRequest *request)
             { handleSendMsg(request); });
+  server.on("/gateway", HTTP_POST, [this](AsyncWebServerRequest *request)
+            { handleGateway(request); });
+  server.on("/fec", HTTP_POST, [this](AsyncWebServerRequest *request)
+            { handleFec(request); });
+  server.on("/power", HTTP_POST, [this](AsyncWebServerRequest *request)
+            { handlePower(request); });
 
   server.begin();
 }
@@ -498,5 +1094,20 @@ void LoRaWeb::loop()
     lastTableSend = now;
   }
 
+  // Messages the radio logged since the last pass go to the journal; beacons stay out
+  {
+    MessageLogView log = radio.getMessageLog();
+    uint32_t first = log->firstNumber();
+    size_t i = (int32_t)(journaled - first) > 0 ? journaled - first : 0;
+    for (; i < log->size(); i++)
+    {
+      LogEntry m = log->at(i);
+      if (m.type != LORA_PKT_BEACON)
+        journal.append(m.timestamp, m.sender, m.senderLen, m.content, m.contentLen, m.rssi, m.snr, m.type);
+    }
+    journaled = first + log->size();
+  }
+  journal.loop(now);
+
   dnsServer.processNextRequest();
 }
@@ -5,8 +5,19 @@
 #include <ESPAsyncWebServer.h>
 #include "LoRaRadio.h"
 #include "User.h"
+#include "MessageJournal.h"
+#include "PageStream.h"
+#include "LiveFeed.h"
+#include <memory>
 
+#define WEB_JSON_LIMIT 50       ///< Entries per cursor page when the client gives no limit
+#define WEB_JSON_LIMIT_MAX 200
+#define WEB_LIVE_UPDATE_MS 100  ///< Least time between two looks at the snapshots for live events
+#define WEB_LIVE_SIGNAL_STEP 3.0f  ///< RSSI or SNR change (dB) that makes a neighbour event
+#define WEB_LIVE_NOTICES 8      ///< Delivery events per update; a burst waits in the notice queue instead of flushing the ring
 
+/// Writes one log entry of a streamed list; step is the number of rows before it
+typedef std::function<void(String &out, const LogEntry &m, uint32_t number, size_t step)> LogRow;
 
 class LoRaWeb
 {
@@ -16,18 +27,28 @@ public:
   void loop();
 
   // LoRa helpers
-  void loraSendTable();
+  RadioQueueResult loraSendTable();
 
-  // HTML helpers
-  String neighbourTableHtml();
-  String messageLogHtml();
-  String userListHtml();
-  String rootHTML(String session);
+  // HTML helpers; tables and logs are streamed row by row, see PageStream.h
+  void addNeighbourTable(PageStream &page);
+  void addMessageLog(PageStream &page, const char *heading, bool raw, bool newestFirst);
+  void addLogRows(PageStream &page, bool raw, uint32_t start, uint32_t count, bool newestFirst, LogRow row);
+  void addUserList(PageStream &page);
+  void addRouteTable(PageStream &page);
+  void addRoot(PageStream &page, const String &session);
+  String radioStatsHtml();
+  void sendPage(AsyncWebServerRequest *request, std::shared_ptr<PageStream> page,
+                const char *contentType = "text/html", const String &etag = String());
+
+  // JSON API: streamed like the pages, with an ETag per version of the data
+  String jsonTag(const String &state);
+  bool notModified(AsyncWebServerRequest *request, const String &etag);
 
   // Cookie/session helpers
   String getSessionToken(AsyncWebServerRequest *request);
   bool requireLogin(AsyncWebServerRequest *request);
   String getCookie(AsyncWebServerRequest *request, const String &name);
+  void sendQueueResult(AsyncWebServerRequest *request, RadioQueueResult result);
 
   // AsyncWebServer handlers
   void handleRoot(AsyncWebServerRequest *request);
@@ -35,9 +56,32 @@ public:
   void handleClearCookie(AsyncWebServerRequest *request);
   void handleSendTable(AsyncWebServerRequest *request);
   void handleSendMsg(AsyncWebServerRequest *request);
+  void handleGateway(AsyncWebServerRequest *request);
+  void handleFec(AsyncWebServerRequest *request);
+  void handlePower(AsyncWebServerRequest *request);
+  void handleMessageHistory(AsyncWebServerRequest *request);
+  void handleLogJson(AsyncWebServerRequest *request, bool raw);
+  void handleNeighboursJson(AsyncWebServerRequest *request);
+  void handleUsersJson(AsyncWebServerRequest *request);
+
+  // Live feed: Server-Sent Events on /events, see LiveFeed.h
+  void handleEvents(AsyncWebServerRequest *request);
+  void updateLive();
+  void addLiveScript(PageStream &page);
 
 private:
   LoRaRadio &radio;
   AsyncWebServer server;
   UserManager userManager;
+  MessageJournal journal;
+  uint32_t journaled = 0;  ///< Running number of the next messageLog entry to journal
+  uint16_t boot = 0;       ///< Journal boot number; running numbers and versions restart with it
+
+  // Live feed, web server task only
+  LiveFeed live;
+  uint32_t liveMessages = 0;          ///< Running number of the next messageLog entry to publish
+  uint32_t liveNeighbourVersion = 0;  ///< Snapshot version last compared
+  NeighbourTable liveNeighbours;      ///< Neighbours as last published
+  uint32_t liveUpdatedAt = 0;
+  uint32_t liveNoticesLost = 0;       ///< Delivery results lost as of the last update
 };
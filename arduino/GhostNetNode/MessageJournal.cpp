@@ -0,0 +1,297 @@
+#include "MessageJournal.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <memory>
+#include "LoRaPacket.h"
+
+static_assert(sizeof(JournalIndexEntry) == 16, "JournalIndexEntry is stored as is");
+
+#define JOURNAL_READ_BLOCK 32   ///< Index entries read at once when paging
+
+bool MessageJournal::begin() {
+  if (!mutex)
+    mutex = xSemaphoreCreateMutex();
+  lock();
+  if (!LittleFS.exists(JOURNAL_DIR) && !LittleFS.mkdir(JOURNAL_DIR)) {
+    Serial.println("[Journal] ERROR: cannot create " JOURNAL_DIR);
+    unlock();
+    return false;
+  }
+
+  segments.clear();
+  File dir = LittleFS.open(JOURNAL_DIR);
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    String name = f.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    if (name.endsWith(".idx"))
+      segments.push_back(strtoul(name.c_str(), nullptr, 16));
+  }
+  dir.close();
+  std::sort(segments.begin(), segments.end());
+
+  // Continue after the last complete record. A batch cut short by a reset
+  // leaves index entries pointing past the end of the log; those are
+  // ignored and the next record starts a fresh segment.
+  next = 1;
+  boot = 1;
+  segmentBytes = 0;
+  bool damaged = false;
+  for (size_t k = segments.size(); k-- > 0;) {
+    File idx = LittleFS.open(segmentPath(segments[k], ".idx"), "r");
+    File log = LittleFS.open(segmentPath(segments[k], ".log"), "r");
+    size_t logSize = log ? log.size() : 0;
+    size_t n = idx ? idx.size() / sizeof(JournalIndexEntry) : 0;
+    if (idx && idx.size() % sizeof(JournalIndexEntry))
+      damaged = true;
+    JournalIndexEntry e;
+    while (n > 0) {
+      idx.seek((n - 1) * sizeof(JournalIndexEntry));
+      if (idx.read((uint8_t *)&e, sizeof(e)) == sizeof(e) && e.offset + sizeof(RecordHeader) <= logSize)
+        break;
+      damaged = true;
+      n--;
+    }
+    if (k == segments.size() - 1) {
+      next = segments[k] + n;
+      segmentBytes = logSize;
+    }
+    if (n > 0) {
+      boot = e.boot + 1;
+      break;
+    }
+  }
+  if (segments.empty() || damaged || segmentBytes >= JOURNAL_SEGMENT_BYTES)
+    startSegment();
+
+  counters.boot = boot;
+  Serial.printf("[Journal] %u records in %u segments, boot %u\n", (unsigned)(next - segments.front()), (unsigned)segments.size(), boot);
+  unlock();
+  return true;
+}
+
+void MessageJournal::lock() {
+  if (mutex)
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void MessageJournal::unlock() {
+  if (mutex)
+    xSemaphoreGive(mutex);
+}
+
+String MessageJournal::segmentPath(uint32_t firstSeq, const char *ext) const {
+  char path[32];
+  snprintf(path, sizeof(path), JOURNAL_DIR "/%08x%s", (unsigned)firstSeq, ext);
+  return String(path);
+}
+
+void MessageJournal::startSegment() {
+  if (!segments.empty() && segments.back() == next) {
+    // Nothing valid in the current segment: reuse its number
+    LittleFS.remove(segmentPath(next, ".log"));
+    LittleFS.remove(segmentPath(next, ".idx"));
+  } else {
+    segments.push_back(next);
+  }
+  segmentBytes = 0;
+  while (segments.size() > JOURNAL_MAX_SEGMENTS) {
+    LittleFS.remove(segmentPath(segments.front(), ".log"));
+    LittleFS.remove(segmentPath(segments.front(), ".idx"));
+    segments.erase(segments.begin());
+  }
+}
+
+void MessageJournal::append(uint32_t ms, const char *sender, size_t senderLen, const char *content, size_t contentLen,
+                            float rssi, float snr, uint8_t type) {
+  if (senderLen > UINT8_MAX)
+    senderLen = UINT8_MAX;
+  size_t maxContent = JOURNAL_SEGMENT_BYTES - sizeof(RecordHeader) - senderLen;
+  if (contentLen > maxContent)
+    contentLen = maxContent;
+  size_t len = sizeof(RecordHeader) + senderLen + contentLen;
+
+  lock();
+  if (segmentBytes && segmentBytes + len > JOURNAL_SEGMENT_BYTES) {
+    flushLocked();
+    startSegment();
+  }
+  if (pendingCount == JOURNAL_FLUSH_ENTRIES || pendingLogLen + len > sizeof(pendingLog))
+    flushLocked();
+
+  String senderName(sender, senderLen);
+  JournalIndexEntry e{ segmentBytes, ms, boot, type, 0, loraNodeHash(senderName.c_str()) };
+  RecordHeader rec{ (uint16_t)senderLen, (uint16_t)contentLen, rssi, snr };
+  if (len > sizeof(pendingLog)) {
+    // Too big to batch: written on its own
+    File log = LittleFS.open(segmentPath(segments.back(), ".log"), "a");
+    File idx = LittleFS.open(segmentPath(segments.back(), ".idx"), "a");
+    if (log && idx) {
+      log.write((const uint8_t *)&rec, sizeof(rec));
+      log.write((const uint8_t *)sender, senderLen);
+      log.write((const uint8_t *)content, contentLen);
+      idx.write((const uint8_t *)&e, sizeof(e));
+      counters.flushes++;
+      counters.bytesWritten += len + sizeof(e);
+    } else {
+      Serial.println("[Journal] ERROR: cannot open segment");
+    }
+  } else {
+    uint8_t *p = pendingLog + pendingLogLen;
+    memcpy(p, &rec, sizeof(rec));
+    memcpy(p + sizeof(rec), sender, senderLen);
+    memcpy(p + sizeof(rec) + senderLen, content, contentLen);
+    pendingLogLen += len;
+    if (pendingCount == 0)
+      pendingSince = millis();
+    pendingIdx[pendingCount++] = e;
+  }
+  segmentBytes += len;
+  next++;
+  unlock();
+}
+
+void MessageJournal::loop(uint32_t now) {
+  lock();
+  if (pendingCount && now - pendingSince >= JOURNAL_FLUSH_MS)
+    flushLocked();
+  unlock();
+}
+
+void MessageJournal::flush() {
+  lock();
+  flushLocked();
+  unlock();
+}
+
+void MessageJournal::flushLocked() {
+  if (pendingCount == 0)
+    return;
+  // Log before index: an index entry never points at data that is not there
+  File log = LittleFS.open(segmentPath(segments.back(), ".log"), "a");
+  bool ok = log && log.write(pendingLog, pendingLogLen) == pendingLogLen;
+  log.close();
+  File idx = LittleFS.open(segmentPath(segments.back(), ".idx"), "a");
+  size_t idxLen = pendingCount * sizeof(JournalIndexEntry);
+  ok = ok && idx && idx.write((const uint8_t *)pendingIdx, idxLen) == idxLen;
+  idx.close();
+  if (!ok)
+    Serial.println("[Journal] ERROR: write failed, records lost");
+  counters.flushes++;
+  counters.bytesWritten += pendingLogLen + idxLen;
+  pendingLogLen = 0;
+  pendingCount = 0;
+}
+
+bool MessageJournal::readRecord(File &log, const JournalIndexEntry &e, uint32_t seq, JournalRecord &out) {
+  RecordHeader rec;
+  if (!log.seek(e.offset) || log.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec))
+    return false;
+  size_t len = rec.senderLen + rec.contentLen;
+  if (e.offset + sizeof(rec) + len > log.size())
+    return false;
+  std::unique_ptr<char[]> text(new char[len + 1]);
+  if (log.read((uint8_t *)text.get(), len) != len)
+    return false;
+  text[len] = 0;
+  setRecord(rec, text.get(), e, seq, out);
+  return true;
+}
+
+void MessageJournal::readPending(size_t i, uint32_t seq, JournalRecord &out) const {
+  // Pending records are the end of the current segment
+  const uint8_t *p = pendingLog + (pendingIdx[i].offset - (segmentBytes - pendingLogLen));
+  RecordHeader rec;
+  memcpy(&rec, p, sizeof(rec));
+  size_t len = rec.senderLen + rec.contentLen;
+  std::unique_ptr<char[]> text(new char[len + 1]);
+  memcpy(text.get(), p + sizeof(rec), len);
+  text[len] = 0;
+  setRecord(rec, text.get(), pendingIdx[i], seq, out);
+}
+
+// text: the sender followed by the content, NUL terminated
+void MessageJournal::setRecord(const RecordHeader &rec, const char *text, const JournalIndexEntry &e, uint32_t seq, JournalRecord &out) {
+  out.seq = seq;
+  out.boot = e.boot;
+  out.ms = e.ms;
+  out.type = e.type;
+  out.rssi = rec.rssi;
+  out.snr = rec.snr;
+  out.content = String(text + rec.senderLen);
+  out.sender = String(text, rec.senderLen);
+}
+
+uint32_t MessageJournal::read(uint32_t before, size_t limit, const char *sender, std::vector<JournalRecord> &out) {
+  uint32_t senderHash = sender && *sender ? loraNodeHash(sender) : 0;
+  lock();
+  uint32_t seq = before == 0 || before > next ? next : before;
+  uint32_t resume = 0;
+  JournalIndexEntry block[JOURNAL_READ_BLOCK];
+
+  // The newest records may still be in the batch; they reach flash with loop()
+  uint32_t firstPending = next - pendingCount;
+  while (seq > firstPending && out.size() < limit) {
+    seq--;
+    if (senderHash && pendingIdx[seq - firstPending].senderHash != senderHash)
+      continue;
+    JournalRecord r;
+    readPending(seq - firstPending, seq, r);
+    out.push_back(r);
+  }
+  if (out.size() == limit)
+    resume = seq;
+
+  for (size_t k = segments.size(); k-- > 0 && out.size() < limit;) {
+    uint32_t first = segments[k];
+    if (first >= seq)
+      continue;
+    File idx = LittleFS.open(segmentPath(first, ".idx"), "r");
+    File log = LittleFS.open(segmentPath(first, ".log"), "r");
+    if (!idx || !log)
+      continue;
+    uint32_t end = first + idx.size() / sizeof(JournalIndexEntry);
+    if (seq > end)
+      seq = end;
+    // Index entries are read backwards, a block at a time
+    while (seq > first && out.size() < limit) {
+      uint32_t lo = seq - first > JOURNAL_READ_BLOCK ? seq - JOURNAL_READ_BLOCK : first;
+      size_t n = seq - lo;
+      idx.seek((lo - first) * sizeof(JournalIndexEntry));
+      if (idx.read((uint8_t *)block, n * sizeof(JournalIndexEntry)) != n * sizeof(JournalIndexEntry))
+        break;
+      for (size_t i = n; i-- > 0 && out.size() < limit;) {
+        seq = lo + i;
+        if (senderHash && block[i].senderHash != senderHash)
+          continue;
+        JournalRecord r;
+        if (readRecord(log, block[i], seq, r))
+          out.push_back(r);
+      }
+      if (out.size() < limit)
+        seq = lo;
+    }
+    if (out.size() == limit)
+      resume = seq;
+    seq = first;
+  }
+  if (!segments.empty() && resume <= segments.front())
+    resume = 0;
+  unlock();
+  return resume;
+}
+
+uint32_t MessageJournal::nextSeq() {
+  lock();
+  uint32_t n = next;
+  unlock();
+  return n;
+}
+
+JournalStats MessageJournal::stats() {
+  lock();
+  JournalStats s = counters;
+  s.records = segments.empty() ? 0 : next - segments.front();
+  s.segments = segments.size();
+  unlock();
+  return s;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/semphr.h>
+#include <vector>
+
+/**
+ * @file MessageJournal.h
+ * @brief Message history on LittleFS that survives reboots.
+ *
+ * The radio keeps only the last messages of the last few minutes in RAM. The
+ * journal keeps every game message in append-only segment files under
+ * JOURNAL_DIR. Each segment is a pair:
+ *  - <first seq>.log holds the records: sender, content, RSSI and SNR;
+ *  - <first seq>.idx holds one 16-byte JournalIndexEntry per record, with the
+ *    record's offset, its time and a hash of the sender.
+ * Records get consecutive sequence numbers, so record n is found with one
+ * seek in the index of the segment it belongs to. Paging back through
+ * history or filtering by sender only reads index entries until a record is
+ * actually returned.
+ *
+ * Appends are collected in RAM and written in one go when the batch is full
+ * or JOURNAL_FLUSH_MS has passed, so flash sees a few larger writes instead
+ * of one per message. A new segment starts at JOURNAL_SEGMENT_BYTES; the
+ * oldest one is deleted when there are more than JOURNAL_MAX_SEGMENTS.
+ *
+ * Time is kept as a boot number plus millis(), since the node has no clock.
+ * The boot number is one more than that of the newest record found at begin().
+ *
+ * All methods are safe to call from different tasks.
+ */
+
+#define JOURNAL_DIR "/journal"
+#define JOURNAL_SEGMENT_BYTES 32768   ///< Record bytes per segment
+#define JOURNAL_MAX_SEGMENTS 8        ///< About 256 KB of history
+#define JOURNAL_FLUSH_BYTES 1024      ///< Record bytes collected before a write
+#define JOURNAL_FLUSH_ENTRIES 32      ///< Records collected before a write
+#define JOURNAL_FLUSH_MS 30000UL      ///< Longest time a record waits in RAM
+
+struct JournalIndexEntry {
+  uint32_t offset;        ///< Record position in the .log file
+  uint32_t ms;            ///< millis() when the message was received
+  uint16_t boot;          ///< Boot number
+  uint8_t type;           ///< LoRaPacketType
+  uint8_t reserved;
+  uint32_t senderHash;    ///< loraNodeHash() of the sender name
+};
+
+struct JournalRecord {
+  uint32_t seq;
+  uint16_t boot;
+  uint32_t ms;
+  uint8_t type;
+  float rssi;
+  float snr;
+  String sender;
+  String content;
+};
+
+struct JournalStats {
+  uint32_t records = 0;       ///< Records on flash, including those not written yet
+  uint32_t segments = 0;
+  uint32_t flushes = 0;       ///< Batched writes since boot
+  uint32_t bytesWritten = 0;  ///< Log and index bytes written since boot
+  uint16_t boot = 0;          ///< Boot number of this run
+};
+
+class MessageJournal {
+public:
+  /**
+   * @brief Find the existing segments and continue after the last record.
+   *
+   * LittleFS must be mounted.
+   * @return false if the directory cannot be created.
+   */
+  bool begin();
+
+  /**
+   * @brief Add a record; it reaches flash with the next batch.
+   */
+  void append(uint32_t ms, const char *sender, size_t senderLen, const char *content, size_t contentLen,
+              float rssi, float snr, uint8_t type);
+
+  /**
+   * @brief Write the collected records once they are due.
+   */
+  void loop(uint32_t now);
+
+  /**
+   * @brief Write the collected records now.
+   */
+  void flush();
+
+  /**
+   * @brief Read records newest first.
+   *
+   * Records still waiting for the batch write are read from RAM, so paging
+   * through history never writes flash.
+   * @param before Start below this sequence number, 0 for the newest record.
+   * @param limit Maximum number of records.
+   * @param sender Only records from this sender, nullptr or "" for all.
+   * @param out Receives the records.
+   * @return Sequence number to pass as before for the next page, 0 if there are no older records.
+   */
+  uint32_t read(uint32_t before, size_t limit, const char *sender, std::vector<JournalRecord> &out);
+
+  /**
+   * @brief Sequence number the next record gets.
+   */
+  uint32_t nextSeq();
+
+  JournalStats stats();
+
+private:
+  struct RecordHeader {
+    uint16_t senderLen;
+    uint16_t contentLen;
+    float rssi;
+    float snr;
+  };
+
+  void lock();
+  void unlock();
+  void flushLocked();
+  void startSegment();
+  String segmentPath(uint32_t firstSeq, const char *ext) const;
+  bool readRecord(File &log, const JournalIndexEntry &e, uint32_t seq, JournalRecord &out);
+  void readPending(size_t i, uint32_t seq, JournalRecord &out) const;
+  static void setRecord(const RecordHeader &rec, const char *text, const JournalIndexEntry &e, uint32_t seq, JournalRecord &out);
+
+  SemaphoreHandle_t mutex = nullptr;
+  std::vector<uint32_t> segments;   ///< First sequence number of each segment, oldest first
+  uint32_t next = 1;                ///< Sequence number of the next record
+  uint32_t segmentBytes = 0;        ///< Size of the current .log including pending records
+  uint16_t boot = 1;
+
+  uint8_t pendingLog[JOURNAL_FLUSH_BYTES];
+  JournalIndexEntry pendingIdx[JOURNAL_FLUSH_ENTRIES];
+  size_t pendingLogLen = 0;
+  size_t pendingCount = 0;
+  uint32_t pendingSince = 0;        ///< millis() of the oldest pending record
+  JournalStats counters;
+};
@@ -0,0 +1,157 @@
+#include "MessageRing.h"
+#include <string.h>
+#include <new>
+
+#define MESSAGE_RING_MAX_SENDER 64
+
+MessageRing::MessageRing(const MessageRing &other) {
+  *this = other;
+}
+
+MessageRing &MessageRing::operator=(const MessageRing &other) {
+  if (this == &other)
+    return *this;
+  if (capacity != other.capacity || maxEntries != other.maxEntries) {
+    release();
+    if (!other.arena || !begin(other.capacity, other.maxEntries))
+      return *this;
+  }
+  memcpy(arena, other.arena, capacity);
+  memcpy(offsets, other.offsets, maxEntries * sizeof(uint32_t));
+  first = other.first;
+  count = other.count;
+  head = other.head;
+  appended = other.appended;
+  return *this;
+}
+
+MessageRing::~MessageRing() {
+  release();
+}
+
+bool MessageRing::begin(size_t arenaBytes, size_t entries) {
+  release();
+  arenaBytes &= ~(size_t)3;
+  if (arenaBytes < recordSize(0, 0) || entries == 0)
+    return false;
+  arena = new (std::nothrow) uint8_t[arenaBytes];
+  offsets = new (std::nothrow) uint32_t[entries];
+  if (!arena || !offsets) {
+    release();
+    return false;
+  }
+  capacity = arenaBytes;
+  maxEntries = entries;
+  return true;
+}
+
+void MessageRing::release() {
+  delete[] arena;
+  delete[] offsets;
+  arena = nullptr;
+  offsets = nullptr;
+  capacity = 0;
+  maxEntries = 0;
+  clear();
+}
+
+void MessageRing::clear() {
+  first = 0;
+  count = 0;
+  head = 0;
+}
+
+size_t MessageRing::recordSize(size_t senderLen, size_t contentLen) {
+  return (sizeof(Record) + senderLen + 1 + contentLen + 1 + 3) & ~(size_t)3;
+}
+
+void MessageRing::evictOldest() {
+  if (count == 0)
+    return;
+  first = (first + 1) % maxEntries;
+  if (--count == 0)
+    head = 0;
+}
+
+void MessageRing::append(uint32_t timestamp, const char *sender, size_t senderLen, const char *content, size_t contentLen,
+                         float rssi, float snr, uint8_t type) {
+  if (!arena)
+    return;
+  if (senderLen > MESSAGE_RING_MAX_SENDER)
+    senderLen = MESSAGE_RING_MAX_SENDER;
+  size_t maxContent = capacity - sizeof(Record) - senderLen - 2;
+  if (maxContent > UINT16_MAX)
+    maxContent = UINT16_MAX;
+  if (contentLen > maxContent)
+    contentLen = maxContent;
+  size_t len = recordSize(senderLen, contentLen);
+
+  if (count == maxEntries)
+    evictOldest();
+
+  // Free space is [head, end) plus [0, oldest) before the arena wraps,
+  // and [head, oldest) after it
+  size_t pos;
+  for (;;) {
+    if (count == 0) {
+      pos = 0;
+      break;
+    }
+    size_t tail = offsets[first];
+    if (head > tail) {
+      if (head + len <= capacity) {
+        pos = head;
+        break;
+      }
+      if (len <= tail) {
+        pos = 0;
+        break;
+      }
+    } else if (head + len <= tail) {
+      pos = head;
+      break;
+    }
+    evictOldest();
+  }
+
+  Record rec{ timestamp, rssi, snr, (uint16_t)contentLen, (uint8_t)senderLen, type };
+  uint8_t *p = arena + pos;
+  memcpy(p, &rec, sizeof(rec));
+  p += sizeof(rec);
+  memcpy(p, sender, senderLen);
+  p[senderLen] = 0;
+  p += senderLen + 1;
+  memcpy(p, content, contentLen);
+  p[contentLen] = 0;
+
+  offsets[(first + count) % maxEntries] = pos;
+  count++;
+  appended++;
+  head = pos + len;
+}
+
+size_t MessageRing::trim(uint32_t now, uint32_t maxAge) {
+  size_t n = 0;
+  while (count && now - at(0).timestamp > maxAge) {
+    evictOldest();
+    n++;
+  }
+  return n;
+}
+
+LogEntry MessageRing::at(size_t i) const {
+  const uint8_t *p = arena + offsets[(first + i) % maxEntries];
+  Record rec;
+  memcpy(&rec, p, sizeof(rec));
+  const char *sender = (const char *)p + sizeof(rec);
+  return LogEntry{ rec.timestamp, rec.rssi, rec.snr, sender, sender + rec.senderLen + 1, rec.senderLen, rec.contentLen, rec.type };
+}
+
+size_t MessageRing::usedBytes() const {
+  size_t used = 0;
+  for (size_t i = 0; i < count; i++) {
+    LogEntry e = at(i);
+    used += recordSize(e.senderLen, e.contentLen);
+  }
+  return used;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <iterator>
+
+/**
+ * @file MessageRing.h
+ * @brief Bounded log of received messages in one preallocated arena.
+ *
+ * Each entry is stored inline as a small header followed by the sender and
+ * the content, both NUL-terminated, so appending a message does not touch the
+ * heap. The arena and the entry index are allocated once by begin(); when a
+ * new entry does not fit, the oldest entries are evicted. Entries never wrap
+ * around the end of the arena, so a LogEntry always points at contiguous text.
+ *
+ * Used for LoRaRadio's message log and raw frame log.
+ */
+
+/**
+ * @brief One log entry; the pointers stay valid until the entry is evicted.
+ */
+struct LogEntry {
+  uint32_t timestamp;
+  float rssi;
+  float snr;
+  const char *sender;
+  const char *content;
+  uint16_t senderLen;
+  uint16_t contentLen;
+  uint8_t type;           ///< LoRaPacketType of the message, 0 if not given
+};
+
+class MessageRing {
+public:
+  MessageRing() = default;
+  MessageRing(const MessageRing &other);
+  MessageRing &operator=(const MessageRing &other);
+  ~MessageRing();
+
+  /**
+   * @brief Allocate the arena. Call once at boot.
+   * @param arenaBytes Bytes for headers and text of all entries.
+   * @param maxEntries Entry limit, independent of their size.
+   * @return false if the allocation failed.
+   */
+  bool begin(size_t arenaBytes, size_t maxEntries);
+
+  /**
+   * @brief Append an entry, evicting the oldest ones until it fits.
+   *
+   * Content that would not fit in an empty arena is cut off.
+   */
+  void append(uint32_t timestamp, const char *sender, size_t senderLen, const char *content, size_t contentLen,
+              float rssi, float snr, uint8_t type = 0);
+
+  /**
+   * @brief Evict entries older than maxAge ms.
+   * @return Number of entries evicted.
+   */
+  size_t trim(uint32_t now, uint32_t maxAge);
+
+  void clear();
+  size_t size() const { return count; }
+  /// Running number of entry 0; entry i is number firstNumber() + i.
+  uint32_t firstNumber() const { return appended - count; }
+  bool empty() const { return count == 0; }
+
+  /**
+   * @brief Entry i, 0 being the oldest.
+   */
+  LogEntry at(size_t i) const;
+
+  /// Bytes of the arena taken by entries, padding included.
+  size_t usedBytes() const;
+  size_t capacityBytes() const { return capacity; }
+
+  class const_iterator {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef LogEntry value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const LogEntry *pointer;
+    typedef LogEntry reference;
+
+    const_iterator(const MessageRing *ring, size_t index) : ring(ring), index(index) {}
+    LogEntry operator*() const { return ring->at(index); }
+    const_iterator &operator++() { index++; return *this; }
+    const_iterator &operator--() { index--; return *this; }
+    bool operator==(const const_iterator &o) const { return index == o.index; }
+    bool operator!=(const const_iterator &o) const { return index != o.index; }
+
+  private:
+    const MessageRing *ring;
+    size_t index;
+  };
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, count); }
+  /// Newest first
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+private:
+  struct Record {
+    uint32_t timestamp;
+    float rssi;
+    float snr;
+    uint16_t contentLen;
+    uint8_t senderLen;
+    uint8_t type;
+  };
+
+  static size_t recordSize(size_t senderLen, size_t contentLen);
+  void evictOldest();
+  void release();
+
+  uint8_t *arena = nullptr;
+  uint32_t *offsets = nullptr;   ///< Arena offset per entry, a ring of maxEntries
+  size_t capacity = 0;
+  size_t maxEntries = 0;
+  size_t first = 0;              ///< Index in offsets of the oldest entry
+  size_t count = 0;
+  size_t head = 0;               ///< Arena offset just past the newest entry
+  uint32_t appended = 0;         ///< Entries ever appended, eviction does not lower it
+};
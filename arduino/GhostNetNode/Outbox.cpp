@@ -0,0 +1,246 @@
+#include "Outbox.h"
+#include <string.h>
+#include "FecCodec.h"
+
+static int popcount32(uint32_t v) {
+  int n = 0;
+  while (v) {
+    v &= v - 1;
+    n++;
+  }
+  return n;
+}
+
+bool Outbox::hasFreeSlot() const {
+  for (const Slot &s : slots)
+    if (s.state == SLOT_FREE)
+      return true;
+  return false;
+}
+
+uint32_t Outbox::fullMask(const Slot &s) const {
+  return s.hdr.fragCount >= 32 ? 0xFFFFFFFFUL : (1UL << s.hdr.fragCount) - 1;
+}
+
+uint32_t Outbox::codedMask(const Slot &s) const {
+  uint8_t blocks = s.hdr.fragCount + s.repairCount;
+  return blocks >= 32 ? 0xFFFFFFFFUL : (1UL << blocks) - 1;
+}
+
+bool Outbox::complete(const Slot &s, uint32_t bitmap) const {
+  if ((bitmap & fullMask(s)) == fullMask(s))
+    return true;
+  return s.repairCount && popcount32(bitmap) >= s.hdr.fragCount;
+}
+
+uint32_t Outbox::resendMask(const Slot &s) const {
+  uint32_t missing = fullMask(s) & ~s.bestAck;
+  if (!s.repairCount)
+    return missing;
+  // Repair fragments the neighbour holds stand in for data fragments
+  int needed = s.hdr.fragCount - popcount32(s.bestAck);
+  uint32_t resend = 0;
+  for (int i = 0; i < 32 && needed > 0; i++) {
+    if (missing & (1UL << i)) {
+      resend |= 1UL << i;
+      needed--;
+    }
+  }
+  return resend;
+}
+
+bool Outbox::add(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, uint8_t maxRetries, uint8_t repairs) {
+  if (len > sizeof(Slot::data))
+    return false;
+  for (Slot &s : slots) {
+    if (s.state != SLOT_FREE)
+      continue;
+    s.hdr = hdr;
+    s.hdr.fragCount = len == 0 ? 1 : (len + REASSEMBLY_FRAGMENT_SIZE - 1) / REASSEMBLY_FRAGMENT_SIZE;
+    s.lastLen = len - (s.hdr.fragCount - 1) * REASSEMBLY_FRAGMENT_SIZE;
+    s.repairCount = s.hdr.fragCount >= 2 && s.hdr.fragCount + repairs <= REASSEMBLY_MAX_FRAGMENTS ? repairs : 0;
+    s.maxRetries = maxRetries;
+    s.retries = 0;
+    s.probed = false;
+    s.bestAck = 0;
+    s.roundSentAt = 0;
+    memcpy(s.data, data, len);
+    // The last fragment is coded as a full block
+    memset(s.data + len, 0, s.hdr.fragCount * REASSEMBLY_FRAGMENT_SIZE - len);
+    startRound(s, codedMask(s));
+    return true;
+  }
+  return false;
+}
+
+void Outbox::startRound(Slot &s, uint32_t fragments) {
+  s.state = SLOT_SENDING;
+  s.toSend = fragments;
+  s.roundLast = 31 - __builtin_clz(fragments);
+  s.deadline = 0;
+}
+
+bool Outbox::nextFragment(LoRaPacketHeader &hdr, const uint8_t *&payload, size_t &len, uint16_t &tag) {
+  for (size_t i = 0; i < OUTBOX_SLOTS; i++) {
+    Slot &s = slots[i];
+    if (s.state != SLOT_SENDING || !s.toSend)
+      continue;
+    uint8_t idx = __builtin_ctz(s.toSend);
+    s.toSend &= ~(1UL << idx);
+
+    hdr = s.hdr;
+    hdr.fragIndex = idx;
+    hdr.flags = s.hdr.flags & ~LORA_FLAG_ACK_REQ;
+    if (idx == s.roundLast)
+      hdr.flags |= LORA_FLAG_ACK_REQ;
+    if (idx >= s.hdr.fragCount) {
+      // Coded when it is handed out; the transmitter copies it right away
+      hdr.flags |= LORA_FLAG_REPAIR;
+      repairBuf[0] = s.lastLen;
+      fecEncode(s.data, s.hdr.fragCount, REASSEMBLY_FRAGMENT_SIZE, idx - s.hdr.fragCount, repairBuf + 1);
+      payload = repairBuf;
+      len = sizeof(repairBuf);
+      counters.repairs++;
+    } else {
+      payload = s.data + idx * REASSEMBLY_FRAGMENT_SIZE;
+      len = idx + 1 == s.hdr.fragCount ? s.lastLen : REASSEMBLY_FRAGMENT_SIZE;
+    }
+    tag = ((i + 1) << 8) | idx;
+    if (s.retries > 0)
+      counters.retransmissions++;
+    return true;
+  }
+  return false;
+}
+
+void Outbox::onFrameDone(uint16_t tag, uint32_t now) {
+  if (!tag)
+    return;
+  size_t i = tagSlot(tag);
+  if (i >= OUTBOX_SLOTS)
+    return;
+  Slot &s = slots[i];
+  if (s.state != SLOT_SENDING || (tag & 0xFF) != s.roundLast)
+    return;
+
+  // Round complete on air; now wait for the ACK
+  uint32_t rto = counters.rtoMs ? counters.rtoMs : 5000;
+  for (uint8_t r = 0; r < s.retries && rto < OUTBOX_MAX_RTO_MS; r++)
+    rto *= 2;
+  if (rto > OUTBOX_MAX_RTO_MS)
+    rto = OUTBOX_MAX_RTO_MS;
+  s.state = SLOT_WAITING;
+  s.roundSentAt = now;
+  s.deadline = now + rto;
+}
+
+void Outbox::sampleRtt(uint32_t rtt) {
+  if (counters.srttMs == 0) {
+    counters.srttMs = rtt;
+    counters.rttvarMs = rtt / 2;
+  } else {
+    uint32_t err = rtt > counters.srttMs ? rtt - counters.srttMs : counters.srttMs - rtt;
+    counters.rttvarMs = (3 * counters.rttvarMs + err) / 4;
+    counters.srttMs = (7 * counters.srttMs + rtt) / 8;
+  }
+}
+
+void Outbox::onAck(uint16_t seq, uint32_t bitmap, uint32_t now) {
+  for (size_t i = 0; i < OUTBOX_SLOTS; i++) {
+    Slot &s = slots[i];
+    if (s.state == SLOT_FREE || s.hdr.seq != seq)
+      continue;
+
+    bitmap &= codedMask(s);
+    if (popcount32(bitmap) > popcount32(s.bestAck))
+      s.bestAck = bitmap;
+
+    if (s.state == SLOT_WAITING && s.retries == 0)
+      sampleRtt(now - s.roundSentAt);
+
+    if (complete(s, bitmap)) {
+      finish(i, DELIVERY_DELIVERED, now);
+    } else if (s.state == SLOT_WAITING) {
+      // Selective repeat: only what the best neighbour is missing
+      s.retries++;
+      if (s.retries > s.maxRetries)
+        finish(i, DELIVERY_FAILED, now);
+      else
+        startRound(s, resendMask(s));
+    }
+    return;
+  }
+}
+
+void Outbox::poll(uint32_t now, uint32_t ackAirtimeMs, uint32_t *timedOutDest) {
+  // Timeout: measured RTT when available, else a few ACK times
+  uint32_t minRto = ackAirtimeMs + 500;
+  uint32_t rto = counters.srttMs ? counters.srttMs + (4 * counters.rttvarMs > 500 ? 4 * counters.rttvarMs : 500)
+                                 : 2 * ackAirtimeMs + 3000;
+  counters.rtoMs = rto < minRto ? minRto : (rto > OUTBOX_MAX_RTO_MS ? OUTBOX_MAX_RTO_MS : rto);
+
+  for (size_t i = 0; i < OUTBOX_SLOTS; i++) {
+    Slot &s = slots[i];
+    if (s.state != SLOT_WAITING || (int32_t)(now - s.deadline) < 0)
+      continue;
+
+    if (timedOutDest && s.hdr.dest)
+      *timedOutDest = s.hdr.dest;
+    s.retries++;
+    if (s.retries > s.maxRetries) {
+      finish(i, DELIVERY_FAILED, now);
+      continue;
+    }
+    uint32_t missing = resendMask(s);
+    if (!s.bestAck && s.hdr.fragCount > 2 && !s.probed) {
+      // Nobody answered: the ACK_REQ frame itself may be what got lost
+      s.probed = true;
+      startRound(s, 1UL << (s.hdr.fragCount - 1));
+    } else {
+      startRound(s, missing);
+    }
+  }
+}
+
+bool Outbox::nextDeadline(uint32_t &at) const {
+  bool found = false;
+  for (const Slot &s : slots) {
+    if (s.state == SLOT_WAITING && (!found || (int32_t)(s.deadline - at) < 0)) {
+      at = s.deadline;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void Outbox::finish(size_t idx, DeliveryState st, uint32_t now) {
+  Slot &s = slots[idx];
+  s.state = SLOT_FREE;
+  s.toSend = 0;
+  finishedSlots |= 1 << idx;
+  if (st == DELIVERY_DELIVERED)
+    counters.delivered++;
+  else
+    counters.failed++;
+
+  results[resultHead] = { s.hdr.seq, st, now };
+  resultHead = (resultHead + 1) % OUTBOX_RESULTS;
+  if (callback)
+    callback(s.hdr.seq, st);
+}
+
+uint8_t Outbox::takeFinishedSlots() {
+  uint8_t mask = finishedSlots;
+  finishedSlots = 0;
+  return mask;
+}
+
+DeliveryState Outbox::state(uint16_t seq, uint32_t now) const {
+  for (const Slot &s : slots)
+    if (s.state != SLOT_FREE && s.hdr.seq == seq)
+      return DELIVERY_PENDING;
+  for (const Result &r : results)
+    if (r.state != DELIVERY_UNKNOWN && r.seq == seq && now - r.at <= OUTBOX_RESULT_TTL_MS)
+      return r.state;
+  return DELIVERY_UNKNOWN;
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "LoRaPacket.h"
+#include "ReassemblyTable.h"
+
+/**
+ * @file Outbox.h
+ * @brief Reliable delivery of originated messages with selective repeat.
+ *
+ * A message is kept in an outbox slot until a neighbour ACKs all of its
+ * fragments or the retries run out. Fragments are sent in rounds; the last
+ * frame of a round carries LORA_FLAG_ACK_REQ and receivers answer with a
+ * bitmap of the fragments they hold, so the next round only contains the
+ * missing ones. If a round gets no answer at all, the final fragment is
+ * resent alone as a cheap probe for the bitmap before everything is resent.
+ *
+ * With forward error correction the first round also carries repair
+ * fragments (FecCodec.h). A neighbour that holds as many fragments as the
+ * message has data fragments can rebuild it, so that counts as delivered, and
+ * a retransmission round only resends as many data fragments as are short.
+ *
+ * The retransmission timeout follows the measured round trip time (SRTT +
+ * 4 * RTTVAR, Jacobson/Karels) and doubles with every retry. Samples are only
+ * taken from first rounds so retransmissions never skew the estimate.
+ */
+
+#define OUTBOX_SLOTS 3
+#define OUTBOX_MAX_RETRIES 4
+#define OUTBOX_RESULTS 32
+#define OUTBOX_RESULT_TTL_MS (10UL * 60UL * 1000UL)
+#define OUTBOX_MAX_RTO_MS 60000UL
+
+enum DeliveryState : uint8_t {
+  DELIVERY_UNKNOWN = 0,  ///< Not sent by this node, or forgotten
+  DELIVERY_PENDING,      ///< Waiting for a complete ACK
+  DELIVERY_DELIVERED,    ///< A neighbour holds every fragment
+  DELIVERY_FAILED        ///< Retries exhausted
+};
+
+/// Called once per message when it reaches DELIVERED or FAILED
+typedef void (*DeliveryCallback)(uint16_t seq, DeliveryState state);
+
+struct OutboxStats {
+  uint32_t delivered = 0;
+  uint32_t failed = 0;
+  uint32_t retransmissions = 0;  ///< Fragments sent again
+  uint32_t repairs = 0;          ///< Repair fragments sent
+  uint32_t srttMs = 0;           ///< Smoothed round trip time, 0 until measured
+  uint32_t rttvarMs = 0;
+  uint32_t rtoMs = 0;            ///< Base timeout for the next round
+};
+
+class Outbox {
+public:
+  bool hasFreeSlot() const;
+
+  /**
+   * @brief Take a message for delivery.
+   * @param hdr Header template (type, origin, seq, hop limit); fragment fields are filled in.
+   * @param data Message bytes, copied into the slot.
+   * @param len Message length, at most REASSEMBLY_MAX_FRAGMENTS * REASSEMBLY_FRAGMENT_SIZE.
+   * @param maxRetries Rounds allowed after the first one.
+   * @param repairs Repair fragments sent after the data fragments in the first round.
+   * @return false if no slot is free or the message is too long.
+   */
+  bool add(const LoRaPacketHeader &hdr, const uint8_t *data, size_t len, uint8_t maxRetries, uint8_t repairs = 0);
+
+  /**
+   * @brief Next fragment to hand to the transmitter.
+   * @param hdr Receives the frame header.
+   * @param payload Receives a pointer to the fragment bytes.
+   * @param len Receives the fragment length.
+   * @param tag Receives a non-zero tag to pass back to onFrameDone().
+   * @return false if nothing is waiting to be sent.
+   */
+  bool nextFragment(LoRaPacketHeader &hdr, const uint8_t *&payload, size_t &len, uint16_t &tag);
+
+  /**
+   * @brief A tagged frame left the transmitter (sent, failed or dropped).
+   */
+  void onFrameDone(uint16_t tag, uint32_t now);
+
+  /**
+   * @brief Process an ACK for one of our messages.
+   * @param seq Acknowledged sequence number.
+   * @param bitmap Fragments the neighbour holds.
+   * @param now Current time in ms.
+   */
+  void onAck(uint16_t seq, uint32_t bitmap, uint32_t now);
+
+  /**
+   * @brief Handle retransmission timeouts. Call regularly.
+   * @param now Current time in ms.
+   * @param ackAirtimeMs Time on air of one ACK frame, lower bound for the timeout.
+   * @param timedOutDest If not null, receives the destination of a unicast message that timed out.
+   */
+  void poll(uint32_t now, uint32_t ackAirtimeMs, uint32_t *timedOutDest = nullptr);
+
+  /**
+   * @brief Earliest retransmission timeout of a round waiting for its ACK.
+   * @return false if no round is waiting; sending rounds get their deadline at TX done.
+   */
+  bool nextDeadline(uint32_t &at) const;
+
+  /**
+   * @brief Slot index encoded in a tag, so queued frames of a finished message can be purged.
+   */
+  static uint8_t tagSlot(uint16_t tag) { return (tag >> 8) - 1; }
+
+  /**
+   * @brief Bitmask of slots freed since the last call, so their queued frames can be purged.
+   */
+  uint8_t takeFinishedSlots();
+
+  DeliveryState state(uint16_t seq, uint32_t now) const;
+  void setCallback(DeliveryCallback cb) { callback = cb; }
+  const OutboxStats &stats() const { return counters; }
+
+private:
+  enum SlotState : uint8_t { SLOT_FREE, SLOT_SENDING, SLOT_WAITING };
+
+  struct Slot {
+    SlotState state = SLOT_FREE;
+    LoRaPacketHeader hdr;
+    uint8_t maxRetries = 0;
+    uint8_t retries = 0;
+    bool probed = false;
+    uint8_t lastLen = 0;
+    uint8_t repairCount = 0;   ///< Repair fragments behind the data fragments
+    uint8_t roundLast = 0;     ///< Fragment that carries ACK_REQ this round
+    uint32_t toSend = 0;       ///< Fragments of this round not yet handed out
+    uint32_t bestAck = 0;      ///< Most complete bitmap any neighbour reported
+    uint32_t roundSentAt = 0;  ///< TX done of roundLast
+    uint32_t deadline = 0;
+    uint8_t data[REASSEMBLY_MAX_FRAGMENTS * REASSEMBLY_FRAGMENT_SIZE];
+  };
+
+  struct Result {
+    uint16_t seq;
+    DeliveryState state;
+    uint32_t at;
+  };
+
+  void startRound(Slot &s, uint32_t fragments);
+  void finish(size_t idx, DeliveryState st, uint32_t now);
+  void sampleRtt(uint32_t rtt);
+  uint32_t fullMask(const Slot &s) const;
+  uint32_t codedMask(const Slot &s) const;
+  bool complete(const Slot &s, uint32_t bitmap) const;
+  uint32_t resendMask(const Slot &s) const;
+
+  Slot slots[OUTBOX_SLOTS];
+  Result results[OUTBOX_RESULTS] = {};
+  size_t resultHead = 0;
+  uint8_t finishedSlots = 0;
+  uint8_t repairBuf[1 + REASSEMBLY_FRAGMENT_SIZE];  ///< Last repair fragment handed out
+  DeliveryCallback callback = nullptr;
+  OutboxStats counters;
+};
@@ -0,0 +1,51 @@
+#include "PageStream.h"
+#include <string.h>
+
+void PageStream::add(const char *html) {
+  sections.push_back([html](size_t step, String &out) {
+    if (step)
+      return false;
+    out += html;
+    return true;
+  });
+}
+
+void PageStream::add(Section section) {
+  sections.push_back(section);
+}
+
+PageStream::Section PageStream::once(std::function<String()> render) {
+  return [render](size_t step, String &out) {
+    if (step)
+      return false;
+    out = render();
+    return true;
+  };
+}
+
+size_t PageStream::fill(uint8_t *buf, size_t maxLen) {
+  size_t n = 0;
+  while (n < maxLen) {
+    if (sent == piece.length()) {
+      if (current == sections.size())
+        break;
+      // The String keeps its buffer, so rows of similar length reuse it
+      piece = "";
+      sent = 0;
+      if (!sections[current](step++, piece)) {
+        current++;
+        step = 0;
+      }
+      if (piece.length() > largest)
+        largest = piece.length();
+      continue;
+    }
+    size_t take = piece.length() - sent;
+    if (take > maxLen - n)
+      take = maxLen - n;
+    memcpy(buf + n, piece.c_str() + sent, take);
+    sent += take;
+    n += take;
+  }
+  return n;
+}
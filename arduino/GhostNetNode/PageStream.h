@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+/**
+ * @file PageStream.h
+ * @brief A web page or JSON response produced piece by piece while the TCP
+ *        buffer takes it.
+ *
+ * A page is a list of sections. A section is called with step 0, 1, 2, ...
+ * and appends one piece per call, a table row, a JSON object or a short block,
+ * until it returns false. fill() copies pieces into the buffer of a chunked
+ * response and only asks for the next one when the previous one is out, so
+ * a request holds one piece at a time however long the logs are.
+ *
+ * Sections must not keep a snapshot view between calls: the LoRa task cannot
+ * publish while a reader holds the spare buffer. They keep a position (a log
+ * running number, a map key, an index) and pin the view for one row only, or,
+ * for a small table that must come out as one version, copy it at step 0.
+ *
+ * Used by LoRaWeb; only fill() runs on the host.
+ */
+
+class PageStream {
+public:
+  /// Appends piece number step to out; false when the section is complete (nothing appended)
+  typedef std::function<bool(size_t step, String &out)> Section;
+
+  /**
+   * @brief Add fixed HTML. The text is not copied: use a literal.
+   */
+  void add(const char *html);
+
+  void add(Section section);
+
+  /**
+   * @brief A section of one piece, rendered when its turn comes.
+   */
+  static Section once(std::function<String()> render);
+
+  /**
+   * @brief Copy the next bytes of the page into buf.
+   * @return Bytes written, 0 once the page is complete.
+   */
+  size_t fill(uint8_t *buf, size_t maxLen);
+
+  /// Longest piece so far, the heap a request needs beyond this object
+  size_t largestPiece() const { return largest; }
+
+private:
+  std::vector<Section> sections;
+  size_t current = 0;   ///< Section being sent
+  size_t step = 0;      ///< Next step of that section
+  String piece;
+  size_t sent = 0;      ///< Bytes of piece already copied
+  size_t largest = 0;
+};
@@ -0,0 +1,140 @@
+#include "PayloadCodec.h"
+#include <string.h>
+
+#define CODEC_ESCAPE 0x01
+#define CODEC_DICT_BASE 0x80
+#define CODEC_MATCH_BASE 0xC0
+#define CODEC_MIN_MATCH 3
+#define CODEC_MAX_MATCH 10
+#define CODEC_WINDOW 2048
+
+// The encoder tries every entry and takes the longest match. Only append:
+// the index is what goes on air.
+static const char *const dictionary[64] = {
+  // Neighbour table (LoRaWeb::loraSendTable)
+  "TABLE van ", "Node: NODE_", " | Laatst: ", "s | RSSI: -", " | SNR: ", "BEACON van ",
+  // Protocol and UI
+  "NODE_", "bericht", "verzonden", "ontvangen", "ACK", "team", "token", "speler",
+  // Game vocabulary
+  "spook", "geest", "ghost", "gevonden", "locatie", "punten", "score", "start",
+  "einde", "ronde", "vangen", "gevangen", "zoeken", "verstopt", "hint", "opdracht",
+  "klaar", "wacht", "rood", "blauw", "groen", "geel",
+  // Frequent Dutch words and fragments
+  "de ", "het ", "een ", " en ", "van ", "is ", "niet ", "naar ", "voor ", "met ",
+  "op ", "in ", "er ", "je ", "we ", "zijn ", "wordt ", "heeft ", "nog ", "ook ",
+  "dat ", "die ", "ij", "aa", "ee", "oo", "ch", "ng",
+};
+
+static uint8_t dictLen[64];
+static bool dictReady = false;
+
+static void initDictionary() {
+  if (dictReady)
+    return;
+  for (int i = 0; i < 64; i++)
+    dictLen[i] = strlen(dictionary[i]);
+  dictReady = true;
+}
+
+size_t codecCompress(const uint8_t *in, size_t len, uint8_t *out, size_t outSize) {
+  if (len == 0 || len > CODEC_MAX_SIZE)
+    return 0;
+  initDictionary();
+
+  size_t limit = len - 1 < outSize ? len - 1 : outSize;  // must end up shorter
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    size_t remaining = len - i;
+
+    // Best dictionary entry: saves length - 1 bytes
+    int bestDict = -1;
+    size_t dictMatch = 0;
+    for (int d = 0; d < 64; d++) {
+      size_t l = dictLen[d];
+      if (l > dictMatch && l <= remaining && dictionary[d][0] == in[i] && memcmp(in + i, dictionary[d], l) == 0) {
+        bestDict = d;
+        dictMatch = l;
+      }
+    }
+
+    // Best back reference: saves length - 2 bytes
+    size_t lzMatch = 0;
+    size_t lzOffset = 0;
+    if (remaining >= CODEC_MIN_MATCH) {
+      size_t maxLen = remaining < CODEC_MAX_MATCH ? remaining : CODEC_MAX_MATCH;
+      size_t start = i > CODEC_WINDOW ? i - CODEC_WINDOW : 0;
+      for (size_t j = i; j-- > start;) {
+        if (in[j] != in[i] || in[j + 1] != in[i + 1])
+          continue;
+        size_t l = 2;
+        while (l < maxLen && in[j + l] == in[i + l])
+          l++;
+        if (l > lzMatch) {
+          lzMatch = l;
+          lzOffset = i - j;
+          if (l == maxLen)
+            break;
+        }
+      }
+    }
+
+    if (lzMatch >= CODEC_MIN_MATCH && lzMatch - 2 > (dictMatch ? dictMatch - 1 : 0)) {
+      if (o + 2 > limit)
+        return 0;
+      size_t off = lzOffset - 1;
+      out[o++] = CODEC_MATCH_BASE | ((lzMatch - CODEC_MIN_MATCH) << 3) | (off >> 8);
+      out[o++] = off & 0xFF;
+      i += lzMatch;
+    } else if (dictMatch >= 2) {
+      if (o + 1 > limit)
+        return 0;
+      out[o++] = CODEC_DICT_BASE | bestDict;
+      i += dictMatch;
+    } else {
+      uint8_t b = in[i++];
+      bool escape = b == CODEC_ESCAPE || b >= CODEC_DICT_BASE;
+      if (o + (escape ? 2 : 1) > limit)
+        return 0;
+      if (escape)
+        out[o++] = CODEC_ESCAPE;
+      out[o++] = b;
+    }
+  }
+  return o;
+}
+
+size_t codecDecompress(const uint8_t *in, size_t len, uint8_t *out, size_t outSize) {
+  initDictionary();
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t c = in[i++];
+    if (c >= CODEC_MATCH_BASE) {
+      if (i >= len)
+        return 0;
+      size_t l = ((c >> 3) & 0x07) + CODEC_MIN_MATCH;
+      size_t off = (((size_t)(c & 0x07) << 8) | in[i++]) + 1;
+      if (off > o || o + l > outSize)
+        return 0;
+      for (size_t k = 0; k < l; k++, o++)
+        out[o] = out[o - off];  // may overlap, byte by byte on purpose
+    } else if (c >= CODEC_DICT_BASE) {
+      uint8_t d = c - CODEC_DICT_BASE;
+      if (o + dictLen[d] > outSize)
+        return 0;
+      memcpy(out + o, dictionary[d], dictLen[d]);
+      o += dictLen[d];
+    } else {
+      if (c == CODEC_ESCAPE) {
+        if (i >= len)
+          return 0;
+        c = in[i++];
+      }
+      if (o >= outSize)
+        return 0;
+      out[o++] = c;
+    }
+  }
+  return o;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file PayloadCodec.h
+ * @brief Compression for short LoRa text payloads.
+ *
+ * Messages are a few dozen to a few hundred bytes, too short for a general
+ * purpose compressor to learn anything. The codec combines a fixed dictionary
+ * of protocol keywords and game vocabulary with a small LZ77 over the message
+ * itself, so repeated table rows compress as well. Each code is one byte:
+ *
+ *   0x00, 0x02-0x7F   literal byte
+ *   0x01 b            escaped literal b (for 0x01 and 0x80-0xFF, e.g. UTF-8)
+ *   0x80-0xBF         dictionary entry 0..63
+ *   0xC0-0xFF o       back reference: length 3..10 in bits 5-3, offset
+ *                     1..2048 in bits 2-0 and the next byte
+ *
+ * The encoder is greedy and only used when the result is shorter than the
+ * input; LORA_FLAG_COMPRESSED tells the receiver to decode.
+ *
+ * This file has no Arduino dependencies so it can be built on the host too.
+ */
+
+#define CODEC_MAX_SIZE 2560  ///< Largest message either side handles (32 fragments of 80 bytes)
+
+/**
+ * @brief Compress a message.
+ * @param in Message bytes.
+ * @param len Message length.
+ * @param out Output buffer.
+ * @param outSize Output buffer size.
+ * @return Compressed length, or 0 if the result would not be shorter or does not fit.
+ */
+size_t codecCompress(const uint8_t *in, size_t len, uint8_t *out, size_t outSize);
+
+/**
+ * @brief Decompress a message produced by codecCompress().
+ * @param in Compressed bytes.
+ * @param len Compressed length.
+ * @param out Output buffer.
+ * @param outSize Output buffer size.
+ * @return Decompressed length, or 0 if the input is corrupt or the output does not fit.
+ */
+size_t codecDecompress(const uint8_t *in, size_t len, uint8_t *out, size_t outSize);
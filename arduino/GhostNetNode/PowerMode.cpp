@@ -0,0 +1,79 @@
+#include "PowerMode.h"
+
+static uint32_t symbolUs(uint8_t sf, float bw) {
+  return (uint32_t)((float)(1UL << sf) * 1000.0f / bw);
+}
+
+uint16_t powerWakePreamble(uint8_t sf, float bw) {
+  uint32_t symbols = (POWER_WAKE_PREAMBLE_MS * 1000UL + symbolUs(sf, bw) - 1) / symbolUs(sf, bw);
+  // At SF11/12 a few symbols already take that long; below 2 * minSymbols
+  // plus a little the receiver would have no time to sleep
+  uint32_t minimum = 3 * POWER_MIN_SYMBOLS;
+  if (symbols < minimum)
+    symbols = minimum;
+  return symbols > UINT16_MAX ? UINT16_MAX : (uint16_t)symbols;
+}
+
+RxDutyCycle powerRxDutyCycle(uint8_t sf, float bw, uint16_t senderPreamble, uint16_t minSymbols) {
+  if (2 * minSymbols > senderPreamble)
+    return { 0, 0 };
+  uint32_t symbol = symbolUs(sf, bw);
+  uint32_t sleepUs = symbol * (senderPreamble - 2 * minSymbols);
+  if (sleepUs < 1000)
+    return { 0, 0 };
+  // Awake long enough to see minSymbols, and to still be listening when a
+  // preamble that started just after the previous window ends
+  uint32_t coverUs = symbol * (senderPreamble + 1) > sleepUs - 1000 ? (symbol * (senderPreamble + 1) - (sleepUs - 1000)) / 2 : 0;
+  uint32_t rxUs = symbol * (minSymbols + 1);
+  if (coverUs > rxUs)
+    rxUs = coverUs;
+  return { rxUs, sleepUs };
+}
+
+void SleeperTable::heard(uint32_t node, bool sleeps, uint32_t now) {
+  Entry *slot = nullptr;
+  for (Entry &e : entries) {
+    if (e.node == node) {
+      slot = &e;
+      break;
+    }
+  }
+  if (!sleeps) {
+    if (slot)
+      slot->node = 0;
+    return;
+  }
+  if (!slot) {
+    // A free slot, else the neighbour heard longest ago
+    slot = &entries[0];
+    for (Entry &e : entries) {
+      if (e.node == 0 || now - e.heardAt > ttlMs) {
+        slot = &e;
+        break;
+      }
+      if (now - e.heardAt > now - slot->heardAt)
+        slot = &e;
+    }
+  }
+  slot->node = node;
+  slot->heardAt = now;
+}
+
+bool SleeperTable::sleeps(uint32_t node, uint32_t now) const {
+  for (const Entry &e : entries)
+    if (e.node == node && now - e.heardAt <= ttlMs)
+      return true;
+  return false;
+}
+
+bool SleeperTable::any(uint32_t now) const {
+  return size(now) > 0;
+}
+
+size_t SleeperTable::size(uint32_t now) const {
+  size_t n = 0;
+  for (const Entry &e : entries)
+    if (e.node != 0 && now - e.heardAt <= ttlMs)
+      n++;
+  return n;
+}
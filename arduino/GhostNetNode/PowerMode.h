@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file PowerMode.h
+ * @brief Power-saving operating mode for battery-powered field nodes.
+ *
+ * POWER_ALWAYS_ON is the original behaviour: the SX1262 listens all the
+ * time, WiFi and the display are on. Gateways and nodes players connect to
+ * stay in this mode.
+ *
+ * In POWER_SAVE the node is a relay: no WiFi, no display, the ESP32 is in
+ * light sleep until DIO1 or the next radio timer, and the SX1262 uses its
+ * RX duty cycle: it wakes briefly to look for a preamble and sleeps again.
+ * A sleeping receiver only catches frames whose preamble outlasts its sleep
+ * period, so its neighbours send it frames with a wake-up preamble of about
+ * POWER_WAKE_PREAMBLE_MS. Nodes announce the mode in their beacon
+ * (LORA_BEACON_POWER); SleeperTable remembers which neighbours sleep.
+ * Frames to an awake neighbour keep the short preamble.
+ *
+ * ACKs are the exception: after each of its own frames a sleeping node
+ * listens continuously for POWER_ACK_WINDOW_MS plus two ACK times, like the
+ * receive windows of a LoRaWAN class A device, so the answer needs no
+ * wake-up preamble.
+ */
+
+#define POWER_WAKE_PREAMBLE_MS 120      ///< Longest sleep between two preamble checks
+#define POWER_MIN_SYMBOLS 8             ///< Preamble symbols the SX1262 needs to detect a frame
+#define POWER_DEFAULT_PREAMBLE 8        ///< Preamble of frames to awake neighbours
+#define POWER_ACK_WINDOW_MS 500         ///< Continuous RX after a frame, on top of two ACK times
+#define POWER_SLEEPER_SLOTS 16
+#define POWER_SLEEPER_TTL_MS (10UL * 60UL * 1000UL)  ///< Same as ROUTE_TTL_MS, until setTtl()
+
+// Flags of the LORA_BEACON_POWER section
+#define POWER_FLAG_SLEEPS 0x01          ///< Receiver is duty cycled, send with the wake-up preamble
+
+enum PowerMode : uint8_t {
+  POWER_ALWAYS_ON = 0,  ///< Continuous RX, WiFi and display on
+  POWER_SAVE = 1        ///< RX duty cycle and light sleep, relay only
+};
+
+struct RxDutyCycle {
+  uint32_t rxUs;     ///< Listening window, 0 if the radio never sleeps
+  uint32_t sleepUs;  ///< Sleep between two windows
+};
+
+/**
+ * @brief Preamble symbols of a frame that a duty-cycled receiver cannot miss.
+ *
+ * About POWER_WAKE_PREAMBLE_MS long, and at least long enough for the
+ * receiver to sleep at all at slow spreading factors.
+ */
+uint16_t powerWakePreamble(uint8_t sf, float bw);
+
+/**
+ * @brief Listen and sleep periods of SX126x::startReceiveDutyCycleAuto().
+ *
+ * Follows RadioLib: the receiver sleeps senderPreamble - 2 * minSymbols
+ * symbols and listens long enough to see minSymbols of any preamble of that
+ * length. Used by the simulator and the energy model.
+ */
+RxDutyCycle powerRxDutyCycle(uint8_t sf, float bw, uint16_t senderPreamble, uint16_t minSymbols = POWER_MIN_SYMBOLS);
+
+/**
+ * @brief Neighbours that announced POWER_SAVE in their last beacon.
+ */
+class SleeperTable {
+public:
+  /**
+   * @brief Record the mode a neighbour announced in its beacon.
+   */
+  void heard(uint32_t node, bool sleeps, uint32_t now);
+
+  bool sleeps(uint32_t node, uint32_t now) const;
+
+  /**
+   * @brief Any neighbour asleep, so broadcasts need the wake-up preamble.
+   */
+  bool any(uint32_t now) const;
+
+  size_t size(uint32_t now) const;
+
+  /**
+   * @brief Forget neighbours whose beacon was not heard for this long.
+   */
+  void setTtl(uint32_t ms) { ttlMs = ms; }
+
+private:
+  struct Entry {
+    uint32_t node = 0;
+    uint32_t heardAt = 0;
+  };
+
+  Entry entries[POWER_SLEEPER_SLOTS];
+  uint32_t ttlMs = POWER_SLEEPER_TTL_MS;
+};
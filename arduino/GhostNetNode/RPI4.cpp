@@ -5,8 +5,8 @@ void RPI4::sendToRPI4(const String& msg) {
     Serial.println("[RPI4] " + msg);
 }
 
-void RPI4::sendLoRaMessage(const ReceivedMessage& msg) {
-    String out = "[RPI4] LORA: [" + String(msg.timestamp) + "] " + msg.sender + ": " + msg.content + " (RSSI=" + String(msg.rssi, 1) + ", SNR=" + String(msg.snr, 1) + ")";
+void RPI4::sendLoRaMessage(const LogEntry& msg) {
+    String out = "[RPI4] LORA: [" + String(msg.timestamp) + "] " + String(msg.sender) + ": " + msg.content + " (RSSI=" + String(msg.rssi, 1) + ", SNR=" + String(msg.snr, 1) + ")";
     Serial.println(out);
 }
 
@@ -0,0 +1,84 @@
+#include "RadioQueue.h"
+#include <string.h>
+
+static_assert((RADIO_QUEUE_SLOTS & (RADIO_QUEUE_SLOTS - 1)) == 0, "RADIO_QUEUE_SLOTS must be a power of two");
+
+RadioQueue::RadioQueue() {
+  for (uint32_t i = 0; i < RADIO_QUEUE_SLOTS; i++)
+    slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+RadioQueueResult RadioQueue::push(uint8_t type, const uint8_t *content, size_t len, const char *receiver) {
+  if (!receiver)
+    receiver = "";
+  size_t receiverLen = strlen(receiver);
+  if (len > RADIO_MESSAGE_MAX || receiverLen >= RADIO_RECEIVER_MAX) {
+    tooLong.fetch_add(1, std::memory_order_relaxed);
+    return RADIO_QUEUE_TOO_LONG;
+  }
+
+  // Claim a position whose slot the consumer has released
+  uint32_t pos = head.load(std::memory_order_relaxed);
+  Slot *slot;
+  for (;;) {
+    slot = &slots[pos & (RADIO_QUEUE_SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      full.fetch_add(1, std::memory_order_relaxed);
+      return RADIO_QUEUE_FULL;
+    } else {
+      pos = head.load(std::memory_order_relaxed);  // another producer took it
+    }
+  }
+
+  slot->msg.type = type;
+  slot->msg.len = (uint16_t)len;
+  memcpy(slot->msg.receiver, receiver, receiverLen + 1);
+  if (len)
+    memcpy(slot->msg.content, content, len);
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  accepted.fetch_add(1, std::memory_order_relaxed);
+  uint32_t depth = pos + 1 - tail.load(std::memory_order_relaxed);
+  if (depth > RADIO_QUEUE_SLOTS)
+    depth = 0;  // the consumer already read past this slot
+  uint32_t seen = maxDepth.load(std::memory_order_relaxed);
+  while (depth > seen && !maxDepth.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {}
+  return RADIO_QUEUE_OK;
+}
+
+const RadioMessage *RadioQueue::front() {
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  Slot &slot = slots[pos & (RADIO_QUEUE_SLOTS - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+    return nullptr;  // empty, or the producer of this slot is still copying
+  return &slot.msg;
+}
+
+void RadioQueue::pop() {
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  Slot &slot = slots[pos & (RADIO_QUEUE_SLOTS - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+    return;
+  // Free for the producer that comes round the ring next
+  slot.seq.store(pos + RADIO_QUEUE_SLOTS, std::memory_order_release);
+  tail.store(pos + 1, std::memory_order_relaxed);
+}
+
+size_t RadioQueue::size() const {
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  uint32_t h = head.load(std::memory_order_relaxed);
+  return h - t <= RADIO_QUEUE_SLOTS ? h - t : 0;
+}
+
+RadioQueueStats RadioQueue::stats() const {
+  RadioQueueStats s;
+  s.accepted = accepted.load(std::memory_order_relaxed);
+  s.full = full.load(std::memory_order_relaxed);
+  s.tooLong = tooLong.load(std::memory_order_relaxed);
+  s.maxDepth = maxDepth.load(std::memory_order_relaxed);
+  return s;
+}
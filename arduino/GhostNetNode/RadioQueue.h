@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @file RadioQueue.h
+ * @brief Lock-free hand-over of outgoing messages to the LoRa task.
+ *
+ * The web server, the user manager and the game logic run on core 0, the LoRa
+ * task on core 1. Producers copy a message into one of RADIO_QUEUE_SLOTS
+ * preallocated slots; the LoRa task reads it in place and releases the slot.
+ * Nothing is allocated on either side and no lock is taken: every slot has a
+ * sequence number that says whether it is free for the producer at a given
+ * ring position or holds a message for the consumer (D. Vyukov's bounded
+ * queue). Any number of producers may push, only the LoRa task pops.
+ *
+ * A full queue is reported to the caller instead of silently dropping the
+ * message, so the web UI can ask the player to try again.
+ */
+
+#define RADIO_QUEUE_SLOTS 16      ///< Power of two
+#define RADIO_MESSAGE_MAX 1024    ///< Longest message content a slot holds
+#define RADIO_RECEIVER_MAX 24     ///< "ALL", "GATEWAY" or a node name, with terminator
+
+enum RadioQueueResult : uint8_t {
+  RADIO_QUEUE_OK,
+  RADIO_QUEUE_FULL,       ///< All slots taken, try again later
+  RADIO_QUEUE_TOO_LONG,   ///< Content or receiver does not fit in a slot
+};
+
+struct RadioMessage {
+  uint8_t type;                        ///< LoRaPacketType for the frame header
+  uint16_t len;                        ///< Bytes used in content
+  char receiver[RADIO_RECEIVER_MAX];   ///< Receiver name, "ALL" for broadcast
+  uint8_t content[RADIO_MESSAGE_MAX];
+};
+
+struct RadioQueueStats {
+  uint32_t accepted = 0;    ///< Messages queued
+  uint32_t full = 0;        ///< Messages refused because every slot was taken
+  uint32_t tooLong = 0;     ///< Messages refused because they do not fit in a slot
+  uint32_t maxDepth = 0;    ///< Highest queue depth seen
+};
+
+class RadioQueue {
+public:
+  RadioQueue();
+
+  /**
+   * @brief Copy a message into a free slot. Safe from any task, never blocks.
+   * @param type LoRaPacketType of the message.
+   * @param content Message bytes.
+   * @param len Number of bytes, at most RADIO_MESSAGE_MAX.
+   * @param receiver Receiver name, nullptr or "" for broadcast.
+   */
+  RadioQueueResult push(uint8_t type, const uint8_t *content, size_t len, const char *receiver);
+
+  /**
+   * @brief Oldest message, or nullptr if the queue is empty. Consumer only.
+   *
+   * The message stays in its slot until pop(), so it is not copied.
+   */
+  const RadioMessage *front();
+
+  /**
+   * @brief Release the slot returned by front(). Consumer only.
+   */
+  void pop();
+
+  size_t size() const;
+
+  /**
+   * @brief Counters as seen at this moment; producers may update them concurrently.
+   */
+  RadioQueueStats stats() const;
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;   ///< pos: free for the producer at pos, pos + 1: holds a message
+    RadioMessage msg;
+  };
+
+  Slot slots[RADIO_QUEUE_SLOTS];
+  std::atomic<uint32_t> head{0};   ///< Next position a producer claims
+  std::atomic<uint32_t> tail{0};   ///< Next position the consumer reads
+  std::atomic<uint32_t> accepted{0};
+  std::atomic<uint32_t> full{0};
+  std::atomic<uint32_t> tooLong{0};
+  std::atomic<uint32_t> maxDepth{0};
+};
@@ -0,0 +1,132 @@
+#include "ReassemblyTable.h"
+#include <string.h>
+
+ReassemblyTable::Result ReassemblyTable::add(uint32_t origin, uint16_t seq, uint8_t index, uint8_t count,
+                                             const uint8_t *data, size_t len, uint32_t now,
+                                             const uint8_t *&out, size_t &outLen, bool repair) {
+  // Every fragment but the last must be full size so offsets are index * size.
+  // A repair fragment is the last fragment's length and one coded block.
+  bool last = index + 1 == count;
+  bool valid = repair ? count >= 2 && index >= count && index < REASSEMBLY_MAX_FRAGMENTS &&
+                            len == 1 + REASSEMBLY_FRAGMENT_SIZE && data[0] >= 1 && data[0] <= REASSEMBLY_FRAGMENT_SIZE
+                      : count > 0 && count <= REASSEMBLY_MAX_FRAGMENTS && index < count &&
+                            len <= REASSEMBLY_FRAGMENT_SIZE && (last || len == REASSEMBLY_FRAGMENT_SIZE);
+  if (!valid) {
+    counters.rejected++;
+    return REJECTED;
+  }
+
+  expire(now);
+
+  // Fragments that arrive after the message was rebuilt from repair ones
+  for (const Done &d : done)
+    if (d.count == count && d.origin == origin && d.seq == seq)
+      return DUPLICATE;
+
+  Slot *slot = findOrClaim(origin, seq, count, now);
+  uint32_t bit = 1UL << index;
+  if (slot->bitmap & bit)
+    return DUPLICATE;
+
+  uint8_t *block = slot->data + index * REASSEMBLY_FRAGMENT_SIZE;
+  if (repair) {
+    memcpy(block, data + 1, REASSEMBLY_FRAGMENT_SIZE);
+    slot->lastLen = data[0];
+  } else {
+    // Zero padded, the repair fragments were coded that way
+    memcpy(block, data, len);
+    memset(block + len, 0, REASSEMBLY_FRAGMENT_SIZE - len);
+    if (last)
+      slot->lastLen = len;
+  }
+  slot->bitmap |= bit;
+  slot->lastUpdate = now;
+
+  uint32_t full = count == 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+  if ((slot->bitmap & full) != full) {
+    // Enough pieces: rebuild the missing data fragments from the repair ones
+    if (__builtin_popcount(slot->bitmap) < count ||
+        !fecDecode(slot->data, count, REASSEMBLY_FRAGMENT_SIZE, slot->bitmap))
+      return PENDING;
+    counters.recovered++;
+  }
+
+  slot->used = false;
+  counters.completed++;
+  done[doneHead] = { origin, seq, count };
+  doneHead = (doneHead + 1) % REASSEMBLY_DONE_HISTORY;
+  out = slot->data;
+  outLen = (count - 1) * REASSEMBLY_FRAGMENT_SIZE + slot->lastLen;
+  return COMPLETE;
+}
+
+ReassemblyTable::Slot *ReassemblyTable::findOrClaim(uint32_t origin, uint16_t seq, uint8_t count, uint32_t now) {
+  Slot *freeSlot = nullptr;
+  Slot *oldest = nullptr;
+  for (Slot &s : slots) {
+    if (!s.used) {
+      if (!freeSlot)
+        freeSlot = &s;
+      continue;
+    }
+    if (s.origin == origin && s.seq == seq && s.count == count)
+      return &s;
+    if (!oldest || (int32_t)(s.lastUpdate - oldest->lastUpdate) < 0)
+      oldest = &s;
+  }
+
+  Slot *slot = freeSlot;
+  if (!slot) {
+    slot = oldest;
+    counters.dropped++;
+  }
+  slot->used = true;
+  slot->origin = origin;
+  slot->seq = seq;
+  slot->count = count;
+  slot->lastLen = 0;
+  slot->bitmap = 0;
+  slot->lastUpdate = now;
+  return slot;
+}
+
+void ReassemblyTable::expire(uint32_t now) {
+  for (Slot &s : slots) {
+    if (s.used && now - s.lastUpdate > REASSEMBLY_TIMEOUT_MS) {
+      s.used = false;
+      counters.expired++;
+    }
+  }
+}
+
+bool ReassemblyTable::nextExpiry(uint32_t &at) const {
+  bool found = false;
+  for (const Slot &s : slots) {
+    uint32_t t = s.lastUpdate + REASSEMBLY_TIMEOUT_MS + 1;
+    if (s.used && (!found || (int32_t)(t - at) < 0)) {
+      at = t;
+      found = true;
+    }
+  }
+  return found;
+}
+
+uint32_t ReassemblyTable::receivedBitmap(uint32_t origin, uint16_t seq, uint8_t count) const {
+  if (count == 0 || count > REASSEMBLY_MAX_FRAGMENTS)
+    return 0;
+  for (const Slot &s : slots)
+    if (s.used && s.origin == origin && s.seq == seq && s.count == count)
+      return s.bitmap;
+  for (const Done &d : done)
+    if (d.count == count && d.origin == origin && d.seq == seq)
+      return count == 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+  return 0;
+}
+
+size_t ReassemblyTable::activeSlots() const {
+  size_t n = 0;
+  for (const Slot &s : slots)
+    if (s.used)
+      n++;
+  return n;
+}
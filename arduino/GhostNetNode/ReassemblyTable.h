@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "FecCodec.h"
+
+/**
+ * @file ReassemblyTable.h
+ * @brief Fixed-capacity fragment reassembly without per-fragment allocation.
+ *
+ * Each slot owns a contiguous buffer large enough for a full message and a
+ * bitmap of the fragments received so far. Slots are recycled when a message
+ * completes, when it has been idle for longer than the timeout, or (least
+ * recently used first) when a new message arrives and all slots are busy.
+ *
+ * Repair fragments of an erasure-coded message (FecCodec.h) are stored
+ * behind the data fragments in the same buffer; as soon as any count of the
+ * fragments are in, the missing data fragments are rebuilt from them.
+ */
+
+#define REASSEMBLY_SLOTS 4
+#define REASSEMBLY_MAX_FRAGMENTS 32  ///< Width of the received-fragment bitmap
+#define REASSEMBLY_FRAGMENT_SIZE 80  ///< Payload bytes in every fragment but the last
+#define REASSEMBLY_TIMEOUT_MS 120000UL
+#define REASSEMBLY_DONE_HISTORY 16  ///< Completed messages remembered for ACK bitmaps
+
+struct ReassemblyStats {
+  uint32_t completed = 0;  ///< Messages reassembled
+  uint32_t dropped = 0;    ///< Partials evicted to make room for a new message
+  uint32_t expired = 0;    ///< Partials evicted after REASSEMBLY_TIMEOUT_MS
+  uint32_t rejected = 0;   ///< Fragments that could never fit a slot
+  uint32_t recovered = 0;  ///< Messages completed with repair fragments instead of a retransmission
+};
+
+class ReassemblyTable {
+public:
+  enum Result {
+    PENDING,    ///< Stored, message not complete yet
+    COMPLETE,   ///< Message complete, out/outLen point to it
+    DUPLICATE,  ///< Fragment was already stored
+    REJECTED    ///< Fragment index/size invalid or message too long
+  };
+
+  /**
+   * @brief Store one fragment.
+   *
+   * On COMPLETE the slot is released and out points into its buffer; the data
+   * stays valid until the next call to add().
+   * @param origin Origin node hash.
+   * @param seq Origin sequence number.
+   * @param index Fragment index (0-based); count and up for repair fragments.
+   * @param count Number of data fragments.
+   * @param data Fragment payload.
+   * @param len Fragment payload length.
+   * @param now Current time in ms.
+   * @param out Receives the assembled message on COMPLETE.
+   * @param outLen Receives the assembled length on COMPLETE.
+   * @param repair true for a LORA_FLAG_REPAIR fragment.
+   * @return One of Result.
+   */
+  Result add(uint32_t origin, uint16_t seq, uint8_t index, uint8_t count,
+             const uint8_t *data, size_t len, uint32_t now,
+             const uint8_t *&out, size_t &outLen, bool repair = false);
+
+  /**
+   * @brief Release partials that have not seen a fragment within the timeout.
+   * @param now Current time in ms.
+   */
+  void expire(uint32_t now);
+
+  /**
+   * @brief Time at which expire() releases the next partial.
+   * @return false if no partial is held.
+   */
+  bool nextExpiry(uint32_t &at) const;
+
+  /**
+   * @brief Fragments held for a message, for the bitmap in an ACK.
+   * @return Partial bitmap (repair fragments above the data bits), all data
+   *         bits for a recently completed message, 0 if unknown.
+   */
+  uint32_t receivedBitmap(uint32_t origin, uint16_t seq, uint8_t count) const;
+
+  /**
+   * @brief Number of slots holding a partial message.
+   */
+  size_t activeSlots() const;
+
+  const ReassemblyStats &stats() const { return counters; }
+
+private:
+  struct Slot {
+    bool used = false;
+    uint32_t origin = 0;
+    uint16_t seq = 0;
+    uint8_t count = 0;
+    uint8_t lastLen = 0;     ///< Length of the final data fragment, 0 until known
+    uint32_t bitmap = 0;     ///< Bit i set when fragment i is stored
+    uint32_t lastUpdate = 0; ///< Time of the most recent fragment
+    uint8_t data[REASSEMBLY_MAX_FRAGMENTS * REASSEMBLY_FRAGMENT_SIZE];  ///< Data, then repair fragments
+  };
+
+  struct Done {
+    uint32_t origin;
+    uint16_t seq;
+    uint8_t count;
+  };
+
+  Slot *findOrClaim(uint32_t origin, uint16_t seq, uint8_t count, uint32_t now);
+
+  Slot slots[REASSEMBLY_SLOTS];
+  Done done[REASSEMBLY_DONE_HISTORY] = {};
+  size_t doneHead = 0;
+  ReassemblyStats counters;
+};
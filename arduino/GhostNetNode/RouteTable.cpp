@@ -0,0 +1,166 @@
+#include "RouteTable.h"
+
+static void putU32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void RouteTable::begin(uint32_t self, bool gateway) {
+  selfId = self;
+  isGateway = gateway;
+}
+
+bool RouteTable::alive(const RouteEntry &r, uint32_t now) const {
+  return r.dest && r.metric < ROUTE_METRIC_INFINITE && now - r.updatedAt <= ttlMs;
+}
+
+RouteEntry *RouteTable::find(uint32_t dest) {
+  for (RouteEntry &r : routes)
+    if (r.dest == dest)
+      return &r;
+  return nullptr;
+}
+
+uint8_t RouteTable::linkCost(uint8_t sf) {
+  // Airtime roughly doubles per SF step
+  if (sf < 7)
+    sf = 7;
+  return (1 << (sf - 7)) + ROUTE_HOP_PENALTY;
+}
+
+bool RouteTable::onAdvert(uint32_t neighbour, uint8_t linkCost, const uint8_t *data, size_t len, uint32_t now) {
+  bool changed = false;
+  for (size_t pos = 0; pos + ROUTE_ADVERT_ENTRY_SIZE <= len; pos += ROUTE_ADVERT_ENTRY_SIZE) {
+    uint32_t dest = getU32(data + pos);
+    uint16_t seq = data[pos + 4] | (data[pos + 5] << 8);
+    uint16_t metric = data[pos + 6] + linkCost;
+    uint8_t flags = data[pos + 7];
+    if (dest == 0 || dest == selfId)
+      continue;
+    if (metric >= ROUTE_METRIC_INFINITE)
+      metric = ROUTE_METRIC_INFINITE;
+
+    RouteEntry *r = find(dest);
+    if (!r) {
+      if (metric == ROUTE_METRIC_INFINITE)
+        continue;
+      // Free or expired entry, otherwise replace the most expensive route
+      for (RouteEntry &c : routes) {
+        if (!alive(c, now)) {
+          r = &c;
+          break;
+        }
+        if (!r || c.metric > r->metric)
+          r = &c;
+      }
+      if (alive(*r, now) && r->metric <= metric)
+        continue;
+      *r = RouteEntry();
+    } else {
+      int16_t age = (int16_t)(seq - r->seq);
+      bool fresher = age > 0 && (metric <= r->metric || now - r->updatedAt > settleMs);
+      bool better = age >= 0 && metric < r->metric;
+      bool fromNextHop = r->nextHop == neighbour && age >= 0;
+      // A broken route keeps its sequence for the TTL, so stale adverts of
+      // the old path cannot revive it
+      if (now - r->updatedAt <= ttlMs && !fresher && !better && !fromNextHop)
+        continue;
+      if ((seq & 1) && metric < ROUTE_METRIC_INFINITE && r->nextHop != neighbour)
+        continue;
+      // Only the next hop can break a route, and only a working one
+      if (metric == ROUTE_METRIC_INFINITE && (!fromNextHop || !alive(*r, now)))
+        continue;
+    }
+
+    bool appeared = r->dest != dest || !alive(*r, now) || r->flags != flags;
+    bool broke = metric == ROUTE_METRIC_INFINITE;
+    if (appeared || broke || r->nextHop != neighbour || r->metric != metric)
+      counters.updates++;
+    r->dest = dest;
+    r->nextHop = neighbour;
+    r->seq = seq;
+    r->metric = metric;
+    r->flags = flags;
+    r->unreported = broke;
+    r->updatedAt = now;
+    changed |= appeared || broke;
+  }
+  return changed;
+}
+
+void RouteTable::putEntry(uint8_t *p, const RouteEntry &r) const {
+  putU32(p, r.dest);
+  p[4] = r.seq & 0xFF;
+  p[5] = r.seq >> 8;
+  p[6] = r.metric;
+  p[7] = r.flags;
+}
+
+size_t RouteTable::encodeAdvert(uint8_t *out, uint32_t now, size_t maxEntries) {
+  selfSeq += 2;
+  putU32(out, selfId);
+  out[4] = selfSeq & 0xFF;
+  out[5] = selfSeq >> 8;
+  out[6] = 0;
+  out[7] = isGateway ? ROUTE_FLAG_GATEWAY : 0;
+  size_t n = 1;
+
+  if (maxEntries > ROUTE_ADVERT_MAX_ENTRIES)
+    maxEntries = ROUTE_ADVERT_MAX_ENTRIES;
+  for (RouteEntry &r : routes) {
+    if (!r.unreported || n == maxEntries)
+      continue;
+    putEntry(out + n * ROUTE_ADVERT_ENTRY_SIZE, r);
+    r.unreported = false;
+    n++;
+  }
+  for (size_t k = 0; k < ROUTE_TABLE_SIZE && n < maxEntries; k++) {
+    const RouteEntry &r = routes[(advertCursor + k) % ROUTE_TABLE_SIZE];
+    if (!alive(r, now))
+      continue;
+    putEntry(out + n * ROUTE_ADVERT_ENTRY_SIZE, r);
+    n++;
+    if (n == maxEntries)
+      advertCursor = (advertCursor + k + 1) % ROUTE_TABLE_SIZE;
+  }
+  return n * ROUTE_ADVERT_ENTRY_SIZE;
+}
+
+const RouteEntry *RouteTable::lookup(uint32_t dest, uint32_t now) const {
+  for (const RouteEntry &r : routes)
+    if (r.dest == dest && alive(r, now))
+      return &r;
+  return nullptr;
+}
+
+const RouteEntry *RouteTable::nearestGateway(uint32_t now) const {
+  const RouteEntry *best = nullptr;
+  for (const RouteEntry &r : routes)
+    if ((r.flags & ROUTE_FLAG_GATEWAY) && alive(r, now) && (!best || r.metric < best->metric))
+      best = &r;
+  return best;
+}
+
+void RouteTable::linkFailed(uint32_t nextHop, uint32_t now) {
+  for (RouteEntry &r : routes) {
+    if (!alive(r, now) || r.nextHop != nextHop)
+      continue;
+    r.seq |= 1;  // the odd number after the destination's last one
+    r.metric = ROUTE_METRIC_INFINITE;
+    r.unreported = true;
+    r.updatedAt = now;
+  }
+  counters.linkFailures++;
+}
+
+size_t RouteTable::size(uint32_t now) const {
+  size_t n = 0;
+  for (const RouteEntry &r : routes)
+    if (alive(r, now))
+      n++;
+  return n;
+}
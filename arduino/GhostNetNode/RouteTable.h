@@ -0,0 +1,146 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file RouteTable.h
+ * @brief Distance-vector routing fed by beacons.
+ *
+ * Every beacon carries a route advertisement: the sender itself (metric 0)
+ * followed by the destinations it can reach, each with the destination's own
+ * sequence number and the sender's metric. A receiver adds the cost of the
+ * link it heard the beacon on. As in DSDV, a newer destination sequence
+ * always wins and, for the same sequence, the lower metric wins, so stale
+ * routes cannot loop back. Updates from the current next hop are always
+ * taken, also when they are worse. A newer sequence heard first through a
+ * worse neighbour only replaces a route that has not been refreshed for
+ * the settle time, so the route does not flip back and forth every time
+ * adverts of one round arrive in a different order.
+ *
+ * Destinations only use even sequence numbers. A node that loses its next
+ * hop bumps the route to the odd number after it and advertises it once
+ * with ROUTE_METRIC_INFINITE, so neighbours that still route through it
+ * drop the route instead of offering it back. A finite route with an odd
+ * sequence is only taken from the current next hop.
+ *
+ * The link cost follows the airtime of the link's spreading factor plus a
+ * fixed per-hop penalty, so two fast hops can beat one SF12 hop but a long
+ * chain of hops does not.
+ */
+
+#define ROUTE_TABLE_SIZE 32
+#define ROUTE_METRIC_INFINITE 255
+#define ROUTE_HOP_PENALTY 4
+#define ROUTE_TTL_MS (10UL * 60UL * 1000UL)  ///< Forget routes not advertised for this long
+#define ROUTE_SETTLE_MS (90UL * 1000UL)      ///< Wait this long for the current next hop before taking a worse one, until setSettle()
+#define ROUTE_MAX_HOPS 8                     ///< Hop limit for routed frames
+#define ROUTE_ADVERT_ENTRY_SIZE 8            ///< Destination, sequence, metric, flags
+#define ROUTE_ADVERT_MAX_ENTRIES 6            ///< Keeps SF12 beacons short, the rest rotates
+
+#define ROUTE_FLAG_GATEWAY 0x01  ///< Destination is a gateway (has the Raspberry Pi attached)
+
+struct RouteEntry {
+  uint32_t dest = 0;      ///< 0 = unused
+  uint32_t nextHop = 0;
+  uint16_t seq = 0;       ///< Destination sequence number
+  uint8_t metric = ROUTE_METRIC_INFINITE;
+  uint8_t flags = 0;      ///< ROUTE_FLAG_*
+  bool unreported = false; ///< Broken, not yet advertised as unreachable
+  uint32_t updatedAt = 0;
+};
+
+struct RouteStats {
+  uint32_t updates = 0;       ///< Entries added or changed by advertisements
+  uint32_t routed = 0;        ///< Frames sent or forwarded along a route
+  uint32_t floodFallback = 0; ///< Unicast frames flooded because no route was known
+  uint32_t linkFailures = 0;  ///< Next hops dropped after an unanswered exchange
+};
+
+class RouteTable {
+public:
+  /**
+   * @brief Set our own identity and role, advertised in every beacon.
+   */
+  void begin(uint32_t self, bool gateway);
+  void setGateway(bool gateway) { isGateway = gateway; }
+  bool gateway() const { return isGateway; }
+
+  /**
+   * @brief Forget routes not advertised for this long, ROUTE_TTL_MS until set.
+   */
+  void setTtl(uint32_t ms) { ttlMs = ms; }
+
+  /**
+   * @brief Wait this long for the current next hop before taking a worse
+   *        route with a newer sequence, ROUTE_SETTLE_MS until set.
+   */
+  void setSettle(uint32_t ms) { settleMs = ms; }
+
+  /**
+   * @brief Process the route advertisement in a beacon.
+   * @param neighbour Node hash of the beacon origin (heard directly).
+   * @param linkCost Cost of the link to that neighbour, see linkCost().
+   * @param data Advertisement bytes (ROUTE_ADVERT_ENTRY_SIZE per entry).
+   * @param len Advertisement length.
+   * @param now Current time in ms.
+   * @return true if a destination became reachable or unreachable or changed
+   *         its flags; metric and next hop changes just go out with the next
+   *         regular beacon.
+   */
+  bool onAdvert(uint32_t neighbour, uint8_t linkCost, const uint8_t *data, size_t len, uint32_t now);
+
+  /**
+   * @brief Build the advertisement for our next beacon and bump our sequence number.
+   *        Broken routes not advertised yet go first.
+   * @param out Output buffer, at least ROUTE_ADVERT_MAX_ENTRIES * ROUTE_ADVERT_ENTRY_SIZE bytes.
+   * @param now Current time in ms.
+   * @param maxEntries Entries that fit the beacon, our own included (at least
+   *        1); the rest rotates through later beacons.
+   * @return Advertisement length in bytes.
+   */
+  size_t encodeAdvert(uint8_t *out, uint32_t now, size_t maxEntries = ROUTE_ADVERT_MAX_ENTRIES);
+
+  /**
+   * @brief Route to a destination, nullptr if none is known.
+   */
+  const RouteEntry *lookup(uint32_t dest, uint32_t now) const;
+
+  /**
+   * @brief Route to the gateway with the lowest metric, nullptr if none is known.
+   */
+  const RouteEntry *nearestGateway(uint32_t now) const;
+
+  /**
+   * @brief A next hop did not answer: break every route through it.
+   */
+  void linkFailed(uint32_t nextHop, uint32_t now);
+
+  /**
+   * @brief Cost of one hop at a spreading factor.
+   */
+  static uint8_t linkCost(uint8_t sf);
+
+  /**
+   * @brief Entry i of the table (for display), unused entries have dest 0.
+   */
+  const RouteEntry &entry(size_t i) const { return routes[i]; }
+
+  size_t size(uint32_t now) const;
+  void countRouted() { counters.routed++; }
+  void countFloodFallback() { counters.floodFallback++; }
+  const RouteStats &stats() const { return counters; }
+
+private:
+  bool alive(const RouteEntry &r, uint32_t now) const;
+  void putEntry(uint8_t *p, const RouteEntry &r) const;
+  RouteEntry *find(uint32_t dest);
+
+  RouteEntry routes[ROUTE_TABLE_SIZE];
+  uint32_t selfId = 0;
+  uint16_t selfSeq = 0;
+  bool isGateway = false;
+  uint32_t ttlMs = ROUTE_TTL_MS;
+  uint32_t settleMs = ROUTE_SETTLE_MS;
+  size_t advertCursor = 0;  ///< Rotates through the table when it does not fit one beacon
+  RouteStats counters;
+};
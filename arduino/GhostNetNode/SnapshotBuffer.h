@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * @file SnapshotBuffer.h
+ * @brief Double-buffered snapshots for readers on another core.
+ *
+ * The LoRa task (core 1) owns the neighbour table and the message logs; the
+ * web server and the display (core 0) only read them. Instead of sharing the
+ * live containers, the LoRa task copies them into the spare one of two
+ * buffers and publishes it with one atomic store. Readers pin the published
+ * buffer for as long as they use it and always see a complete version.
+ *
+ * Neither side waits: a reader that races with a publish just pins the new
+ * buffer instead, and when a reader still holds the spare buffer the writer
+ * skips this publish and tries again on its next pass (counted in deferred()).
+ * There must be a single writer; any number of readers is fine.
+ */
+
+template <typename T>
+class SnapshotBuffer {
+public:
+  /**
+   * @brief Read access to the published version; keep it short-lived.
+   */
+  class Reader {
+  public:
+    explicit Reader(SnapshotBuffer &owner) : buf(&owner) {
+      for (;;) {
+        index = buf->published.load();
+        buf->readers[index].fetch_add(1);
+        if (buf->published.load() == index)
+          break;
+        buf->readers[index].fetch_sub(1);  // a publish came in between, pin the new one
+      }
+    }
+    Reader(Reader &&other) : buf(other.buf), index(other.index) { other.buf = nullptr; }
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+    ~Reader() {
+      if (buf)
+        buf->readers[index].fetch_sub(1);
+    }
+
+    const T &operator*() const { return buf->slots[index].value; }
+    const T *operator->() const { return &buf->slots[index].value; }
+    uint32_t version() const { return buf->slots[index].version; }
+
+  private:
+    SnapshotBuffer *buf;
+    uint8_t index = 0;
+  };
+
+  /**
+   * @brief The spare buffer to fill, or nullptr if a reader still holds it. Writer only.
+   *
+   * It still contains the version before the published one.
+   */
+  T *beginWrite() {
+    uint8_t spare = published.load() ^ 1;
+    if (readers[spare].load() != 0) {
+      deferredCount.fetch_add(1);
+      return nullptr;
+    }
+    return &slots[spare].value;
+  }
+
+  /**
+   * @brief Make the buffer from beginWrite() the published version. Writer only.
+   */
+  void publish() {
+    uint8_t spare = published.load() ^ 1;
+    uint32_t v = lastVersion.load() + 1;
+    slots[spare].version = v;
+    published.store(spare);
+    lastVersion.store(v);
+  }
+
+  /**
+   * @brief Version of the published buffer, 0 before the first publish.
+   */
+  uint32_t version() const { return lastVersion.load(); }
+
+  /**
+   * @brief Publishes skipped because a reader held the spare buffer.
+   */
+  uint32_t deferred() const { return deferredCount.load(); }
+
+private:
+  struct Slot {
+    T value{};
+    uint32_t version = 0;
+  };
+
+  Slot slots[2];
+  std::atomic<uint8_t> published{0};
+  std::atomic<uint32_t> readers[2] = {{0}, {0}};
+  std::atomic<uint32_t> lastVersion{0};
+  std::atomic<uint32_t> deferredCount{0};
+};
@@ -0,0 +1,61 @@
+#include "TimerWheel.h"
+
+static_assert(TIMER_WHEEL_SLOTS <= 16, "armedMask has 16 bits");
+
+void TimerWheel::unlink(uint8_t id) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (order[i] != id)
+      continue;
+    for (; i + 1 < count; i++)
+      order[i] = order[i + 1];
+    count--;
+    break;
+  }
+  armedMask &= ~(1u << id);
+}
+
+void TimerWheel::arm(uint8_t id, uint32_t at) {
+  if (id >= TIMER_WHEEL_SLOTS)
+    return;
+  if (armed(id)) {
+    if (dueAt[id] == at)
+      return;
+    unlink(id);
+  }
+  // Insert behind every timer that is due no later, so equal deadlines fire in arming order
+  uint8_t pos = count;
+  while (pos > 0 && (int32_t)(at - dueAt[order[pos - 1]]) < 0) {
+    order[pos] = order[pos - 1];
+    pos--;
+  }
+  order[pos] = id;
+  dueAt[id] = at;
+  armedMask |= 1u << id;
+  count++;
+}
+
+void TimerWheel::cancel(uint8_t id) {
+  if (armed(id))
+    unlink(id);
+}
+
+bool TimerWheel::armed(uint8_t id) const {
+  return id < TIMER_WHEEL_SLOTS && (armedMask & (1u << id));
+}
+
+bool TimerWheel::popDue(uint32_t now, uint8_t &id) {
+  if (count == 0 || (int32_t)(now - dueAt[order[0]]) < 0)
+    return false;
+  id = order[0];
+  unlink(id);
+  return true;
+}
+
+uint32_t TimerWheel::untilNext(uint32_t now, uint32_t maxMs) const {
+  if (count == 0)
+    return maxMs;
+  int32_t left = (int32_t)(dueAt[order[0]] - now);
+  if (left <= 0)
+    return 0;
+  return (uint32_t)left < maxMs ? (uint32_t)left : maxMs;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file TimerWheel.h
+ * @brief Deadline-ordered one-shot timers for the LoRa task.
+ *
+ * Every time-driven job of the radio (beacon, retransmission timeouts,
+ * rebroadcast delays, reassembly expiry, ...) has one timer, identified by a
+ * small number. The armed timers are kept sorted by deadline, so the task
+ * knows how long it may sleep and which jobs are due when it wakes. Arming a
+ * timer that is already armed moves it.
+ *
+ * With a dozen timers a sorted array beats the buckets of a classic hashed
+ * wheel: arming is a short insertion, the next deadline is always slot 0.
+ * Deadlines are millis() values; ordering is wrap-safe as long as no timer
+ * lies more than 24 days ahead.
+ */
+
+#define TIMER_WHEEL_SLOTS 16
+
+class TimerWheel {
+public:
+  /**
+   * @brief Arm timer id to fire at the given time, replacing an earlier deadline.
+   */
+  void arm(uint8_t id, uint32_t at);
+
+  /**
+   * @brief Disarm timer id; nothing happens if it is not armed.
+   */
+  void cancel(uint8_t id);
+
+  bool armed(uint8_t id) const;
+
+  /**
+   * @brief Take the earliest timer that is due.
+   * @param id Receives the timer id.
+   * @return false if no timer is due.
+   */
+  bool popDue(uint32_t now, uint8_t &id);
+
+  /**
+   * @brief Time until the earliest deadline.
+   * @param maxMs Returned when no timer is armed or the earliest lies further ahead.
+   * @return 0 if a timer is already due.
+   */
+  uint32_t untilNext(uint32_t now, uint32_t maxMs) const;
+
+  size_t size() const { return count; }
+
+private:
+  void unlink(uint8_t id);
+
+  uint32_t dueAt[TIMER_WHEEL_SLOTS] = {};
+  uint8_t order[TIMER_WHEEL_SLOTS] = {};  ///< Armed ids, earliest deadline first
+  uint16_t armedMask = 0;
+  uint8_t count = 0;
+};
@@ -0,0 +1,72 @@
+#include "TrickleTimer.h"
+
+uint32_t TrickleTimer::nextRandom() {
+  // xorshift32, plenty for spreading due times
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+void TrickleTimer::fitAirtime(uint32_t beaconUs, uint32_t budgetMs) {
+  // One beacon per Imax within the share: Imax >= beacon * 1 h / (budget * share)
+  uint64_t imax = (uint64_t)beaconUs * 3600 * 100 / ((uint64_t)budgetMs * TRICKLE_AIRTIME_SHARE);
+  imaxMs = imax > TRICKLE_IMAX_MS ? (uint32_t)imax : TRICKLE_IMAX_MS;
+  iminMs = imaxMs / 4 > TRICKLE_IMIN_MS ? imaxMs / 4 : TRICKLE_IMIN_MS;
+
+  // The doubling intervals after a reset must fit their share of the hour too
+  uint64_t allowed = (uint64_t)budgetMs * 1000 * TRICKLE_IMIN_SHARE / 100;
+  while (iminMs < imaxMs && (uint64_t)beaconsAfterReset(3600000UL) * beaconUs > allowed)
+    iminMs = iminMs + iminMs / 8 < imaxMs ? iminMs + iminMs / 8 : imaxMs;
+}
+
+uint32_t TrickleTimer::beaconsAfterReset(uint32_t periodMs) const {
+  uint32_t count = 0;
+  uint32_t interval = iminMs;
+  for (uint32_t t = 0; t < periodMs; t += interval, interval = interval * 2 < imaxMs ? interval * 2 : imaxMs)
+    count++;
+  return count;
+}
+
+void TrickleTimer::begin(uint32_t now, uint32_t seed) {
+  rng = seed ? seed : 1;
+  intervalMs = iminMs;
+  lastSentAt = now;
+  startInterval(now);
+}
+
+void TrickleTimer::startInterval(uint32_t now) {
+  startedAt = now;
+  dueAt = now + intervalMs / 2 + nextRandom() % (intervalMs / 2);
+  done = false;
+  counters.intervalMs = intervalMs;
+}
+
+void TrickleTimer::reset(uint32_t now) {
+  if (intervalMs == iminMs)
+    return;
+  intervalMs = iminMs;
+  counters.resets++;
+  startInterval(now);
+}
+
+bool TrickleTimer::poll(uint32_t now) {
+  if (now - startedAt >= intervalMs) {
+    if (intervalMs < imaxMs)
+      intervalMs = intervalMs * 2 < imaxMs ? intervalMs * 2 : imaxMs;
+    startInterval(now);
+  }
+  return !done && (int32_t)(now - dueAt) >= 0;
+}
+
+void TrickleTimer::sent(uint32_t now, uint32_t airtimeUs, uint32_t standaloneUs, bool piggybacked) {
+  done = true;
+  if (piggybacked)
+    counters.piggybacked++;
+  else
+    counters.standalone++;
+  counters.airtimeUs += airtimeUs;
+  // A fixed schedule would have sent one standalone beacon per Imin since the last one
+  counters.fixedAirtimeUs += (uint64_t)standaloneUs * (now - lastSentAt) / TRICKLE_IMIN_MS;
+  lastSentAt = now;
+}
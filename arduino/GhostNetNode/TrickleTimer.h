@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file TrickleTimer.h
+ * @brief Adaptive beacon interval after Trickle (RFC 6206).
+ *
+ * The beacon interval starts at TRICKLE_IMIN_MS and doubles every time an
+ * interval passes without a topology change, up to TRICKLE_IMAX_MS. Within
+ * an interval the beacon is due at a random point in its second half, so
+ * nodes that reset together do not all transmit together. A topology change
+ * (new neighbour, changed route, lost link) resets the interval to Imin;
+ * a reset while already at Imin changes nothing, so a burst of changes
+ * cannot turn into a burst of beacons.
+ *
+ * Trickle's suppression counter is not used: a beacon carries the sender's
+ * own link report and route sequence number, which beacons of other nodes
+ * cannot stand in for.
+ *
+ * Until the due time, a beacon can also ride along on an outgoing frame;
+ * sent() closes the interval either way.
+ *
+ * At a slow SF a beacon takes seconds of the duty-cycle budget, so
+ * fitAirtime() stretches both bounds until a beacon every Imax costs no
+ * more than TRICKLE_AIRTIME_SHARE of the budget, and the beacons of the hour
+ * after a reset no more than TRICKLE_IMIN_SHARE; beyond half of it the
+ * airtime budget drops beacons. Whoever keeps state alive with beacons
+ * (links, routes, sleepers) has to follow imin() and imax().
+ */
+
+#define TRICKLE_IMIN_MS 30000UL                 ///< The former fixed beacon interval
+#define TRICKLE_IMAX_MS (4 * TRICKLE_IMIN_MS)   ///< Two lost beacons still stay within ROUTE_TTL_MS
+#define TRICKLE_AIRTIME_SHARE 30                ///< Percent of the duty-cycle budget for beacons at Imax
+#define TRICKLE_IMIN_SHARE 45                   ///< The same for the hour after a reset, below the half low priority frames may use
+
+struct BeaconStats {
+  uint32_t standalone = 0;       ///< Beacons queued as their own frame
+  uint32_t piggybacked = 0;      ///< Beacons carried by a data frame
+  uint32_t resets = 0;           ///< Topology changes that brought the interval back to Imin
+  uint32_t intervalMs = 0;       ///< Current interval
+  uint64_t airtimeUs = 0;        ///< Time on air spent on beacons (extension bytes only when piggybacked)
+  uint64_t fixedAirtimeUs = 0;   ///< Estimate for the same period with a standalone beacon every Imin
+};
+
+class TrickleTimer {
+public:
+  /**
+   * @brief Stretch Imin and Imax to the time on air of a beacon. Call before begin().
+   * @param beaconUs Time on air of the largest standalone beacon.
+   * @param budgetMs Duty-cycle budget per hour.
+   */
+  void fitAirtime(uint32_t beaconUs, uint32_t budgetMs);
+
+  uint32_t imin() const { return iminMs; }
+  uint32_t imax() const { return imaxMs; }
+
+  /**
+   * @brief Start at Imin.
+   * @param now Current time in ms.
+   * @param seed Seed for the due time within each interval (node specific).
+   */
+  void begin(uint32_t now, uint32_t seed);
+
+  /**
+   * @brief The topology changed: back to Imin, unless already there.
+   */
+  void reset(uint32_t now);
+
+  /**
+   * @brief Advance the interval; true when a standalone beacon is due.
+   */
+  bool poll(uint32_t now);
+
+  /**
+   * @brief When poll() next has something to do: the due time, or the end of the interval.
+   */
+  uint32_t nextPoll() const { return done ? startedAt + intervalMs : dueAt; }
+
+  /**
+   * @brief No beacon went out yet in this interval, one may ride along on a frame.
+   */
+  bool wanted() const { return !done; }
+
+  /**
+   * @brief A beacon went out, standalone or piggybacked.
+   * @param now Current time in ms.
+   * @param airtimeUs Time on air it cost.
+   * @param standaloneUs Time on air of the same beacon as its own frame.
+   * @param piggybacked true if it rode along on another frame.
+   */
+  void sent(uint32_t now, uint32_t airtimeUs, uint32_t standaloneUs, bool piggybacked);
+
+  const BeaconStats &stats() const { return counters; }
+
+private:
+  void startInterval(uint32_t now);
+  uint32_t beaconsAfterReset(uint32_t periodMs) const;
+  uint32_t nextRandom();
+
+  uint32_t iminMs = TRICKLE_IMIN_MS;
+  uint32_t imaxMs = TRICKLE_IMAX_MS;
+  uint32_t intervalMs = TRICKLE_IMIN_MS;
+  uint32_t startedAt = 0;
+  uint32_t dueAt = 0;
+  uint32_t lastSentAt = 0;
+  bool done = false;
+  uint32_t rng = 1;
+  BeaconStats counters;
+};
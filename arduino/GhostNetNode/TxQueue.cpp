@@ -0,0 +1,114 @@
+#include "TxQueue.h"
+#include <string.h>
+
+static const uint16_t lingerMs[TX_PRIO_COUNT] = { TX_LINGER_LOW_MS, TX_LINGER_NORMAL_MS, TX_LINGER_HIGH_MS };
+
+uint8_t txPriorityForType(uint8_t type) {
+  switch (type) {
+    case LORA_PKT_ACK: return TX_PRIO_HIGH;
+    case LORA_PKT_BEACON:
+    case LORA_PKT_TABLE: return TX_PRIO_LOW;
+    default: return TX_PRIO_NORMAL;
+  }
+}
+
+bool TxQueue::push(const uint8_t *frame, size_t len, uint8_t priority, uint32_t now, uint16_t tag,
+                   uint32_t peer, uint8_t nextSf) {
+  if (count == TX_QUEUE_SLOTS || len > LORA_PACKET_MAX_SIZE) {
+    counters.dropped++;
+    return false;
+  }
+  for (TxFrame &slot : slots) {
+    if (slot.used)
+      continue;
+    memcpy(slot.data, frame, len);
+    slot.used = true;
+    slot.deferred = false;
+    slot.priority = priority;
+    slot.len = len;
+    slot.queuedAt = now;
+    slot.tag = tag;
+    slot.peer = peer;
+    slot.nextSf = nextSf;
+    break;
+  }
+  count++;
+  if (count > counters.maxDepth)
+    counters.maxDepth = count;
+  return true;
+}
+
+TxFrame *TxQueue::oldest(uint8_t priority) {
+  TxFrame *best = nullptr;
+  for (TxFrame &slot : slots) {
+    if (!slot.used || slot.priority != priority)
+      continue;
+    if (!best || (int32_t)(slot.queuedAt - best->queuedAt) < 0)
+      best = &slot;
+  }
+  return best;
+}
+
+void TxQueue::remove(TxFrame *frame) {
+  if (!frame || !frame->used)
+    return;
+  frame->used = false;
+  count--;
+}
+
+size_t TxQueue::collect(TxFrame *head, TxFrame **out, size_t max, size_t room, size_t &left) {
+  left = room;
+  if (max == 0)
+    return 0;
+  size_t n = 0;
+  out[n++] = head;
+  left = (size_t)head->len + 1 <= room ? room - head->len - 1 : 0;
+  for (int prio = TX_PRIO_HIGH; prio >= TX_PRIO_LOW; prio--) {
+    // Few slots: pick the oldest that fits again and again rather than sort
+    while (n < max) {
+      TxFrame *best = nullptr;
+      for (TxFrame &slot : slots) {
+        if (!slot.used || slot.priority != prio || slot.peer != head->peer || (size_t)slot.len + 1 > left)
+          continue;
+        bool taken = false;
+        for (size_t i = 0; i < n && !taken; i++)
+          taken = out[i] == &slot;
+        if (!taken && (!best || (int32_t)(slot.queuedAt - best->queuedAt) < 0))
+          best = &slot;
+      }
+      if (!best)
+        break;
+      out[n++] = best;
+      left -= best->len + 1;
+    }
+  }
+  return n;
+}
+
+uint32_t TxQueue::lingerUntil(const TxFrame &head) {
+  return head.queuedAt + lingerMs[head.priority < TX_PRIO_COUNT ? head.priority : (uint8_t)TX_PRIO_NORMAL];
+}
+
+size_t TxQueue::removeTagged(uint16_t mask, uint16_t value) {
+  size_t n = 0;
+  for (TxFrame &slot : slots) {
+    if (slot.used && slot.tag && (slot.tag & mask) == value) {
+      remove(&slot);
+      n++;
+    }
+  }
+  return n;
+}
+
+void TxQueue::recordSent(uint32_t queuedAt, uint32_t now, uint32_t airtimeUs, uint8_t packets) {
+  uint32_t tta = now - queuedAt;
+  counters.sent++;
+  counters.packets += packets;
+  if (packets > 1)
+    counters.batches++;
+  counters.lastTimeToAir = tta;
+  if (tta > counters.maxTimeToAir)
+    counters.maxTimeToAir = tta;
+  counters.avgTimeToAir = counters.sent == 1 ? tta : counters.avgTimeToAir + ((int32_t)(tta - counters.avgTimeToAir) >> 3);
+  counters.airtimeUs += airtimeUs;
+}
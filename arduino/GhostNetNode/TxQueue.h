@@ -0,0 +1,123 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "LoRaPacket.h"
+#include "AirtimeBudget.h"
+
+/**
+ * @file TxQueue.h
+ * @brief Outbound frame queue for the asynchronous LoRa transmitter.
+ *
+ * Frames are copied into preallocated slots and sent one at a time by
+ * LoRaRadio::loop(), oldest first within each TX_PRIO_* class. The queue
+ * also keeps the TX metrics: depth, drops and time-to-air (from enqueue until
+ * the TX-done interrupt).
+ *
+ * Frames for the same next hop can share one transmission (LORA_PKT_BATCH):
+ * one preamble, one CAD and one backoff instead of one for each. The first
+ * frame of a batch lingers up to TX_LINGER_*_MS after it was queued so small
+ * frames behind it can join, unless the batch is full already. ACKs do not
+ * linger, they only take along what is waiting anyway.
+ */
+
+#define TX_QUEUE_SLOTS 16
+#define TX_BATCH_MAX 8             ///< Frames in one batch
+#define TX_BATCH_MIN_ROOM 24       ///< Batch payload bytes left below which lingering is pointless
+#define TX_LINGER_HIGH_MS 0        ///< ACKs
+#define TX_LINGER_NORMAL_MS 100    ///< Game traffic and forwards
+#define TX_LINGER_LOW_MS 1000      ///< Beacons and tables
+
+struct TxStats {
+  uint32_t sent = 0;          ///< Frames that completed transmission
+  uint32_t packets = 0;       ///< Queued frames they carried, more than sent when batched
+  uint32_t batches = 0;       ///< Sent frames that were a batch
+  uint32_t dropped = 0;       ///< Frames refused because the queue was full
+  uint32_t failed = 0;        ///< startTransmit errors and TX timeouts
+  uint32_t maxDepth = 0;      ///< Highest queue depth seen
+  uint32_t lastTimeToAir = 0; ///< ms from enqueue to TX done, last frame
+  uint32_t maxTimeToAir = 0;  ///< ms, worst frame
+  uint32_t avgTimeToAir = 0;  ///< ms, exponential moving average (1/8)
+  uint64_t airtimeUs = 0;     ///< Total time on air
+};
+
+struct TxFrame {
+  bool used = false;
+  bool deferred = false;      ///< Already held back once by the airtime budget
+  uint8_t priority = TX_PRIO_NORMAL;
+  uint8_t len = 0;
+  uint32_t queuedAt = 0;
+  uint16_t tag = 0;           ///< Outbox fragment tag, 0 for untracked frames
+  uint32_t peer = 0;          ///< Unicast neighbour, the frame may use its faster SF
+  uint8_t nextSf = 0;         ///< SF the peer is told to follow, 0 if none
+  uint8_t data[LORA_PACKET_MAX_SIZE];
+};
+
+/**
+ * @brief Priority class for a packet type: ACKs high, beacons and tables low.
+ */
+uint8_t txPriorityForType(uint8_t type);
+
+class TxQueue {
+public:
+  /**
+   * @brief Copy a frame into the queue.
+   * @param tag Handed back when the frame leaves the queue, 0 if nobody tracks it.
+   * @param peer Direct neighbour the frame is meant for, 0 for broadcast.
+   * @param nextSf SF extension carried in the frame, 0 if none.
+   * @return false (and count a drop) if the queue is full.
+   */
+  bool push(const uint8_t *frame, size_t len, uint8_t priority, uint32_t now, uint16_t tag = 0,
+            uint32_t peer = 0, uint8_t nextSf = 0);
+
+  /**
+   * @brief Oldest frame of a priority class, or nullptr. Stays queued until remove().
+   */
+  TxFrame *oldest(uint8_t priority);
+
+  void remove(TxFrame *frame);
+
+  /**
+   * @brief Frames that can go out in one batch with head.
+   *
+   * Frames for the same peer (broadcasts with broadcasts), higher classes
+   * first and oldest first within a class, as long as they fit.
+   * @param out Receives head followed by the others.
+   * @param max Size of out.
+   * @param room Batch payload size; each frame takes its length plus one byte.
+   * @param left Receives the room that is left.
+   * @return Number of frames in out, at least 1.
+   */
+  size_t collect(TxFrame *head, TxFrame **out, size_t max, size_t room, size_t &left);
+
+  /**
+   * @brief Until when head may wait for frames to batch with, see TX_LINGER_*_MS.
+   */
+  static uint32_t lingerUntil(const TxFrame &head);
+
+  /**
+   * @brief Remove every frame whose tag matches value under mask.
+   * @return Number of frames removed.
+   */
+  size_t removeTagged(uint16_t mask, uint16_t value);
+
+  size_t size() const { return count; }
+  size_t freeSlots() const { return TX_QUEUE_SLOTS - count; }
+  bool empty() const { return count == 0; }
+
+  /**
+   * @brief Record a finished transmission.
+   * @param queuedAt Enqueue time of the frame.
+   * @param now Time of the TX-done interrupt.
+   * @param airtimeUs Time on air of the frame.
+   * @param packets Queued frames it carried, more than 1 for a batch.
+   */
+  void recordSent(uint32_t queuedAt, uint32_t now, uint32_t airtimeUs, uint8_t packets = 1);
+  void recordFailed() { counters.failed++; }
+
+  const TxStats &stats() const { return counters; }
+
+private:
+  TxFrame slots[TX_QUEUE_SLOTS];
+  size_t count = 0;
+  TxStats counters;
+};
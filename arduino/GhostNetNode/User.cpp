@@ -4,6 +4,7 @@
 #include <Preferences.h>
 
 int UserManager::userCount = 0;
+uint32_t UserManager::version = 0;
 Preferences UserManager::prefs;
 
 User UserManager::users[MAX_USERS];
@@ -165,6 +166,7 @@ void UserManager::loadUsersNVS() {
         addUser("admin", "admin", "admin");
     }
     Serial.printf("[User] Loaded %d users from NVS\n", userCount);
+    version++;
     prefs.end();
 }
 
@@ -180,5 +182,6 @@ void UserManager::saveUsersNVS() {
         prefs.putString(key.c_str(), line);
     }
     prefs.end();
+    version++;
     Serial.println("[User] Users saved to NVS");
 }
@@ -30,6 +30,7 @@ public:
 
     static User users[MAX_USERS];
     static int userCount;
+    static uint32_t version;  ///< Raised whenever users are loaded or saved
     static Preferences prefs;
 
     static void loadUsersNVS();
@@ -84,8 +84,8 @@ void frame2(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t
 
 void frame3(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y) {
   display->setFont(ArialMT_Plain_16);
-  auto &neighbours = LoRaRadio::getNeighbours();
-  display->drawString(x, y, "Nodes: " + String(neighbours.size()));
+  extern LoRaRadio LoRa;
+  display->drawString(x, y, "Nodes: " + String(LoRa.getNeighbours()->size()));
 }
 
 void frame4(OLEDDisplay *display, OLEDDisplayUiState *state, int16_t x, int16_t y) {
@@ -109,7 +109,8 @@ void HeltecDisplay::overlay(OLEDDisplay *display, OLEDDisplayUiState *state) {
   display->drawString(100, 32, String(bat) + "%");
 }
 
-void HeltecDisplay::loop() {
-  ui.update();
+uint32_t HeltecDisplay::loop() {
+  int16_t budget = ui.update();
+  return budget > 0 ? budget : 0;
 }
 
@@ -21,8 +21,8 @@ public:
 
     void begin(const char *ssid);
 
-    // Setup and update
-    void loop();
+    // Setup and update; returns the ms until the next frame is due
+    uint32_t loop();
 
     // Overlay callback
     void overlay(OLEDDisplay *display, OLEDDisplayUiState* state);
@@ -0,0 +1,91 @@
+// Airtime comparison between the old ASCII framing ("MSG:id:sender:" and
+// "[id|i|n]" fragment headers) and the binary LoRaPacket header.
+//
+// Build and run from arduino/host:  make bench && ./build/bench_airtime
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "LoRaPacket.h"
+
+static const size_t kFragmentPayload = 80;
+static const char *kNodeName = "NODE_A1B2C3D4E5F6";
+static const char *kMsgID = "10800000";  // millis() three hours into a game day
+
+struct FrameSet {
+  std::vector<size_t> frames;
+};
+
+// Mirror of the pre-binary LoRaRadio::sendMessageWithAck framing
+static FrameSet textFrames(const std::string &msg) {
+  FrameSet set;
+  std::string full = std::string("MSG:") + kMsgID + ":" + kNodeName + ":" + msg;
+  if (full.size() <= kFragmentPayload) {
+    set.frames.push_back(full.size());
+  } else {
+    size_t total = (full.size() + kFragmentPayload - 1) / kFragmentPayload;
+    for (size_t i = 0; i < total; i++) {
+      size_t len = std::min(full.size() - i * kFragmentPayload, kFragmentPayload);
+      std::string hdr = std::string("[") + kMsgID + "|" + std::to_string(i + 1) + "|" + std::to_string(total) + "]";
+      set.frames.push_back(hdr.size() + len);
+    }
+  }
+  // ACK from one neighbour
+  set.frames.push_back(std::string(std::string("ACK:") + kMsgID + ":" + kNodeName).size());
+  return set;
+}
+
+static FrameSet binaryFrames(const std::string &msg) {
+  FrameSet set;
+  uint8_t frame[LORA_PACKET_MAX_SIZE];
+  LoRaPacketHeader hdr;
+  hdr.origin = loraNodeHash(kNodeName);
+  hdr.seq = 4242;
+  hdr.flags = LORA_FLAG_ACK_REQ;
+  size_t total = msg.empty() ? 1 : (msg.size() + kFragmentPayload - 1) / kFragmentPayload;
+  hdr.fragCount = total;
+  for (size_t i = 0; i < total; i++) {
+    size_t len = std::min(msg.size() - i * kFragmentPayload, kFragmentPayload);
+    hdr.fragIndex = i;
+    set.frames.push_back(loraEncodePacket(hdr, (const uint8_t *)msg.data() + i * kFragmentPayload, len, frame, sizeof(frame)));
+  }
+  LoRaAckPayload ack{ hdr.origin, hdr.seq, 1 };
+  uint8_t ackPayload[LORA_ACK_PAYLOAD_SIZE];
+  size_t ackLen = loraEncodeAck(ack, ackPayload);
+  LoRaPacketHeader ackHdr;
+  ackHdr.type = LORA_PKT_ACK;
+  set.frames.push_back(loraEncodePacket(ackHdr, ackPayload, ackLen, frame, sizeof(frame)));
+  return set;
+}
+
+static void totals(const FrameSet &set, uint8_t sf, size_t &bytes, double &ms) {
+  bytes = 0;
+  ms = 0;
+  for (size_t f : set.frames) {
+    bytes += f;
+    ms += loraTimeOnAirUs(f, sf, 125.0, 8) / 1000.0;
+  }
+}
+
+int main() {
+  const size_t sizes[] = { 5, 20, 40, 80, 160, 400 };
+  const uint8_t sfs[] = { 7, 9, 12 };
+
+  printf("Message + one ACK, BW125 CR4/8, %zu byte fragments\n\n", kFragmentPayload);
+  printf("%6s %3s | %6s %5s %10s | %6s %5s %10s | %7s\n",
+         "msg B", "SF", "frames", "bytes", "text ms", "frames", "bytes", "binary ms", "saved");
+  for (size_t size : sizes) {
+    std::string msg(size, 'x');
+    FrameSet text = textFrames(msg);
+    FrameSet bin = binaryFrames(msg);
+    for (uint8_t sf : sfs) {
+      size_t textBytes, binBytes;
+      double textMs, binMs;
+      totals(text, sf, textBytes, textMs);
+      totals(bin, sf, binBytes, binMs);
+      printf("%6zu %3u | %6zu %5zu %10.1f | %6zu %5zu %10.1f | %6.1f%%\n",
+             size, sf, text.frames.size(), textBytes, textMs, bin.frames.size(), binBytes, binMs,
+             100.0 * (textMs - binMs) / textMs);
+    }
+  }
+  return 0;
+}
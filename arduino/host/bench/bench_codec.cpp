@@ -0,0 +1,101 @@
+// Compression ratio, speed and SF12 airtime of PayloadCodec on sample traffic.
+// Each line of the corpus is one message; "\n" inside a line is a newline.
+//
+// Build and run from arduino/host:  make bench && ./build/bench_codec [bench/traffic.txt]
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "LoRaPacket.h"
+#include "PayloadCodec.h"
+
+static const size_t kFragmentPayload = 80;
+static const int kRounds = 200;
+
+static std::string unescape(const std::string &line) {
+  std::string out;
+  for (size_t i = 0; i < line.size(); i++) {
+    if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == 'n') {
+      out += '\n';
+      i++;
+    } else {
+      out += line[i];
+    }
+  }
+  return out;
+}
+
+// Data frames only, BW125 CR4/8
+static double airtimeMs(size_t len, uint8_t sf) {
+  size_t frames = len == 0 ? 1 : (len + kFragmentPayload - 1) / kFragmentPayload;
+  double ms = 0;
+  for (size_t i = 0; i < frames; i++) {
+    size_t part = std::min(len - i * kFragmentPayload, kFragmentPayload);
+    ms += loraTimeOnAirUs(LORA_PACKET_HEADER_SIZE + part, sf, 125.0, 8) / 1000.0;
+  }
+  return ms;
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "bench/traffic.txt";
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  std::vector<std::string> corpus;
+  std::string line;
+  while (std::getline(file, line))
+    if (!line.empty())
+      corpus.push_back(unescape(line));
+
+  static uint8_t packed[CODEC_MAX_SIZE];
+  static uint8_t unpacked[CODEC_MAX_SIZE];
+  size_t rawTotal = 0, sentTotal = 0, failures = 0;
+  double rawMs = 0, sentMs = 0, encNs = 0, decNs = 0;
+
+  printf("%5s %5s %6s %10s %10s %9s %9s  %s\n", "raw B", "sent", "ratio", "SF12 raw", "SF12 sent", "enc us", "dec us", "message");
+  for (const std::string &msg : corpus) {
+    const uint8_t *in = (const uint8_t *)msg.data();
+    size_t packedLen = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; r++)
+      packedLen = codecCompress(in, msg.size(), packed, sizeof(packed));
+    auto t1 = std::chrono::steady_clock::now();
+    size_t unpackedLen = 0;
+    if (packedLen) {
+      for (int r = 0; r < kRounds; r++)
+        unpackedLen = codecDecompress(packed, packedLen, unpacked, sizeof(unpacked));
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    if (packedLen && (unpackedLen != msg.size() || memcmp(unpacked, in, unpackedLen) != 0))
+      failures++;
+    double enc = std::chrono::duration<double, std::micro>(t1 - t0).count() / kRounds;
+    double dec = packedLen ? std::chrono::duration<double, std::micro>(t2 - t1).count() / kRounds : 0;
+    size_t sent = packedLen ? packedLen : msg.size();  // sent uncompressed when it does not shrink
+    double a = airtimeMs(msg.size(), 12), b = airtimeMs(sent, 12);
+
+    std::string label = msg.substr(0, 32);
+    for (char &c : label)
+      if (c == '\n')
+        c = ' ';
+    printf("%5zu %5zu %5.2fx %10.1f %10.1f %9.2f %9.2f  %s\n", msg.size(), sent, (double)msg.size() / sent, a, b, enc, dec, label.c_str());
+
+    rawTotal += msg.size();
+    sentTotal += sent;
+    rawMs += a;
+    sentMs += b;
+    encNs += enc * 1000;
+    decNs += dec * 1000;
+  }
+
+  printf("\n%zu messages, %zu -> %zu bytes (%.2fx), SF12 data airtime %.0f -> %.0f ms (%.1f%% saved)\n",
+         corpus.size(), rawTotal, sentTotal, (double)rawTotal / sentTotal, rawMs, sentMs, 100.0 * (rawMs - sentMs) / rawMs);
+  printf("encode %.1f ns/byte, decode %.1f ns/byte on this host\n", encNs / rawTotal, decNs / rawTotal);
+  if (failures)
+    printf("ROUND TRIP FAILURES: %zu\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+// Throughput of the FecCodec erasure code for the message sizes the radio sends.
+// Encoding makes every repair fragment; decoding rebuilds the worst case, as
+// many lost data fragments as there are repair fragments.
+//
+// Build and run from arduino/host:  make bench && ./build/bench_fec
+// The firmware logs the same work in CPU cycles with DEBUG_ENABLED ("[LoRa FEC]"),
+// which gives the ESP32-S3 figures.
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "FecCodec.h"
+
+static const size_t kBlock = 80;  // REASSEMBLY_FRAGMENT_SIZE
+static const int kRounds = 2000;
+
+int main() {
+  std::mt19937 rng(1);
+  size_t failures = 0;
+  printf("%4s %4s %9s %11s %11s %11s %11s\n", "data", "rep", "bytes", "enc us", "enc MB/s", "dec us", "dec MB/s");
+  const uint8_t cases[][2] = { { 2, 1 }, { 4, 1 }, { 4, 2 }, { 8, 2 }, { 8, 4 }, { 16, 4 }, { 16, 8 }, { 24, 8 } };
+  for (const auto &c : cases) {
+    uint8_t n = c[0], k = c[1];
+    std::vector<uint8_t> original(n * kBlock), blocks((n + k) * kBlock), work((n + k) * kBlock);
+    for (uint8_t &b : original)
+      b = rng();
+    memcpy(blocks.data(), original.data(), original.size());
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; r++)
+      for (uint8_t j = 0; j < k; j++)
+        fecEncode(blocks.data(), n, kBlock, j, blocks.data() + (n + j) * kBlock);
+    auto t1 = std::chrono::steady_clock::now();
+
+    // Lose k data fragments spread over the message
+    uint32_t have = (n + k >= 32 ? 0xFFFFFFFFUL : (1UL << (n + k)) - 1);
+    for (uint8_t j = 0; j < k; j++)
+      have &= ~(1UL << (j * n / k));
+    double decUs = 0;
+    for (int r = 0; r < kRounds; r++) {
+      work = blocks;
+      for (uint8_t i = 0; i < n; i++)
+        if (!(have & (1UL << i)))
+          memset(work.data() + i * kBlock, 0, kBlock);
+      auto d0 = std::chrono::steady_clock::now();
+      bool ok = fecDecode(work.data(), n, kBlock, have);
+      decUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - d0).count();
+      if (r == 0 && (!ok || memcmp(work.data(), original.data(), original.size()) != 0))
+        failures++;
+    }
+
+    double encUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / kRounds;
+    decUs /= kRounds;
+    size_t bytes = n * kBlock;
+    printf("%4u %4u %9zu %11.2f %11.1f %11.2f %11.1f\n", n, k, bytes, encUs, bytes / encUs, decUs, bytes / decUs);
+  }
+  if (failures)
+    printf("DECODE FAILURES: %zu\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+// The live feed with more phones than it takes, on links of different speed.
+// Every 100 ms the web server would call fill() for each open feed with what
+// the TCP window takes; a message event comes about once a second, plus a
+// burst of announcements every minute. Each message gets its delivery result
+// from the radio a few seconds later, through notify(), and the web side
+// turns it into an event as LoRaWeb::updateLive() does. Each phone parses its
+// stream and the events are checked against what was published. For
+// comparison the heap a queue per client would need (a copy of every event
+// for every phone, at most 32 queued, like AsyncEventSource) is tracked on
+// the same traffic.
+//
+// The radio task only meets the feed in notify(), which never waits; the time
+// it takes and the web server's work per 100 ms are measured. Halfway, the
+// radio reports more results at once than the notice queue holds (custody
+// entries confirmed together, say); the web side has to publish a "reset" for
+// the lost ones and every phone on the feed has to get it, or be reset when it
+// reconnects.
+//
+// Build and run from arduino/host:  make bench && ./build/bench_live
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include "LiveFeed.h"
+
+static const int kPhones = LIVE_CLIENTS + 2;
+static const uint32_t kStepMs = 100;
+static const uint32_t kDurationMs = 10 * 60 * 1000;
+static const size_t kCopyQueueMax = 32;
+static const uint32_t kFloodAtMs = kDurationMs / 2;
+static const int kFloodResults = 2 * LIVE_NOTICES;
+static const int kNoticesPerTick = 8;   // WEB_LIVE_NOTICES
+
+struct Link {
+  const char *name;
+  size_t bytes;         // taken per call
+  uint32_t everyMs;     // between calls
+};
+
+// Wifi at the edge of the portal: most phones are fine, some barely get through
+static const Link kFast = { "fast", 1436, 100 };
+static const Link kSlow = { "slow", 128, 500 };
+static const Link kCrawl = { "crawl", 32, 1000 };
+
+struct Event {
+  std::string name, data;
+};
+
+struct Delivery {
+  uint32_t dueMs;
+  uint16_t seq;
+};
+
+struct Phone {
+  const Link *link = &kFast;
+  int slot = -1;
+  bool polling = false;        // refused, uses the JSON API
+  uint32_t reconnectAt = 0;
+  std::string lastId;
+  std::string pending;         // bytes of an unfinished event block
+  uint32_t expect = 0;         // number the next event should have, 0: any
+  size_t bytes = 0, events = 0, evictions = 0, resets = 0, resyncs = 0, lagMax = 0;
+  bool reloaded = false;       // reset after the lost delivery results
+  std::deque<size_t> copies;   // per-client queue model: sizes still to send
+  size_t copyHead = 0;         // bytes of copies.front() already sent
+};
+
+int main() {
+  std::mt19937 rng(1);
+  LiveFeed feed;
+  if (!feed.begin(7)) {
+    printf("no memory\n");
+    return 1;
+  }
+  std::vector<Event> published;
+  std::deque<Delivery> deliveries;   // results the radio has yet to report
+  uint16_t nextSeq = 0;
+  std::vector<Phone> phones(kPhones);
+  for (int i = 0; i < kPhones; i++)
+    phones[i].link = i == 7 || i == 8 ? &kSlow : i == 9 ? &kCrawl : &kFast;
+
+  size_t failures = 0, fills = 0, copyPeak = 0, copyDropped = 0, notices = 0, lost = 0, resyncsPublished = 0;
+  uint32_t lostSeen = 0;
+  double fillUs = 0, notifyMaxUs = 0, tickUs = 0, tickMaxUs = 0;
+  uint8_t buf[1436];
+
+  for (uint32_t now = 0; now < kDurationMs; now += kStepMs) {
+    for (Phone &p : phones) {
+      if (p.slot >= 0 || p.polling || now < p.reconnectAt)
+        continue;
+      p.slot = feed.attach(p.lastId.empty() ? nullptr : p.lastId.c_str(), now);
+      p.polling = p.slot < 0;
+      p.expect = 0;
+      p.pending.clear();
+    }
+
+    auto publish = [&](const char *name, const std::string &data) {
+      feed.publish(name, data.c_str(), data.size());
+      published.push_back({ name, data });
+      for (Phone &p : phones) {
+        if (p.slot < 0)
+          continue;
+        if (p.copies.size() < kCopyQueueMax)
+          p.copies.push_back(data.size() + 30);
+        else
+          copyDropped++;
+      }
+    };
+
+    if (now == kFloodAtMs)
+      for (int i = 0; i < kFloodResults; i++)
+        deliveries.push_front({ now, nextSeq++ });
+
+    // Radio task: delivery results that are due
+    while (!deliveries.empty() && deliveries.front().dueMs <= now) {
+      auto t0 = std::chrono::steady_clock::now();
+      if (!feed.notify(deliveries.front().seq, 2))
+        lost++;
+      notifyMaxUs = std::max(notifyMaxUs, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+      notices++;
+      deliveries.pop_front();
+    }
+
+    // Web server task from here: events from the radio, then the feeds
+    auto tick0 = std::chrono::steady_clock::now();
+    LiveNotice notice;
+    uint32_t lostNow = feed.stats().noticesLost;
+    if (lostNow != lostSeen) {
+      lostSeen = lostNow;
+      while (feed.takeNotice(notice))
+        ;
+      publish("reset", "{}");
+      resyncsPublished++;
+    }
+    for (int i = 0; i < kNoticesPerTick && feed.takeNotice(notice); i++)
+      publish("dlv", "{\"id\":" + std::to_string(notice.seq) + ",\"state\":\"delivered\"}");
+
+    // About one message a second, and 40 announcements in two seconds every minute
+    int burst = now % 60000 < 2000 ? 2 : 0;
+    int count = burst + (rng() % 10 == 0 ? 1 : 0);
+    for (int e = 0; e < count; e++) {
+      uint32_t n = feed.nextNumber();
+      publish("msg", "{\"n\":" + std::to_string(n) + ",\"content\":\"" + std::string(40 + rng() % 700, 'a' + n % 26) + "\"}");
+      Delivery d = { now + 2000 + (uint32_t)(rng() % 6000), nextSeq++ };
+      deliveries.insert(std::upper_bound(deliveries.begin(), deliveries.end(), d,
+                                         [](const Delivery &a, const Delivery &b) { return a.dueMs < b.dueMs; }), d);
+    }
+    double stepUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tick0).count();
+
+    size_t copyBytes = 0;
+    for (Phone &p : phones) {
+      if (p.slot < 0)
+        continue;
+      size_t lag = feed.nextNumber() - (p.expect ? p.expect : feed.nextNumber());
+      if (lag > p.lagMax)
+        p.lagMax = lag;
+      if (now % p.link->everyMs == 0) {
+        // Per-client queue model drains at the same speed
+        size_t room = p.link->bytes;
+        while (room && !p.copies.empty()) {
+          size_t take = std::min(room, p.copies.front() - p.copyHead);
+          p.copyHead += take;
+          room -= take;
+          if (p.copyHead == p.copies.front()) {
+            p.copies.pop_front();
+            p.copyHead = 0;
+          }
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        size_t n = feed.fill(p.slot, buf, p.link->bytes, now);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        fillUs += us;
+        stepUs += us;
+        fills++;
+        p.bytes += n;
+        p.pending.append((const char *)buf, n);
+        size_t end;
+        while ((end = p.pending.find("\n\n")) != std::string::npos) {
+          std::string block = p.pending.substr(0, end);
+          p.pending.erase(0, end + 2);
+          if (block.compare(0, 1, ":") == 0 || block.compare(0, 6, "retry:") == 0) {
+            if (block.find("event: reset") != std::string::npos) {
+              p.resets++;
+              p.reloaded |= now >= kFloodAtMs;
+            }
+            continue;
+          }
+          unsigned boot = 0;
+          unsigned long number = 0;
+          char name[16], data[1024];
+          if (sscanf(block.c_str(), "id: %u-%lu\nevent: %15[^\n]\ndata: %1023[^\n]", &boot, &number, name, data) != 4 || boot != 7 ||
+              number >= published.size() || published[number].name != name || published[number].data != data ||
+              (p.expect && number != p.expect)) {
+            failures++;
+            continue;
+          }
+          if (strcmp(name, "reset") == 0) {
+            p.resyncs++;
+            p.reloaded = true;
+          }
+          p.lastId = std::to_string(boot) + "-" + std::to_string(number);
+          p.expect = number + 1;
+          p.events++;
+        }
+        if (!feed.isOpen(p.slot)) {
+          // Closed: the browser drops the unfinished block and comes back after retry
+          feed.detach(p.slot);
+          p.slot = -1;
+          p.evictions++;
+          p.reconnectAt = now + LIVE_RETRY_MS;
+        }
+      }
+      for (size_t s : p.copies)
+        copyBytes += s;
+      copyBytes -= p.copies.empty() ? 0 : p.copyHead;
+    }
+    if (copyBytes > copyPeak)
+      copyPeak = copyBytes;
+    tickUs += stepUs;
+    tickMaxUs = std::max(tickMaxUs, stepUs);
+  }
+
+  LiveStats st = feed.stats();
+  printf("%d phones: %u on the feed (%d slots), %u refused (poll the JSON API); %zu events published\n", kPhones,
+         (unsigned)(kPhones - st.refused), LIVE_CLIENTS, (unsigned)st.refused, published.size());
+  printf("%6s %7s %10s %8s %9s %7s %7s %8s\n", "link", "phones", "bytes", "events", "evicted", "resets", "resync", "max lag");
+  for (const Link *link : { &kFast, &kSlow, &kCrawl }) {
+    size_t n = 0, bytes = 0, events = 0, evictions = 0, resets = 0, resyncs = 0, lag = 0;
+    for (const Phone &p : phones) {
+      if (p.link != link || p.polling)
+        continue;
+      n++;
+      bytes += p.bytes;
+      events += p.events;
+      evictions += p.evictions;
+      resets += p.resets;
+      resyncs += p.resyncs;
+      lag = std::max(lag, p.lagMax);
+    }
+    printf("%6s %7zu %10zu %8zu %9zu %7zu %7zu %8zu\n", link->name, n, bytes, events, evictions, resets, resyncs, lag);
+  }
+  printf("shared ring: %u B for all phones, %zu B per phone; fill() %.2f us per call\n",
+         (unsigned)LIVE_ARENA_BYTES + LIVE_EVENTS * 4, sizeof(LiveClient), fills ? fillUs / fills : 0.0);
+  printf("queue per phone: peak %zu B queued, %zu events dropped at %zu per phone\n", copyPeak, copyDropped, kCopyQueueMax);
+  printf("radio task: %zu delivery results, notify() max %.2f us, %zu lost (queue of %d), %zu resync events published\n",
+         notices, notifyMaxUs, lost, LIVE_NOTICES, resyncsPublished);
+  printf("web server: %.1f us per 100 ms tick for all feeds, max %.1f us (%.3f%% of the tick)\n", tickUs / (kDurationMs / kStepMs),
+         tickMaxUs, tickMaxUs / 1000.0);
+  for (const Phone &p : phones)
+    if (!p.polling && !p.reloaded) {
+      printf("phone on %s link missed the reset after lost delivery results\n", p.link->name);
+      failures++;
+    }
+  if (failures) {
+    printf("STREAM ERRORS: %zu\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+// Heap and time per request for the /messages page, built as one String the
+// way it used to be and streamed through PageStream the way LoRaWeb sends it
+// now. Rows are rendered as in LoRaWeb::addMessageLog; the chunk size is
+// what AsyncWebServer typically offers per call (one TCP segment).
+//
+// Build and run from arduino/host:  make bench && ./build/bench_pages
+// Heap is counted by the shim's operator new (shim/HostContext.h).
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "HostContext.h"
+#include "MessageRing.h"
+#include "PageStream.h"
+
+static const size_t kChunk = 1436;
+static const int kRounds = 200;
+
+static String row(const LogEntry &m) {
+  return "<li>[" + String(m.timestamp) + "] " + m.sender + ": " + m.content + " (RSSI=" + String(m.rssi, 1) +
+         ", SNR=" + String(m.snr, 1) + ")</li>";
+}
+
+static size_t concatenated(const MessageRing &log, uint8_t *chunk) {
+  String html = "<h2>Messages</h2><ul>";
+  for (auto it = log.rbegin(); it != log.rend(); ++it)
+    html += row(*it);
+  html += "</ul>";
+  // The response copies it out in segments as well
+  for (size_t pos = 0; pos < html.length(); pos += kChunk)
+    memcpy(chunk, html.c_str() + pos, std::min(kChunk, html.length() - pos));
+  return html.length();
+}
+
+static size_t streamed(const MessageRing &log, uint8_t *chunk, size_t &largest) {
+  PageStream page;
+  page.add("<h2>Messages</h2><ul>");
+  uint32_t next = log.firstNumber() + log.size() - 1, left = log.size();
+  page.add([&log, next, left](size_t, String &out) mutable {
+    if (left == 0)
+      return false;
+    out += row(log.at(next - log.firstNumber()));
+    next--;
+    left--;
+    return true;
+  });
+  page.add("</ul>");
+  size_t total = 0, n;
+  while ((n = page.fill(chunk, kChunk)) > 0)
+    total += n;
+  largest = page.largestPiece();
+  return total;
+}
+
+int main() {
+  std::mt19937 rng(1);
+  static uint8_t chunk[kChunk];
+  printf("%7s %9s %15s %15s %12s %12s\n", "entries", "bytes", "concat peak B", "stream peak B", "concat us", "stream us");
+  size_t failures = 0;
+  for (size_t entries : { 25, 100, 400, 1600 }) {
+    MessageRing log;
+    log.begin(entries * 256, entries);
+    for (size_t i = 0; i < entries; i++) {
+      char sender[24], content[200];
+      snprintf(sender, sizeof(sender), "NODE_%012X", (unsigned)rng());
+      size_t len = 20 + rng() % 160;
+      for (size_t k = 0; k < len; k++)
+        content[k] = 'a' + rng() % 26;
+      log.append(i * 1000, sender, strlen(sender), content, len, -90.5f, 7.25f, 1);
+    }
+
+    HostNode account;
+    size_t bytes[2] = {}, peak[2] = {}, largest = 0;
+    double us[2] = {};
+    for (int way = 0; way < 2; way++) {
+      hostCurrent = &account;
+      account.heapBytes = account.heapPeak = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      for (int r = 0; r < kRounds; r++)
+        bytes[way] = way == 0 ? concatenated(log, chunk) : streamed(log, chunk, largest);
+      us[way] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / kRounds;
+      peak[way] = account.heapPeak;
+      hostCurrent = nullptr;
+    }
+    if (bytes[0] != bytes[1])
+      failures++;
+    printf("%7zu %9zu %15zu %15zu %12.1f %12.1f\n", entries, bytes[1], peak[0], peak[1], us[0], us[1]);
+  }
+  if (failures)
+    printf("PAGES DIFFER: %zu\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+#include <Arduino.h>
+#include <new>
+#include "HostContext.h"
+
+uint64_t hostNowUs = 0;
+HostNode *hostCurrent = nullptr;
+std::mt19937 hostRng(1);
+bool hostLogAll = false;
+
+HardwareSerial Serial;
+EspClass ESP;
+
+unsigned long millis() { return hostNowUs / 1000; }
+unsigned long micros() { return hostNowUs; }
+void delay(unsigned long) {}  // simulated code never blocks
+
+long random(long max) { return max > 0 ? (long)(hostRng() % (uint32_t)max) : 0; }
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+uint32_t esp_random() { return hostRng(); }
+
+uint64_t EspClass::getEfuseMac() { return hostCurrent ? hostCurrent->mac : 0x0000A1B2C3D4E5F6ULL; }
+uint32_t EspClass::getFreeHeap() { return HOST_HEAP_SIZE - (hostCurrent ? hostCurrent->heapBytes : 0); }
+uint32_t EspClass::getCycleCount() { return (uint32_t)(hostNowUs * getCpuFreqMHz()); }
+
+// =======================
+// Serial: prefixed with time and node, silent unless asked for
+// =======================
+static bool echo() { return hostLogAll || (hostCurrent && hostCurrent->log); }
+
+static void prefix() {
+  if (hostCurrent)
+    fprintf(stdout, "%9.3f n%-3d ", hostNowUs / 1e6, hostCurrent->index);
+  else
+    fprintf(stdout, "%9.3f      ", hostNowUs / 1e6);
+}
+
+size_t HardwareSerial::print(const String &s) { return print(s.c_str()); }
+size_t HardwareSerial::print(long v) { return print(String(v)); }
+size_t HardwareSerial::println(const String &s) { return println(s.c_str()); }
+size_t HardwareSerial::println(long v) { return println(String(v)); }
+
+size_t HardwareSerial::print(const char *s) {
+  if (!echo())
+    return strlen(s);
+  prefix();
+  return fputs(s, stdout);
+}
+
+size_t HardwareSerial::println(const char *s) {
+  if (!echo())
+    return strlen(s) + 1;
+  prefix();
+  return fprintf(stdout, "%s\n", s);
+}
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+  if (!echo())
+    return 0;
+  prefix();
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vfprintf(stdout, fmt, ap);
+  va_end(ap);
+  return n < 0 ? 0 : n;
+}
+
+// =======================
+// Heap accounting per node. Every block carries the node that allocated it,
+// so a node's high-water mark includes what other code frees for it later.
+// =======================
+namespace {
+struct alignas(16) BlockHeader {
+  size_t size;
+  HostNode *owner;
+};
+}
+
+static void *hostAlloc(size_t size) {
+  BlockHeader *b = (BlockHeader *)malloc(sizeof(BlockHeader) + size);
+  if (!b)
+    throw std::bad_alloc();
+  b->size = size;
+  b->owner = hostCurrent;
+  if (hostCurrent) {
+    hostCurrent->heapBytes += size;
+    if (hostCurrent->heapBytes > hostCurrent->heapPeak)
+      hostCurrent->heapPeak = hostCurrent->heapBytes;
+  }
+  return b + 1;
+}
+
+static void hostFree(void *p) {
+  if (!p)
+    return;
+  BlockHeader *b = (BlockHeader *)p - 1;
+  if (b->owner)
+    b->owner->heapBytes -= b->size;
+  free(b);
+}
+
+void *operator new(size_t size) { return hostAlloc(size); }
+void *operator new[](size_t size) { return hostAlloc(size); }
+void operator delete(void *p) noexcept { hostFree(p); }
+void operator delete[](void *p) noexcept { hostFree(p); }
+void operator delete(void *p, size_t) noexcept { hostFree(p); }
+void operator delete[](void *p, size_t) noexcept { hostFree(p); }
@@ -0,0 +1,54 @@
+#pragma once
+// Host shim for the subset of the Arduino-ESP32 core used by the GhostNetNode sources.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include "WString.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#define IRAM_ATTR
+#define HEX 16
+#define DEC 10
+
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+long random(long max);
+long random(long min, long max);
+uint32_t esp_random();
+
+class HardwareSerial {
+public:
+  void begin(unsigned long) {}
+  size_t print(const String &s);
+  size_t print(const char *s);
+  size_t print(long v);
+  size_t println(const String &s);
+  size_t println(const char *s = "");
+  size_t println(long v);
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint64_t getEfuseMac();
+  uint32_t getFreeHeap();
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+};
+extern EspClass ESP;
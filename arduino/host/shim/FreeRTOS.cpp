@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+
+// Byte-copying queue, like the real one: items must be trivially copyable
+struct SimQueue {
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new SimQueue{ length, itemSize, {} };
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t) {
+  if (!q || q->items.size() >= q->length)
+    return pdFAIL;
+  const uint8_t *p = (const uint8_t *)item;
+  q->items.emplace_back(p, p + q->itemSize);
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t) {
+  if (!q || q->items.empty())
+    return pdFAIL;
+  memcpy(item, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  return pdPASS;
+}
+
+struct SimTask {
+  uint32_t notified = 0;
+};
+
+static SimTask currentTask;
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return &currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  task->notified++;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken) {
+  task->notified++;
+  if (higherPriorityTaskWoken)
+    *higherPriorityTaskWoken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t) {
+  uint32_t n = currentTask.notified;
+  currentTask.notified = clearOnExit ? 0 : (n ? n - 1 : 0);
+  return n;
+}
@@ -0,0 +1,30 @@
+#pragma once
+// State behind the Arduino shims. Everything a sketch source sees as "the
+// board" (clock, MAC, NVS, LittleFS, heap, serial port) is looked up through
+// hostCurrent, so the simulator can run many nodes in one process by
+// switching it before it runs a node.
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct HostNode {
+  int index = -1;
+  uint64_t mac = 0;
+  bool log = false;                            ///< Echo Serial output of this node
+  std::map<std::string, std::string> prefs;    ///< "namespace/key" -> value
+  std::map<std::string, std::vector<uint8_t>> files;  ///< LittleFS: path -> content
+  size_t flashWritten = 0;                     ///< Bytes written to LittleFS
+  size_t heapBytes = 0;                        ///< Live heap allocations made by this node
+  size_t heapPeak = 0;
+};
+
+extern uint64_t hostNowUs;      ///< Simulated clock behind millis()/micros()
+extern HostNode *hostCurrent;   ///< Node whose code is running, nullptr for the host itself
+extern std::mt19937 hostRng;    ///< Source for random() and esp_random()
+extern bool hostLogAll;         ///< Echo Serial output of every node
+
+/// Total heap of an ESP32-S3 without PSRAM, minus what the core and WiFi take
+#define HOST_HEAP_SIZE (320u * 1024u)
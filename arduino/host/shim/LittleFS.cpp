@@ -0,0 +1,145 @@
+#include <LittleFS.h>
+#include <string.h>
+#include <algorithm>
+#include "HostContext.h"
+
+fs::LittleFSFS LittleFS;
+
+// Storage is flash: grow it without charging the node's heap
+namespace {
+struct FlashScope {
+  HostNode *saved = hostCurrent;
+  FlashScope() { hostCurrent = nullptr; }
+  ~FlashScope() { hostCurrent = saved; }
+};
+}
+
+static std::vector<uint8_t> *content(HostNode *owner, const std::string &path) {
+  if (!owner)
+    return nullptr;
+  auto it = owner->files.find(path);
+  return it == owner->files.end() ? nullptr : &it->second;
+}
+
+namespace fs {
+
+File::File(HostNode *owner, const std::string &path, size_t pos, bool writable)
+  : owner(owner), name_(path), pos(pos), writable(writable) {}
+
+File::operator bool() const {
+  return content(owner, name_) != nullptr;
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+  std::vector<uint8_t> *data = content(owner, name_);
+  if (!data || !writable)
+    return 0;
+  {
+    // Writing past the end fills the gap with zeros, as littlefs does
+    FlashScope flash;
+    if (data->size() < pos + size)
+      data->resize(pos + size);
+  }
+  memcpy(data->data() + pos, buf, size);
+  pos += size;
+  owner->flashWritten += size;
+  return size;
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+  std::vector<uint8_t> *data = content(owner, name_);
+  if (!data || pos >= data->size())
+    return 0;
+  size_t n = std::min(size, data->size() - pos);
+  memcpy(buf, data->data() + pos, n);
+  pos += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int File::available() {
+  std::vector<uint8_t> *data = content(owner, name_);
+  return data && pos < data->size() ? (int)(data->size() - pos) : 0;
+}
+
+bool File::seek(uint32_t to, SeekMode mode) {
+  std::vector<uint8_t> *data = content(owner, name_);
+  if (!data)
+    return false;
+  size_t base = mode == SeekCur ? pos : mode == SeekEnd ? data->size() : 0;
+  pos = base + to;
+  return true;
+}
+
+size_t File::size() const {
+  std::vector<uint8_t> *data = content(owner, name_);
+  return data ? data->size() : 0;
+}
+
+File LittleFSFS::open(const char *path, const char *mode) {
+  HostNode *owner = hostCurrent;
+  if (!owner)
+    return File();
+  std::string p = path;
+  std::vector<uint8_t> *data = content(owner, p);
+  bool plus = strchr(mode, '+') != nullptr;
+  FlashScope flash;
+  switch (mode[0]) {
+    case 'w':
+      owner->files[p].clear();
+      return File(owner, p, 0, true);
+    case 'a':
+      return File(owner, p, owner->files[p].size(), true);
+    default:
+      return data ? File(owner, p, 0, plus) : File();
+  }
+}
+
+bool LittleFSFS::exists(const char *path) {
+  if (!hostCurrent)
+    return false;
+  std::string p = path;
+  if (hostCurrent->files.count(p))
+    return true;
+  // A folder exists while it holds a file
+  auto it = hostCurrent->files.lower_bound(p + "/");
+  return it != hostCurrent->files.end() && it->first.compare(0, p.size() + 1, p + "/") == 0;
+}
+
+bool LittleFSFS::remove(const char *path) {
+  FlashScope flash;
+  return flash.saved && flash.saved->files.erase(path) > 0;
+}
+
+bool LittleFSFS::rename(const char *from, const char *to) {
+  FlashScope flash;
+  HostNode *owner = flash.saved;
+  if (!owner)
+    return false;
+  auto it = owner->files.find(from);
+  if (it == owner->files.end())
+    return false;
+  // Replaces the target in one step, like lfs_rename
+  std::vector<uint8_t> data = std::move(it->second);
+  owner->files.erase(it);
+  owner->files[to] = std::move(data);
+  return true;
+}
+
+bool LittleFSFS::mkdir(const char *) {
+  return hostCurrent != nullptr;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 0;
+  if (hostCurrent)
+    for (const auto &kv : hostCurrent->files)
+      used += kv.second.size();
+  return used;
+}
+
+}  // namespace fs
@@ -0,0 +1,69 @@
+#pragma once
+// Host mock of the ESP32 LittleFS. Files live in memory per node
+// (HostNode::files), so they survive a simulated reboot of the node. Their
+// contents are flash, not heap: they are not counted in the node's heap.
+#include <Arduino.h>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct HostNode;
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File {
+public:
+  File() {}
+  File(HostNode *owner, const std::string &path, size_t pos, bool writable);
+
+  size_t write(const uint8_t *buf, size_t size);
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t read(uint8_t *buf, size_t size);
+  int read();
+  int available();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const { return pos; }
+  size_t size() const;
+  void close() { owner = nullptr; }
+  const char *path() const { return name_.c_str(); }
+  explicit operator bool() const;
+
+private:
+  HostNode *owner = nullptr;
+  std::string name_;
+  size_t pos = 0;
+  bool writable = false;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    return true;
+  }
+  File open(const char *path, const char *mode = FILE_READ);
+  File open(const String &path, const char *mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  size_t totalBytes() { return 1536 * 1024; }
+  size_t usedBytes();
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,75 @@
+#include <Preferences.h>
+#include "HostContext.h"
+
+// NVS of the running node, kept as strings under "namespace/key"
+static std::string ns;
+
+static std::string *lookup(const char *key) {
+  if (!hostCurrent)
+    return nullptr;
+  auto it = hostCurrent->prefs.find(ns + "/" + key);
+  return it == hostCurrent->prefs.end() ? nullptr : &it->second;
+}
+
+static size_t store(const char *key, const std::string &v) {
+  if (!hostCurrent)
+    return 0;
+  hostCurrent->prefs[ns + "/" + key] = v;
+  return v.size();
+}
+
+bool Preferences::begin(const char *name, bool) {
+  ns = name;
+  return true;
+}
+
+void Preferences::end() {}
+
+bool Preferences::clear() {
+  if (!hostCurrent)
+    return false;
+  auto &prefs = hostCurrent->prefs;
+  for (auto it = prefs.begin(); it != prefs.end();)
+    it = it->first.compare(0, ns.size() + 1, ns + "/") == 0 ? prefs.erase(it) : std::next(it);
+  return true;
+}
+
+size_t Preferences::putInt(const char *key, int32_t v) { return store(key, std::to_string(v)) ? 4 : 0; }
+size_t Preferences::putString(const char *key, const String &v) { return store(key, v.std()); }
+size_t Preferences::putBool(const char *key, bool v) { return store(key, v ? "1" : "0") ? 1 : 0; }
+
+int32_t Preferences::getInt(const char *key, int32_t def) {
+  std::string *v = lookup(key);
+  return v ? atoi(v->c_str()) : def;
+}
+
+String Preferences::getString(const char *key, const String &def) {
+  std::string *v = lookup(key);
+  return v ? String(*v) : def;
+}
+
+bool Preferences::getBool(const char *key, bool def) {
+  std::string *v = lookup(key);
+  return v ? *v == "1" : def;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  return store(key, std::string((const char *)value, len));
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  std::string *v = lookup(key);
+  if (!v || v->size() > maxLen)
+    return 0;
+  memcpy(buf, v->data(), v->size());
+  return v->size();
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  std::string *v = lookup(key);
+  return v ? v->size() : 0;
+}
+
+bool Preferences::remove(const char *key) {
+  return hostCurrent && hostCurrent->prefs.erase(ns + "/" + key) > 0;
+}
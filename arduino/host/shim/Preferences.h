@@ -0,0 +1,18 @@
+#pragma once
+#include <Arduino.h>
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  size_t putInt(const char *key, int32_t v);
+  int32_t getInt(const char *key, int32_t def = 0);
+  size_t putString(const char *key, const String &v);
+  String getString(const char *key, const String &def = String());
+  size_t putBool(const char *key, bool v);
+  bool getBool(const char *key, bool def = false);
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t getBytesLength(const char *key);
+  bool remove(const char *key);
+};
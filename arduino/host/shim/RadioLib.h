@@ -0,0 +1,76 @@
+#pragma once
+// Host mock of the RadioLib SX1262 driver. Frames are handed to the simulated
+// medium (sim/Medium.h) instead of an SPI bus.
+#include <Arduino.h>
+
+#define RADIOLIB_ERR_NONE 0
+#define RADIOLIB_ERR_UNKNOWN -1
+#define RADIOLIB_ERR_PACKET_TOO_LONG -4
+#define RADIOLIB_ERR_TX_TIMEOUT -5
+#define RADIOLIB_ERR_RX_TIMEOUT -6
+#define RADIOLIB_ERR_CRC_MISMATCH -7
+#define RADIOLIB_LORA_DETECTED -702
+#define RADIOLIB_CHANNEL_FREE -703
+
+// Chip independent IRQ bit positions, as in RadioLib 7
+typedef uint32_t RadioLibIrqFlags_t;
+#define RADIOLIB_IRQ_TX_DONE 0
+#define RADIOLIB_IRQ_RX_DONE 1
+#define RADIOLIB_IRQ_PREAMBLE_DETECTED 2
+#define RADIOLIB_IRQ_HEADER_VALID 4
+#define RADIOLIB_IRQ_HEADER_ERR 5
+#define RADIOLIB_IRQ_CRC_ERR 6
+#define RADIOLIB_IRQ_TIMEOUT 9
+#define RADIOLIB_IRQ_RX_DEFAULT_FLAGS ((1UL << RADIOLIB_IRQ_RX_DONE) | (1UL << RADIOLIB_IRQ_TIMEOUT) | \
+                                       (1UL << RADIOLIB_IRQ_CRC_ERR) | (1UL << RADIOLIB_IRQ_HEADER_VALID) | \
+                                       (1UL << RADIOLIB_IRQ_HEADER_ERR))
+#define RADIOLIB_IRQ_RX_DEFAULT_MASK (1UL << RADIOLIB_IRQ_RX_DONE)
+
+// SX126x GetIrqStatus bits
+#define RADIOLIB_SX126X_IRQ_RX_DONE 0x0002
+#define RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED 0x0004
+#define RADIOLIB_SX126X_IRQ_HEADER_VALID 0x0010
+#define RADIOLIB_SX126X_IRQ_ALL 0x43FF
+#define RADIOLIB_SX126X_RX_TIMEOUT_INF 0xFFFFFF
+
+class Module {
+public:
+  Module(int, int, int, int) {}
+};
+
+class SX1262 {
+public:
+  explicit SX1262(Module *) {}
+
+  int16_t begin(float freq = 434.0, float bw = 125.0, uint8_t sf = 9, uint8_t cr = 7,
+                uint8_t syncWord = 0x12, int8_t power = 10, uint16_t preambleLength = 8);
+  int16_t transmit(uint8_t *data, size_t len, uint8_t addr = 0);
+  int16_t startTransmit(uint8_t *data, size_t len, uint8_t addr = 0);
+  int16_t finishTransmit();
+  int16_t startReceive();
+  int16_t startReceive(uint32_t timeout, RadioLibIrqFlags_t irqFlags = RADIOLIB_IRQ_RX_DEFAULT_FLAGS,
+                       RadioLibIrqFlags_t irqMask = RADIOLIB_IRQ_RX_DEFAULT_MASK, size_t len = 0);
+  int16_t readData(uint8_t *data, size_t len);
+  size_t getPacketLength(bool update = true);
+  float getRSSI();
+  float getSNR();
+  void setDio1Action(void (*func)(void));
+  void clearDio1Action();
+  int16_t setSpreadingFactor(uint8_t sf);
+  int16_t setBandwidth(float bw);
+  int16_t setCodingRate(uint8_t cr);
+  int16_t setPreambleLength(size_t len);
+  int16_t standby();
+  int16_t sleep();
+  int16_t startChannelScan();
+  int16_t getChannelScanResult();
+  int16_t scanChannel();
+  int16_t startReceiveDutyCycleAuto(uint16_t senderPreambleLength = 0, uint16_t minSymbols = 8,
+                                    RadioLibIrqFlags_t irqFlags = RADIOLIB_IRQ_RX_DEFAULT_FLAGS,
+                                    RadioLibIrqFlags_t irqMask = RADIOLIB_IRQ_RX_DEFAULT_MASK);
+  uint32_t getIrqFlags();
+  int16_t clearIrqFlags(uint32_t irq);
+  uint32_t getTimeOnAir(size_t len);
+
+  int nodeIndex = -1;  ///< Simulated node, taken from hostCurrent by begin()
+};
@@ -0,0 +1,104 @@
+#include <Arduino.h>
+#include <ctype.h>
+
+static std::string formatInt(unsigned long long v, bool negative, unsigned char base) {
+  if (base < 2 || base > 36)
+    base = 10;
+  char buf[72];
+  int pos = sizeof(buf);
+  buf[--pos] = 0;
+  do {
+    int d = v % base;
+    buf[--pos] = d < 10 ? '0' + d : 'a' + d - 10;  // Arduino prints hex in lower case
+    v /= base;
+  } while (v);
+  if (negative)
+    buf[--pos] = '-';
+  return std::string(buf + pos);
+}
+
+static std::string formatSigned(long long v, unsigned char base) {
+  // Arduino only prints a sign in base 10; other bases show the two's complement
+  if (base == 10)
+    return formatInt(v < 0 ? -(unsigned long long)v : v, v < 0, base);
+  return formatInt((unsigned long)v, false, base);
+}
+
+String::String(int v, unsigned char base) : s_(formatSigned(v, base)) {}
+String::String(unsigned int v, unsigned char base) : s_(formatInt(v, false, base)) {}
+String::String(long v, unsigned char base) : s_(formatSigned(v, base)) {}
+String::String(unsigned long v, unsigned char base) : s_(formatInt(v, false, base)) {}
+String::String(long long v, unsigned char base) : s_(formatSigned(v, base)) {}
+String::String(unsigned long long v, unsigned char base) : s_(formatInt(v, false, base)) {}
+
+String::String(float v, unsigned int decimals) : String((double)v, decimals) {}
+
+String::String(double v, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+  s_ = buf;
+}
+
+bool String::equalsIgnoreCase(const String &o) const {
+  if (s_.size() != o.s_.size())
+    return false;
+  for (size_t i = 0; i < s_.size(); i++)
+    if (tolower((unsigned char)s_[i]) != tolower((unsigned char)o.s_[i]))
+      return false;
+  return true;
+}
+
+bool String::endsWith(const String &p) const {
+  return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = s_.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &p, unsigned int from) const {
+  size_t pos = s_.find(p.s_, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = s_.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+  return from >= s_.size() ? String() : String(s_.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to)
+    std::swap(from, to);
+  if (from >= s_.size())
+    return String();
+  return String(s_.substr(from, std::min<size_t>(to, s_.size()) - from));
+}
+
+void String::trim() {
+  size_t b = 0, e = s_.size();
+  while (b < e && isspace((unsigned char)s_[b]))
+    b++;
+  while (e > b && isspace((unsigned char)s_[e - 1]))
+    e--;
+  s_ = s_.substr(b, e - b);
+}
+
+void String::toLowerCase() {
+  for (char &c : s_)
+    c = tolower((unsigned char)c);
+}
+
+void String::replace(const String &from, const String &to) {
+  if (from.s_.empty())
+    return;
+  size_t pos = 0;
+  while ((pos = s_.find(from.s_, pos)) != std::string::npos) {
+    s_.replace(pos, from.s_.size(), to.s_);
+    pos += to.s_.size();
+  }
+}
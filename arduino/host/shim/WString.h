@@ -0,0 +1,68 @@
+#pragma once
+// Minimal Arduino String on top of std::string.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const char *s, unsigned int len) : s_(s, len) {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = 10);
+  String(unsigned int v, unsigned char base = 10);
+  String(long v, unsigned char base = 10);
+  String(unsigned long v, unsigned char base = 10);
+  String(long long v, unsigned char base = 10);
+  String(unsigned long long v, unsigned char base = 10);
+  String(float v, unsigned int decimals = 2);
+  String(double v, unsigned int decimals = 2);
+
+  unsigned int length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *o) { s_ += o; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  bool concat(const char *p, unsigned int len) { s_.append(p, len); return true; }
+  bool concat(const String &o) { s_ += o.s_; return true; }
+  bool concat(char c) { s_ += c; return true; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.s_); }
+  friend String operator+(const String &a, char b) { return String(a.s_ + b); }
+
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator==(const char *o) const { return s_ == o; }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool operator!=(const char *o) const { return s_ != o; }
+  bool operator<(const String &o) const { return s_ < o.s_; }
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  bool equals(const String &o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String &o) const;
+  bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String &p) const;
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &p, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  void trim();
+  void toLowerCase();
+  void replace(const String &from, const String &to);
+  long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s_.c_str(), nullptr); }
+  bool isEmpty() const { return s_.empty(); }
+  void remove(unsigned int index, unsigned int count) { if (index < s_.size()) s_.erase(index, count); }
+
+  const std::string &std() const { return s_; }
+
+private:
+  std::string s_;
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xFFFFFFFFu
@@ -0,0 +1,7 @@
+#pragma once
+#include "FreeRTOS.h"
+struct SimQueue;
+typedef SimQueue *QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
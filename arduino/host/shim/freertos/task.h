@@ -0,0 +1,11 @@
+#pragma once
+#include "FreeRTOS.h"
+// Task notifications only; the simulator runs every node's loop() itself,
+// so a notification just counts until somebody takes it
+struct SimTask;
+typedef SimTask *TaskHandle_t;
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higherPriorityTaskWoken);
+#define portYIELD_FROM_ISR() ((void)0)
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait);
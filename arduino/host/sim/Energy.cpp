@@ -0,0 +1,21 @@
+#include "Energy.h"
+
+EnergyUse estimateEnergy(const EnergyProfile &p, PowerMode mode, const RadioTime &radio, uint64_t wakeups, uint64_t spanUs) {
+  EnergyUse e;
+  if (spanUs == 0)
+    return e;
+  double span = (double)spanUs;
+  e.radioMa = (radio.txUs * p.radioTxMa + radio.rxUs * p.radioRxMa + radio.standbyUs * p.radioStandbyMa +
+               radio.sleepUs * p.radioSleepMa) / span;
+  if (mode == POWER_SAVE) {
+    double awake = wakeups * p.wakeUs / span;
+    if (awake > 1.0)
+      awake = 1.0;
+    e.mcuMa = awake * p.mcuActiveMa + (1.0 - awake) * p.mcuLightSleepMa;
+  } else {
+    e.mcuMa = p.mcuActiveMa + p.wifiApMa + p.displayMa;
+  }
+  e.mcuMa += p.boardMa;
+  e.totalMa = e.radioMa + e.mcuMa;
+  return e;
+}
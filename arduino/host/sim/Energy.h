@@ -0,0 +1,34 @@
+#pragma once
+// Energy model of a Heltec LoRa32 V3 node, from the time the simulated radio
+// spent in each state and the wakeups of the LoRa task. Currents are typical
+// datasheet figures (SX1262, ESP32-S3) and a few bench numbers for the board;
+// the result is a planning estimate, not a measurement.
+#include <stdint.h>
+#include "Medium.h"
+#include "PowerMode.h"
+
+struct EnergyProfile {
+  double radioTxMa = 45.0;        ///< SX1262 at +14 dBm
+  double radioRxMa = 4.6;         ///< SX1262 RX, DC-DC, 125 kHz
+  double radioStandbyMa = 0.6;    ///< STDBY_RC
+  double radioSleepMa = 0.0012;   ///< Warm-start sleep, also between duty-cycle windows
+  double mcuActiveMa = 40.0;      ///< ESP32-S3 at 240 MHz, WiFi off
+  double wifiApMa = 60.0;         ///< Extra while the soft AP is up; its receiver never sleeps
+  double displayMa = 8.0;         ///< SSD1306 with a few lines lit
+  double mcuLightSleepMa = 0.24;  ///< ESP32-S3 light sleep, RTC timer and GPIO wake-up armed
+  double boardMa = 0.05;          ///< Regulator quiescent current and battery divider
+  double wakeUs = 1500;           ///< Awake time per LoRa task wakeup from light sleep
+};
+
+struct EnergyUse {
+  double radioMa = 0;   ///< Average current of the SX1262
+  double mcuMa = 0;     ///< Average current of the ESP32, WiFi and display
+  double totalMa = 0;   ///< Also the mAh used per hour
+};
+
+/**
+ * Average current of one node over spanUs.
+ * @param wakeups LoRa task wakeups in that time; in POWER_SAVE the ESP32
+ *                sleeps in between, in POWER_ALWAYS_ON it never sleeps.
+ */
+EnergyUse estimateEnergy(const EnergyProfile &p, PowerMode mode, const RadioTime &radio, uint64_t wakeups, uint64_t spanUs);
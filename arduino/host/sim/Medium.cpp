@@ -0,0 +1,384 @@
+#include "Medium.h"
+#include <math.h>
+#include <algorithm>
+#include <string.h>
+#include <RadioLib.h>
+#include "HostContext.h"
+#include "LinkAdr.h"
+#include "LoRaPacket.h"
+#include "PowerMode.h"
+
+Medium *simMedium = nullptr;
+
+Medium::Medium(const MediumConfig &cfg, uint32_t seed) : cfg(cfg), rng(seed) {}
+
+int Medium::addNode(float x, float y) {
+  size_t n = nodes.size();
+  Radio r;
+  r.x = x;
+  r.y = y;
+  nodes.push_back(r);
+
+  // Grow the loss matrix by one row and column; shadowing is fixed per link
+  // and the same both ways
+  std::vector<float> grown((n + 1) * (n + 1), 0.0f);
+  for (size_t a = 0; a < n; a++)
+    for (size_t b = 0; b < n; b++)
+      grown[a * (n + 1) + b] = loss[a * n + b];
+  std::normal_distribution<float> shadow(0.0f, cfg.shadowingDb);
+  for (size_t a = 0; a < n; a++) {
+    float d = hypotf(nodes[a].x - x, nodes[a].y - y);
+    float pl = cfg.refLossDb + 10.0f * cfg.pathLossExponent * log10f(d < 1.0f ? 1.0f : d) + shadow(rng);
+    grown[a * (n + 1) + n] = pl;
+    grown[n * (n + 1) + a] = pl;
+  }
+  loss.swap(grown);
+  return (int)n;
+}
+
+bool Medium::decodable(int a, int b, uint8_t sf) const {
+  return !nodes[a].away && !nodes[b].away && snr(a, b) >= LinkAdr::requiredSnr(sf);
+}
+
+size_t Medium::reach(int a, uint8_t sf) const {
+  size_t n = 0;
+  for (size_t b = 0; b < nodes.size(); b++)
+    if ((int)b != a && decodable(a, b, sf))
+      n++;
+  return n;
+}
+
+void Medium::attach(int node, SX1262 *driver) {
+  nodes[node].driver = driver;
+}
+
+double Medium::sleepShare(const Radio &r) const {
+  return r.dutyRxUs ? (double)r.dutySleepUs / (r.dutyRxUs + r.dutySleepUs) : 0.0;
+}
+
+void Medium::account(int node) {
+  Radio &r = nodes[node];
+  uint64_t elapsed = hostNowUs - r.sinceUs;
+  r.sinceUs = hostNowUs;
+  switch (r.mode) {
+  case TX:
+    r.time.txUs += elapsed;
+    break;
+  case RX: {
+    uint64_t asleep = (uint64_t)(elapsed * sleepShare(r));
+    r.time.sleepUs += asleep;
+    r.time.rxUs += elapsed - asleep;
+    break;
+  }
+  case STANDBY:
+    r.time.standbyUs += elapsed;
+    break;
+  case SLEEP:
+    r.time.sleepUs += elapsed;
+    break;
+  }
+}
+
+RadioTime Medium::radioTime(int node) {
+  account(node);
+  RadioTime t = nodes[node].time;
+  uint64_t caught = std::min(nodes[node].caughtUs, t.sleepUs);
+  t.sleepUs -= caught;
+  t.rxUs += caught;
+  return t;
+}
+
+void Medium::setDutyCycle(int node, uint32_t rxUs, uint32_t sleepUs) {
+  account(node);
+  nodes[node].dutyRxUs = rxUs;
+  nodes[node].dutySleepUs = sleepUs;
+}
+
+void Medium::setMode(int node, Mode mode) {
+  Radio &r = nodes[node];
+  account(node);
+  if (r.mode != mode)
+    r.epoch++;  // a reception in progress is lost, a new one needs a fresh preamble
+  r.mode = mode;
+}
+
+void Medium::setSf(int node, uint8_t sf) {
+  Radio &r = nodes[node];
+  if (r.sf != sf)
+    r.epoch++;
+  r.sf = sf;
+}
+
+bool Medium::preambleOnAir(int node) const {
+  const Radio &r = nodes[node];
+  for (const Transmission &t : onAir)
+    if (t.sf == r.sf && t.from != node && hostNowUs < t.startUs + t.preambleUs && decodable(t.from, node, t.sf))
+      return true;
+  return false;
+}
+
+void Medium::clearIrq(int node) {
+  nodes[node].irqClearedUs = hostNowUs;
+}
+
+uint16_t Medium::irqStatus(int node) const {
+  // The preamble is detected after a few symbols, the header follows the
+  // preamble; both stay set until the frame is done or the flags are cleared
+  const Radio &r = nodes[node];
+  uint16_t irq = 0;
+  if (r.mode != RX)
+    return irq;
+  for (const Transmission &t : onAir) {
+    for (const Reception &rec : t.receptions) {
+      if (rec.node != node || rec.epoch != r.epoch)
+        continue;
+      uint64_t detectedUs = t.startUs + (uint64_t)(POWER_MIN_SYMBOLS * symbolUs(t.sf, r.bw));
+      if (hostNowUs >= detectedUs && detectedUs > r.irqClearedUs)
+        irq |= RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED;
+      if (hostNowUs >= t.startUs + t.preambleUs + (uint64_t)(8 * symbolUs(t.sf, r.bw)))
+        irq |= RADIOLIB_SX126X_IRQ_HEADER_VALID;
+    }
+  }
+  return irq;
+}
+
+void Medium::transmit(int from, const uint8_t *data, size_t len) {
+  Radio &sender = nodes[from];
+  setMode(from, TX);
+  Transmission tx;
+  tx.from = from;
+  tx.sf = sender.sf;
+  tx.startUs = hostNowUs;
+  tx.endUs = hostNowUs + loraTimeOnAirUs(len, sender.sf, sender.bw, sender.cr, sender.preamble);
+  tx.preambleUs = (uint64_t)((sender.preamble + 4.25) * symbolUs(sender.sf, sender.bw));
+  tx.data.assign(data, data + len);
+  counters.frames++;
+  counters.byType[data[0] & 0x0F]++;
+  counters.airtimeByType[data[0] & 0x0F] += tx.endUs - tx.startUs;
+
+  for (size_t j = 0; j < nodes.size(); j++) {
+    const Radio &rx = nodes[j];
+    if ((int)j == from || rx.away || sender.away)
+      continue;
+    float power = rssi(from, j);
+
+    // Same-SF frames already on air: a receiver locked onto one of them
+    // cannot switch, and whichever is not clearly stronger is lost
+    bool busy = false, drowned = false;
+    for (Transmission &other : onAir) {
+      if (other.sf != tx.sf || nodes[other.from].away)
+        continue;  // SFs are treated as orthogonal
+      float otherPower = rssi(other.from, j);
+      if (otherPower > power - cfg.captureDb)
+        drowned = true;
+      for (Reception &rec : other.receptions) {
+        if (rec.node != (int)j || rec.epoch != rx.epoch)
+          continue;
+        busy = true;
+        if (power > rec.rssi - cfg.captureDb)
+          rec.collided = true;
+      }
+    }
+
+    if (!decodable(from, j, tx.sf))
+      continue;
+    if (rx.mode != RX || rx.sf != tx.sf) {
+      counters.notListening++;
+      continue;
+    }
+    if (busy) {
+      counters.collisions++;
+      continue;
+    }
+    // A duty-cycled receiver needs minSymbols of the preamble inside one of its listening windows
+    if (rx.dutyRxUs) {
+      double window = (sender.preamble - POWER_MIN_SYMBOLS) * symbolUs(tx.sf, sender.bw) + rx.dutyRxUs;
+      double chance = window / (rx.dutyRxUs + rx.dutySleepUs);
+      if (chance < 1.0 && std::uniform_real_distribution<double>(0, 1)(rng) >= chance) {
+        counters.asleep++;
+        continue;
+      }
+    }
+    tx.receptions.push_back(Reception{ (int)j, rx.epoch, power, drowned });
+  }
+  onAir.push_back(std::move(tx));
+}
+
+uint64_t Medium::nextEventUs() const {
+  uint64_t next = UINT64_MAX;
+  for (const Transmission &t : onAir)
+    if (t.endUs < next)
+      next = t.endUs;
+  return next;
+}
+
+void Medium::complete(uint64_t now, std::vector<int> &txDone, std::vector<int> &rxDone) {
+  for (size_t i = 0; i < onAir.size();) {
+    Transmission &t = onAir[i];
+    if (t.endUs > now) {
+      i++;
+      continue;
+    }
+    // The SX1262 drops to standby after TX done
+    if (nodes[t.from].mode == TX)
+      nodes[t.from].mode = STANDBY;
+    txDone.push_back(t.from);
+
+    for (const Reception &rec : t.receptions) {
+      Radio &rx = nodes[rec.node];
+      bool locked = rx.epoch == rec.epoch && rx.mode == RX && rx.sf == t.sf;
+      if (rec.collided) {
+        counters.collisions++;
+        // The receiver stayed on the frame to the end: RX done with a CRC error
+        if (locked) {
+          rx.rxLen = t.data.size();
+          rx.rxCrcError = true;
+          rxDone.push_back(rec.node);
+        }
+        continue;
+      }
+      if (!locked) {
+        counters.notListening++;
+        continue;
+      }
+      if (rx.dutyRxUs)
+        rx.caughtUs += (uint64_t)((t.endUs - t.startUs) * sleepShare(rx));
+      memcpy(rx.rxData, t.data.data(), t.data.size());
+      rx.rxLen = t.data.size();
+      rx.rxCrcError = false;
+      rx.rxRssi = rec.rssi;
+      rx.rxSnr = rec.rssi - cfg.noiseFloorDbm;
+      counters.receptions++;
+      rxDone.push_back(rec.node);
+    }
+    onAir.erase(onAir.begin() + i);
+  }
+}
+
+void Medium::fireDio1(int node) {
+  if (nodes[node].dio1)
+    nodes[node].dio1();
+}
+
+// =======================
+// SX1262 mock
+// =======================
+int16_t SX1262::begin(float, float bw, uint8_t sf, uint8_t cr, uint8_t, int8_t, uint16_t) {
+  if (!simMedium || !hostCurrent)
+    return RADIOLIB_ERR_UNKNOWN;
+  nodeIndex = hostCurrent->index;
+  simMedium->attach(nodeIndex, this);
+  Medium::Radio &r = simMedium->radio(nodeIndex);
+  r.bw = bw;
+  r.sf = sf;
+  r.cr = cr;
+  simMedium->setMode(nodeIndex, Medium::STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startTransmit(uint8_t *data, size_t len, uint8_t) {
+  if (len > 255)
+    return RADIOLIB_ERR_PACKET_TOO_LONG;
+  simMedium->transmit(nodeIndex, data, len);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::transmit(uint8_t *data, size_t len, uint8_t addr) {
+  // Blocking TX would stall the simulated clock; it finishes like startTransmit
+  return startTransmit(data, len, addr);
+}
+
+int16_t SX1262::finishTransmit() {
+  simMedium->setMode(nodeIndex, Medium::STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startReceive() {
+  return startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF);
+}
+
+int16_t SX1262::startReceive(uint32_t, RadioLibIrqFlags_t, RadioLibIrqFlags_t, size_t) {
+  simMedium->setDutyCycle(nodeIndex, 0, 0);
+  simMedium->setMode(nodeIndex, Medium::RX);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startReceiveDutyCycleAuto(uint16_t senderPreambleLength, uint16_t minSymbols, RadioLibIrqFlags_t,
+                                          RadioLibIrqFlags_t) {
+  Medium::Radio &r = simMedium->radio(nodeIndex);
+  RxDutyCycle d = powerRxDutyCycle(r.sf, r.bw, senderPreambleLength ? senderPreambleLength : r.preamble, minSymbols);
+  simMedium->setDutyCycle(nodeIndex, d.rxUs, d.sleepUs);
+  simMedium->setMode(nodeIndex, Medium::RX);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::readData(uint8_t *data, size_t len) {
+  Medium::Radio &r = simMedium->radio(nodeIndex);
+  if (r.rxLen == 0)
+    return RADIOLIB_ERR_RX_TIMEOUT;
+  if (r.rxCrcError)
+    return RADIOLIB_ERR_CRC_MISMATCH;
+  memcpy(data, r.rxData, len < r.rxLen ? len : r.rxLen);
+  return RADIOLIB_ERR_NONE;
+}
+
+size_t SX1262::getPacketLength(bool) { return simMedium->radio(nodeIndex).rxLen; }
+float SX1262::getRSSI() { return simMedium->radio(nodeIndex).rxRssi; }
+float SX1262::getSNR() { return simMedium->radio(nodeIndex).rxSnr; }
+
+void SX1262::setDio1Action(void (*func)(void)) { simMedium->radio(nodeIndex).dio1 = func; }
+void SX1262::clearDio1Action() { simMedium->radio(nodeIndex).dio1 = nullptr; }
+
+int16_t SX1262::setSpreadingFactor(uint8_t sf) {
+  if (sf < 5 || sf > 12)
+    return RADIOLIB_ERR_UNKNOWN;
+  simMedium->setSf(nodeIndex, sf);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setBandwidth(float bw) {
+  simMedium->radio(nodeIndex).bw = bw;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setCodingRate(uint8_t cr) {
+  simMedium->radio(nodeIndex).cr = cr;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setPreambleLength(size_t len) {
+  simMedium->radio(nodeIndex).preamble = len;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::standby() {
+  simMedium->setMode(nodeIndex, Medium::STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::sleep() {
+  simMedium->setMode(nodeIndex, Medium::SLEEP);
+  return RADIOLIB_ERR_NONE;
+}
+
+// CAD puts the radio in standby, which loses a frame it was receiving, and
+// reliably sees only a preamble. It takes no simulated time.
+int16_t SX1262::scanChannel() {
+  simMedium->setMode(nodeIndex, Medium::STANDBY);
+  return simMedium->preambleOnAir(nodeIndex) ? RADIOLIB_LORA_DETECTED : RADIOLIB_CHANNEL_FREE;
+}
+
+int16_t SX1262::startChannelScan() { return RADIOLIB_ERR_NONE; }
+int16_t SX1262::getChannelScanResult() { return scanChannel(); }
+
+uint32_t SX1262::getIrqFlags() { return simMedium->irqStatus(nodeIndex); }
+
+int16_t SX1262::clearIrqFlags(uint32_t) {
+  simMedium->clearIrq(nodeIndex);
+  return RADIOLIB_ERR_NONE;
+}
+
+uint32_t SX1262::getTimeOnAir(size_t len) {
+  const Medium::Radio &r = simMedium->radio(nodeIndex);
+  return loraTimeOnAirUs(len, r.sf, r.bw, r.cr, r.preamble);
+}
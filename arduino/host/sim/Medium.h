@@ -0,0 +1,139 @@
+#pragma once
+// Shared radio channel of the simulator: path loss between node positions,
+// time on air per SF, half duplex and collisions with capture. The SX1262
+// mock (shim/RadioLib.h) hands its frames to the one Medium instance.
+#include <stdint.h>
+#include <stddef.h>
+#include <random>
+#include <vector>
+
+class SX1262;
+
+/// Time a radio spent in each state, for the energy model
+struct RadioTime {
+  uint64_t txUs = 0;
+  uint64_t rxUs = 0;       ///< Listening, including duty-cycle windows and frames caught
+  uint64_t standbyUs = 0;
+  uint64_t sleepUs = 0;    ///< SLEEP and the sleep part of the RX duty cycle
+};
+
+struct MediumConfig {
+  float txPowerDbm = 14.0f;        ///< EU868 ERP limit of the Heltec setup
+  float refLossDb = 31.2f;         ///< Free-space loss at 1 m, 868 MHz
+  float pathLossExponent = 3.5f;   ///< Outdoors with trees, tents and people
+  float shadowingDb = 4.0f;        ///< Sigma of the fixed per-link log-normal shadowing
+  float noiseFloorDbm = -117.0f;   ///< Thermal noise over 125 kHz plus 6 dB noise figure
+  float captureDb = 6.0f;          ///< A frame survives interference this much weaker
+};
+
+struct MediumStats {
+  uint32_t frames = 0;        ///< Frames put on air
+  uint32_t receptions = 0;    ///< Frames delivered to a receiver
+  uint32_t collisions = 0;    ///< Receptions lost to another frame at the same SF
+  uint32_t notListening = 0;  ///< Receptions lost because the receiver was sending or on another SF
+  uint32_t asleep = 0;        ///< Receptions lost because the preamble fell in a duty-cycle sleep
+  uint32_t byType[16] = {};   ///< Frames per LoRaPacketType
+  uint64_t airtimeByType[16] = {};
+};
+
+class Medium {
+public:
+  Medium(const MediumConfig &cfg, uint32_t seed);
+
+  /// Add a node at (x, y) metres; returns its index.
+  int addNode(float x, float y);
+  size_t size() const { return nodes.size(); }
+
+  /// Received power at b of a frame sent by a.
+  float rssi(int a, int b) const { return cfg.txPowerDbm - loss[a * nodes.size() + b]; }
+  float snr(int a, int b) const { return rssi(a, b) - cfg.noiseFloorDbm; }
+
+  /// Take a node out of range of every other node, or bring it back.
+  void setAway(int node, bool away) { nodes[node].away = away; }
+
+  /// Nodes that can decode a at this SF when nothing else is on air.
+  size_t reach(int a, uint8_t sf) const;
+
+  /// End time of the earliest frame on air, UINT64_MAX if the channel is idle.
+  uint64_t nextEventUs() const;
+
+  /**
+   * Finish the frames whose time on air ended at or before now.
+   * txDone receives the senders, rxDone the receivers that now hold a frame.
+   */
+  void complete(uint64_t now, std::vector<int> &txDone, std::vector<int> &rxDone);
+
+  /// Call the DIO1 handler the node's driver registered.
+  void fireDio1(int node);
+
+  /// Time the node's radio spent in each state up to now.
+  RadioTime radioTime(int node);
+
+  const MediumStats &stats() const { return counters; }
+
+  // ---- Used by the SX1262 mock ----
+  enum Mode : uint8_t { STANDBY, RX, TX, SLEEP };
+  struct Radio {
+    SX1262 *driver = nullptr;
+    void (*dio1)(void) = nullptr;
+    Mode mode = STANDBY;
+    uint8_t sf = 12;
+    float bw = 125.0f;
+    uint8_t cr = 8;
+    uint32_t epoch = 0;       ///< Bumped whenever the receiver stops listening
+    uint8_t rxData[256];
+    size_t rxLen = 0;
+    float rxRssi = 0, rxSnr = 0;
+    bool rxCrcError = false;  ///< Last frame was hit by a collision while receiving it
+    float x = 0, y = 0;
+    bool away = false;        ///< Out of range of every other node
+    uint16_t preamble = 8;    ///< TX preamble in symbols
+    uint32_t dutyRxUs = 0;    ///< RX duty cycle: listening window, 0 for continuous RX
+    uint32_t dutySleepUs = 0;
+    uint64_t sinceUs = 0;     ///< Start of the state being accounted
+    RadioTime time;
+    uint64_t caughtUs = 0;    ///< Duty-cycle sleep spent receiving a frame instead
+    uint64_t irqClearedUs = 0; ///< Preamble detections before this were cleared
+  };
+  Radio &radio(int node) { return nodes[node]; }
+  void attach(int node, SX1262 *driver);
+  void setMode(int node, Mode mode);
+  void setSf(int node, uint8_t sf);
+  void setDutyCycle(int node, uint32_t rxUs, uint32_t sleepUs);
+  void transmit(int node, const uint8_t *data, size_t len);
+  /// CAD: a preamble at the node's SF on air right now. Payload symbols are not seen.
+  bool preambleOnAir(int node) const;
+  /// SX126x IRQ status bits of the reception the node is locked onto.
+  uint16_t irqStatus(int node) const;
+  void clearIrq(int node);
+
+private:
+  struct Reception {
+    int node;
+    uint32_t epoch;
+    float rssi;
+    bool collided;
+  };
+  struct Transmission {
+    int from;
+    uint8_t sf;
+    uint64_t startUs, endUs;
+    uint64_t preambleUs;      ///< Preamble and sync word, all a CAD can see
+    std::vector<uint8_t> data;
+    std::vector<Reception> receptions;
+  };
+
+  bool decodable(int a, int b, uint8_t sf) const;
+  void account(int node);
+  double sleepShare(const Radio &r) const;
+  double symbolUs(uint8_t sf, float bw) const { return (double)(1UL << sf) * 1000.0 / bw; }
+
+  MediumConfig cfg;
+  std::vector<Radio> nodes;
+  std::vector<float> loss;   ///< Path loss a -> b, row major
+  std::vector<Transmission> onAir;
+  std::mt19937 rng;
+  MediumStats counters;
+};
+
+extern Medium *simMedium;
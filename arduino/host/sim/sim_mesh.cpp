@@ -0,0 +1,657 @@
+// Discrete-event mesh simulation running the real LoRaRadio code.
+//
+// Every node is a LoRaRadio instance with its own clock view, MAC, NVS and
+// heap account (shim/HostContext.h). Frames go through the SX1262 mock into
+// the simulated Medium; loop() runs on every DIO1, when a message is queued
+// and when the time it returned has passed, like the LoRa task. After
+// a warm-up for beacons and routes, messages are injected at random nodes:
+// broadcasts, unicasts to a random node and messages for the gateway.
+// With --away, some nodes leave radio range for a while, like a team walking
+// off, to show what store-and-forward custody recovers. --tick adds the fixed
+// poll the LoRa task used to have, to compare wakeups and CPU time.
+// --power-save puts a share of the nodes in POWER_SAVE; the energy report
+// estimates mAh per hour for each mode (sim/Energy.h). --fec sends repair
+// fragments with fragmented messages (FecCodec.h). --file sends a file of
+// that many bytes from --file-from to --file-to (default: the node it hears
+// worst) when the traffic starts; --reboot restarts the receiver that many
+// seconds later, --reboot-sender the sender, to show the transfer resuming.
+// --min-delivery makes the run fail (exit code 1) when fewer unicast and
+// gateway messages together arrive, in percent, and --max-resets when the
+// nodes together reset their beacon interval more often; make sim-check
+// uses both.
+//
+// Build and run from arduino/host:  make sim && ./build/sim_mesh --nodes 100 --minutes 30
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HostContext.h"
+#include "Medium.h"
+#include "LoRaRadio.h"
+#include "Energy.h"
+
+// Referenced by User.cpp; the simulated nodes are separate instances
+LoRaRadio LoRa;
+
+struct Options {
+  int nodes = 50;
+  float areaM = 4000;        ///< Side of the square field
+  double minutes = 10;       ///< Traffic period
+  double warmupS = 120;      ///< Beacons only, before traffic starts
+  double drainS = 120;       ///< No new traffic, deliveries may still finish
+  double rate = 0.5;         ///< Messages per node per minute
+  double unicast = 0.4;      ///< Share of messages for a random node
+  double toGateway = 0.3;    ///< Share of messages for the gateway, the rest is broadcast
+  int maxSize = 160;         ///< Message length is uniform in 20..maxSize bytes
+  int sf = 12;
+  float freq = 868.0;        ///< Picks the duty-cycle sub-band
+  int tickMs = 0;            ///< Extra loop() period of every node, 0 for none
+  uint32_t seed = 1;
+  double away = 0;           ///< Share of the nodes that is out of range for a while
+  double awayS = 300;        ///< How long they stay away, from a quarter into the traffic period
+  double powerSave = 0;      ///< Share of the nodes in POWER_SAVE (never the gateway)
+  bool fec = false;          ///< Forward error correction on every node
+  double batteryMah = 2000;  ///< Battery for the runtime estimate
+  int fileBytes = 0;         ///< File sent when the traffic starts, 0 for none
+  int fileFrom = 1;
+  int fileTo = -1;           ///< -1: the node the sender hears worst
+  double rebootS = -1;       ///< Receiver restarts this long after the file went out
+  double rebootSenderS = -1;
+  int logNode = -1;          ///< Echo Serial output of this node
+  bool perNode = false;
+  double minDelivery = 0;    ///< Exit with 1 below this unicast and gateway delivery, in percent
+  int maxResets = -1;        ///< Exit with 1 above this many beacon interval resets, -1 = no limit
+  MediumConfig medium;
+};
+
+struct SimMessage {
+  int origin;
+  int dest;                  ///< Node index, -1 broadcast, -2 gateway
+  size_t len;
+  uint64_t createdUs;
+  std::map<int, uint64_t> heard;  ///< Receiver -> time it logged the message
+};
+
+struct Node {
+  HostNode host;
+  std::unique_ptr<LoRaRadio> radio;
+  String name;
+  uint32_t hash = 0;
+  std::vector<uint32_t> backlog;   ///< Messages radioQueue did not take yet
+  unsigned long scannedMs = 0;     ///< messageLog entries before this were seen
+  uint64_t wakeAtUs = 0;           ///< Time loop() asked to run again
+  double loopS = 0;                ///< Host CPU time spent in loop()
+};
+
+static std::vector<Node> nodes;
+static std::vector<SimMessage> messages;
+static int gatewayNode = 0;
+
+static void enter(Node &n) {
+  hostCurrent = &n.host;
+  LoRaRadio::dio1Target = n.radio.get();
+}
+
+static void leave() {
+  hostCurrent = nullptr;
+}
+
+static const char *kPhrases[] = {
+  "Team rood heeft de vlag bij de brug. ", "Spook gezien bij het bos, kom snel! ", "Punten: 120. ",
+  "Verzamelen bij de ingang om 21:00. ", "Batterij bijna leeg, ik ga terug naar de basis. ",
+  "Wie heeft de sleutel van het kamp? ", "Opdracht voltooid. ", "Let op: nieuwe ronde begint. ",
+};
+
+static String messageText(uint32_t id, size_t len) {
+  std::string s = "SIM#" + std::to_string(id) + " ";
+  while (s.size() < len)
+    s += kPhrases[hostRng() % (sizeof(kPhrases) / sizeof(kPhrases[0]))];
+  s.resize(len);
+  return String(s);
+}
+
+// Queue waiting messages for the LoRa task the way the web UI does; they stay
+// in the backlog while radioQueue is full, like a player pressing send again
+static void submit(Node &n) {
+  while (!n.backlog.empty()) {
+    uint32_t id = n.backlog.front();
+    const SimMessage &m = messages[id];
+    const char *to = m.dest >= 0 ? nodes[m.dest].name.c_str() : m.dest == -2 ? "GATEWAY" : "ALL";
+    String text = messageText(id, m.len);
+    if (n.radio->enqueueMessage(LORA_PKT_DATA, text.c_str(), text.length(), to) == RADIO_QUEUE_FULL)
+      return;
+    n.backlog.erase(n.backlog.begin());
+  }
+}
+
+// Record messages that reached this node's messageLog
+static void scanLog(Node &n, int index) {
+  MessageLogView log = n.radio->getMessageLog();
+  for (auto it = log->rbegin(); it != log->rend() && (*it).timestamp >= n.scannedMs; ++it) {
+    const char *content = (*it).content;
+    if (strncmp(content, "SIM#", 4) != 0)
+      continue;
+    uint32_t id = strtoul(content + 4, nullptr, 10);
+    if (id < messages.size() && messages[id].origin != index)
+      messages[id].heard.emplace(index, hostNowUs);
+  }
+  n.scannedMs = millis();
+}
+
+static void runNode(int i) {
+  Node &n = nodes[i];
+  enter(n);
+  submit(n);
+  auto start = std::chrono::steady_clock::now();
+  uint32_t sleepMs = n.radio->loop();
+  n.loopS += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  // Run again right away means a moment later: the task yields in between
+  n.wakeAtUs = hostNowUs + (sleepMs ? (uint64_t)sleepMs * 1000 : 1);
+  scanLog(n, i);
+  leave();
+}
+
+// Power cycle: LittleFS and NVS survive, everything in RAM starts over
+static void reboot(int i, const Options &o) {
+  Node &n = nodes[i];
+  enter(n);
+  n.radio.reset();  // first, or both would count against the heap peak
+  n.radio.reset(new LoRaRadio());
+  LoRaRadio::dio1Target = n.radio.get();
+  n.radio->begin(o.freq, 125.0, o.sf, 8, 0x56);
+  n.scannedMs = 0;
+  n.wakeAtUs = hostNowUs;
+  leave();
+}
+
+static void wake(int i) {
+  enter(nodes[i]);
+  simMedium->fireDio1(i);
+  leave();
+  runNode(i);
+}
+
+// =======================
+// Report helpers
+// =======================
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5))];
+}
+
+static void latencyLine(const char *label, const std::vector<double> &lat, size_t delivered, size_t total) {
+  printf("%-10s %5zu/%-5zu %6.1f%%  p50 %6.2f s  p90 %6.2f s  p99 %6.2f s  max %6.2f s\n", label, delivered, total,
+         total ? 100.0 * delivered / total : 0.0, percentile(lat, 0.5), percentile(lat, 0.9), percentile(lat, 0.99),
+         percentile(lat, 1.0));
+}
+
+static void histogram(const std::vector<double> &lat) {
+  static const double edges[] = { 1, 2, 5, 10, 30, 60 };
+  size_t counts[7] = {};
+  for (double l : lat) {
+    size_t b = 0;
+    while (b < 6 && l >= edges[b])
+      b++;
+    counts[b]++;
+  }
+  printf("latency    <1s %zu | 1-2s %zu | 2-5s %zu | 5-10s %zu | 10-30s %zu | 30-60s %zu | >60s %zu\n",
+         counts[0], counts[1], counts[2], counts[3], counts[4], counts[5], counts[6]);
+}
+
+static void usage() {
+  printf("sim_mesh [--nodes N] [--area M] [--minutes T] [--warmup S] [--drain S] [--rate R]\n"
+         "         [--unicast F] [--gateway F] [--size B] [--sf SF] [--freq MHZ] [--tick MS] [--seed S]\n"
+         "         [--exponent N] [--shadowing DB] [--away F] [--away-for S] [--power-save F] [--fec]\n"
+         "         [--battery MAH] [--file BYTES] [--file-from N] [--file-to N] [--reboot S] [--reboot-sender S]\n"
+         "         [--log NODE] [--log-all] [--per-node] [--min-delivery PCT]\n"
+         "         [--max-resets N]\n");
+}
+
+static bool parse(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto num = [&](double &v) {
+      if (i + 1 >= argc)
+        return false;
+      v = atof(argv[++i]);
+      return true;
+    };
+    double v = 0;
+    if (a == "--per-node") o.perNode = true;
+    else if (a == "--log-all") hostLogAll = true;
+    else if (a == "--fec") o.fec = true;
+    else if (!num(v)) return false;
+    else if (a == "--nodes") o.nodes = (int)v;
+    else if (a == "--area") o.areaM = v;
+    else if (a == "--minutes") o.minutes = v;
+    else if (a == "--warmup") o.warmupS = v;
+    else if (a == "--drain") o.drainS = v;
+    else if (a == "--rate") o.rate = v;
+    else if (a == "--unicast") o.unicast = v;
+    else if (a == "--gateway") o.toGateway = v;
+    else if (a == "--size") o.maxSize = (int)v;
+    else if (a == "--sf") o.sf = (int)v;
+    else if (a == "--freq") o.freq = v;
+    else if (a == "--tick") o.tickMs = (int)v;
+    else if (a == "--seed") o.seed = (uint32_t)v;
+    else if (a == "--exponent") o.medium.pathLossExponent = v;
+    else if (a == "--shadowing") o.medium.shadowingDb = v;
+    else if (a == "--away") o.away = v;
+    else if (a == "--away-for") o.awayS = v;
+    else if (a == "--power-save") o.powerSave = v;
+    else if (a == "--battery") o.batteryMah = v;
+    else if (a == "--file") o.fileBytes = (int)v;
+    else if (a == "--file-from") o.fileFrom = (int)v;
+    else if (a == "--file-to") o.fileTo = (int)v;
+    else if (a == "--reboot") o.rebootS = v;
+    else if (a == "--reboot-sender") o.rebootSenderS = v;
+    else if (a == "--log") o.logNode = (int)v;
+    else if (a == "--min-delivery") o.minDelivery = v;
+    else if (a == "--max-resets") o.maxResets = (int)v;
+    else return false;
+  }
+  return o.nodes >= 2 && o.tickMs >= 0 && o.maxSize >= 20 && o.maxSize <= RADIO_MESSAGE_MAX && o.sf >= 7 && o.sf <= 12;
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parse(argc, argv, opt)) {
+    usage();
+    return 1;
+  }
+  auto wallStart = std::chrono::steady_clock::now();
+  hostRng.seed(opt.seed);
+  Medium medium(opt.medium, opt.seed);
+  simMedium = &medium;
+
+  // Nodes in a square field, the gateway in the middle. HostNode addresses
+  // must stay put: heap blocks point back at their owner.
+  nodes.resize(opt.nodes);
+  std::uniform_real_distribution<float> coord(0, opt.areaM);
+  int sleepers = 0;
+  for (int i = 0; i < opt.nodes; i++) {
+    Node &n = nodes[i];
+    float x = i == gatewayNode ? opt.areaM / 2 : coord(hostRng);
+    float y = i == gatewayNode ? opt.areaM / 2 : coord(hostRng);
+    n.host.index = medium.addNode(x, y);
+    n.host.mac = 0x0000A1B2C3000000ULL + i;
+    n.host.log = i == opt.logNode;
+    n.host.prefs["lora/gateway"] = i == gatewayNode ? "1" : "0";
+    bool save = i != gatewayNode && sleepers < opt.powerSave * opt.nodes;
+    n.host.prefs["lora/powersave"] = save ? "1" : "0";
+    n.host.prefs["lora/fec"] = opt.fec ? "1" : "0";
+    sleepers += save;
+    hostNowUs = (uint64_t)i * 1000;  // boards are not switched on in the same millisecond
+    enter(n);
+    n.radio.reset(new LoRaRadio());
+    LoRaRadio::dio1Target = n.radio.get();
+    n.radio->begin(opt.freq, 125.0, opt.sf, 8, 0x56);
+    n.name = n.radio->getNodeName();
+    n.hash = n.radio->getNodeId();
+    n.wakeAtUs = hostNowUs;
+    leave();
+  }
+
+  uint64_t tickUs = (uint64_t)opt.tickMs * 1000;
+  uint64_t trafficStart = (uint64_t)(opt.warmupS * 1e6);
+  uint64_t trafficEnd = trafficStart + (uint64_t)(opt.minutes * 60e6);
+  uint64_t endUs = trafficEnd + (uint64_t)(opt.drainS * 1e6);
+  double perUs = opt.rate * opt.nodes / 60e6;
+  std::exponential_distribution<double> gap(perUs > 0 ? perUs : 1);
+  uint64_t nextTick = tickUs ? hostNowUs + tickUs : UINT64_MAX;
+  uint64_t nextInject = perUs > 0 ? trafficStart + (uint64_t)gap(hostRng) : UINT64_MAX;
+  std::vector<int> txDone, rxDone;
+
+  // The gateway never walks off
+  std::vector<int> awayNodes;
+  for (int i = 0; i < opt.nodes; i++)
+    if (i != gatewayNode && awayNodes.size() < opt.away * opt.nodes)
+      awayNodes.push_back(i);
+  uint64_t awayStart = trafficStart + (uint64_t)(opt.minutes * 60e6 / 4);
+  uint64_t awayEnd = awayStart + (uint64_t)(opt.awayS * 1e6);
+  bool isAway = false;
+
+  // One file, written straight into the sender's flash
+  static const char *kFilePath = "/photo.jpg";
+  static const char *kFileReceived = "/files/photo.jpg";
+  std::vector<uint8_t> fileData(opt.fileBytes);
+  int fileFrom = std::min(std::max(opt.fileFrom, 0), opt.nodes - 1), fileTo = opt.fileTo;
+  if (fileTo < 0 || fileTo >= opt.nodes || fileTo == fileFrom) {
+    fileTo = fileFrom == 0 ? 1 : 0;
+    for (int i = 0; i < opt.nodes; i++)
+      if (i != fileFrom && medium.rssi(fileFrom, i) < medium.rssi(fileFrom, fileTo))
+        fileTo = i;
+  }
+  bool fileSent = opt.fileBytes <= 0;
+  uint64_t fileDoneUs = 0;
+  uint64_t rebootAt = opt.rebootS >= 0 ? trafficStart + (uint64_t)(opt.rebootS * 1e6) : UINT64_MAX;
+  uint64_t rebootSenderAt = opt.rebootSenderS >= 0 ? trafficStart + (uint64_t)(opt.rebootSenderS * 1e6) : UINT64_MAX;
+  std::mt19937 fileRng(opt.seed);  // not hostRng: the traffic stays the same with and without a file
+  for (uint8_t &b : fileData)
+    b = fileRng();
+
+  while (hostNowUs < endUs) {
+    uint64_t nextAir = medium.nextEventUs();
+    int due = 0;
+    for (int i = 1; i < opt.nodes; i++)
+      if (nodes[i].wakeAtUs < nodes[due].wakeAtUs)
+        due = i;
+    uint64_t nextFile = !fileSent ? trafficStart : std::min(rebootAt, rebootSenderAt);
+    uint64_t t = std::min(std::min(std::min(std::min(nextAir, nextTick), nextInject), nodes[due].wakeAtUs), nextFile);
+    if (t >= endUs)
+      break;
+    hostNowUs = t;
+    if (!fileDoneUs && fileSent && nodes[fileTo].host.files.count(kFileReceived))
+      fileDoneUs = t;
+    bool awayNow = !awayNodes.empty() && t >= awayStart && t < awayEnd;
+    if (awayNow != isAway) {
+      for (int i : awayNodes)
+        medium.setAway(i, awayNow);
+      isAway = awayNow;
+    }
+
+    if (t == nextFile) {
+      int node = fileFrom;
+      if (!fileSent) {
+        nodes[fileFrom].host.files[kFilePath] = fileData;
+        enter(nodes[fileFrom]);
+        nodes[fileFrom].radio->sendFile(kFilePath, nodes[fileTo].name);
+        leave();
+        fileSent = true;
+      } else if (t == rebootAt) {
+        node = fileTo;
+        rebootAt = UINT64_MAX;
+        reboot(node, opt);
+      } else {
+        rebootSenderAt = UINT64_MAX;
+        reboot(node, opt);
+      }
+      runNode(node);
+    } else if (t == nodes[due].wakeAtUs) {
+      runNode(due);
+    } else if (t == nextAir) {
+      txDone.clear();
+      rxDone.clear();
+      medium.complete(t, txDone, rxDone);
+      for (int i : txDone)
+        wake(i);
+      for (int i : rxDone)
+        wake(i);
+    } else if (t == nextInject) {
+      int origin = hostRng() % opt.nodes;
+      double kind = std::uniform_real_distribution<double>(0, 1)(hostRng);
+      int dest = -1;
+      if (kind < opt.unicast) {
+        dest = hostRng() % (opt.nodes - 1);
+        if (dest >= origin)
+          dest++;
+      } else if (kind < opt.unicast + opt.toGateway && origin != gatewayNode) {
+        dest = -2;
+      }
+      size_t len = 20 + hostRng() % (opt.maxSize - 19);
+      messages.push_back(SimMessage{ origin, dest, len, t, {} });
+      nodes[origin].backlog.push_back(messages.size() - 1);
+      runNode(origin);
+      uint64_t next = t + (uint64_t)gap(hostRng) + 1;
+      nextInject = next < trafficEnd ? next : UINT64_MAX;
+    } else {
+      for (int i = 0; i < opt.nodes; i++)
+        runNode(i);
+      nextTick += tickUs;
+    }
+  }
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simS = hostNowUs / 1e6;
+
+  // ---- Delivery ----
+  size_t uniTotal = 0, uniOk = 0, gwTotal = 0, gwOk = 0, bcTotal = 0, backlog = 0;
+  double reachSum = 0;
+  std::vector<double> uniLat, gwLat, bcLat;
+  for (const SimMessage &m : messages) {
+    if (m.dest >= 0) {
+      uniTotal++;
+      auto it = m.heard.find(m.dest);
+      if (it != m.heard.end()) {
+        uniOk++;
+        uniLat.push_back((it->second - m.createdUs) / 1e6);
+      }
+    } else if (m.dest == -2) {
+      gwTotal++;
+      auto it = m.heard.find(gatewayNode);
+      if (it != m.heard.end()) {
+        gwOk++;
+        gwLat.push_back((it->second - m.createdUs) / 1e6);
+      }
+    } else {
+      bcTotal++;
+      reachSum += (double)m.heard.size() / (opt.nodes - 1);
+      for (auto &h : m.heard)
+        bcLat.push_back((h.second - m.createdUs) / 1e6);
+    }
+  }
+  size_t queued = 0;
+  uint32_t queueFull = 0, queueMax = 0;
+  for (const Node &n : nodes) {
+    backlog += n.backlog.size();
+    queued += n.radio->getMessageQueueDepth();
+    RadioQueueStats q = n.radio->getMessageQueueStats();
+    queueFull += q.full;
+    queueMax = std::max(queueMax, q.maxDepth);
+  }
+
+  printf("%d nodes in %.0fx%.0f m, SF%d, %.1f msg/node/min, %.0f s simulated in %.2f s (%.0fx)\n", opt.nodes, opt.areaM,
+         opt.areaM, opt.sf, opt.rate, simS, wallS, wallS > 0 ? simS / wallS : 0.0);
+  size_t reachSum0 = 0;
+  for (int i = 0; i < opt.nodes; i++)
+    reachSum0 += medium.reach(i, opt.sf);
+  printf("mean neighbours at SF%d: %.1f\n", opt.sf, (double)reachSum0 / opt.nodes);
+  if (!awayNodes.empty())
+    printf("%zu nodes out of range from %.0f s to %.0f s\n", awayNodes.size(), awayStart / 1e6, awayEnd / 1e6);
+  printf("\n");
+
+  printf("%zu messages injected, %zu still in radioQueue (max depth %u, %u times full), %zu never queued\n",
+         messages.size(), queued, queueMax, queueFull, backlog);
+  latencyLine("unicast", uniLat, uniOk, uniTotal);
+  latencyLine("gateway", gwLat, gwOk, gwTotal);
+  printf("%-10s %5zu msgs    mean reach %.1f%% of the other nodes, p50 %.2f s  p90 %.2f s\n", "broadcast", bcTotal,
+         bcTotal ? 100.0 * reachSum / bcTotal : 0.0, percentile(bcLat, 0.5), percentile(bcLat, 0.9));
+  std::vector<double> allLat = uniLat;
+  allLat.insert(allLat.end(), gwLat.begin(), gwLat.end());
+  histogram(allLat);
+
+  // ---- Channel and protocol ----
+  const MediumStats &ms = medium.stats();
+  printf("\nchannel    %u frames, %u receptions, %u lost to collisions, %u lost while not listening, %u while asleep\n",
+         ms.frames, ms.receptions, ms.collisions, ms.notListening, ms.asleep);
+  printf("frames    ");
+  for (int t = 0; t < 16; t++)
+    if (ms.byType[t])
+      printf(" %s %u (%.0f s)", loraPacketTypeName(t), ms.byType[t], ms.airtimeByType[t] / 1e6);
+  printf("\n");
+  uint32_t hopDelivered = 0, hopFailed = 0, retrans = 0, repairs = 0, recovered = 0, beacons = 0, piggy = 0, resets = 0, routed = 0, flooded = 0, dropped = 0;
+  uint32_t droppedBy[TX_PRIO_COUNT] = {};
+  for (const Node &n : nodes) {
+    RadioStatusView st = n.radio->getStatus();
+    const OutboxStats &o = st->outbox;
+    hopDelivered += o.delivered;
+    hopFailed += o.failed;
+    retrans += o.retransmissions;
+    repairs += o.repairs;
+    recovered += st->reassembly.recovered;
+    beacons += st->beacons.standalone;
+    piggy += st->beacons.piggybacked;
+    resets += st->beacons.resets;
+    routed += st->routes.routed;
+    flooded += st->routes.floodFallback;
+    const AirtimeStats &a = st->airtime.stats;
+    for (int p = 0; p < TX_PRIO_COUNT; p++) {
+      dropped += a.dropped[p];
+      droppedBy[p] += a.dropped[p];
+    }
+  }
+  printf("outbox     %u ACKed, %u failed, %u fragments resent, %u repair fragments sent\n", hopDelivered, hopFailed, retrans, repairs);
+  printf("fec        %u messages rebuilt from repair fragments\n", recovered);
+  printf("routing    %u frames routed, %u flooded without route\n", routed, flooded);
+  CustodyStats cs = {};
+  size_t stillHeld = 0;
+  for (const Node &n : nodes) {
+    RadioStatusView st = n.radio->getStatus();
+    const CustodyStats &c = st->custody;
+    cs.held += c.held;
+    cs.confirmed += c.confirmed;
+    cs.resent += c.resent;
+    cs.expired += c.expired;
+    cs.dropped += c.dropped;
+    cs.offers += c.offers;
+    cs.replies += c.replies;
+    for (const auto &kv : n.host.prefs)
+      if (kv.first.compare(0, 8, "custody/") == 0)
+        stillHeld++;
+  }
+  printf("custody    %u held, %u confirmed, %u resent, %u expired, %u evicted, %zu still held; %u offers, %u replies\n",
+         cs.held, cs.confirmed, cs.resent, cs.expired, cs.dropped, stillHeld, cs.offers, cs.replies);
+  printf("beacons    %u standalone, %u piggybacked, %u interval resets\n", beacons, piggy, resets);
+  CsmaStats ca = {};
+  for (const Node &n : nodes) {
+    RadioStatusView st = n.radio->getStatus();
+    const CsmaStats &c = st->csma;
+    ca.cads += c.cads;
+    for (int p = 0; p < TX_PRIO_COUNT; p++)
+      ca.busy[p] += c.busy[p];
+    ca.backoffs += c.backoffs;
+    ca.forced += c.forced;
+    ca.receiving += c.receiving;
+    ca.corrupted += c.corrupted;
+    ca.backoffMs += c.backoffMs;
+  }
+  printf("csma       %u CADs, busy low/normal/ACK %u/%u/%u, %u sent on a busy channel, %u waits while receiving, "
+         "%u corrupted receptions, %.1f ms mean backoff\n", ca.cads, ca.busy[TX_PRIO_LOW], ca.busy[TX_PRIO_NORMAL],
+         ca.busy[TX_PRIO_HIGH], ca.forced, ca.receiving, ca.corrupted, ca.backoffs ? (double)ca.backoffMs / ca.backoffs : 0.0);
+  printf("duty cycle %u frames dropped by the airtime budget, low/normal/ACK %u/%u/%u\n", dropped, droppedBy[TX_PRIO_LOW],
+         droppedBy[TX_PRIO_NORMAL], droppedBy[TX_PRIO_HIGH]);
+  uint32_t sent = 0, packets = 0, batches = 0;
+  for (const Node &n : nodes) {
+    RadioStatusView st = n.radio->getStatus();
+    const TxStats &tx = st->tx;
+    sent += tx.sent;
+    packets += tx.packets;
+    batches += tx.batches;
+  }
+  printf("batching   %u frames on air carried %u queued frames, %u of them batches; %.2f frames per queued frame, "
+         "%.1f per message\n", sent, packets, batches, packets ? (double)sent / packets : 0.0,
+         messages.empty() ? 0.0 : (double)sent / messages.size());
+  uint64_t wakeups = 0, timersFired = 0;
+  double loopS = 0;
+  for (const Node &n : nodes) {
+    RadioStatusView st = n.radio->getStatus();
+    wakeups += st->loop.wakeups;
+    timersFired += st->loop.timers;
+    loopS += n.loopS;
+  }
+  printf("LoRa task  %.1f wakeups/s per node, %.2f timers per wakeup, %.1f us host CPU per wakeup (%.4f%% busy)\n",
+         wakeups / simS / opt.nodes, wakeups ? (double)timersFired / wakeups : 0.0, wakeups ? 1e6 * loopS / wakeups : 0.0,
+         100.0 * loopS / simS / opt.nodes);
+
+  // ---- File transfer ----
+  if (opt.fileBytes > 0) {
+    RadioStatusView from = nodes[fileFrom].radio->getStatus(), to = nodes[fileTo].radio->getStatus();
+    const FileStats &fs = from->files;
+    const FileStats &fr = to->files;
+    auto got = nodes[fileTo].host.files.find(kFileReceived);
+    bool intact = got != nodes[fileTo].host.files.end() && got->second == fileData;
+    double fileS = fileDoneUs ? (fileDoneUs - trafficStart) / 1e6 : 0;
+    printf("\nfile       %d B from node %d to node %d (%.0f dBm): ", opt.fileBytes, fileFrom, fileTo, medium.rssi(fileFrom, fileTo));
+    if (fileDoneUs)
+      printf("%s after %.1f s, %.1f B/s\n", intact ? "complete" : "DAMAGED", fileS, opt.fileBytes / fileS);
+    else
+      printf("not complete\n");
+    // Counters restart with a reboot
+    printf("           %u chunks sent for %u, %u resent, %u probes, %u pauses; receiver %u duplicates, %u resumed\n",
+           fs.chunksSent, fileChunks(opt.fileBytes), fs.chunksResent, fs.probes, fs.pauses, fr.duplicates, fr.resumed);
+    printf("           heap peak sender %.1f KB, receiver %.1f KB; flash written by the receiver %zu B; FileTransfer object %zu B\n",
+           nodes[fileFrom].host.heapPeak / 1024.0, nodes[fileTo].host.heapPeak / 1024.0, nodes[fileTo].host.flashWritten,
+           sizeof(FileTransfer));
+  }
+
+  // ---- Energy per operating mode ----
+  EnergyProfile profile;
+  std::vector<EnergyUse> energy(opt.nodes);
+  printf("\n");
+  for (PowerMode mode : { POWER_ALWAYS_ON, POWER_SAVE }) {
+    EnergyUse sum;
+    double wakeSum = 0;
+    int count = 0;
+    for (int i = 0; i < opt.nodes; i++) {
+      if (nodes[i].radio->getPowerMode() != mode)
+        continue;
+      energy[i] = estimateEnergy(profile, mode, medium.radioTime(i), nodes[i].radio->getStatus()->loop.wakeups, hostNowUs);
+      sum.radioMa += energy[i].radioMa;
+      sum.mcuMa += energy[i].mcuMa;
+      sum.totalMa += energy[i].totalMa;
+      wakeSum += nodes[i].radio->getStatus()->loop.wakeups / simS;
+      count++;
+    }
+    if (count == 0)
+      continue;
+    printf("energy     %-10s %3d nodes: %7.2f mAh/h (radio %.2f, ESP32 %.2f), %.1f wakeups/s, %.0f h on %.0f mAh\n",
+           mode == POWER_SAVE ? "power-save" : "always-on", count, sum.totalMa / count, sum.radioMa / count, sum.mcuMa / count,
+           wakeSum / count, opt.batteryMah / (sum.totalMa / count), opt.batteryMah);
+  }
+
+  // ---- Airtime and heap per node ----
+  std::vector<double> airMs, heapKb;
+  for (const Node &n : nodes) {
+    airMs.push_back(n.radio->getStatus()->tx.airtimeUs / 1000.0);
+    heapKb.push_back(n.host.heapPeak / 1024.0);
+  }
+  double airMean = 0, heapMean = 0;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    airMean += airMs[i] / nodes.size();
+    heapMean += heapKb[i] / nodes.size();
+  }
+  printf("\nairtime    per node min %.0f ms, mean %.0f ms, max %.0f ms (%.2f%% of the time)\n", percentile(airMs, 0),
+         airMean, percentile(airMs, 1), 100.0 * percentile(airMs, 1) / 1000.0 / simS);
+  printf("heap peak  per node min %.1f KB, mean %.1f KB, max %.1f KB (LoRaRadio object %zu B included)\n",
+         percentile(heapKb, 0), heapMean, percentile(heapKb, 1), sizeof(LoRaRadio));
+
+  if (opt.perNode) {
+    printf("\n%4s %-18s %5s %6s %9s %6s %7s %6s %5s %7s %7s\n", "node", "name", "reach", "frames", "air ms", "duty%", "heap KB",
+           "routes", "busy", "corrupt", "mAh/h");
+    for (int i = 0; i < opt.nodes; i++) {
+      Node &n = nodes[i];
+      RadioStatusView st = n.radio->getStatus();
+      const TxStats &tx = st->tx;
+      const CsmaStats &c = st->csma;
+      printf("%4d %-18s %5zu %6u %9.0f %6.2f %7.1f %6zu %5u %7u %7.2f%s%s\n", i, n.name.c_str(), medium.reach(i, opt.sf), tx.sent,
+             airMs[i], 100.0 * airMs[i] / 1000.0 / simS, heapKb[i], st->routeCount,
+             c.busy[TX_PRIO_LOW] + c.busy[TX_PRIO_NORMAL] + c.busy[TX_PRIO_HIGH], c.corrupted, energy[i].totalMa,
+             i == gatewayNode ? "  gateway" : "", n.radio->getPowerMode() == POWER_SAVE ? "  power-save" : "");
+    }
+  }
+
+  int rc = 0;
+  double delivered = uniTotal + gwTotal ? 100.0 * (uniOk + gwOk) / (uniTotal + gwTotal) : 100.0;
+  if (delivered < opt.minDelivery) {
+    fprintf(stderr, "FAILED: %.1f%% of the unicast and gateway messages delivered, at least %.1f%% expected\n", delivered,
+           opt.minDelivery);
+    rc = 1;
+  }
+  if (opt.maxResets >= 0 && resets > (uint32_t)opt.maxResets) {
+    fprintf(stderr, "FAILED: %u beacon interval resets, at most %d expected\n", resets, opt.maxResets);
+    rc = 1;
+  }
+
+  // Radios first: their heap blocks point at the HostNode accounts
+  for (Node &n : nodes) {
+    enter(n);
+    n.radio.reset();
+    leave();
+  }
+  return rc;
+}
@@ -0,0 +1,268 @@
+// Cross-core hand-over structures under load on host threads:
+//  - SnapshotBuffer: one writer keeps changing a table and publishing it while
+//    readers check that every view they get is one complete version.
+//  - RadioQueue: producers push numbered messages while one consumer checks
+//    that each arrives exactly once, intact and in order per producer.
+//  - LiveFeed notices: the LoRa task reports delivery results while the web
+//    task takes them; every result arrives intact and in order or is counted lost.
+// Exits non-zero on the first inconsistency. Best run under ThreadSanitizer:
+//
+// Build and run from arduino/host:  make stress && ./build/stress_concurrency [seconds]
+//                                   make stress-tsan && ./build/stress_concurrency_tsan
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LiveFeed.h"
+#include "RadioQueue.h"
+#include "SnapshotBuffer.h"
+
+static const int kReaders = 3;
+static const int kProducers = 3;
+
+static std::atomic<bool> stop{false};
+static std::atomic<bool> failed{false};
+
+static void fail(const char *what) {
+  if (!failed.exchange(true))
+    fprintf(stderr, "FAIL: %s\n", what);
+  stop = true;
+}
+
+// ---- SnapshotBuffer ----
+
+// Like the neighbour table: every entry of one version carries that version,
+// and the entry count follows from it
+struct Entry {
+  uint32_t generation;
+  std::string name;
+};
+typedef std::map<std::string, Entry> Table;
+typedef std::vector<std::shared_ptr<const Entry>> Log;
+
+struct SnapshotCounters {
+  uint64_t published = 0;
+  std::atomic<uint64_t> reads{0};
+};
+
+static size_t tableSize(uint32_t generation) { return 1 + generation % 40; }
+
+static void snapshotWriter(SnapshotBuffer<Table> &table, SnapshotBuffer<Log> &log, SnapshotCounters &c) {
+  Table live;
+  Log liveLog;
+  for (uint32_t gen = 1; !stop; gen++) {
+    live.clear();
+    for (size_t i = 0; i < tableSize(gen); i++) {
+      std::string name = "NODE_" + std::to_string(i);
+      live[name] = Entry{ gen, name };
+    }
+    liveLog.push_back(std::make_shared<const Entry>(Entry{ gen, "msg" }));
+    if (liveLog.size() > 100)
+      liveLog.erase(liveLog.begin());
+
+    // Retry like loop() does on its next pass
+    for (;;) {
+      if (Table *next = table.beginWrite()) {
+        *next = live;
+        table.publish();
+        break;
+      }
+      std::this_thread::yield();
+    }
+    for (;;) {
+      if (Log *next = log.beginWrite()) {
+        *next = liveLog;
+        log.publish();
+        break;
+      }
+      std::this_thread::yield();
+    }
+    c.published++;
+  }
+}
+
+static void snapshotReader(SnapshotBuffer<Table> &table, SnapshotBuffer<Log> &log, SnapshotCounters &c) {
+  uint32_t lastVersion = 0, lastLogVersion = 0;
+  while (!stop) {
+    {
+      SnapshotBuffer<Table>::Reader view(table);
+      if (view.version() < lastVersion)
+        fail("table version went backwards");
+      lastVersion = view.version();
+      if (view.version() == 0)
+        continue;
+      uint32_t gen = view->begin()->second.generation;
+      if (view->size() != tableSize(gen))
+        fail("table snapshot has entries of two versions");
+      for (auto &kv : *view)
+        if (kv.second.generation != gen || kv.first != kv.second.name)
+          fail("table snapshot changed while held");
+    }
+    {
+      SnapshotBuffer<Log>::Reader view(log);
+      if (view.version() < lastLogVersion)
+        fail("log version went backwards");
+      lastLogVersion = view.version();
+      uint32_t prev = 0;
+      for (auto &e : *view) {
+        if (e->generation != prev + 1 && prev != 0)
+          fail("log snapshot has a gap");
+        prev = e->generation;
+      }
+    }
+    c.reads++;
+  }
+}
+
+// ---- RadioQueue ----
+
+struct QueueCounters {
+  std::atomic<uint64_t> pushed{0};
+  std::atomic<uint64_t> full{0};
+  uint64_t popped = 0;
+};
+
+static void producer(RadioQueue &q, int id, QueueCounters &c) {
+  char receiver[RADIO_RECEIVER_MAX];
+  snprintf(receiver, sizeof(receiver), "NODE_%d", id);
+  uint8_t content[RADIO_MESSAGE_MAX];
+  for (uint32_t seq = 0; !stop;) {
+    // Length and fill byte follow from (id, seq), so the consumer can check them
+    size_t len = 8 + (seq * 37 + id) % (RADIO_MESSAGE_MAX - 8);
+    memcpy(content, &seq, 4);
+    memcpy(content + 4, &id, 4);
+    memset(content + 8, (uint8_t)(seq + id), len - 8);
+    RadioQueueResult r = q.push((uint8_t)id, content, len, receiver);
+    if (r == RADIO_QUEUE_OK) {
+      seq++;
+      c.pushed++;
+    } else if (r == RADIO_QUEUE_FULL) {
+      c.full++;
+      std::this_thread::yield();
+    } else {
+      fail("message refused as too long");
+    }
+  }
+}
+
+static void consumer(RadioQueue &q, QueueCounters &c) {
+  std::vector<uint32_t> next(kProducers, 0);
+  for (;;) {
+    const RadioMessage *m = q.front();
+    if (!m) {
+      if (stop && c.popped == c.pushed)
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    uint32_t seq;
+    int id;
+    memcpy(&seq, m->content, 4);
+    memcpy(&id, m->content + 4, 4);
+    char receiver[RADIO_RECEIVER_MAX];
+    snprintf(receiver, sizeof(receiver), "NODE_%d", id);
+    if (id < 0 || id >= kProducers || m->type != id || strcmp(m->receiver, receiver) != 0)
+      fail("queued message from an unknown producer");
+    else if (seq != next[id])
+      fail("queued messages lost, duplicated or reordered");
+    else if (m->len != 8 + (seq * 37 + id) % (RADIO_MESSAGE_MAX - 8))
+      fail("queued message has the wrong length");
+    else
+      for (size_t i = 8; i < m->len; i++)
+        if (m->content[i] != (uint8_t)(seq + id)) {
+          fail("queued message torn");
+          break;
+        }
+    if (failed)
+      return;
+    next[id]++;
+    q.pop();
+    c.popped++;
+    if (q.size() > RADIO_QUEUE_SLOTS)
+      fail("queue depth out of range");
+  }
+}
+
+// ---- LiveFeed notices ----
+
+struct NoticeCounters {
+  std::atomic<uint64_t> sent{0};
+  uint64_t taken = 0;
+};
+
+static void noticeProducer(LiveFeed &feed, NoticeCounters &c) {
+  for (uint16_t seq = 0; !stop; seq++) {
+    feed.notify(seq, (uint8_t)(seq * 7));
+    c.sent++;
+    if (seq % 64 == 0)
+      std::this_thread::yield();
+  }
+}
+
+static void noticeConsumer(LiveFeed &feed, NoticeCounters &c) {
+  uint16_t last = 0;
+  for (;;) {
+    LiveNotice n;
+    if (!feed.takeNotice(n)) {
+      if (stop && c.taken + feed.stats().noticesLost == c.sent)
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    if (n.state != (uint8_t)(n.seq * 7))
+      fail("delivery notice torn");
+    else if (c.taken && (uint16_t)(n.seq - last) >= 0x8000)
+      fail("delivery notices reordered");
+    if (failed)
+      return;
+    last = n.seq;
+    c.taken++;
+  }
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+
+  static SnapshotBuffer<Table> table;
+  static SnapshotBuffer<Log> log;
+  static RadioQueue queue;
+  static LiveFeed feed;
+  SnapshotCounters sc;
+  QueueCounters qc;
+  NoticeCounters nc;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  threads.emplace_back(snapshotWriter, std::ref(table), std::ref(log), std::ref(sc));
+  for (int i = 0; i < kReaders; i++)
+    threads.emplace_back(snapshotReader, std::ref(table), std::ref(log), std::ref(sc));
+  for (int i = 0; i < kProducers; i++)
+    threads.emplace_back(producer, std::ref(queue), i, std::ref(qc));
+  threads.emplace_back(consumer, std::ref(queue), std::ref(qc));
+  threads.emplace_back(noticeProducer, std::ref(feed), std::ref(nc));
+  threads.emplace_back(noticeConsumer, std::ref(feed), std::ref(nc));
+
+  while (!stop && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds)
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  stop = true;
+  for (std::thread &t : threads)
+    t.join();
+
+  printf("snapshots  %llu published, %llu views checked, %u publishes deferred by readers\n",
+         (unsigned long long)sc.published, (unsigned long long)sc.reads.load(), table.deferred() + log.deferred());
+  RadioQueueStats qs = queue.stats();
+  printf("radioQueue %llu messages checked, %llu pushes refused (full), max depth %u\n",
+         (unsigned long long)qc.popped, (unsigned long long)qc.full.load(), qs.maxDepth);
+  printf("notices    %llu delivery results taken, %u lost (queue full)\n", (unsigned long long)nc.taken,
+         feed.stats().noticesLost);
+  if (failed)
+    return 1;
+  printf("OK\n");
+  return 0;
+}